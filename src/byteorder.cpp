@@ -0,0 +1,261 @@
+// Xgtools
+// Copyright (C) M. P. Ruffoni 2011-2015
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//==============================================================================
+// Byte order functions (byteorder.cpp)
+//==============================================================================
+
+#include "byteorder.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <cmath>
+#include <cstring>
+
+// On x86 processors the SSSE3 kernel below is compiled alongside the plain one,
+// whatever the target of the rest of the program, and chosen at run time
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#define BO_SSSE3_DISPATCH
+#include <tmmintrin.h>
+#endif
+
+// Shuffle masks that reverse the bytes of every 2, 4 and 8 byte value in a
+// 16 byte block
+static const unsigned char Swap16Mask [BO_MASK_SIZE] =
+  { 1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14 };
+static const unsigned char Swap32Mask [BO_MASK_SIZE] =
+  { 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 };
+static const unsigned char Swap64Mask [BO_MASK_SIZE] =
+  { 7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8 };
+
+// A value read in the wrong byte order is judged implausible if its magnitude
+// lies outside these limits
+#define BO_MIN_PLAUSIBLE 1.0e-30
+#define BO_MAX_PLAUSIBLE 1.0e+30
+
+// The data overrule the header only if this much larger a fraction of the
+// sample is plausible in the opposite byte order
+#define BO_OVERRULE_MARGIN 0.25
+
+//------------------------------------------------------------------------------
+// shufflePlain (unsigned char *, size_t, size_t, const unsigned char *, size_t)
+// : Rearranges the bytes of each of the arg2 records of arg3 bytes at arg1, as
+// described for shuffleRecords(), using a simple byte loop.
+//
+static void shufflePlain (unsigned char *Record, size_t NumRecords,
+  size_t RecordSize, const unsigned char *Masks, size_t NumMasks) {
+  unsigned char Copy [BO_MASK_SIZE];
+  for (size_t i = 0; i < NumRecords; i ++, Record += RecordSize) {
+    for (size_t j = 0; j < NumMasks; j ++) {
+      unsigned char *Block = Record + j * BO_MASK_SIZE;
+      const unsigned char *Mask = Masks + j * BO_MASK_SIZE;
+      memcpy (Copy, Block, BO_MASK_SIZE);
+      for (int k = 0; k < BO_MASK_SIZE; k ++) Block [k] = Copy [Mask [k]];
+    }
+  }
+}
+
+
+#ifdef BO_SSSE3_DISPATCH
+//------------------------------------------------------------------------------
+// shuffleSSSE3 (unsigned char *, size_t, size_t, const unsigned char *, size_t)
+// : As shufflePlain(), but swaps each 16 byte block with a single pshufb
+// instruction. Only called if the processor supports SSSE3.
+//
+__attribute__ ((target ("ssse3")))
+static void shuffleSSSE3 (unsigned char *Record, size_t NumRecords,
+  size_t RecordSize, const unsigned char *Masks, size_t NumMasks) {
+  for (size_t i = 0; i < NumRecords; i ++, Record += RecordSize) {
+    for (size_t j = 0; j < NumMasks; j ++) {
+      __m128i *Block = (__m128i *) (Record + j * BO_MASK_SIZE);
+      __m128i Order = _mm_loadu_si128 ((const __m128i *)
+        (Masks + j * BO_MASK_SIZE));
+      _mm_storeu_si128 (Block,
+        _mm_shuffle_epi8 (_mm_loadu_si128 (Block), Order));
+    }
+  }
+}
+#endif
+
+
+// The form of the shuffle kernels
+typedef void (*ShuffleKernel) (unsigned char *, size_t, size_t,
+  const unsigned char *, size_t);
+
+//------------------------------------------------------------------------------
+// chooseShuffle () : Returns the fastest of the shuffle kernels above that the
+// processor supports. Called once, when the program starts.
+//
+static ShuffleKernel chooseShuffle () {
+#ifdef BO_SSSE3_DISPATCH
+  __builtin_cpu_init ();
+  if (__builtin_cpu_supports ("ssse3")) return shuffleSSSE3;
+#endif
+  return shufflePlain;
+}
+
+static const ShuffleKernel shuffleKernel = chooseShuffle ();
+
+
+//------------------------------------------------------------------------------
+// swapValues (void *, size_t, size_t, const unsigned char *) : Reverses the
+// bytes of each of the arg2 values of arg3 bytes at arg1, using the shuffle
+// mask at arg4 for all the complete 16 byte blocks.
+//
+static void swapValues (void *Data, size_t Count, size_t Size,
+  const unsigned char *Mask) {
+  unsigned char *Bytes = (unsigned char *) Data;
+  size_t Length = Count * Size;
+  size_t i = 0;
+  if (Length >= BO_MASK_SIZE) {
+    i = Length - Length % BO_MASK_SIZE;
+    shuffleKernel (Bytes, i / BO_MASK_SIZE, BO_MASK_SIZE, Mask, 1);
+  }
+  for (; i < Length; i += Size) {
+    for (size_t j = 0; j < Size / 2; j ++) {
+      unsigned char Byte = Bytes [i + j];
+      Bytes [i + j] = Bytes [i + Size - 1 - j];
+      Bytes [i + Size - 1 - j] = Byte;
+    }
+  }
+}
+
+
+//------------------------------------------------------------------------------
+// nativeByteOrder () : Returns BO_LITTLE_ENDIAN or BO_BIG_ENDIAN, for the byte
+// order of the machine on which the program is running.
+//
+int nativeByteOrder () {
+  unsigned int One = 1;
+  return (*(unsigned char *) &One == 1) ? BO_LITTLE_ENDIAN : BO_BIG_ENDIAN;
+}
+
+
+//------------------------------------------------------------------------------
+// swapBytes16 (void *, size_t), swapBytes32 (void *, size_t), swapBytes64
+// (void *, size_t) : Reverse the byte order of each of the arg2 values at
+// arg1, which are respectively 2, 4 and 8 bytes long.
+//
+void swapBytes16 (void *Data, size_t Count) {
+  swapValues (Data, Count, 2, Swap16Mask);
+}
+
+void swapBytes32 (void *Data, size_t Count) {
+  swapValues (Data, Count, 4, Swap32Mask);
+}
+
+void swapBytes64 (void *Data, size_t Count) {
+  swapValues (Data, Count, 8, Swap64Mask);
+}
+
+
+//------------------------------------------------------------------------------
+// shuffleRecords (void *, size_t, size_t, const unsigned char *, size_t) :
+// Rearranges the bytes of each of the arg2 records at arg1, which are each
+// arg3 bytes long. The first 16 bytes of each record are rearranged by the
+// first 16 byte mask at arg4, the next 16 by the second mask, and so on for
+// all arg5 masks. Any bytes after those are left as they are.
+//
+void shuffleRecords (void *Data, size_t NumRecords, size_t RecordSize,
+  const unsigned char *Masks, size_t NumMasks) {
+  shuffleKernel ((unsigned char *) Data, NumRecords, RecordSize, Masks,
+    NumMasks);
+}
+
+
+//------------------------------------------------------------------------------
+// headerByteOrder (string) : Returns the byte order given by the bocode
+// variable in the XGremlin header file named at arg1, or BO_UNKNOWN if the
+// file cannot be read or does not contain bocode.
+//
+int headerByteOrder (string HeaderName) {
+  ifstream Header (HeaderName.c_str (), ios::in);
+  string LineString, NextField;
+  istringstream iss;
+  int Code;
+
+  while (getline (Header, LineString)) {
+    iss.str (LineString);
+    iss >> NextField;
+    iss.clear ();
+    if (NextField == BO_HEADER_TAG && LineString.length () > 9) {
+      iss.str (LineString.substr (9, 23));
+      if (!(iss >> Code)) return BO_UNKNOWN;
+      if (Code == BO_BIG_ENDIAN || Code == BO_LITTLE_ENDIAN) return Code;
+      return BO_UNKNOWN;
+    }
+  }
+  return BO_UNKNOWN;
+}
+
+
+//------------------------------------------------------------------------------
+// plausibleFraction (const float *, size_t) : Returns the fraction of the arg2
+// floats at arg1 that are zero, or finite with a magnitude that a spectrum
+// could reasonably contain.
+//
+double plausibleFraction (const float *Data, size_t Count) {
+  if (Count == 0) return 1.0;
+  size_t Plausible = 0;
+  for (size_t i = 0; i < Count; i ++) {
+    double Value = fabs (Data [i]);
+    if (Value == 0.0 || (Value >= BO_MIN_PLAUSIBLE && Value <= BO_MAX_PLAUSIBLE)) {
+      Plausible ++;
+    }
+  }
+  return double (Plausible) / Count;
+}
+
+
+//------------------------------------------------------------------------------
+// datIsSwapped (string, string) : Returns true if the floats in the .dat file
+// named at arg1 are not in the native byte order, and so must be swapped as
+// they are read. The byte order is taken from the bocode variable of the
+// header file named at arg2, which by default is the .hdr file beside the .dat
+// file. Without bocode, it is guessed from the first BO_SAMPLE_SIZE floats of
+// the data. If the data are clearly in the
+// other byte order to that in the header, a warning is printed and the data
+// are believed.
+//
+bool datIsSwapped (string DataName, string HeaderName) {
+  if (HeaderName.length () == 0) {
+    size_t Dot = DataName.rfind (".dat");
+    HeaderName = (Dot != string::npos && Dot == DataName.length () - 4) ?
+      DataName.substr (0, Dot) + ".hdr" : DataName + ".hdr";
+  }
+  vector <float> Sample (BO_SAMPLE_SIZE);
+  ifstream DataFile (DataName.c_str (), ios::in|ios::binary);
+  DataFile.read ((char *) Sample.data (), BO_SAMPLE_SIZE * sizeof (float));
+  Sample.resize (DataFile.gcount () / sizeof (float));
+  DataFile.close ();
+
+  double Native = plausibleFraction (Sample.data (), Sample.size ());
+  swapBytes32 (Sample.data (), Sample.size ());
+  double Swapped = plausibleFraction (Sample.data (), Sample.size ());
+  int Declared = headerByteOrder (HeaderName);
+  if (Declared == BO_UNKNOWN) return (Swapped > Native);
+  bool HeaderSwapped = (Declared != nativeByteOrder ());
+  double Agree = HeaderSwapped ? Swapped : Native;
+  double Disagree = HeaderSwapped ? Native : Swapped;
+  if (Disagree > Agree + BO_OVERRULE_MARGIN) {
+    cout << "Warning: The data in " << DataName << " do not match the byte "
+      << "order given in " << HeaderName << ". Assuming they are "
+      << (HeaderSwapped ? "in native byte order." : "byte-swapped.") << endl;
+    return !HeaderSwapped;
+  }
+  return HeaderSwapped;
+}
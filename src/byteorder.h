@@ -0,0 +1,77 @@
+// Xgtools
+// Copyright (C) M. P. Ruffoni 2011-2015
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//==============================================================================
+// Byte order functions (byteorder.h)
+//==============================================================================
+// Spectra and line lists written by XGremlin on big-endian workstations store
+// their binary values in the opposite byte order to those written on a PC.
+// These functions find the byte order of a file and convert blocks of values
+// between byte orders as they are read and written.
+//
+// The byte order of a .dat file is given by the bocode variable in its .hdr
+// file. Since not every header includes bocode, and some old headers give it
+// wrongly, the data themselves are also checked: a block of floats read in the
+// wrong byte order is mostly made up of values that are tiny, enormous or not
+// numbers at all.
+//
+// Values are swapped in place in blocks of 16 bytes, each rearranged by a
+// shuffle mask that gives the source of every byte in the block. On x86
+// processors that support SSSE3, which is checked when the program starts, each
+// block is swapped with a single pshufb instruction. Otherwise a simple byte
+// loop is used, which the compiler is free to vectorise.
+//
+#ifndef XG_BYTE_ORDER_H
+#define XG_BYTE_ORDER_H
+
+#include <string>
+#include <cstddef>
+
+// Values of the XGremlin bocode header variable
+#define BO_BIG_ENDIAN    0
+#define BO_LITTLE_ENDIAN 1
+#define BO_UNKNOWN       -1
+
+// The header variable that gives the byte order of a .dat file
+#define BO_HEADER_TAG "bocode"
+
+// The number of floats checked when guessing the byte order of a .dat file
+#define BO_SAMPLE_SIZE 4096
+
+// The number of bytes rearranged by each shuffle mask
+#define BO_MASK_SIZE 16
+
+using namespace::std;
+
+// Returns the bocode of the machine the program is running on
+int nativeByteOrder ();
+
+// Swap the bytes of every 2, 4 or 8 byte value in a block
+void swapBytes16 (void *Data, size_t Count);
+void swapBytes32 (void *Data, size_t Count);
+void swapBytes64 (void *Data, size_t Count);
+
+// Rearrange the first NumMasks * 16 bytes of each of NumRecords records of
+// RecordSize bytes, using one 16 byte shuffle mask for each 16 bytes
+void shuffleRecords (void *Data, size_t NumRecords, size_t RecordSize,
+  const unsigned char *Masks, size_t NumMasks);
+
+// Functions to find the byte order of XGremlin spectra
+int headerByteOrder (string HeaderName);
+double plausibleFraction (const float *Data, size_t Count);
+bool datIsSwapped (string DataName, string HeaderName = "");
+
+#endif // XG_BYTE_ORDER_H
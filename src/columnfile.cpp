@@ -0,0 +1,222 @@
+// Xgtools
+// Copyright (C) M. P. Ruffoni 2011-2015
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//==============================================================================
+// Column file functions (columnfile.cpp)
+//==============================================================================
+
+#include "columnfile.h"
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <cstring>
+#include <cstdlib>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// The most significant digits held exactly in the 64 bit mantissa, and the
+// largest power of ten that is exactly representable as a double
+#define MAX_FAST_DIGITS 19
+#define MAX_FAST_EXPONENT 22
+
+// Mantissas above 2^53 cannot be held exactly in a double
+#define MAX_FAST_MANTISSA (uint64_t (1) << 53)
+
+// The longest number passed to strtod from a fixed buffer
+#define MAX_NUMBER_LENGTH 128
+
+static const double PowersOfTen [MAX_FAST_EXPONENT + 1] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13,
+  1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+
+//------------------------------------------------------------------------------
+// isSeparator (char) : Returns true if arg1 may separate two columns.
+//
+static inline bool isSeparator (char c) {
+  return c == ' ' || c == '\t' || c == ',' || c == '\r';
+}
+
+
+//------------------------------------------------------------------------------
+// parseNumber (const char *&, const char *, double &) : Converts the number at
+// arg1 to arg3, reading no further than arg2. arg1 is moved past the number.
+// Returns false if arg1 does not hold a number followed by a separator or the
+// end of the row.
+//
+bool parseNumber (const char *&Text, const char *End, double &Value) {
+  const char *p = Text;
+  bool Negative = false;
+  if (p < End && (*p == '-' || *p == '+')) {
+    Negative = (*p == '-');
+    p ++;
+  }
+
+  // Gather up to MAX_FAST_DIGITS significant digits, noting the position of the
+  // decimal point relative to the last digit kept
+  uint64_t Mantissa = 0;
+  int Digits = 0, Exponent = 0;
+  bool AnyDigits = false, Truncated = false;
+  while (p < End && *p >= '0' && *p <= '9') {
+    AnyDigits = true;
+    if (Digits < MAX_FAST_DIGITS) {
+      Mantissa = Mantissa * 10 + (*p - '0');
+      if (Mantissa > 0) Digits ++;
+    } else {
+      Exponent ++;
+      Truncated = Truncated || (*p != '0');
+    }
+    p ++;
+  }
+  if (p < End && *p == '.') {
+    p ++;
+    while (p < End && *p >= '0' && *p <= '9') {
+      AnyDigits = true;
+      if (Digits < MAX_FAST_DIGITS) {
+        Mantissa = Mantissa * 10 + (*p - '0');
+        if (Mantissa > 0) Digits ++;
+        Exponent --;
+      } else {
+        Truncated = Truncated || (*p != '0');
+      }
+      p ++;
+    }
+  }
+  if (!AnyDigits) return false;
+  if (p < End && (*p == 'e' || *p == 'E')) {
+    const char *q = p + 1;
+    bool NegativeExp = false;
+    if (q < End && (*q == '-' || *q == '+')) {
+      NegativeExp = (*q == '-');
+      q ++;
+    }
+    if (q < End && *q >= '0' && *q <= '9') {
+      int Exp = 0;
+      while (q < End && *q >= '0' && *q <= '9') {
+        if (Exp < 100000) Exp = Exp * 10 + (*q - '0');
+        q ++;
+      }
+      Exponent += NegativeExp ? -Exp : Exp;
+      p = q;
+    }
+  }
+  if (p < End && !isSeparator (*p)) return false;
+
+  if (!Truncated && Mantissa <= MAX_FAST_MANTISSA
+    && Exponent >= -MAX_FAST_EXPONENT && Exponent <= MAX_FAST_EXPONENT) {
+    Value = double (Mantissa);
+    if (Exponent < 0) Value /= PowersOfTen [-Exponent];
+    else Value *= PowersOfTen [Exponent];
+  } else {
+    // Leave numbers that cannot be converted exactly here to strtod, which
+    // needs a copy of the number ending in a null character
+    char Buffer [MAX_NUMBER_LENGTH];
+    size_t Length = p - Text;
+    string Long;
+    const char *Copy = Buffer;
+    if (Length < MAX_NUMBER_LENGTH) {
+      memcpy (Buffer, Text, Length);
+      Buffer [Length] = '\0';
+    } else {
+      Long.assign (Text, Length);
+      Copy = Long.c_str ();
+    }
+    Value = strtod (Copy, NULL);
+    Negative = false;
+  }
+  if (Negative) Value = -Value;
+  Text = p;
+  return true;
+}
+
+
+//------------------------------------------------------------------------------
+// readColumns (string, vector <double> &, vector <double> &) : Reads the first
+// two columns of the file named at arg1 into arg2 and arg3, and returns the
+// number of rows read. Throws an LC_ error code if the file cannot be read.
+//
+size_t readColumns (string Filename, vector <double> &x, vector <double> &y)
+  throw (int) {
+  x.clear ();
+  y.clear ();
+
+  // Map the file into memory, or read it into a buffer if it cannot be mapped,
+  // e.g. if it is a pipe
+  int File = open (Filename.c_str (), O_RDONLY);
+  struct stat FileInfo;
+  if (File < 0 || fstat (File, &FileInfo) != 0) {
+    if (File >= 0) close (File);
+    cout << "Error: Unable to open " << Filename << "." << endl;
+    throw int (LC_FILE_OPEN_ERROR);
+  }
+  size_t Size = FileInfo.st_size;
+  void *Mapped = MAP_FAILED;
+  string Contents;
+  const char *Data;
+  if (Size > 0) {
+    Mapped = mmap (NULL, Size, PROT_READ, MAP_PRIVATE, File, 0);
+  }
+  if (Mapped != MAP_FAILED) {
+    madvise (Mapped, Size, MADV_SEQUENTIAL);
+    Data = (const char *) Mapped;
+  } else {
+    ifstream Input (Filename.c_str (), ios::in | ios::binary);
+    Contents.assign (istreambuf_iterator <char> (Input), istreambuf_iterator <char> ());
+    Data = Contents.data ();
+    Size = Contents.size ();
+  }
+  close (File);
+  const char *End = Data + Size;
+
+  // Count the rows so that the columns are allocated only once
+  size_t NumRows = 0;
+  for (const char *p = Data; p < End; NumRows ++) {
+    const char *Next = (const char *) memchr (p, '\n', End - p);
+    p = Next ? Next + 1 : End;
+  }
+  x.reserve (NumRows);
+  y.reserve (NumRows);
+
+  // Read the first two numbers of every row that is not blank or a comment
+  size_t Row = 0;
+  for (const char *p = Data; p < End; ) {
+    const char *RowEnd = (const char *) memchr (p, '\n', End - p);
+    if (RowEnd == NULL) RowEnd = End;
+    Row ++;
+    while (p < RowEnd && (*p == ' ' || *p == '\t' || *p == '\r')) p ++;
+    if (p < RowEnd && strchr (COLUMN_COMMENT_CHARS, *p) == NULL) {
+      double xi, yi;
+      bool Valid = parseNumber (p, RowEnd, xi);
+      while (Valid && p < RowEnd && isSeparator (*p)) p ++;
+      Valid = Valid && parseNumber (p, RowEnd, yi);
+      if (!Valid) {
+        if (Mapped != MAP_FAILED) munmap (Mapped, Size);
+        cout << "Error: Unable to read row " << Row << " of " << Filename
+          << ". Each row must begin with two numbers." << endl;
+        throw int (LC_FILE_READ_ERROR);
+      }
+      x.push_back (xi);
+      y.push_back (yi);
+    }
+    p = RowEnd + 1;
+  }
+  if (Mapped != MAP_FAILED) munmap (Mapped, Size);
+  return x.size ();
+}
@@ -0,0 +1,57 @@
+// Xgtools
+// Copyright (C) M. P. Ruffoni 2011-2015
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//==============================================================================
+// Column file functions (columnfile.h)
+//==============================================================================
+// Reads the first two columns of an ASCII file of numbers, such as a spectrum
+// saved with the XGremlin writeasc command, a lamp radiance table, or a
+// response function written by ftsresponse. Such files can run to millions of
+// rows, so rather than reading them a line at a time through a stream, the file
+// is mapped into memory, the ends of its rows are found with memchr, and the
+// numbers are converted directly from the mapped text.
+//
+// Columns may be separated by spaces, tabs or commas, and any columns after the
+// second are ignored. Blank rows, and rows beginning with COMMENT_CHARS, are
+// skipped. A number with no more than 19 significant digits and a decimal
+// exponent of at most 22 either way is converted with a single multiplication
+// or division by an exact power of ten, which rounds correctly since both
+// operands are exact. Anything else is passed to strtod.
+//
+#ifndef XG_COLUMN_FILE_H
+#define XG_COLUMN_FILE_H
+
+#include <string>
+#include <vector>
+#include "ErrDefs.h"
+
+// Rows beginning with any of these characters are comments
+#define COLUMN_COMMENT_CHARS "#!"
+
+using namespace::std;
+
+// Reads the first two columns of every row of the named file into x and y,
+// replacing their contents, and returns the number of rows read. Throws an LC_
+// error code if the file cannot be opened or a row does not start with two
+// numbers.
+size_t readColumns (string Filename, vector <double> &x, vector <double> &y)
+  throw (int);
+
+// Converts the number starting at Text, which must end before End. On success,
+// Text is left on the character following the number.
+bool parseNumber (const char *&Text, const char *End, double &Value);
+
+#endif // XG_COLUMN_FILE_H
@@ -22,6 +22,8 @@
 #include <sstream>
 #include <string>
 #include <cmath>
+#include "xgcache.h"
+#include "fixedformat.h"
 
 using namespace::std;
 
@@ -94,14 +96,38 @@ int main (int argc, char* argv[])
     iss >> LevelEnergy;
   }
 
+  // If the cache is enabled and the same extraction has been made from this
+  // list before, print the stored result instead of rescanning the list. The
+  // Kurucz lists run to gigabytes, so the list is keyed on its path, size and
+  // modification time rather than on its contents.
+  XgCache Cache ("extractlevel");
+  XgCacheRecord CachedLines;
+  string Extracted;
+  try {
+    Cache.addFileStat (argv [KURUCZ_INPUT]);
+  } catch (int Err) {
+    return ERR_INPUT_READ_ERROR;
+  }
+  Cache.addValue (LevelEnergy);
+  Cache.addValue (string (argv [LEVEL_TYPE]));
+  Cache.addValue (double (IgnoreMinus));
+  Cache.addValue (double (RemovePredicted));
+  if (Cache.fetch (CachedLines)) {
+    try {
+      CachedLines.get (Extracted);
+      cout << Extracted;
+      return ERR_NO_ERROR;
+    } catch (int Err) {
+      Extracted = "";
+    }
+  }
+
   ifstream FullKuruczList (argv [KURUCZ_INPUT]);
 
   if (FullKuruczList.is_open ()) 
   {
     istringstream iss;
-    ostringstream oss;
     string NextLine;
-    oss << fixed << right;
     double LowerLevel, UpperLevel, Temp;
     double *TargetLevel;
     if (argv [LEVEL_TYPE][0] == 'l') { TargetLevel = &LowerLevel; }
@@ -123,15 +149,12 @@ int main (int argc, char* argv[])
         if (IgnoreMinus && (LowerLevel < 0 || UpperLevel < 0)) {
           LowerLevel = abs(LowerLevel);
           UpperLevel = abs(UpperLevel);
-          oss.str (""); oss.clear ();
-          oss << NextLine.substr (0, 24);
-          oss.precision (3); oss.width (12);
-          oss << LowerLevel;
-          oss << NextLine.substr (36, 16);
-          oss.precision (3); oss.width (12);
-          oss << UpperLevel;
-          oss << NextLine.substr (64);
-          NextLine = oss.str ();
+          const FieldFormat &Energy1 = KuruczFormat [KZ_FIELD_ENERGY_1];
+          const FieldFormat &Energy2 = KuruczFormat [KZ_FIELD_ENERGY_2];
+          NextLine.replace (Energy2.Offset, Energy2.Width, 
+            FixedRecord::format (Energy2, UpperLevel));
+          NextLine.replace (Energy1.Offset, Energy1.Width, 
+            FixedRecord::format (Energy1, LowerLevel));
         }
             
         if (abs(LowerLevel) > abs(UpperLevel))
@@ -144,6 +167,7 @@ int main (int argc, char* argv[])
         if (abs(abs(*TargetLevel) - LevelEnergy) < DISCRIMINATOR) {
           if (!(RemovePredicted && (LowerLevel < 0 || UpperLevel < 0))) {
             cout << NextLine << endl;
+            if (Cache.enabled ()) Extracted += NextLine + "\n";
           }
         }
       }
@@ -155,6 +179,8 @@ int main (int argc, char* argv[])
     return ERR_INPUT_READ_ERROR;
   }
   FullKuruczList.close ();
+  CachedLines.put (Extracted);
+  Cache.store (CachedLines);
   return ERR_NO_ERROR;
 }
 
@@ -0,0 +1,125 @@
+// Xgtools
+// Copyright (C) M. P. Ruffoni 2011-2015
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//==============================================================================
+// FixedRecord class (fixedformat.cpp)
+//==============================================================================
+
+#include "fixedformat.h"
+#include <cstdio>
+
+//------------------------------------------------------------------------------
+// FixedRecord constructor : Prepares to write records in the format given by
+// the schema at arg1, which must remain valid for the life of the object.
+//
+FixedRecord::FixedRecord (const FieldFormat *NewSchema) {
+  Schema = NewSchema;
+  clear ();
+}
+
+
+//------------------------------------------------------------------------------
+// clear () : Empties the buffer and returns to the first field of the schema.
+//
+void FixedRecord::clear () {
+  Buffer.clear ();
+  Next = Schema;
+  Overflow = 0;
+}
+
+
+//------------------------------------------------------------------------------
+// append (const char *, int) : Adds the formatted text of the next field to the
+// record. The record is first padded with spaces to the start of the field,
+// which is moved right by the overflow of all the earlier fields.
+//
+void FixedRecord::append (const char *Text, int Length) {
+  if (Next -> Kind == FF_END) return;
+  if (Length < 0) Length = 0;
+  if (Length >= FF_MAX_FIELD_LENGTH) Length = FF_MAX_FIELD_LENGTH - 1;
+  size_t Start = Next -> Offset + Overflow;
+  if (Buffer.length () < Start) Buffer.append (Start - Buffer.length (), ' ');
+  Buffer.append (Text, Length);
+  if ((unsigned int) Length > Next -> Width) Overflow += Length - Next -> Width;
+  Next ++;
+}
+
+
+//------------------------------------------------------------------------------
+// put (double), put (int), put (const string &), put (const char *),
+// put (char) : Format the value at arg1 according to the next field in the
+// schema, and append it to the record. A number passed to an integer field is
+// truncated, and one passed to a text field is written as a fixed point value.
+//
+void FixedRecord::put (double Value) {
+  char Text [FF_MAX_FIELD_LENGTH];
+  int Length;
+  switch (Next -> Kind) {
+    case FF_INTEGER:
+      Length = snprintf (Text, FF_MAX_FIELD_LENGTH, "%*d", Next -> Width,
+        (int) Value);
+      break;
+    case FF_SCIENTIFIC:
+      Length = snprintf (Text, FF_MAX_FIELD_LENGTH, "%*.*e", Next -> Width,
+        Next -> Precision, Value);
+      break;
+    default:
+      Length = snprintf (Text, FF_MAX_FIELD_LENGTH, "%*.*f", Next -> Width,
+        Next -> Precision, Value);
+  }
+  append (Text, Length);
+}
+
+void FixedRecord::put (int Value) {
+  if (Next -> Kind != FF_INTEGER) {
+    put (double (Value));
+    return;
+  }
+  char Text [FF_MAX_FIELD_LENGTH];
+  append (Text, snprintf (Text, FF_MAX_FIELD_LENGTH, "%*d", Next -> Width, Value));
+}
+
+void FixedRecord::put (const string &Value) {
+  put (Value.c_str ());
+}
+
+void FixedRecord::put (const char *Value) {
+  char Text [FF_MAX_FIELD_LENGTH];
+  const char *Format = (Next -> Kind == FF_TEXT_LEFT) ? "%-*.*s" : "%*.*s";
+  int MaxLength = (Next -> Precision < 0) ? FF_MAX_FIELD_LENGTH - 1
+    : Next -> Precision;
+  append (Text, snprintf (Text, FF_MAX_FIELD_LENGTH, Format, Next -> Width,
+    MaxLength, Value));
+}
+
+void FixedRecord::put (char Value) {
+  char Text [FF_MAX_FIELD_LENGTH];
+  append (Text, snprintf (Text, FF_MAX_FIELD_LENGTH, "%*c", Next -> Width, Value));
+}
+
+
+//------------------------------------------------------------------------------
+// format (const FieldFormat &, double) : Returns the value at arg2 formatted as
+// it would be in a field described by arg1, e.g. to replace that field in an
+// existing record.
+//
+string FixedRecord::format (const FieldFormat &Field, double Value) {
+  FieldFormat Single [2] = { Field, { 0, 0, 0, FF_END } };
+  Single[0].Offset = 0;
+  FixedRecord Record (Single);
+  Record.put (Value);
+  return Record.str ();
+}
@@ -0,0 +1,164 @@
+// Xgtools
+// Copyright (C) M. P. Ruffoni 2011-2015
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//==============================================================================
+// FixedRecord class (fixedformat.h)
+//==============================================================================
+// Writes the fixed-width text records used by Kurucz line lists, XGremlin
+// writelines files, and XGremlin SYN files. Each format is described by a
+// schema: a constant array of FieldFormat, one for each field in the record,
+// giving the column at which the field starts, its width, its precision, and
+// the kind of value it holds. The array ends with a field of kind FF_END.
+//
+// A record is built by passing each of its values, in order, to put(). Every
+// value is formatted directly into the record buffer, and any gap between the
+// end of one field and the start of the next is filled with spaces. The buffer
+// is reused by the next record after clear(), so writing a long list does not
+// allocate memory for each line.
+//
+// Numeric fields are right justified, and, as with printf, a value too long for
+// its field is written in full. All later fields are then moved right by the
+// same number of characters, so the records are identical to those produced by
+// the printf and ostream formatting that this class replaces.
+//
+#ifndef FIXED_FORMAT_H
+#define FIXED_FORMAT_H
+
+#include <string>
+
+// Kinds of field in a fixed-width record
+#define FF_END        0  /* Marks the end of a schema                   */
+#define FF_INTEGER    1  /* Integer                                     */
+#define FF_FIXED      2  /* Fixed point, with Precision decimal places  */
+#define FF_SCIENTIFIC 3  /* Exponential notation, Precision places      */
+#define FF_TEXT       4  /* Right justified string                      */
+#define FF_TEXT_LEFT  5  /* Left justified string                       */
+#define FF_CHAR       6  /* A single character                          */
+
+// The longest single field that can be formatted, in characters
+#define FF_MAX_FIELD_LENGTH 512
+
+using namespace::std;
+
+// Define a structure to describe one field of a fixed-width record. For text
+// fields, Precision is the maximum number of characters written, or -1 if the
+// whole string should always be written.
+typedef struct td_FieldFormat {
+  unsigned int Offset;
+  unsigned int Width;
+  int Precision;
+  int Kind;
+} FieldFormat;
+
+// Kurucz line list records, as read by KzLine::readLine (). The positions of
+// the level energies are used to rewrite them in place.
+static const FieldFormat KuruczFormat [] = {
+  {   0, 11,  4, FF_FIXED }, /* Wavelength / nm       */
+  {  11,  7,  3, FF_FIXED }, /* log(gf)               */
+  {  18,  6,  2, FF_FIXED }, /* Element code          */
+  {  24, 12,  3, FF_FIXED }, /* Energy of 1st level   */
+  {  36,  5,  1, FF_FIXED }, /* J of 1st level        */
+  {  42, 10, -1, FF_TEXT },  /* Configuration         */
+  {  52, 12,  3, FF_FIXED }, /* Energy of 2nd level   */
+  {  64,  5,  1, FF_FIXED }, /* J of 2nd level        */
+  {  70, 10, -1, FF_TEXT },  /* Configuration         */
+  {  80,  6,  2, FF_FIXED }, /* log(Gamma rad)        */
+  {  86,  6,  2, FF_FIXED }, /* log(Gamma Stark)      */
+  {  92,  6,  2, FF_FIXED }, /* log(Gamma Waals)      */
+  {  98,  4, -1, FF_TEXT },  /* Reference             */
+  { 102,  2,  0, FF_INTEGER }, /* NLTE level 1        */
+  { 104,  2,  0, FF_INTEGER }, /* NLTE level 2        */
+  { 106,  3,  0, FF_INTEGER }, /* Isotope             */
+  { 109,  6,  3, FF_FIXED }, /* log(hyperfine frac.)  */
+  { 115,  3,  0, FF_INTEGER }, /* Isotope 2           */
+  { 118,  6,  3, FF_FIXED }, /* log(isotope frac.)    */
+  { 124,  5,  0, FF_INTEGER }, /* Hyperfine shift 1   */
+  { 129,  5,  0, FF_INTEGER }, /* Hyperfine shift 2   */
+  { 135,  1,  0, FF_INTEGER }, /* Hyperfine F 1       */
+  { 136,  1,  0, FF_CHAR },  /* Hyperfine note 1      */
+  { 138,  1,  0, FF_INTEGER }, /* Hyperfine F 2       */
+  { 139,  1,  0, FF_CHAR },  /* Hyperfine note 2      */
+  { 140,  1,  0, FF_INTEGER }, /* Strength class      */
+  { 141,  3, -1, FF_TEXT },  /* Tag code              */
+  { 144,  5,  0, FF_INTEGER }, /* Lande g 1           */
+  { 149,  5,  0, FF_INTEGER }, /* Lande g 2           */
+  { 154,  6,  0, FF_INTEGER }, /* Isotope shift       */
+  {   0,  0,  0, FF_END }
+};
+#define KZ_FIELD_ENERGY_1 3
+#define KZ_FIELD_ENERGY_2 6
+
+// XGremlin writelines records
+static const FieldFormat WritelinesFormat [] = {
+  {   0,  6,  0, FF_INTEGER },    /* Line number  */
+  {   8, 12,  6, FF_FIXED },      /* Wavenumber   */
+  {  20, 10,  3, FF_SCIENTIFIC }, /* Peak         */
+  {  30,  9,  2, FF_FIXED },      /* Width        */
+  {  39,  9,  4, FF_FIXED },      /* Damping      */
+  {  48, 11,  4, FF_SCIENTIFIC }, /* Eq. width    */
+  {  59,  6,  0, FF_INTEGER },    /* Iterations   */
+  {  65,  4,  0, FF_INTEGER },    /* H            */
+  {  69,  5, -1, FF_TEXT },       /* Tags         */
+  {  74, 11,  4, FF_SCIENTIFIC }, /* Epsilon tot  */
+  {  85, 11,  4, FF_SCIENTIFIC }, /* Epsilon even */
+  {  96, 11,  4, FF_SCIENTIFIC }, /* Epsilon odd  */
+  { 107, 11,  4, FF_SCIENTIFIC }, /* Epsilon rand */
+  { 119, 30, 30, FF_TEXT_LEFT },  /* Identification */
+  { 149, 11,  6, FF_FIXED },      /* Wavelength   */
+  {   0,  0,  0, FF_END }
+};
+
+// XGremlin SYN records, as read by the readlines command in 'syn' mode
+static const FieldFormat SynFormat [] = {
+  {   0, 15, -1, FF_TEXT_LEFT }, /* Identification */
+  {  17, 12,  5, FF_FIXED },     /* Wavenumber     */
+  {  29, 10,  4, FF_FIXED },     /* Peak           */
+  {  39,  9,  2, FF_FIXED },     /* Width          */
+  {  48,  8,  4, FF_FIXED },     /* Damping        */
+  {   0,  0,  0, FF_END }
+};
+
+class FixedRecord {
+  public:
+    FixedRecord (const FieldFormat *NewSchema);
+    ~FixedRecord () {}
+
+    // Starts a new record, keeping the memory allocated for the last one
+    void clear ();
+
+    // Append the next field of the record
+    void put (double Value);
+    void put (int Value);
+    void put (const string &Value);
+    void put (const char *Value);
+    void put (char Value);
+
+    // Access the completed record
+    const string &str () { return Buffer; }
+    size_t length () { return Buffer.length (); }
+
+    // Formats a single value as it would appear in a field of format arg1
+    static string format (const FieldFormat &Field, double Value);
+
+  private:
+    const FieldFormat *Schema;
+    const FieldFormat *Next;
+    size_t Overflow;
+    string Buffer;
+    void append (const char *Text, int Length);
+};
+
+#endif // FIXED_FORMAT_H
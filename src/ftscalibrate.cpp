@@ -56,10 +56,36 @@
 // using the equation given by Brault in Mikrochim. Acta (Wien) 3 pp.215 (1987),
 // and secondly, by using the standard deviation in the fit residuals.
 //
+// In series mode (-s), a chain file lists one or more chains of line lists,
+// each on its own row as: <standards> <list 1> <list 2> ... <list N>. The first
+// list in each chain is calibrated against the standards as described above.
+// Every following list is then calibrated against the calibrated lines of the
+// list before it, so that the calibration is transferred along the chain. Each
+// list is read only once and held in memory until the next list has been
+// calibrated against it. The error of each correction includes the error of
+// the list it was transferred from, added in quadrature. The calibrated lists
+// and calibration records are saved as <list>.cln and <list>.cal. Independent
+// chains are calibrated concurrently. If a memory budget is set with the
+// --mem-limit option or the XGTOOLS_MEM_LIMIT environment variable, fewer
+// chains are calibrated at once so that their lists fit within it.
+//
+// By default, epsilon is a single constant. If the wavenumber scale error 
+// varies across the spectrum, the -poly N option instead fits epsilon as a
+// polynomial of order N in wavenumber, and -pwl K as a piecewise linear 
+// function with K equal pieces spanning the fitted lines. Each line is then
+// corrected by epsilon evaluated at its own wavenumber, and the scale error
+// in the .cal file is that of the model at each line.
+//
 #include "listcal.h"
 #include <iostream>
+#include <fstream>
 #include <string>
 #include <sstream>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include "memlimit.h"
+#include "xgtrace.h"
 
 #define LC_VERSION "1.0"
 
@@ -75,10 +101,268 @@
 #define ARG_OUT_FILE_1 7    /* 7th arg is the output for the calibrated list  */
 #define ARG_OUT_FILE_2 3    /* as above, but for the second argument form     */
 
+// Definitions for the series mode command line arguments
+#define SERIES_OPTION "-s"
+#define REQ_NUM_ARGS_S1 7   /* 6 arguments are needed (plus 1 for the binary) */
+#define REQ_NUM_ARGS_S2 3   /* 2 arguments are needed (plus 1 for the binary) */
+#define ARG_CHAIN_FILE 2    /* 2nd arg is the file listing the chains. The fit */
+                            /* parameters follow as args 3-6, as above.       */
+
+// Correction model options, which must precede all other arguments
+#define POLY_OPTION "-poly"
+#define PWL_OPTION "-pwl"
+
+// The approximate memory needed to hold a line list, per byte of the file
+#define LIST_MEMORY_FACTOR 3
+
 // Error codes
 #define LC_NO_ERROR     0
 #define LC_SYNTAX_ERROR 1
 
+//------------------------------------------------------------------------------
+// loadStandardLists (ListCal &, string) : Loads each of the standard line lists
+// named in arg2 into the ListCal object at arg1. The lists are separated by
+// commas, and each name may be followed by a colon and the uncertainty of the
+// lines in that list, in cm^-1.
+//
+void loadStandardLists (ListCal &ListFitter, string Standards) throw (int) {
+  istringstream iss (Standards);
+  string NextList;
+  while (getline (iss, NextList, ',')) {
+    double Uncertainty = 0.0;
+    size_t Colon = NextList.rfind (':');
+    if (Colon != string::npos) {
+      Uncertainty = atof (NextList.substr (Colon + 1).c_str ());
+      NextList.erase (Colon);
+      if (Uncertainty <= 0.0) {
+        cout << "Error: The uncertainty given for " << NextList 
+          << " must be a positive number." << endl;
+        throw int (LC_SYNTAX_ERROR);
+      }
+    }
+    ListFitter.loadStandardList (NextList.c_str (), Uncertainty);
+  }
+}
+
+
+//------------------------------------------------------------------------------
+// Series mode
+//
+// A chain of line lists to be calibrated in turn, as read from the chain file.
+// Status is set to a non-zero error code if the chain could not be completed.
+typedef struct td_Chain {
+  string Standards;
+  vector <string> Lists;
+  int Status;
+} Chain;
+
+// The fit parameters shared by all the calibrations in series mode
+typedef struct td_SeriesParams {
+  bool Set;
+  double Discriminator;
+  double Threshold;
+  double DiscardLimit;
+  double PointSpacing;
+  int ModelType;
+  unsigned int ModelOrder;
+} SeriesParams;
+
+// Serialises console output and the allocation of chains to threads
+mutex SeriesLock;
+
+
+//------------------------------------------------------------------------------
+// readChainFile (string) : Reads the chains from the file at arg1. Blank rows
+// and rows starting with # are ignored. Each other row must name the standards
+// followed by at least one line list.
+//
+vector <Chain> readChainFile (string Filename) throw (int) {
+  vector <Chain> Chains;
+  string NextRow, NextList;
+  ifstream ChainFile (Filename.c_str (), ios::in);
+  if (!ChainFile.is_open ()) {
+    cout << "Error: Cannot read " << Filename 
+      << ". Check the file exists and has read permissions." << endl;
+    throw int (LC_FILE_OPEN_ERROR);
+  }
+  while (getline (ChainFile, NextRow)) {
+    istringstream iss (NextRow);
+    Chain NewChain;
+    NewChain.Status = LC_NO_ERROR;
+    if (!(iss >> NewChain.Standards) || NewChain.Standards[0] == '#') continue;
+    while (iss >> NextList) NewChain.Lists.push_back (NextList);
+    if (NewChain.Lists.size () == 0) {
+      cout << "Error: No line lists follow " << NewChain.Standards << " in " 
+        << Filename << "." << endl;
+      throw int (LC_FILE_READ_ERROR);
+    }
+    Chains.push_back (NewChain);
+  }
+  ChainFile.close ();
+  return Chains;
+}
+
+
+//------------------------------------------------------------------------------
+// calibrateChain (Chain &, unsigned int, SeriesParams &) : Calibrates each list
+// in the chain at arg1 against the one before it, and saves the results. Only
+// the ListCal objects for the current and previous lists are held at once.
+//
+void calibrateChain (Chain &Links, unsigned int ChainNum, SeriesParams &Params) {
+  XgTraceSpan ChainSpan ("calibrate chain");
+  ListCal *Previous = NULL, *Current = NULL;
+  try {
+    for (unsigned int i = 0; i < Links.Lists.size (); i ++) {
+      Current = new ListCal ();
+      Current -> setCorrectionModel (Params.ModelType, Params.ModelOrder);
+      if (Params.Set) {
+        Current -> setDiscriminator (Params.Discriminator);
+        Current -> setPeakAmpThreshold (Params.Threshold);
+        Current -> setDiscardLimit (Params.DiscardLimit);
+        Current -> setPointSpacing (Params.PointSpacing);
+      }
+      {
+        XgTraceSpan Span ("read lists");
+        Current -> loadLineList (Links.Lists[i].c_str ());
+        if (Previous == NULL) {
+          loadStandardLists (*Current, Links.Standards);
+        } else {
+          Current -> loadStandardList (*Previous);
+          Current -> setStandardError (Previous -> getTotalCorrectionError ());
+          delete Previous;
+          Previous = NULL;
+        }
+      }
+      {
+        XgTraceSpan Span ("fit calibration");
+        Current -> findCommonLines (false);
+        Current -> findFittedLines (false);
+        if (!Current -> loadCachedCalibration ()) {
+          do {
+            Current -> findCorrection (false);
+          } while (Current -> removeBadLines (false));
+          Current -> saveCachedCalibration ();
+        }
+      }
+      {
+        XgTraceSpan Span ("write list");
+        int Err = Current -> saveLineList (Links.Lists[i].c_str ());
+        if (Err != LC_NO_ERROR) throw int (Err);
+      }
+      
+      SeriesLock.lock ();
+      cout << "Chain " << ChainNum + 1 << ", " << Links.Lists[i] << " : dSig/Sig = " 
+        << Current -> getWaveCorrection () << " +/- " 
+        << Current -> getTotalCorrectionError () << endl;
+      SeriesLock.unlock ();
+      Previous = Current;
+      Current = NULL;
+    }
+  } catch (int Err) {
+    SeriesLock.lock ();
+    cout << "Chain " << ChainNum + 1 << " ABORTED." << endl;
+    SeriesLock.unlock ();
+    Links.Status = Err;
+  }
+  delete Previous;
+  delete Current;
+}
+
+
+//------------------------------------------------------------------------------
+// seriesWorker (vector <Chain> *, unsigned int *, SeriesParams *) : Thread 
+// function that takes the next uncalibrated chain from arg1 until none remain.
+// arg2 is the index of the next chain, shared between all the workers.
+//
+void seriesWorker (vector <Chain> *Chains, unsigned int *NextChain, 
+  SeriesParams *Params) {
+  while (true) {
+    SeriesLock.lock ();
+    unsigned int ChainNum = (*NextChain) ++;
+    SeriesLock.unlock ();
+    if (ChainNum >= Chains -> size ()) return;
+    calibrateChain (Chains -> at (ChainNum), ChainNum, *Params);
+  }
+}
+
+
+//------------------------------------------------------------------------------
+// chainMemory (Chain &) : Estimates the memory needed to calibrate the chain at
+// arg1, from the sizes of the largest pair of lists that are held at once.
+//
+size_t chainMemory (Chain &Links) {
+  size_t Previous = 0, Largest = 0;
+  istringstream iss (Links.Standards);
+  string NextList;
+  while (getline (iss, NextList, ',')) {
+    Previous += XgMemLimit::fileSize (NextList.substr (0, NextList.rfind (':')));
+  }
+  for (unsigned int i = 0; i < Links.Lists.size (); i ++) {
+    size_t Current = XgMemLimit::fileSize (Links.Lists[i]);
+    if (Previous + Current > Largest) Largest = Previous + Current;
+    Previous = Current;
+  }
+  return Largest * LIST_MEMORY_FACTOR;
+}
+
+
+//------------------------------------------------------------------------------
+// runSeries (int, char *[], int, unsigned int, XgMemLimit &) : Runs
+// ftscalibrate in series mode, fitting the correction model given by args 3
+// and 4. The chains are shared between as many threads as there are chains, up
+// to the number of processor cores, and as many as the memory budget at arg5
+// allows for the largest chain. Returns the error code of the first chain that
+// failed.
+//
+int runSeries (int argc, char *argv[], int ModelType, unsigned int ModelOrder,
+  XgMemLimit &Budget) {
+  SeriesParams Params;
+  vector <Chain> Chains;
+  vector <thread> Workers;
+  unsigned int NextChain = 0;
+  
+  Params.ModelType = ModelType;
+  Params.ModelOrder = ModelOrder;
+  Params.Set = (argc == REQ_NUM_ARGS_S1);
+  if (Params.Set) {
+    Params.Discriminator = atof (argv[ARG_DISCRIMINATOR]);
+    Params.Threshold = atof (argv[ARG_THRESHOLD]);
+    Params.DiscardLimit = atof (argv[ARG_DISCARD_LIMIT]);
+    Params.PointSpacing = atof (argv[ARG_POINT_SPACING]);
+  }
+  try {
+    Chains = readChainFile (argv[ARG_CHAIN_FILE]);
+  } catch (int Err) {
+    return Err;
+  }
+  
+  unsigned int NumWorkers = thread::hardware_concurrency ();
+  if (NumWorkers == 0) NumWorkers = 1;
+  if (NumWorkers > Chains.size ()) NumWorkers = Chains.size ();
+  size_t ChainSize = 0;
+  for (unsigned int i = 0; i < Chains.size (); i ++) {
+    size_t NextSize = chainMemory (Chains[i]);
+    if (NextSize > ChainSize) ChainSize = NextSize;
+  }
+  NumWorkers = Budget.threads (ChainSize, NumWorkers);
+  cout << "Calibrating " << Chains.size () << " chain" 
+    << (Chains.size () == 1 ? "" : "s") << " with " << NumWorkers 
+    << " thread" << (NumWorkers == 1 ? "" : "s") << "..." << endl;
+  for (unsigned int i = 0; i < NumWorkers; i ++) {
+    Workers.push_back (thread (seriesWorker, &Chains, &NextChain, &Params));
+  }
+  for (unsigned int i = 0; i < Workers.size (); i ++) {
+    Workers[i].join ();
+  }
+  for (unsigned int i = 0; i < Chains.size (); i ++) {
+    if (Chains[i].Status != LC_NO_ERROR) return Chains[i].Status;
+  }
+  cout << "Series calibration complete." << endl;
+  Budget.report ();
+  return LC_NO_ERROR;
+}
+
+
 //==============================================================================
 // main
 //
@@ -86,18 +370,64 @@ int main (int argc, char *argv[]) {
   ListCal ListFitter;
   string OutputName;
   ostringstream oss;
+  int ModelType = LC_MODEL_CONSTANT;
+  unsigned int ModelOrder = 0;
+  XgMemLimit Budget ("ftscalibrate");
   
   cout << "FTS Line List Calibrator v" << LC_VERSION << " (built " << __DATE__ << ")" << endl << endl;
 
+  // Remove the --mem-limit option from anywhere in the command line
+  try {
+    argc = Budget.parseArgs (argc, argv);
+  } catch (int Err) {
+    return Err;
+  }
+
+  // Read and remove any correction model option from the command line, so that
+  // the remaining arguments are in their usual positions
+  if (argc > 2 && (string (argv[1]) == POLY_OPTION || string (argv[1]) == PWL_OPTION)) {
+    ModelType = (string (argv[1]) == POLY_OPTION) ? 
+      LC_MODEL_POLYNOMIAL : LC_MODEL_PIECEWISE;
+    istringstream iss (argv[2]);
+    char Extra;
+    int Order;
+    if (!(iss >> Order) || (iss >> Extra) || Order <= 0) {
+      cout << "Syntax error: The order of the correction model must be a "
+        << "positive integer." << endl;
+      return LC_SYNTAX_ERROR;
+    }
+    ModelOrder = Order;
+    for (int i = 1; i < argc - 2; i ++) {
+      argv[i] = argv[i + 2];
+    }
+    argc -= 2;
+    try {
+      ListFitter.setCorrectionModel (ModelType, ModelOrder);
+    } catch (int Err) {
+      return Err;
+    }
+    if (ModelOrder == 0) ModelType = LC_MODEL_CONSTANT;
+  }
   
   // Check the command line syntax. Output a help message if it's incorrect
   // and abort, returning a non-zero error code
+  if (argc > 1 && string (argv[1]) == SERIES_OPTION
+    && (argc == REQ_NUM_ARGS_S1 || argc == REQ_NUM_ARGS_S2)) {
+    return runSeries (argc, argv, ModelType, ModelOrder, Budget);
+  }
   if (argc != REQ_NUM_ARGS_1 && argc != REQ_NUM_ARGS_2) {
     cout << "ftscalibrate: Calibrates the wavenumbers of lines saved in an XGremlin ASCII (writelines) line list" << endl;
     cout << "---------------------------------------------------------------------------------------------------" << endl;
-    cout << "Syntax: ftscalibrate <list> <standards> [<discriminator> <min S/N> <discard limit> <spacing>] <output file>" << endl << endl;
+    cout << "Syntax: ftscalibrate [<model>] <list> <standards> [<discriminator> <min S/N> <discard limit> <spacing>] <output file>" << endl;
+    cout << "        ftscalibrate [<model>] -s <chain file> [<discriminator> <min S/N> <discard limit> <spacing>]" << endl << endl;
+    cout << "<model>        : Optional. -poly <N> fits the correction as a polynomial of order N in wavenumber, and" << endl;
+    cout << "                 -pwl <K> as a piecewise linear function of K pieces. By default it is a constant." << endl;
+    cout << "                 Outside the range of the fitted lines, the correction is held at its value at the nearer end." << endl;
     cout << "<list>         : An XGremlin ASCII line list containing the lines to be calibrated (written with writelines)." << endl;
     cout << "<standards>    : An XGremlin ASCII line list to act as the calibration standard (also in writelines format)." << endl;
+    cout << "                 Several lists may be given, separated by commas, and each may be followed by :<uncertainty>" << endl;
+    cout << "                 in cm^-1 to weight its lines in the fit, e.g. ArII_a.lines:0.0005,ArII_b.lines:0.002. Lines" << endl;
+    cout << "                 found in more than one list within <discriminator> are taken from the list of lowest uncertainty." << endl;
     cout << "<discriminator>: The maximum allowed wavenumber difference (in cm^-1) when searching for common lines in" << endl;
     cout << "                 <list> and <standards>. Any line without a partner within this limit will be ignored." << endl;
     cout << "<min S/N>      : The minimum allowed S/N ratio for any line used in the calibration." << endl;
@@ -105,6 +435,11 @@ int main (int argc, char *argv[]) {
     cout << "                 will be discarded from the calibration." << endl;
     cout << "<spacing>      : The separation, in cm^-1, between data points in the spectrum." << endl;
     cout << "<output file>  : A file name where the calibrated <list> will be saved." << endl;
+    cout << "<chain file>   : Series mode. Each row of this file holds a chain of lists: <standards> <list 1> ... <list N>." << endl;
+    cout << "                 <list 1> is calibrated against <standards>, and each later list against the list before" << endl;
+    cout << "                 it. Results are saved to <list>.cln and <list>.cal. Chains are calibrated concurrently." << endl;
+    cout << "--mem-limit    : Optional, anywhere. --mem-limit <size> (e.g. 2G) limits the number of chains calibrated" << endl;
+    cout << "                 at once so that their line lists fit within <size>. Also set by XGTOOLS_MEM_LIMIT." << endl;
     cout << endl;
     return LC_SYNTAX_ERROR;
   }
@@ -126,6 +461,11 @@ int main (int argc, char *argv[]) {
   cout << "Discriminator             : " << ListFitter.getDiscriminator() << endl;
   cout << "Minimum line amplitude    : " << ListFitter.getPeakAmpThreshold() << endl;
   cout << "Discard beyond x Std Dev  : " << ListFitter.getDiscardLimit() << endl;  
+  if (ModelType == LC_MODEL_POLYNOMIAL) {
+    cout << "Correction model          : Polynomial, order " << ModelOrder << endl;
+  } else if (ModelType == LC_MODEL_PIECEWISE) {
+    cout << "Correction model          : Piecewise linear, " << ModelOrder << " pieces" << endl;
+  }
   cout << "Calibrated list saved to  : " << OutputName << endl;
 
   // Prepare the calibration. Pass the list files to the ListCal object
@@ -134,36 +474,56 @@ int main (int argc, char *argv[]) {
   cout << endl << "Starting calibration..." << endl;
   try {
     ListFitter.loadLineList (argv[ARG_LIST_FILE]);
-    ListFitter.loadStandardList (argv[ARG_STD_FILE]);
+    loadStandardLists (ListFitter, argv[ARG_STD_FILE]);
     ListFitter.findCommonLines (false);
     ListFitter.findFittedLines (true);
   } catch (int Err) {
     return Err;
   }
+  if (ModelType != LC_MODEL_CONSTANT
+    && ModelOrder >= ListFitter.getNumFittedLines ()) {
+    cout << "Syntax error: The order of the correction model must be less than "
+      << "the number of lines fitted (" << ListFitter.getNumFittedLines ()
+      << ")." << endl;
+    return LC_SYNTAX_ERROR;
+  }
 
-  // Now fit the uncalibrated list to the standard lines. If any lines remain
-  // beyond DEF_DISCARD_LIMIT standard deviations of the mean after fitting,
-  // remove them and refine the fit. Stop when all the fitted lines are within
-  // DEF_DISCARD_LIMIT standard deviations of the mean.
-  unsigned int NumLinesRemoved;
-  do {
-  
-    // Do the fitting here
-    ListFitter.findCorrection ();
+  // If this calibration has been performed before with identical inputs and
+  // the cache is enabled, reuse the stored result rather than fitting again.
+  if (ListFitter.loadCachedCalibration ()) {
+    cout << "Using cached calibration result." << endl;
+  } else {
+    // Now fit the uncalibrated list to the standard lines. If any lines remain
+    // beyond DEF_DISCARD_LIMIT standard deviations of the mean after fitting,
+    // remove them and refine the fit. Stop when all the fitted lines are within
+    // DEF_DISCARD_LIMIT standard deviations of the mean.
+    unsigned int NumLinesRemoved;
+    try {
+      do {
     
-    // Remove any bad lines and output the results to the user
-    if ((NumLinesRemoved = ListFitter.removeBadLines (true))) {
-      cout << "Removed " << NumLinesRemoved << " bad line" << flush;
-      if (NumLinesRemoved > 1) cout << "s" << flush;
-      cout << " from the fit." << endl;
-      cout << endl << "Refining the calibration..." << endl;
-    } else {
-      cout << "All lines are within " << DEF_DISCARD_LIMIT << " standard deviations of the mean." << endl;
-      cout << endl << "Calibration complete." << endl;
+        // Do the fitting here
+        ListFitter.findCorrection ();
+      
+        // Remove any bad lines and output the results to the user
+        if ((NumLinesRemoved = ListFitter.removeBadLines (true))) {
+          cout << "Removed " << NumLinesRemoved << " bad line" << flush;
+          if (NumLinesRemoved > 1) cout << "s" << flush;
+          cout << " from the fit." << endl;
+          cout << endl << "Refining the calibration..." << endl;
+        } else {
+          cout << "All lines are within " << DEF_DISCARD_LIMIT << " standard deviations of the mean." << endl;
+          cout << endl << "Calibration complete." << endl;
+        }
+      
+        // Continue until no lines are removed by ListFitter.removeBadLines()
+      } while (NumLinesRemoved);
+    } catch (int Err) {
+      cout << "Calibration ABORTED." << endl;
+      return Err;
     }
-    
-    // Continue until no lines are removed by ListFitter.removeBadLines()
-  } while (NumLinesRemoved);
+  
+    ListFitter.saveCachedCalibration ();
+  }
   
   // The calibration is now complete. Output the results to the user
   cout << endl;
@@ -175,7 +535,16 @@ int main (int argc, char *argv[]) {
     << ListFitter.getWaveCorrectionError() << endl;
   cout << "--------------------------------------------------" << endl;
   cout << endl;
-  ListFitter.saveLineList (OutputName.c_str());
+  int SaveError;
+  try {
+    SaveError = ListFitter.saveLineList (OutputName.c_str());
+  } catch (int Err) {
+    SaveError = Err;
+  }
+  if (SaveError != LC_NO_ERROR) {
+    cout << "Saving the calibrated list ABORTED." << endl;
+    return SaveError;
+  }
   
   // Finally, plot the results with GNUPlot
   ListFitter.plotDifferences ();
@@ -23,6 +23,9 @@
 #include <vector>
 #include <bitset>
 #include <sstream>
+#include "memlimit.h"
+#include "byteorder.h"
+#include "xgtrace.h"
 
 using namespace::std;
 
@@ -48,10 +51,12 @@ void showHelp () {
   cout << endl;
   cout << "ftscombine : " << endl;
   cout << "---------------------------------------------------------------" << endl;
-  cout << "Syntax : ftscombine <file 1> <operator> <file 2> [<operator> <file 3> ...] <output>" << endl << endl;
+  cout << "Syntax : ftscombine [--mem-limit <size>] <file 1> <operator> <file 2> [<operator> <file 3> ...] <output>" << endl << endl;
   cout << "<file 1>    : Binary file for the left operand." << endl;
   cout << "<operator>  : one of + - * or / for addition, subtraction, multiplication, or division" << endl;
   cout << "<output>    : The calibrated line spectrum will be saved here." << endl;
+  cout << "<size>      : Optional. The most memory to use, e.g. 512M. The spectra are then" << endl;
+  cout << "              combined in blocks that fit within this limit." << endl;
   cout << "<coeffs>    : Number of spline fit coefficients. A larger value will reduce" << endl;
   cout << "              smoothing, allowing higher frequencies to be fitted, but" << endl;
   cout << "              could cause fit instabilities if too high (default "
@@ -97,22 +102,63 @@ vector <char> processCommandLine (int argc, char *argv[]) throw (string)
 }
   
 
+//------------------------------------------------------------------------------
+// combineBlock (float *, float *, int, char) : Applies the operator at arg4 to
+// the arg3 values at arg1 and the corresponding values at arg2, leaving the
+// result at arg1.
+//
+void combineBlock (float *Result, float *Operand, int Length, char Operator)
+{
+  switch (Operator) {
+    case OPERATOR_ADD:
+      for (int j = 0; j < Length; j ++) Result [j] += Operand [j];
+      break;
+    case OPERATOR_SUBTRACT:
+      for (int j = 0; j < Length; j ++) Result [j] -= Operand [j];
+      break;
+    case OPERATOR_MULTIPLY:
+      for (int j = 0; j < Length; j ++) Result [j] *= Operand [j];
+      break;
+    case OPERATOR_DIVIDE:
+      for (int j = 0; j < Length; j ++) Result [j] /= Operand [j];
+      break;
+  }
+}
+
+
 //------------------------------------------------------------------------------
 // Main program
 //
+// The spectra are combined in blocks, reading the same block from every file
+// in turn, so that only two blocks are held in memory at once. Each block is
+// the whole spectrum unless a memory budget has been set with --mem-limit.
+//
+// Files written on machines of the other byte order are swapped into the
+// native order as each block is read, and the result is written in the byte
+// order of the first file, so that the header of that file can be used with it.
+//
 int main (int argc, char *argv[]) 
 {
-  ifstream OperandFile;
+  ifstream FirstFile;
+  vector <ifstream *> OperandFiles;
+  vector <bool> OperandSwapped;
+  bool FirstSwapped;
   ofstream Output;
-  int FileSize, NumFloats;
-  float *Result, NextFloat;
+  int FileSize, NumFloats, BlockSize;
+  float *Result, *Operand;
   vector <char> Operators;
+  XgMemLimit Budget ("ftscombine");
 
   // Check the user's command line input
   try 
   { 
+    argc = Budget.parseArgs (argc, argv);
     Operators = processCommandLine (argc, argv);
   }
+  catch (int Err)
+  {
+    return 1;
+  }
   catch (string Err) 
   {
     cout << Err << endl;
@@ -128,92 +174,88 @@ int main (int argc, char *argv[])
     return 1;
   }
   
-  OperandFile.open (argv [1], ios::in|ios::binary);
-  if (!OperandFile.is_open ())
+  FirstFile.open (argv [1], ios::in|ios::binary);
+  if (!FirstFile.is_open ())
   {
     cout << "Error: Unable to open " << argv [1] << endl
       << "Aborting" << endl;
     return 1;
   }
-  OperandFile.seekg (0, ios::end);
-  FileSize = OperandFile.tellg ();
+  FirstFile.seekg (0, ios::end);
+  FileSize = FirstFile.tellg ();
   NumFloats = FileSize / float_size;
-  OperandFile.seekg (0, ios::beg);
-  Result = new float [NumFloats];
+  FirstFile.seekg (0, ios::beg);
+  FirstSwapped = datIsSwapped (argv [1]);
   cout << "Reading " << FileSize << " bytes from " << argv [1] <<" (" <<
-    NumFloats << " floating point numbers)" << endl;
-  
-  for (int i = 0; i < NumFloats; i ++)
-  {
-    OperandFile.read ((char*)&Result [i], float_size);
-  }
-  OperandFile.close ();
+    NumFloats << " floating point numbers" << (FirstSwapped ? ", byte-swapped" : "")
+    << ")" << endl;
   
+  // Open every other operand before combining anything, stopping at the first
+  // that cannot be used. The result of the operations before it is still saved.
   for (int i = 3; i < argc; i += 2) 
   {
-    OperandFile.open (argv [i], ios::in);
-    if (!OperandFile.is_open ())
+    ifstream *OperandFile = new ifstream (argv [i], ios::in|ios::binary);
+    if (!OperandFile -> is_open ())
     {
       cout << "Error: Unable to open " << argv [i] << endl 
         << "Saving result up to this point and aborting" << endl;
+      delete OperandFile;
       break;
     }
-    OperandFile.seekg (0, ios::end);
-    if (OperandFile.tellg () != FileSize) 
+    OperandFile -> seekg (0, ios::end);
+    if (OperandFile -> tellg () != FileSize) 
     {
       cout << "Error: " << argv [i] << " is not the same size as " << argv [1] << endl 
         << "Saving result up to this point and aborting" << endl;
-      OperandFile.close ();
+      delete OperandFile;
       break;
     }
-    
-    OperandFile.seekg (ios::beg);
-    cout << "   " << argv [i - 1] << " " << argv [i] << endl;
-    switch (Operators [(i - 1) / 2 - 1]) {
-      case OPERATOR_ADD:
-        for (int j = 0; j < NumFloats; j ++)
-        {
-          OperandFile.read ((char*)&NextFloat, float_size);
-//          if (j == 2) cout << Result [j] << " + " << NextFloat << " = " << flush;
-          Result [j] += NextFloat;
-//          if (j == 2) cout << Result [j] << endl;
-        }
-        break;
-      case OPERATOR_SUBTRACT:
-        for (int j = 0; j < NumFloats; j ++)
-        {
-          OperandFile.read ((char*)&NextFloat, float_size);
-          Result [j] -= NextFloat;
-        }
-        break;
-      case OPERATOR_MULTIPLY:
-        for (int j = 0; j < NumFloats; j ++)
-        {
-          OperandFile.read ((char*)&NextFloat, float_size);
-          Result [j] *= NextFloat;
-        }
-        break;
-      case OPERATOR_DIVIDE:
-        for (int j = 0; j < NumFloats; j ++)
-        {
-          OperandFile.read ((char*)&NextFloat, float_size);
-          Result [j] /= NextFloat;
-        }
-        break;
-      default:
-        cout << "An internal error has occurred with the operator at argument "
-          << i - 1 << endl << "Saving result up to this point and aborting" << endl;
-        i = argc;
-    }
-    OperandFile.close ();
+    OperandFile -> seekg (0, ios::beg);
+    OperandFiles.push_back (OperandFile);
+    OperandSwapped.push_back (datIsSwapped (argv [i]));
+    cout << "   " << argv [i - 1] << " " << argv [i] 
+      << (OperandSwapped.back () ? " (byte-swapped)" : "") << endl;
   }
   
+  // Combine the spectra one block at a time
+  BlockSize = Budget.items (2 * float_size, NumFloats, "Spectrum values");
+  if (BlockSize < 1) BlockSize = 1;
+  Result = new float [BlockSize];
+  Operand = new float [BlockSize];
   cout << "Writing the result to " << argv [argc - 1] << endl << endl;
-  for (int i = 0; i < NumFloats; i ++)
+  for (int Start = 0; Start < NumFloats; Start += BlockSize)
+  {
+    int Length = (NumFloats - Start < BlockSize) ? NumFloats - Start : BlockSize;
+    XgTraceSpan BlockSpan ("combine block");
+    {
+      XgTraceSpan Span ("read block");
+      FirstFile.read ((char*)Result, Length * float_size);
+      if (FirstSwapped) swapBytes32 (Result, Length);
+    }
+    for (unsigned int k = 0; k < OperandFiles.size (); k ++)
+    {
+      {
+        XgTraceSpan Span ("read block");
+        OperandFiles [k] -> read ((char*)Operand, Length * float_size);
+        if (OperandSwapped [k]) swapBytes32 (Operand, Length);
+      }
+      combineBlock (Result, Operand, Length, Operators [k]);
+    }
+    XgTraceSpan Span ("write block");
+    if (FirstSwapped) swapBytes32 (Result, Length);
+    Output.write ((char*)Result, Length * float_size);
+  }
+  
+  // Tidy up and quit
+  FirstFile.close ();
+  for (unsigned int k = 0; k < OperandFiles.size (); k ++)
   {
-    Output.write ((char*)&Result [i], float_size);
+    OperandFiles [k] -> close ();
+    delete OperandFiles [k];
   }
   Output.close ();
   delete [] Result;
+  delete [] Operand;
+  Budget.report ();
   return 0;
 }
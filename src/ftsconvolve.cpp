@@ -0,0 +1,361 @@
+// Xgtools
+// Copyright (C) M. P. Ruffoni 2011-2015
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ftsconvolve : Convolves an FTS spectrum with a line shape kernel
+//
+// To compare spectra recorded at different resolutions, the sharper spectrum
+// must first be broadened to match the other. ftsconvolve convolves a .dat
+// spectrum with one of three kernels, each normalised to unit area so that the
+// integrated intensity of every line is kept:
+//
+//   gauss : A Gaussian of FWHM <width>, for general smoothing.
+//   sinc  : sin(x)/x with its first zeros at +/- <width>. This is the
+//           instrument function of an unapodised FTS whose resolution,
+//           1 / (2 x maximum path difference), is <width>.
+//   sinc2 : (sin(x)/x)^2 with its first zeros at +/- <width>. This is the
+//           instrument function of an FTS with triangular apodisation.
+//
+// <width> is given in mK, as for XGremlin line widths. The Gaussian is cut off
+// at GAUSS_SUPPORT FWHM either side of its centre, and the sinc kernels after
+// SINC_SUPPORT zeros.
+//
+// The convolution is done with GSL FFTs by the overlap-save method. The FFT
+// length is chosen from the kernel length, as the smallest power of 2 of at
+// least FFT_KERNEL_RATIO times that length, and each FFT of this length yields
+// that many points of the result, less the kernel length. The spectrum is read
+// and written one block at a time, so the memory needed depends only on the
+// kernel width and not on the size of the spectrum. Blocks are convolved in
+// parallel, one per thread, and the number of threads may be reduced to fit
+// within the budget set by --mem-limit. Beyond the ends of the spectrum, the
+// first and last points are taken to continue unchanged.
+//
+// The result is saved as <output>.dat in the same byte order as the input, with
+// a copy of the input header as <output>.hdr.
+//
+// Make sure the GNU Scientific Library (GSL) development package is installed
+// on your system, then compile this code using the following command:
+//
+// g++ ftsconvolve.cpp xgspectrum.cpp byteorder.cpp memlimit.cpp xgtrace.cpp
+//   -lgsl -lgslcblas -pthread -o ftsconvolve
+//
+
+#include <cstdlib>
+#include <cmath>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <gsl/gsl_fft_real.h>
+#include <gsl/gsl_fft_halfcomplex.h>
+#include "xgspectrum.h"
+#include "byteorder.h"
+#include "memlimit.h"
+#include "xgtrace.h"
+
+using namespace::std;
+
+// ftsconvolve version
+#define VERSION "1.0"
+
+// Kernel names given on the command line
+#define KERNEL_GAUSS "gauss"
+#define KERNEL_SINC  "sinc"
+#define KERNEL_SINC2 "sinc2"
+
+// Extent of each kernel either side of its centre, in FWHM for the Gaussian
+// and in zeros for the sinc kernels
+#define GAUSS_SUPPORT 3.0
+#define SINC_SUPPORT  40.0
+
+// The FFT length is at least this many times the kernel length, so that most
+// of each FFT gives new points of the result
+#define FFT_KERNEL_RATIO 8
+
+// The shortest FFT used
+#define MIN_FFT_LENGTH 1024
+
+// Definitions for command line parameters
+#define REQUIRED_NUM_ARGS 5
+#define ARG_SPECTRUM 1
+#define ARG_KERNEL 2
+#define ARG_WIDTH 3
+#define ARG_OUTPUT 4
+
+// The block of the spectrum convolved by one thread
+typedef struct td_ConvolveBlock {
+  long First;              // Index of the first point read into Points
+  vector <double> Points;  // The FFT buffer, holding FFT length points
+} ConvolveBlock;
+
+
+//------------------------------------------------------------------------------
+// showHelp () : Prints syntax help message to the standard output.
+//
+void showHelp () {
+  cout << endl;
+  cout << "ftsconvolve : " << endl;
+  cout << "---------------------------------------------------------------" << endl;
+  cout << "Syntax : ftsconvolve [--mem-limit <size>] <spectrum> <kernel> <width> <output>" << endl << endl;
+  cout << "<spectrum> : The spectrum to convolve, without the .dat or .hdr extension." << endl;
+  cout << "<kernel>   : " << KERNEL_GAUSS << ", " << KERNEL_SINC << " or " << KERNEL_SINC2 << "." << endl;
+  cout << "<width>    : The FWHM of the Gaussian, or the position of the first zero" << endl;
+  cout << "             of the sinc kernels, in mK." << endl;
+  cout << "<output>   : The result is saved here as <output>.dat and <output>.hdr." << endl;
+  cout << "<size>     : The most memory to use, e.g. 512M." << endl << endl;
+}
+
+
+//------------------------------------------------------------------------------
+// makeKernel (string, double, double) : Returns the kernel named at arg1, of
+// width arg2 in cm^-1, sampled at the point spacing arg3. The centre of the
+// kernel is at the middle element, and the elements sum to 1. Throws
+// LC_SYNTAX_ERROR if the kernel name is not known.
+//
+vector <double> makeKernel (string Type, double Width, double Spacing)
+  throw (int) {
+  double Support;
+  if (Type == KERNEL_GAUSS) Support = GAUSS_SUPPORT * Width;
+  else if (Type == KERNEL_SINC || Type == KERNEL_SINC2) Support = SINC_SUPPORT * Width;
+  else {
+    cout << "Error: Unknown kernel " << Type << endl;
+    throw int (LC_SYNTAX_ERROR);
+  }
+  long HalfLength = (long) ceil (Support / Spacing);
+  vector <double> Kernel (2 * HalfLength + 1);
+  const double FourLn2 = 4.0 * log (2.0);
+  double Sum = 0.0;
+  for (long i = -HalfLength; i <= HalfLength; i ++) {
+    double x = i * Spacing / Width;
+    double Value;
+    if (Type == KERNEL_GAUSS) {
+      Value = exp (-FourLn2 * x * x);
+    } else {
+      Value = (i == 0) ? 1.0 : sin (M_PI * x) / (M_PI * x);
+      if (Type == KERNEL_SINC2) Value *= Value;
+    }
+    Kernel [i + HalfLength] = Value;
+    Sum += Value;
+  }
+  for (size_t i = 0; i < Kernel.size (); i ++) Kernel [i] /= Sum;
+  return Kernel;
+}
+
+
+//------------------------------------------------------------------------------
+// kernelTransform (vector <double> &, size_t) : Returns the FFT, of length arg2,
+// of the kernel at arg1. The centre of the kernel is moved to element 0, with
+// the elements before the centre wrapped round to the end of the buffer.
+//
+vector <double> kernelTransform (vector <double> &Kernel, size_t Length) {
+  vector <double> Transform (Length, 0.0);
+  long HalfLength = Kernel.size () / 2;
+  for (long i = -HalfLength; i <= HalfLength; i ++) {
+    Transform [(i + Length) % Length] = Kernel [i + HalfLength];
+  }
+  gsl_fft_real_radix2_transform (&Transform [0], 1, Length);
+  return Transform;
+}
+
+
+//------------------------------------------------------------------------------
+// convolveBlock (ConvolveBlock *, vector <double> *) : Replaces the points of
+// the block at arg1 by their circular convolution with the kernel whose FFT is
+// at arg2.
+//
+void convolveBlock (ConvolveBlock *Block, vector <double> *KernelFT) {
+  XgTraceSpan Span ("convolve block");
+  vector <double> &A = Block -> Points;
+  vector <double> &K = *KernelFT;
+  size_t n = A.size ();
+  gsl_fft_real_radix2_transform (&A [0], 1, n);
+
+  // Multiply the two transforms, which are in GSL's half-complex order, with
+  // the real part of frequency i held at element i, and its imaginary part at
+  // element n-i.
+  A [0] *= K [0];
+  A [n / 2] *= K [n / 2];
+  for (size_t i = 1; i < n / 2; i ++) {
+    double ar = A [i], ai = A [n - i], kr = K [i], ki = K [n - i];
+    A [i] = ar * kr - ai * ki;
+    A [n - i] = ar * ki + ai * kr;
+  }
+  gsl_fft_halfcomplex_radix2_inverse (&A [0], 1, n);
+}
+
+
+//------------------------------------------------------------------------------
+// readBlock (ifstream &, XgSpectrum &, ConvolveBlock &, vector <float> &,
+// float, float) : Reads the points of the spectrum at arg2 from the .dat file at
+// arg1 into the block at arg3, starting from the point arg3.First, using arg4
+// as a buffer. Points before the start of the spectrum take the value arg5,
+// and those after the end the value arg6.
+//
+void readBlock (ifstream &DataFile, XgSpectrum &Spectrum, ConvolveBlock &Block,
+  vector <float> &Buffer, float FirstValue, float LastValue) throw (int) {
+  XgTraceSpan Span ("read block");
+  long Length = Block.Points.size ();
+  long NumPoints = Spectrum.size ();
+  long Start = max (Block.First, 0L);
+  long End = min (Block.First + Length, NumPoints);
+  if (End > Start) {
+    DataFile.seekg (Start * sizeof (float), ios::beg);
+    DataFile.read ((char*)Buffer.data (), (End - Start) * sizeof (float));
+    if (DataFile.gcount () != (streamsize)((End - Start) * sizeof (float))) {
+      cout << "Error: Unable to read " << Spectrum.name () << ".dat" << endl;
+      throw int (LC_FILE_READ_ERROR);
+    }
+    if (Spectrum.swapped ()) swapBytes32 (Buffer.data (), End - Start);
+  }
+  for (long i = 0; i < Length; i ++) {
+    long j = Block.First + i;
+    if (j < 0) Block.Points [i] = FirstValue;
+    else if (j >= NumPoints) Block.Points [i] = LastValue;
+    else Block.Points [i] = Buffer [j - Start];
+  }
+}
+
+
+//------------------------------------------------------------------------------
+// Main program
+//
+int main (int argc, char *argv[]) {
+  XgSpectrum Spectrum;
+  XgMemLimit Budget ("ftsconvolve");
+  vector <double> Kernel, KernelFT;
+  vector <ConvolveBlock> Blocks;
+  vector <float> Buffer;
+  vector <thread> Workers;
+  ifstream DataFile;
+  ofstream Output;
+  float FirstValue, LastValue;
+
+  // Check the user's command line input
+  try {
+    argc = Budget.parseArgs (argc, argv);
+  } catch (int Err) {
+    return Err;
+  }
+  if (argc != REQUIRED_NUM_ARGS) {
+    showHelp ();
+    return LC_SYNTAX_ERROR;
+  }
+  double Width = atof (argv [ARG_WIDTH]) / 1000.0;
+  if (Width <= 0.0) {
+    cout << "Error: <width> must be a positive number of mK" << endl;
+    return LC_SYNTAX_ERROR;
+  }
+  string OutputName = argv [ARG_OUTPUT];
+
+  // Print introductory message to the standard output
+  cout << "FTS Spectrum Convolution " << VERSION
+    << " (built " << __DATE__ << ")" << endl;
+  cout << "--------------------------------------------------------" << endl;
+  cout << "Spectrum file     : " << argv [ARG_SPECTRUM] << endl;
+  cout << "Kernel            : " << argv [ARG_KERNEL] << ", " << argv [ARG_WIDTH]
+    << " mK" << endl;
+  cout << "Output file       : " << OutputName << endl;
+
+  try {
+    // Read the wavenumber scale and build the kernel
+    Spectrum.loadHeader (argv [ARG_SPECTRUM]);
+    Kernel = makeKernel (argv [ARG_KERNEL], Width, fabs (Spectrum.delw ()));
+
+    // Choose the FFT length from the kernel length. Each FFT then gives Step
+    // new points of the result.
+    size_t FftLength = MIN_FFT_LENGTH;
+    while (FftLength < FFT_KERNEL_RATIO * Kernel.size ()) FftLength *= 2;
+    long HalfLength = Kernel.size () / 2;
+    long Step = FftLength - 2 * HalfLength;
+    long NumPoints = Spectrum.size ();
+    long NumBlocks = (NumPoints + Step - 1) / Step;
+    KernelFT = kernelTransform (Kernel, FftLength);
+
+    // Run one block per thread, as many as the budget allows
+    unsigned int NumWorkers = thread::hardware_concurrency ();
+    if (NumWorkers == 0) NumWorkers = 1;
+    if (long (NumWorkers) > NumBlocks) NumWorkers = NumBlocks;
+    NumWorkers = Budget.threads (FftLength * sizeof (double), NumWorkers);
+    Blocks.resize (NumWorkers);
+    for (unsigned int i = 0; i < NumWorkers; i ++) {
+      Blocks[i].Points.resize (FftLength);
+    }
+    Buffer.resize (FftLength);
+    cout << "Convolving " << NumPoints << " points with a kernel of "
+      << Kernel.size () << " points, in " << NumBlocks << " blocks of "
+      << Step << " points on " << NumWorkers << " thread"
+      << (NumWorkers == 1 ? "" : "s") << "..." << endl;
+
+    // Open the input and output files, and copy the header
+    string DataName = string (argv [ARG_SPECTRUM]) + ".dat";
+    string HeaderName = string (argv [ARG_SPECTRUM]) + ".hdr";
+    DataFile.open (DataName.c_str (), ios::in|ios::binary);
+    Output.open ((OutputName + ".dat").c_str (), ios::out|ios::binary);
+    ofstream HeaderOut ((OutputName + ".hdr").c_str (), ios::out);
+    ifstream HeaderIn (HeaderName.c_str (), ios::in);
+    if (!Output.is_open () || !HeaderOut.is_open ()) {
+      cout << "Error: Unable to write " << OutputName << ". Check that you have "
+        << "permission to write to this location." << endl;
+      throw int (LC_FILE_WRITE_ERROR);
+    }
+    HeaderOut << HeaderIn.rdbuf ();
+    HeaderOut.close ();
+    DataFile.read ((char*)&FirstValue, sizeof (float));
+    DataFile.seekg ((NumPoints - 1) * sizeof (float), ios::beg);
+    DataFile.read ((char*)&LastValue, sizeof (float));
+    if (Spectrum.swapped ()) {
+      swapBytes32 (&FirstValue, 1);
+      swapBytes32 (&LastValue, 1);
+    }
+
+    // Convolve the blocks a round at a time. The blocks of each round are read
+    // in turn, convolved in parallel, and their results written in order. The
+    // result for point First + HalfLength + i of each block is in element
+    // HalfLength + i, for i from 0 to Step - 1.
+    for (long Round = 0; Round < NumBlocks; Round += NumWorkers) {
+      unsigned int NumInRound = min (long (NumWorkers), NumBlocks - Round);
+      for (unsigned int i = 0; i < NumInRound; i ++) {
+        Blocks[i].First = (Round + i) * Step - HalfLength;
+        readBlock (DataFile, Spectrum, Blocks[i], Buffer, FirstValue, LastValue);
+      }
+      for (unsigned int i = 0; i < NumInRound; i ++) {
+        Workers.push_back (thread (convolveBlock, &Blocks[i], &KernelFT));
+      }
+      for (unsigned int i = 0; i < Workers.size (); i ++) Workers[i].join ();
+      Workers.clear ();
+      for (unsigned int i = 0; i < NumInRound; i ++) {
+        XgTraceSpan Span ("write block");
+        long Start = (Round + i) * Step;
+        long Length = min (Step, NumPoints - Start);
+        for (long j = 0; j < Length; j ++) {
+          Buffer [j] = Blocks[i].Points [HalfLength + j];
+        }
+        if (Spectrum.swapped ()) swapBytes32 (Buffer.data (), Length);
+        Output.write ((char*)Buffer.data (), Length * sizeof (float));
+      }
+    }
+    DataFile.close ();
+    Output.close ();
+    if (Output.fail ()) {
+      cout << "Error: Unable to write " << OutputName << ".dat" << endl;
+      throw int (LC_FILE_WRITE_ERROR);
+    }
+  } catch (int Err) {
+    return Err;
+  }
+  Budget.report ();
+  return LC_NO_ERROR;
+}
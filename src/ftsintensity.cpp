@@ -16,11 +16,23 @@
 //
 // ftsintensity : Calibrates the intensity of an FTS spectrum using a response
 // function generated by ftsresponse.
+//
+// The response function is fitted with a cubic B-spline, and each point of the
+// spectrum is divided by the value of the spline at its wavenumber. Only the 4
+// basis splines that overlap a point are nonzero there, so the spline and its
+// uncertainty are found from just those 4 coefficients and the 4 x 4 block of
+// their covariance matrix, rather than from every coefficient.
+//
+// With the -e option, the uncertainty of each calibrated point arising from the
+// spline fit is also written, as a spectrum named <output>_err with a copy of
+// the same header. The covariance of the fit is scaled by chi^2 per degree of
+// freedom, since the response function gives no uncertainties of its own. The
+// noise of the measured spectrum itself is not included.
 
 // Make sure the GNU Scientific Library (GSL) development package is installed
 // on your system, then compile this code using the following command:
 //
-// g++ ftsintensity.cpp -lgsl -lgslcblas -o ftsintensity
+// g++ ftsintensity.cpp xgcache.cpp byteorder.cpp columnfile.cpp -lgsl -lgslcblas -o ftsintensity
 //
 
 #include <cstdlib>
@@ -36,12 +48,25 @@
 #include <gsl/gsl_statistics.h>
 #include <vector>
 #include <cctype>
+#include "xgcache.h"
+#include "byteorder.h"
+#include "columnfile.h"
 
 using namespace::std;
 
 // ftsresponse version
 #define VERSION "1.0"
 
+// The order of the B-splines used to fit the response function (cubic)
+#define SPLINE_ORDER 4
+
+// Write the uncertainty of the calibrated spectrum. Must precede all other
+// arguments.
+#define ERROR_OPTION "-e"
+
+// Suffix of the name of the uncertainty spectrum
+#define ERROR_SUFFIX "_err"
+
 // Default number of fit coefficients
 #define DEFAULT_NUM_COEFFS  200
 
@@ -59,6 +84,9 @@ using namespace::std;
 #define DELTAX_TAG "delw"
 #define NUM_PTS_TAG "npo"
 
+// The number of spectrum points read and calibrated at a time
+#define READ_BLOCK_SIZE 65536
+
 
 //------------------------------------------------------------------------------
 // showHelp () : Prints syntax help message to the standard output.
@@ -67,7 +95,9 @@ void showHelp () {
   cout << endl;
   cout << "ftsintensity : Calibrates the intensity of an FTS line spectrum" << endl;
   cout << "---------------------------------------------------------------" << endl;
-  cout << "Syntax : ftsintensity <spectrum> <response> <output> [<coeffs>]" << endl << endl;
+  cout << "Syntax : ftsintensity [-e] <spectrum> <response> <output> [<coeffs>]" << endl << endl;
+  cout << "-e          : Also save the uncertainty of each calibrated point, due to the" << endl;
+  cout << "              spline fit, as <output>" << ERROR_SUFFIX << "." << endl;
   cout << "<spectrum>  : An XGremlin line spectrum (do not include the '.dat' extension)." << endl;
   cout << "<response>  : The normalised response function given by ftsresponse." << endl;
   cout << "<output>    : The calibrated line spectrum will be saved here." << endl;
@@ -119,6 +149,24 @@ size_t getNumCoefficients (int argc, char *argv[]) {
 }
 
 
+//------------------------------------------------------------------------------
+// copyHeader (ifstream &, string) : Writes an exact copy of the XGremlin header
+// attached to the ifstream at arg1 to the file named at arg2.
+//
+void copyHeader (ifstream &Header, string Filename) {
+  char NextByte;
+  ofstream Copy (Filename.c_str(), ios::out);
+  Header.clear ();
+  Header.seekg (ios::beg);
+  Header.get (NextByte);
+  while (!Header.eof ()) {
+    Copy.put (NextByte);
+    Header.get (NextByte);
+  }
+  Copy.close ();
+}
+
+
 //------------------------------------------------------------------------------
 // getXGremlinHeaderField (ifstream &, string) : Searches the XGremlin header
 // file attached to the ifstream at arg1 for the variable specified at arg2.
@@ -154,6 +202,16 @@ double getXGremlinHeaderField (ifstream &Header, string FieldName) throw (int) {
 // Main program
 //
 int main (int argc, char *argv[]) {
+  bool ErrorOutput = false;
+
+  // Remove the -e option, if given, so the other arguments keep their places
+  if (argc > 1 && string (argv[1]) == ERROR_OPTION) {
+    ErrorOutput = true;
+    for (int i = 1; i < argc - 1; i ++) {
+      argv[i] = argv[i + 1];
+    }
+    argc --;
+  }
 
   // Check the user's command line input
   if (argc != REQUIRED_NUM_ARGS_MODE1 && argc != REQUIRED_NUM_ARGS_MODE2) {
@@ -168,15 +226,17 @@ int main (int argc, char *argv[]) {
   cout << "Line Spectrum file  : " << argv [ARG_SPECTRUM] << endl;
   cout << "Response function   : " << argv [ARG_RESPONSE] << endl;
   cout << "Output file         : " << argv [ARG_OUTPUT] << endl;
+  if (ErrorOutput) {
+    cout << "Uncertainty file    : " << argv [ARG_OUTPUT] << ERROR_SUFFIX << endl;
+  }
   
-  istringstream iss;
   double xmin, xmax, wstart, wstop, delw;
   int numPts;
   size_t ncoeffs = getNumCoefficients (argc, argv);
   const size_t nbreak = ncoeffs - 2; // nbreak = ncoeffs+2-k = ncoeffs-2 as k=4
-  size_t n = 0, i, j;
+  size_t n = 0, i, j, istart, iend;
   gsl_bspline_workspace *bw;
-  gsl_vector *B;
+  gsl_vector *Bk;
   gsl_rng *r;
   gsl_vector *c, *w;
   gsl_vector *x, *y;
@@ -184,9 +244,9 @@ int main (int argc, char *argv[]) {
   gsl_multifit_linear_workspace *mw;
   double chisq, Rsq, dof, tss;
   vector <double> xVec, yVec;
-  double xi, yi, yerr, ySpline;
+  double ySpline, Variance;
   float floatyi, yCal;
-  string SpectrumDAT, SpectrumHDR, CalDAT, CalHDR;
+  string SpectrumDAT, SpectrumHDR, CalDAT, CalHDR, ErrDAT, ErrHDR;
 
   // Variables for file input/output
   SpectrumDAT = argv [ARG_SPECTRUM]; SpectrumDAT += ".dat";
@@ -194,7 +254,8 @@ int main (int argc, char *argv[]) {
   ifstream spectrum (SpectrumDAT.c_str(), ios::in);
   CalDAT = argv [ARG_OUTPUT]; CalDAT += ".dat";
   CalHDR = argv [ARG_OUTPUT]; CalHDR += ".hdr";
-  string LineString, FieldName;
+  ErrDAT = argv [ARG_OUTPUT]; ErrDAT += ERROR_SUFFIX; ErrDAT += ".dat";
+  ErrHDR = argv [ARG_OUTPUT]; ErrHDR += ERROR_SUFFIX; ErrHDR += ".hdr";
 
   // Load the spectrum header and extract wstart, wstop, delw, and npo.
   ifstream header (SpectrumHDR.c_str(), ios::in);
@@ -215,112 +276,203 @@ int main (int argc, char *argv[]) {
     return 1;
   }
 
-  // Load the normalised response function
-  ifstream calData (argv [ARG_RESPONSE], ios::in);
-  if (calData.is_open ()) {
-    getline (calData, LineString);
-    while (!calData.eof ()) {
-      n ++;
-      iss.str (LineString);
-      iss >> xi >> yi;
-
-      xVec.push_back (xi);
-      yVec.push_back (yi);
-      cout << xi << ", " << yi << endl;
-      iss.clear ();
-
-      getline (calData, LineString);
-    }
-    calData.close ();
-  } else {
-    cout << "ERROR: Unable to open " << argv [ARG_RESPONSE] << "." << endl;
+  // If the cache is enabled and this response function has been fitted with
+  // the same number of coefficients before, reuse the stored spline fit.
+  XgCache Cache ("ftsintensity");
+  XgCacheRecord CachedFit;
+  vector <double> CoeffVec, CovVec;
+  bool FitCached = false;
+  try {
+    Cache.addFile (argv [ARG_RESPONSE]);
+  } catch (int Err) {
     return 1;
   }
-  xmin = xVec[0];
-  xmax = xVec[xVec.size () - 1];
+  Cache.addValue (double (ncoeffs));
+  if (Cache.fetch (CachedFit)) {
+    try {
+      CachedFit.get (xmin);
+      CachedFit.get (xmax);
+      CachedFit.get (CoeffVec);
+      CachedFit.get (CovVec);
+      FitCached = (CoeffVec.size () == ncoeffs 
+        && CovVec.size () == ncoeffs * ncoeffs);
+    } catch (int Err) {
+      FitCached = false;
+    }
+    if (FitCached) {
+      cout << "Using cached spline fit (" << Cache.key () << ")" << endl;
+    } else {
+      cout << "Warning: Ignoring unreadable cache record " << Cache.key () << endl;
+    }
+  }
+
+  // Load the normalised response function
+  if (!FitCached) {
+    try {
+      n = readColumns (argv [ARG_RESPONSE], xVec, yVec);
+    } catch (int Err) {
+      return 1;
+    }
+    cout << "Response points     : " << n << endl;
+    if (n == 0) {
+      cout << "ERROR: " << argv [ARG_RESPONSE] << " holds no data." << endl;
+      return 1;
+    }
+    xmin = xVec[0];
+    xmax = xVec[xVec.size () - 1];
   
-  // Check there are sufficient data points in the response function file
-  if (n <= ncoeffs) {
-    cout << "ERROR: There must be more data points in " << argv [ARG_RESPONSE] 
-      << " than spline fit coefficients." << endl;
-    return 1;
+    // Check there are sufficient data points in the response function file
+    if (n <= ncoeffs) {
+      cout << "ERROR: There must be more data points in " << argv [ARG_RESPONSE] 
+        << " than spline fit coefficients." << endl;
+      return 1;
+    }
   }
   
   // Prepare the GSL spline fitting environment
   gsl_rng_env_setup();
   r = gsl_rng_alloc(gsl_rng_default);
 
-  bw = gsl_bspline_alloc(4, nbreak); // allocate a cubic bspline workspace (k=4)
-  B = gsl_vector_alloc(ncoeffs);
-
-  x = gsl_vector_alloc(n);
-  y = gsl_vector_alloc(n);
-  X = gsl_matrix_alloc(n, ncoeffs);
-  c = gsl_vector_alloc(ncoeffs);
-  w = gsl_vector_alloc(n);
-  cov = gsl_matrix_alloc(ncoeffs, ncoeffs);
-  mw = gsl_multifit_linear_alloc(n, ncoeffs);
-  
-  for (i = 0; i < n; i ++) {
-    gsl_vector_set (x, i, xVec[i]);
-    gsl_vector_set (y, i, yVec[i]);
-    gsl_vector_set (w, i, 1.0);
-  }
+  bw = gsl_bspline_alloc(SPLINE_ORDER, nbreak); // cubic bspline workspace
+  Bk = gsl_vector_alloc(SPLINE_ORDER);
 
   // use uniform breakpoints between xmin and xmax
   gsl_bspline_knots_uniform(xmin, xmax, bw);
 
-  // construct the fit matrix X
-  cout << endl << "Constructing spline ... " << flush;
-  for (i = 0; i < n; ++i)
-   {
-     double xi = gsl_vector_get(x, i);
-
-     // compute B_j(xi) for all j
-     gsl_bspline_eval(xi, B, bw);
-
-     // fill in row i of X
-     for (j = 0; j < ncoeffs; ++j)
-       {
-         double Bj = gsl_vector_get(B, j);
-         gsl_matrix_set(X, i, j, Bj);
-       }
-   }
-
-  // do the spline fit
-  gsl_multifit_wlinear(X, w, y, c, cov, &chisq, mw);
-  dof = n - ncoeffs;
-  tss = gsl_stats_wtss(w->data, 1, y->data, 1, y->size);
-  Rsq = 1.0 - chisq / tss;
-  printf("chisq/dof = %e, Rsq = %f\n", chisq / dof, Rsq);
-
-  // Read in the measured line spectrum
+  // The spectrum is calibrated from CoeffVec and CovVec, which hold either the
+  // cached fit or the new fit made here
+  if (!FitCached) {
+    x = gsl_vector_alloc(n);
+    y = gsl_vector_alloc(n);
+    X = gsl_matrix_calloc(n, ncoeffs);
+    w = gsl_vector_alloc(n);
+    c = gsl_vector_alloc(ncoeffs);
+    cov = gsl_matrix_alloc(ncoeffs, ncoeffs);
+    mw = gsl_multifit_linear_alloc(n, ncoeffs);
+  
+    for (i = 0; i < n; i ++) {
+      gsl_vector_set (x, i, xVec[i]);
+      gsl_vector_set (y, i, yVec[i]);
+      gsl_vector_set (w, i, 1.0);
+    }
+
+    // construct the fit matrix X. Only the SPLINE_ORDER basis splines from
+    // istart to iend are nonzero at each point, so only those elements of
+    // each row are set.
+    cout << endl << "Constructing spline ... " << flush;
+    for (i = 0; i < n; ++i)
+     {
+       double xi = gsl_vector_get(x, i);
+
+       // compute the nonzero B_j(xi)
+       gsl_bspline_eval_nonzero(xi, Bk, &istart, &iend, bw);
+
+       // fill in row i of X
+       for (j = 0; j < SPLINE_ORDER; ++j)
+         {
+           gsl_matrix_set(X, i, istart + j, gsl_vector_get(Bk, j));
+         }
+     }
+
+    // do the spline fit
+    gsl_multifit_wlinear(X, w, y, c, cov, &chisq, mw);
+    dof = n - ncoeffs;
+    tss = gsl_stats_wtss(w->data, 1, y->data, 1, y->size);
+    Rsq = 1.0 - chisq / tss;
+    printf("chisq/dof = %e, Rsq = %f\n", chisq / dof, Rsq);
+  
+    // Keep a copy of the fit for future runs with the same response function.
+    // The covariance is scaled by chisq/dof to give the uncertainties of the
+    // coefficients, as the points were fitted with unit weights.
+    for (i = 0; i < ncoeffs; i ++) {
+      CoeffVec.push_back (gsl_vector_get (c, i));
+      for (j = 0; j < ncoeffs; j ++) {
+        CovVec.push_back (gsl_matrix_get (cov, i, j) * chisq / dof);
+      }
+    }
+    CachedFit.put (xmin);
+    CachedFit.put (xmax);
+    CachedFit.put (CoeffVec);
+    CachedFit.put (CovVec);
+    Cache.store (CachedFit);
+
+    gsl_vector_free(x);
+    gsl_vector_free(y);
+    gsl_matrix_free(X);
+    gsl_vector_free(w);
+    gsl_vector_free(c);
+    gsl_matrix_free(cov);
+    gsl_multifit_linear_free(mw);
+  }
+
+  // Read in the measured line spectrum a block at a time. A spectrum written
+  // on a machine of the other byte order is swapped as it is read, and the
+  // calibrated spectrum written in the same byte order so that it matches the
+  // copied header. The spline at each point is found from the 4 basis splines
+  // that are nonzero there, which are those of coefficients istart to iend,
+  // and its variance from the same 4 x 4 block of the covariance matrix.
   if (spectrum.is_open ()) {
     ofstream calSpectrum (CalDAT.c_str(), ios::out);
-    if (calSpectrum.is_open ()) {
-      cout << "Calibrating spectrum ... " << flush;
-      for (int i = 0; i < numPts; i ++) {
-        spectrum.read ((char*)&floatyi, sizeof (float));
-
-        // Only proceed if xi is within the valid spline interpolation range
-        if (i * delw + wstart >= xmin && i * delw + wstart <= xmax) {
-          gsl_bspline_eval(i * delw + wstart, B, bw);
-          gsl_multifit_linear_est(B, c, cov, &ySpline, &yerr);
-           
-          // Normalise the line spectrum intensity using the normalised response
-          // function
-          yCal = floatyi / (float) ySpline;
-          calSpectrum.write ((char*)&yCal, sizeof (float));
-        } else {
-          yCal = 0.0;
-          calSpectrum.write ((char*)&yCal, sizeof (float));
+    ofstream errSpectrum;
+    if (ErrorOutput) errSpectrum.open (ErrDAT.c_str(), ios::out);
+    if (calSpectrum.is_open () && (!ErrorOutput || errSpectrum.is_open ())) {
+      bool Swapped = datIsSwapped (SpectrumDAT, SpectrumHDR);
+      vector <float> Block (READ_BLOCK_SIZE);
+      vector <float> ErrBlock (ErrorOutput ? READ_BLOCK_SIZE : 0);
+      cout << "Calibrating " << (Swapped ? "byte-swapped " : "") 
+        << "spectrum ... " << flush;
+      for (int Start = 0; Start < numPts; Start += READ_BLOCK_SIZE) {
+        int Length = (numPts - Start < READ_BLOCK_SIZE) ? numPts - Start 
+          : READ_BLOCK_SIZE;
+        spectrum.read ((char*)&Block [0], Length * sizeof (float));
+        if (Swapped) swapBytes32 (&Block [0], Length);
+        for (int k = 0; k < Length; k ++) {
+          i = Start + k;
+          floatyi = Block [k];
+
+          // Only proceed if the point is within the valid spline interpolation range
+          if (i * delw + wstart >= xmin && i * delw + wstart <= xmax) {
+            gsl_bspline_eval_nonzero(i * delw + wstart, Bk, &istart, &iend, bw);
+            ySpline = 0.0;
+            for (j = 0; j < SPLINE_ORDER; j ++) {
+              ySpline += gsl_vector_get (Bk, j) * CoeffVec [istart + j];
+            }
+             
+            // Normalise the line spectrum intensity using the normalised 
+            // response function
+            yCal = floatyi / (float) ySpline;
+            if (ErrorOutput) {
+              Variance = 0.0;
+              for (j = 0; j < SPLINE_ORDER; j ++) {
+                const double *CovRow = &CovVec [(istart + j) * ncoeffs + istart];
+                double RowSum = 0.0;
+                for (size_t m = 0; m < SPLINE_ORDER; m ++) {
+                  RowSum += CovRow [m] * gsl_vector_get (Bk, m);
+                }
+                Variance += gsl_vector_get (Bk, j) * RowSum;
+              }
+              ErrBlock [k] = fabs (yCal) * sqrt (fabs (Variance)) / fabs (ySpline);
+            }
+          } else {
+            yCal = 0.0;
+            if (ErrorOutput) ErrBlock [k] = 0.0;
+          }
+          Block [k] = yCal;
+        }
+        if (Swapped) swapBytes32 (&Block [0], Length);
+        calSpectrum.write ((char*)&Block [0], Length * sizeof (float));
+        if (ErrorOutput) {
+          if (Swapped) swapBytes32 (&ErrBlock [0], Length);
+          errSpectrum.write ((char*)&ErrBlock [0], Length * sizeof (float));
         }
       }
       spectrum.close ();
       calSpectrum.close ();
+      if (ErrorOutput) errSpectrum.close ();
       cout << "done" << endl;
     } else {
-      cout << "ERROR: Unable to write to " << CalDAT << endl;
+      cout << "ERROR: Unable to write to " 
+        << (calSpectrum.is_open () ? ErrDAT : CalDAT) << endl;
       return 1;
     }
   } else {
@@ -328,28 +480,15 @@ int main (int argc, char *argv[]) {
     return 1;
   }
   
-  // Produce an exact copy of the input header for the calibrated spectrum
-  char NextByte;
-  ofstream calHeader (CalHDR.c_str(), ios::out);
-  header.seekg (ios::beg);
-  header.get (NextByte);
-  while (!header.eof ()) {
-    calHeader.put (NextByte);
-    header.get (NextByte);
-  }
+  // Produce an exact copy of the input header for the calibrated spectrum, and
+  // for its uncertainty
+  copyHeader (header, CalHDR);
+  if (ErrorOutput) copyHeader (header, ErrHDR);
   header.close ();
-  calHeader.close ();
   
   // Free up the GSL environment and terminate the program
   gsl_rng_free(r);
   gsl_bspline_free(bw);
-  gsl_vector_free(B);
-  gsl_vector_free(x);
-  gsl_vector_free(y);
-  gsl_matrix_free(X);
-  gsl_vector_free(c);
-  gsl_vector_free(w);
-  gsl_matrix_free(cov);
-  gsl_multifit_linear_free(mw);
+  gsl_vector_free(Bk);
   return 0;
 }
@@ -20,7 +20,7 @@
 // Make sure the GNU Scientific Library (GSL) development package is installed
 // on your system, then compile this code using the following command:
 //
-// g++ ftsresponse.cpp -lgsl -lgslcblas -o ftsresponse
+// g++ ftsresponse.cpp xgcache.cpp columnfile.cpp -lgsl -lgslcblas -o ftsresponse
 //
 // In the output file, column 1 is the wavenumber, column 2 the response 
 // function, and column 3 the log of the relative spectral radiance.
@@ -38,6 +38,8 @@
 #include <gsl/gsl_statistics.h>
 #include <vector>
 #include <cctype>
+#include "xgcache.h"
+#include "columnfile.h"
 
 using namespace::std;
 
@@ -86,6 +88,28 @@ bool is_numeric (string a) {
 }
 
 
+//------------------------------------------------------------------------------
+// writeResponse (char *, vector <double> &, vector <double> &) : Writes the
+// normalised response function to the file at arg1. Returns false if the file
+// could not be opened.
+//
+bool writeResponse (char *Filename, vector <double> &xResponse,
+  vector <double> &yResponse) {
+  ofstream response (Filename, ios::out);
+  if (!response.is_open ()) {
+    cout << "ERROR: Unable to write to " << Filename << endl;
+    return false;
+  }
+  cout << "Outputting " << yResponse.size () << " data points to "
+    << Filename << endl;
+  for (size_t i = 0; i < yResponse.size (); i ++) {
+    response << xResponse [i] << " " << yResponse [i] << endl;
+  }
+  response.close ();
+  return true;
+}
+
+
 //------------------------------------------------------------------------------
 // Main program
 //
@@ -127,6 +151,30 @@ int main (int argc, char *argv[]) {
     }
   }
   cout << "Spline Coeffs : " << ncoeffs << endl;
+
+  // If the cache is enabled and these inputs have been processed before, write
+  // out the stored response function instead of repeating the spline fit.
+  XgCache Cache ("ftsresponse");
+  XgCacheRecord CachedResponse;
+  try {
+    Cache.addFile (argv [ARG_SPECTRUM]);
+    Cache.addFile (argv [ARG_CALIBRATION]);
+  } catch (int Err) {
+    return 1;
+  }
+  Cache.addValue (double (ncoeffs));
+  if (Cache.fetch (CachedResponse)) {
+    vector <double> xResponse, yResponse;
+    try {
+      CachedResponse.get (xResponse);
+      CachedResponse.get (yResponse);
+      cout << "Using cached response function (" << Cache.key () << ")" << endl;
+      writeResponse (argv [ARG_OUTPUT], xResponse, yResponse);
+      return 0;
+    } catch (int Err) {
+      cout << "Warning: Ignoring unreadable cache record " << Cache.key () << endl;
+    }
+  }
   
   // Variables for the spline fit and response function calculation
   const size_t nbreak = ncoeffs - 2; // nbreak = ncoeffs+2-k = ncoeffs-2 as k=4
@@ -144,31 +192,19 @@ int main (int argc, char *argv[]) {
   vector <double> xVec, yVec, xResponse, yResponse, yLogRad;
   double xi, yi, yerr, ySpline, wlen, ymax;
 
-  // Variables for file input/output
-  ifstream calData (argv [ARG_CALIBRATION], ios::in);
-  ifstream spectrum (argv [ARG_SPECTRUM], ios::in);
-  ofstream response (argv [ARG_OUTPUT], ios::out);
-  string LineString;
-
   // Load the calibrated standard lamp spectral radiance file
-  if (calData.is_open ()) {
-    getline (calData, LineString);
-    while (!calData.eof ()) {
-      n ++;
-      iss.str (LineString);
-      iss >> xi >> yi;
-
-      xVec.push_back (xi);
-      yVec.push_back (log(yi));
-      iss.clear ();
-
-      getline (calData, LineString);
-    }
-    calData.close ();
-  } else {
-    cout << "ERROR: Unable to open " << argv [ARG_CALIBRATION] << "." << endl;
+  try {
+    n = readColumns (argv [ARG_CALIBRATION], xVec, yVec);
+  } catch (int Err) {
+    return 1;
+  }
+  if (n == 0) {
+    cout << "ERROR: " << argv [ARG_CALIBRATION] << " holds no data." << endl;
     return 1;
   }
+  for (i = 0; i < n; i ++) {
+    yVec[i] = log (yVec[i]);
+  }
   xmin = xVec[0];
   xmax = xVec[xVec.size () - 1];
   
@@ -227,52 +263,45 @@ int main (int argc, char *argv[]) {
   printf("chisq/dof = %e, Rsq = %f\n", chisq / dof, Rsq);
 
   // Read in the measured lamp spectrum
-  if (spectrum.is_open ()) {
-    getline (spectrum, LineString);
-    ymax = 0;
-    while (!spectrum.eof ()) {
-      iss.str (LineString);
-      if (LineString[0] != '#' && LineString[0] != '!') {
-        iss >> xi >> yi;
-        wlen = 1e7 / xi;    // Convert wavenumber to vacuum wavelength
+  vector <double> xSpectrum, ySpectrum;
+  try {
+    readColumns (argv [ARG_SPECTRUM], xSpectrum, ySpectrum);
+  } catch (int Err) {
+    return 1;
+  }
+  xResponse.reserve (xSpectrum.size ());
+  yResponse.reserve (xSpectrum.size ());
+  ymax = 0;
+  for (i = 0; i < xSpectrum.size (); i ++) {
+    xi = xSpectrum[i];
+    yi = ySpectrum[i];
+    wlen = 1e7 / xi;    // Convert wavenumber to vacuum wavelength
 
-        // Only proceed if xi is within the valid spline interpolation range
-        if (wlen >= xmin && wlen <= xmax) {
-          gsl_bspline_eval(wlen, B, bw);
-          gsl_multifit_linear_est(B, c, cov, &ySpline, &yerr);
-          
-          // Calculate the response function based on 'photon' in XGremlin
-          yi = xi * xi * xi * yi / exp(ySpline);
-          xResponse.push_back (xi);
-          yResponse.push_back (yi);
-          yLogRad.push_back (ySpline);
-          if (yi > ymax) ymax = yi;
-        } else {
-          xResponse.push_back (xi);
-          yResponse.push_back (0.0);
-        }
-        iss.clear ();
-      }
-      getline (spectrum, LineString);
-    }
-    spectrum.close ();
-    
-    // Output the normalised response function
-    if (response.is_open ()) {
-      cout << "Outputting " << yResponse.size () << " data points to "
-        << argv [ARG_OUTPUT] << endl;
-      for (i = 0; i < yResponse.size (); i ++) {
-        yResponse [i] /= ymax;
-        response << xResponse [i] << " " << yResponse [i] 
-          /*<< " " << yLogRad [i]*/ << endl;
-      }
-      response.close ();
+    // Only proceed if xi is within the valid spline interpolation range
+    if (wlen >= xmin && wlen <= xmax) {
+      gsl_bspline_eval(wlen, B, bw);
+      gsl_multifit_linear_est(B, c, cov, &ySpline, &yerr);
+      
+      // Calculate the response function based on 'photon' in XGremlin
+      yi = xi * xi * xi * yi / exp(ySpline);
+      xResponse.push_back (xi);
+      yResponse.push_back (yi);
+      yLogRad.push_back (ySpline);
+      if (yi > ymax) ymax = yi;
     } else {
-      cout << "ERROR: Unable to write to " << argv [ARG_OUTPUT] << endl;
+      xResponse.push_back (xi);
+      yResponse.push_back (0.0);
     }
-  } else {
-    cout << "ERROR: Unable to open " << argv [ARG_SPECTRUM] << endl;
-    return 1;
+  }
+  
+  // Normalise and output the response function, keeping a copy in the cache
+  for (i = 0; i < yResponse.size (); i ++) {
+    yResponse [i] /= ymax;
+  }
+  if (writeResponse (argv [ARG_OUTPUT], xResponse, yResponse)) {
+    CachedResponse.put (xResponse);
+    CachedResponse.put (yResponse);
+    Cache.store (CachedResponse);
   }
   
   // Free up the GSL environment and terminate the program
@@ -0,0 +1,339 @@
+// Xgtools
+// Copyright (C) M. P. Ruffoni 2011-2015
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ftsxcorr : Finds the wavenumber scaling factor between two FTS spectra by
+// cross-correlation.
+//
+// ftscalibrate finds the wavenumber scaling factor, epsilon, by comparing line
+// lists, which must first be obtained by fitting every line in both spectra.
+// For two spectra recorded on the same instrument, where the line shapes are
+// alike, epsilon can instead be found directly from the spectra themselves.
+// The calibrated wavenumbers are again given by:
+//
+// \sigma_{cal} = \sigma_{measured} * ( 1 + \epsilon )
+//
+// A wavenumber scale error multiplies every wavenumber by the same factor, and
+// so becomes a constant shift of ln(1 + epsilon) when the spectra are plotted
+// against ln(sigma). Both spectra are therefore resampled by linear
+// interpolation onto a common grid, uniform in ln(sigma), that spans the
+// wavenumber range they share. The grid spacing is that of the more finely
+// sampled spectrum at the top of this range, so no spectral detail is lost.
+//
+// The grid is then divided into overlapping segments, each overlapping half of
+// the next. In each segment, the mean is removed from both spectra, a Hann
+// window applied, and the cross-correlation found with GSL FFTs. The shift of
+// the reference spectrum relative to the measured spectrum is given by the
+// peak of the cross-correlation, which is refined to a fraction of a grid
+// point by fitting a Gaussian through the peak and its two neighbours. (A
+// parabola would pull the refined peak towards the nearest grid point.)
+// Each segment thus gives an independent estimate of epsilon. The result is
+// their mean, and its error the standard error of the mean. Segments where the
+// peak lies at the edge of the search window, or where either spectrum is
+// flat, are not used.
+//
+// No line fitting is needed, so a calibration takes seconds rather than hours.
+// The reference spectrum must already be calibrated, and both spectra must
+// contain many of the same lines in each segment.
+//
+// Make sure the GNU Scientific Library (GSL) development package is installed
+// on your system, then compile this code using the following command:
+//
+// g++ ftsxcorr.cpp xgspectrum.cpp byteorder.cpp -lgsl -lgslcblas -o ftsxcorr
+//
+
+#include <cstdlib>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <gsl/gsl_fft_real.h>
+#include <gsl/gsl_fft_halfcomplex.h>
+#include "xgspectrum.h"
+
+using namespace::std;
+
+// ftsxcorr version
+#define VERSION "1.0"
+
+// Default number of segments in which epsilon is measured
+#define DEFAULT_NUM_SEGMENTS 8
+
+// The fewest grid points allowed in a single segment
+#define MIN_SEGMENT_POINTS 64
+
+// Definitions for command line parameters
+#define REQUIRED_NUM_ARGS_MODE1 3
+#define REQUIRED_NUM_ARGS_MODE2 4
+#define ARG_SPECTRUM 1
+#define ARG_REFERENCE 2
+#define ARG_SEGMENTS 3
+
+// Define a structure to hold the result from a single segment
+typedef struct td_Segment {
+  double Min;          // Wavenumber range of the segment
+  double Max;
+  double Correlation;  // Normalised height of the cross-correlation peak
+  double Epsilon;      // Wavenumber scaling factor found in the segment
+  bool Used;           // false if the segment was rejected
+} Segment;
+
+
+//------------------------------------------------------------------------------
+// showHelp () : Prints syntax help message to the standard output.
+//
+void showHelp () {
+  cout << endl;
+  cout << "ftsxcorr : Finds the wavenumber scaling factor between two FTS spectra" << endl;
+  cout << "---------------------------------------------------------------" << endl;
+  cout << "Syntax : ftsxcorr <spectrum> <reference> [<segments>]" << endl << endl;
+  cout << "<spectrum>  : The XGremlin spectrum to be calibrated (do not include the '.dat' extension)." << endl;
+  cout << "<reference> : A calibrated XGremlin spectrum of the same source (also without '.dat')." << endl;
+  cout << "<segments>  : The number of overlapping segments in which the scaling factor is" << endl;
+  cout << "              measured. The error is found from the scatter between segments" << endl;
+  cout << "              (default " << DEFAULT_NUM_SEGMENTS << ")." << endl << endl;
+}
+
+
+//------------------------------------------------------------------------------
+// resample (XgSpectrum &, double, double, size_t, vector <double> &) : Fills
+// arg5 with the spectrum at arg1 interpolated onto a grid of arg4 points, the
+// first at wavenumber arg2, and each subsequent point a factor exp(arg3)
+// higher than the one before.
+//
+void resample (XgSpectrum &Spectrum, double Min, double Step, size_t NumPoints,
+  vector <double> &Grid) throw (int) {
+  double Max = Spectrum.maxWavenumber ();
+  Grid.resize (NumPoints);
+  for (size_t i = 0; i < NumPoints; i ++) {
+    Grid [i] = Spectrum.interpolate (min (Min * exp (i * Step), Max));
+  }
+}
+
+
+//------------------------------------------------------------------------------
+// prepareSegment (vector <double> &, size_t, size_t, vector <double> &) : Copies
+// arg3 points from arg1, starting at arg2, into arg4, then removes their mean
+// and applies a Hann window. arg4 must already be sized to the FFT length, and
+// all points beyond arg3 are zeroed to avoid wrap-around in the correlation.
+// Returns the sum of the squares of the windowed points.
+//
+double prepareSegment (vector <double> &Grid, size_t Start, size_t Length,
+  vector <double> &Buffer) {
+  double Mean = 0.0, SumSq = 0.0;
+  for (size_t i = 0; i < Length; i ++) Mean += Grid [Start + i];
+  Mean /= Length;
+  for (size_t i = 0; i < Buffer.size (); i ++) {
+    if (i < Length) {
+      Buffer [i] = (Grid [Start + i] - Mean)
+        * 0.5 * (1.0 - cos (2.0 * M_PI * i / (Length - 1)));
+      SumSq += Buffer [i] * Buffer [i];
+    } else {
+      Buffer [i] = 0.0;
+    }
+  }
+  return SumSq;
+}
+
+
+//------------------------------------------------------------------------------
+// crossCorrelate (vector <double> &, vector <double> &) : Replaces arg2 with the
+// cross-correlation of arg1 and arg2, where element k holds the sum over i of
+// arg1[i] * arg2[i+k]. Negative shifts, -k, are held in element size()-k. Both
+// vectors must have the same length, which must be a power of 2. The contents
+// of arg1 are overwritten by its FFT.
+//
+void crossCorrelate (vector <double> &A, vector <double> &B) {
+  size_t n = A.size ();
+  gsl_fft_real_radix2_transform (&A [0], 1, n);
+  gsl_fft_real_radix2_transform (&B [0], 1, n);
+
+  // Multiply the conjugate of the transform of A by that of B. The transforms
+  // are in GSL's half-complex order, with the real part of frequency i held at
+  // element i, and its imaginary part at element n-i.
+  B [0] *= A [0];
+  B [n / 2] *= A [n / 2];
+  for (size_t i = 1; i < n / 2; i ++) {
+    double ar = A [i], ai = A [n - i], br = B [i], bi = B [n - i];
+    B [i] = ar * br + ai * bi;
+    B [n - i] = ar * bi - ai * br;
+  }
+  gsl_fft_halfcomplex_radix2_inverse (&B [0], 1, n);
+}
+
+
+//------------------------------------------------------------------------------
+// findPeak (vector <double> &, long, double &) : Finds the largest element of
+// the cross-correlation at arg1 within shifts of +/- arg2 points. Returns the
+// shift of the peak, refined by a Gaussian through the peak and its neighbours
+// (i.e. a parabola through their logarithms), and sets arg3 to the height of
+// the peak. If either neighbour is not positive, a parabola is used instead.
+// Returns HUGE_VAL if the peak is at the edge of the search window, where it
+// cannot be refined.
+//
+double findPeak (vector <double> &Correlation, long MaxShift, double &Height) {
+  long n = Correlation.size ();
+  long Peak = 0;
+  for (long k = -MaxShift; k <= MaxShift; k ++) {
+    if (Correlation [(k + n) % n] > Correlation [(Peak + n) % n]) Peak = k;
+  }
+  Height = Correlation [(Peak + n) % n];
+  if (Peak == -MaxShift || Peak == MaxShift) return HUGE_VAL;
+
+  double Left = Correlation [(Peak - 1 + n) % n];
+  double Right = Correlation [(Peak + 1 + n) % n];
+  double Centre = Height;
+  if (Left > 0.0 && Right > 0.0) {
+    Left = log (Left);
+    Right = log (Right);
+    Centre = log (Height);
+  }
+  double Curvature = Left - 2.0 * Centre + Right;
+  if (Curvature >= 0.0) return Peak;
+  return Peak + 0.5 * (Left - Right) / Curvature;
+}
+
+
+//------------------------------------------------------------------------------
+// Main program
+//
+int main (int argc, char *argv[]) {
+  XgSpectrum Measured, Reference;
+  vector <double> MeasuredGrid, ReferenceGrid, BufferA, BufferB;
+  vector <Segment> Segments;
+  unsigned int NumSegments = DEFAULT_NUM_SEGMENTS;
+
+  // Check the user's command line input
+  if (argc != REQUIRED_NUM_ARGS_MODE1 && argc != REQUIRED_NUM_ARGS_MODE2) {
+    showHelp ();
+    return LC_SYNTAX_ERROR;
+  }
+  if (argc == REQUIRED_NUM_ARGS_MODE2) {
+    istringstream iss (argv [ARG_SEGMENTS]);
+    if (!(iss >> NumSegments) || NumSegments < 1) {
+      cout << "ERROR: Argument " << ARG_SEGMENTS << " must be a positive integer." << endl;
+      return LC_SYNTAX_ERROR;
+    }
+  }
+
+  // Print introductory message to the standard output
+  cout << "FTS Spectrum Cross-Correlator " << VERSION
+    << " (built " << __DATE__ << ")" << endl;
+  cout << "--------------------------------------------------------" << endl;
+  cout << "Spectrum to be calibrated : " << argv [ARG_SPECTRUM] << endl;
+  cout << "Reference spectrum        : " << argv [ARG_REFERENCE] << endl;
+  cout << "Number of segments        : " << NumSegments << endl;
+
+  // Load both spectra and find the wavenumber range that they share
+  try {
+    Measured.load (argv [ARG_SPECTRUM]);
+    Reference.load (argv [ARG_REFERENCE]);
+  } catch (int Err) {
+    return Err;
+  }
+  double Min = max (Measured.minWavenumber (), Reference.minWavenumber ());
+  double Max = min (Measured.maxWavenumber (), Reference.maxWavenumber ());
+  if (Min >= Max || Min <= 0.0) {
+    cout << "ERROR: The spectra do not share a range of positive wavenumbers." << endl;
+    return LC_NO_OVERLAP;
+  }
+
+  // Resample both spectra onto a common grid that is uniform in ln(sigma)
+  double Step = min (fabs (Measured.delw ()), fabs (Reference.delw ())) / Max;
+  size_t NumPoints = (size_t) (log (Max / Min) / Step) + 1;
+  size_t Length = 2 * NumPoints / (NumSegments + 1);
+  if (Length < MIN_SEGMENT_POINTS) {
+    cout << "ERROR: The spectra overlap by only " << NumPoints << " points, which is"
+      << " too few for " << NumSegments << " segments." << endl;
+    return LC_NO_DATA;
+  }
+  size_t FFTLength = 1;
+  while (FFTLength < 2 * Length) FFTLength *= 2;
+  long MaxShift = Length / 4;
+  cout << "Common wavenumber range   : " << Min << " - " << Max << " K" << endl;
+  cout << "Grid points               : " << NumPoints << " (d ln(sigma) = "
+    << Step << ")" << endl;
+  cout << "Points per segment        : " << Length << " (FFT length "
+    << FFTLength << ")" << endl;
+  try {
+    resample (Measured, Min, Step, NumPoints, MeasuredGrid);
+    resample (Reference, Min, Step, NumPoints, ReferenceGrid);
+  } catch (int Err) {
+    cout << "ERROR: Resampling went beyond the end of a spectrum." << endl;
+    return Err;
+  }
+
+  // Measure epsilon in each segment from the shift of the correlation peak
+  BufferA.resize (FFTLength);
+  BufferB.resize (FFTLength);
+  for (unsigned int s = 0; s < NumSegments; s ++) {
+    Segment Next;
+    size_t Start = s * Length / 2;
+    double Height, Shift;
+    double NormA = prepareSegment (MeasuredGrid, Start, Length, BufferA);
+    double NormB = prepareSegment (ReferenceGrid, Start, Length, BufferB);
+    Next.Min = Min * exp (Start * Step);
+    Next.Max = Min * exp ((Start + Length - 1) * Step);
+    Next.Correlation = 0.0;
+    Next.Epsilon = 0.0;
+    Next.Used = false;
+    if (NormA > 0.0 && NormB > 0.0) {
+      crossCorrelate (BufferA, BufferB);
+      Shift = findPeak (BufferB, MaxShift, Height);
+      Next.Correlation = Height / sqrt (NormA * NormB);
+      if (Shift != HUGE_VAL) {
+        Next.Epsilon = expm1 (Shift * Step);
+        Next.Used = true;
+      }
+    }
+    Segments.push_back (Next);
+  }
+
+  // Combine the results from all the segments
+  double Mean = 0.0, SumSq = 0.0;
+  unsigned int NumUsed = 0;
+  cout << endl << "Segment  Wavenumber range (K)     Correlation  dSig/Sig" << endl;
+  for (unsigned int s = 0; s < Segments.size (); s ++) {
+    printf ("%5d  %11.3f - %11.3f  %9.6f  ", s + 1, Segments[s].Min,
+      Segments[s].Max, Segments[s].Correlation);
+    if (Segments[s].Used) {
+      printf ("%e\n", Segments[s].Epsilon);
+      Mean += Segments[s].Epsilon;
+      NumUsed ++;
+    } else {
+      printf ("rejected\n");
+    }
+  }
+  if (NumUsed == 0) {
+    cout << "ERROR: No segment gave a clear correlation peak." << endl;
+    return NO_SCALING_RATIO_FOUND;
+  }
+  Mean /= NumUsed;
+  for (unsigned int s = 0; s < Segments.size (); s ++) {
+    if (Segments[s].Used) SumSq += pow (Segments[s].Epsilon - Mean, 2);
+  }
+  cout << "--------------------------------------------------" << endl;
+  if (NumUsed > 1) {
+    cout << "Optimal dSig/Sig : " << Mean << " +/- "
+      << sqrt (SumSq / (NumUsed - 1) / NumUsed) << endl;
+  } else {
+    cout << "Optimal dSig/Sig : " << Mean
+      << " (error unknown, only one segment used)" << endl;
+  }
+  cout << "--------------------------------------------------" << endl;
+  return LC_NO_ERROR;
+}
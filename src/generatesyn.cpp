@@ -16,14 +16,50 @@
 //
 // generatesyn : Generates an XGremlin SYN file from a Kurucz line list
 //
+// With the -hfs option, each line with hyperfine structure or several isotopes
+// is written as all of its components, rather than as a single row. Kurucz
+// gives each component as a separate record, with the shifts of both levels
+// from their centres of gravity, the isotope shift, and the log fractions of
+// the line strength in that component and isotope. After all the records have
+// been read, the components are expanded in a single pass: the wavenumber of
+// each is found from its shifts, and its peak is the given peak weighted by
+// its fraction of the line strength. Records of the same transition are then
+// grouped, so that all the components of a line are written as adjacent rows
+// in ascending wavenumber, and the lines ordered by their centres of gravity.
+//
+// Several Kurucz lists, such as the gfXXXX.lines files of different species, may
+// be given at once, separated by commas. Each name may be followed by a colon and
+// a factor by which the peaks of its lines are scaled, and then by another colon
+// and the smallest log gf of the lines to be taken from it, e.g.
+//
+//   generatesyn gf2600.lines,gf2601.lines:0.5:-3.0 fe.syn
+//
+// The lists are read together, and at each step the record of highest
+// wavenumber among those next in each list is taken, so the lines of all the
+// species are merged into a single list without first being copied to one file.
+//
+// Kurucz lists are in descending wavenumber, so the rows are held until the
+// whole list has been read and then written in reverse. If a memory budget is
+// set with --mem-limit, each time the rows held exceed it they are moved to a
+// temporary file beside the SYN output. These files are read back one at a
+// time, last first, when the SYN file is written.
+//
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <iomanip>
 #include <string>
 #include <cmath>
 #include <vector>
+#include <map>
+#include <algorithm>
+#include <queue>
+#include <cstdio>
+#include <cstdlib>
 #include "kzline.h"
 #include "xgline.h"
+#include "fixedformat.h"
+#include "memlimit.h"
 
 using namespace::std;
 
@@ -50,6 +86,56 @@ using namespace::std;
 #define DEF_LINE_WIDTH 30   /* mK */
 #define DEF_LINE_DMP 0.0
 
+// Expand hyperfine and isotope components. Must precede all other arguments.
+#define HFS_OPTION "-hfs"
+
+// The SYN rows written by generatesyn. Note that these place the width before
+// the peak, unlike the SynFormat rows written by the Line classes.
+static const FieldFormat GeneratesynFormat [] = {
+  {   0, 15, -1, FF_TEXT_LEFT }, /* Configuration */
+  {  17, 11,  5, FF_FIXED },     /* Wavenumber    */
+  {  28, 10,  4, FF_FIXED },     /* Width         */
+  {  38,  9,  2, FF_FIXED },     /* Peak          */
+  {  47,  8,  4, FF_FIXED },     /* Damping       */
+  {   0,  0,  0, FF_END }
+};
+
+// Define a structure to hold one of the Kurucz lists being read, with the
+// scale factor for its peaks, the smallest log gf of the lines to take from it,
+// and the next record to be taken from it
+typedef struct td_KuruczInput {
+  string Name;
+  ifstream *File;
+  float Scale;
+  bool HasMinLoggf;
+  double MinLoggf;
+  KzLine Next;
+  double LastSigma;    // Wavenumber of the last record read, or -1 at the start
+  bool Sorted;
+} KuruczInput;
+
+// Orders the lists by the wavenumbers of their next records, so that the
+// highest is at the top of a priority queue. Ties are taken from the list given
+// first.
+typedef struct td_CompareInputs {
+  vector <KuruczInput> *Inputs;
+  bool operator () (unsigned int a, unsigned int b) {
+    double SigmaA = (*Inputs)[a].Next.sigma ();
+    double SigmaB = (*Inputs)[b].Next.sigma ();
+    if (SigmaA != SigmaB) return SigmaA < SigmaB;
+    return a > b;
+  }
+} CompareInputs;
+
+// Define a structure to hold one hyperfine or isotope component of a line
+typedef struct td_SynComponent {
+  string Label;
+  double Sigma;
+  double Peak;
+  double Centre;       // Centre of gravity of the line the component is from
+  unsigned int Group;  // Index of the line the component is from
+} SynComponent;
+
 //------------------------------------------------------------------------------
 // showHelp () : Prints syntax help message to the standard output.
 //
@@ -57,8 +143,14 @@ void showHelp () {
   cout << endl;
   cout << "generatesyn : Generates an XGremlin SYN file from a Kurucz line list" << endl;
   cout << "----------------------------------------------------------------------" << endl;
-  cout << "Syntax : generate_syn <kurucz in> [<peak> <width> <damping>] [<min sigma> <max sigma>] <syn out>" << endl << endl;
-  cout << "<kurucz in> : A Kurucz line list from which to generate a SYN file" << endl;
+  cout << "Syntax : generate_syn [-hfs] [--mem-limit <size>] <kurucz in> [<peak> <width> <damping>] [<min sigma> <max sigma>] <syn out>" << endl << endl;
+  cout << "-hfs        : Write every hyperfine and isotope component of each line, weighted by" << endl;
+  cout << "              its fraction of the line strength, as adjacent rows" << endl;
+  cout << "<size>      : The most memory to use, e.g. 512M. Rows beyond this are held in" << endl;
+  cout << "              temporary files until the SYN file is written" << endl;
+  cout << "<kurucz in> : A Kurucz line list from which to generate a SYN file, or several" << endl;
+  cout << "              separated by commas. Each may be given as <list>:<scale>:<min log gf>" << endl;
+  cout << "              to scale the peaks of its lines and discard those with lower log gf" << endl;
   cout << "<peak>      : Line peak height written to the SYN file (default " << DEF_LINE_PEAK << ")" << endl;
   cout << "<width>     : Line width written to the SYN file (default " << DEF_LINE_WIDTH << ")" << endl;
   cout << "<damping>   : Line damping written to the SYN file (default " << DEF_LINE_DMP << ")" << endl;
@@ -67,19 +159,253 @@ void showHelp () {
   cout << "<syn out>   : The SYN file generated from <kurucz in>" << endl << endl;
 }
 
+
+//------------------------------------------------------------------------------
+// synLabel (KzLine &) : Returns the label written to the SYN file for the line
+// at arg1, which is the configuration of its upper level.
+//
+string synLabel (KzLine &Record) {
+  if (Record.eUpper () > Record.eLower ()) {
+    return Record.configUpper ();
+  } else {
+    return Record.configLower ();
+  }
+}
+
+
+//------------------------------------------------------------------------------
+// synRow (string, double, float, float, float) : Returns a row of a SYN file
+// for a line with label arg1, wavenumber arg2, width arg3, peak arg4, and
+// damping arg5.
+//
+string synRow (string Label, double Sigma, float Width, float Peak, 
+  float Damping) {
+  FixedRecord Record (GeneratesynFormat);
+  Record.put (Label);
+  Record.put (Sigma);
+  Record.put (Width);
+  Record.put (Peak);
+  Record.put (Damping);
+  return Record.str ();
+}
+
+
+//------------------------------------------------------------------------------
+// transitionKey (KzLine &) : Returns a string identifying the transition that
+// the record at arg1 belongs to. All the hyperfine and isotope components of a
+// line share the same species, level configurations, J values, and energies.
+// The energies separate levels of the same configuration and J, which may
+// otherwise give several distinct lines the same key.
+//
+string transitionKey (KzLine &Record) {
+  ostringstream oss;
+  oss << Record.code () << "|" << Record.configLower () << "|" 
+    << Record.jLower () << "|" << Record.configUpper () << "|" 
+    << Record.jUpper () << "|" << fixed << setprecision (3)
+    << Record.eLower () << "|" << Record.eUpper ();
+  return oss.str ();
+}
+
+
+//------------------------------------------------------------------------------
+// compareComponents (const SynComponent &, const SynComponent &) : Orders the
+// components by the centre of gravity of their lines, keeping the components of
+// each line together, and then by their own wavenumbers.
+//
+bool compareComponents (const SynComponent &a, const SynComponent &b) {
+  if (a.Centre != b.Centre) return a.Centre < b.Centre;
+  if (a.Group != b.Group) return a.Group < b.Group;
+  return a.Sigma < b.Sigma;
+}
+
+
+//------------------------------------------------------------------------------
+// expandComponents (vector <KzLine> &, vector <float> &) : Returns the
+// hyperfine and isotope components of all the records at arg1, in the order in
+// which they should be written to the SYN file. The peak of each component is
+// that given for its record in arg2 times its fraction of the line strength.
+//
+vector <SynComponent> expandComponents (vector <KzLine> &Records, 
+  vector <float> &Peaks) {
+  vector <SynComponent> Components (Records.size ());
+  map <string, unsigned int> Groups;
+  vector <double> Weight, WeightedSigma;
+
+  // Find the wavenumber and peak of each component, and accumulate the centre
+  // of gravity of the line that it belongs to.
+  for (unsigned int i = 0; i < Records.size (); i ++) {
+    string Key = transitionKey (Records[i]);
+    map <string, unsigned int>::iterator Group = Groups.find (Key);
+    if (Group == Groups.end ()) {
+      Group = Groups.insert (make_pair (Key, (unsigned int) Weight.size ())).first;
+      Weight.push_back (0.0);
+      WeightedSigma.push_back (0.0);
+    }
+    double Fraction = Records[i].componentFraction ();
+    Components[i].Label = synLabel (Records[i]);
+    Components[i].Sigma = Records[i].componentSigma ();
+    Components[i].Peak = Peaks[i] * Fraction;
+    Components[i].Group = Group -> second;
+    Weight [Group -> second] += Fraction;
+    WeightedSigma [Group -> second] += Fraction * Components[i].Sigma;
+  }
+  for (unsigned int i = 0; i < Components.size (); i ++) {
+    unsigned int g = Components[i].Group;
+    Components[i].Centre = (Weight[g] > 0.0) ? WeightedSigma[g] / Weight[g]
+      : Components[i].Sigma;
+  }
+  stable_sort (Components.begin (), Components.end (), compareComponents);
+  return Components;
+}
+
+//------------------------------------------------------------------------------
+// parseInputs (string) : Returns the Kurucz lists named in arg1, which are
+// separated by commas. Each name may be followed by a colon and the scale factor
+// for the peaks of its lines, and then by another colon and the smallest log gf
+// of the lines to take from it. Every list is opened for reading.
+//
+vector <KuruczInput> parseInputs (string Names) throw (int) {
+  istringstream iss (Names);
+  string NextSpec;
+  vector <KuruczInput> Inputs;
+  while (getline (iss, NextSpec, ',')) {
+    if (NextSpec.length () == 0) continue;
+    KuruczInput NewInput;
+    NewInput.Scale = 1.0;
+    NewInput.HasMinLoggf = false;
+    NewInput.MinLoggf = 0.0;
+    NewInput.LastSigma = -1.0;
+    NewInput.Sorted = true;
+    NewInput.File = NULL;
+    size_t Colon = NextSpec.find (':');
+    NewInput.Name = NextSpec.substr (0, Colon);
+    if (Colon != string::npos) {
+      string Options = NextSpec.substr (Colon + 1);
+      size_t Colon2 = Options.find (':');
+      if (Options.substr (0, Colon2).length () > 0) {
+        NewInput.Scale = atof (Options.substr (0, Colon2).c_str ());
+        if (NewInput.Scale <= 0.0) {
+          cout << "Error: The peak scale given for " << NewInput.Name
+            << " must be a positive number." << endl;
+          throw int (ERR_SYNTAX_ERROR);
+        }
+      }
+      if (Colon2 != string::npos) {
+        NewInput.HasMinLoggf = true;
+        NewInput.MinLoggf = atof (Options.substr (Colon2 + 1).c_str ());
+      }
+    }
+    Inputs.push_back (NewInput);
+  }
+  if (Inputs.size () == 0) {
+    cout << "Error: No Kurucz line list was given" << endl;
+    throw int (ERR_SYNTAX_ERROR);
+  }
+  for (unsigned int i = 0; i < Inputs.size (); i ++) {
+    Inputs[i].File = new ifstream (Inputs[i].Name.c_str ());
+    if (!Inputs[i].File -> is_open ()) {
+      cout << "Error Opening " << Inputs[i].Name << endl << 
+        "Check the file exists and that you have permission to read it" << endl;
+      throw int (ERR_INPUT_READ_ERROR);
+    }
+  }
+  return Inputs;
+}
+
+
+//------------------------------------------------------------------------------
+// readNext (KuruczInput &) : Reads the next record of the list at arg1 that
+// passes its log gf filter. Returns false at the end of the list. A warning is
+// given the first time the list is found not to be in descending wavenumber,
+// since it can then no longer be merged in order with the other lists.
+//
+bool readNext (KuruczInput &Input) {
+  string StrNextLine;
+  while (getline (*Input.File, StrNextLine)) {
+    if (StrNextLine.length () == 0 || StrNextLine[0] == '\0') continue;
+    Input.Next.readLine (StrNextLine);
+    if (Input.Sorted && Input.LastSigma >= 0.0 
+      && Input.Next.sigma () > Input.LastSigma) {
+      cout << "Warning: " << Input.Name << " is not in ascending wavelength. "
+        << "The lines written from it will not all be in order." << endl;
+      Input.Sorted = false;
+    }
+    Input.LastSigma = Input.Next.sigma ();
+    if (Input.HasMinLoggf && Input.Next.loggf () < Input.MinLoggf) continue;
+    return true;
+  }
+  return false;
+}
+
+
+//------------------------------------------------------------------------------
+// spillRows (vector <string> &, string, vector <string> &) : Moves the rows at
+// arg1 to a new temporary file, named from arg2 and the number of files that
+// are already listed in arg3, and adds its name to arg3. Returns false if the
+// file could not be written, in which case the rows are kept.
+//
+bool spillRows (vector <string> &Rows, string Stem, vector <string> &Files) {
+  ostringstream oss;
+  oss << Stem << ".part" << Files.size ();
+  ofstream Spill (oss.str ().c_str ());
+  for (unsigned int i = 0; i < Rows.size () && Spill.good (); i ++) {
+    Spill << Rows[i] << '\n';
+  }
+  Spill.close ();
+  if (!Spill.good ()) {
+    remove (oss.str ().c_str ());
+    return false;
+  }
+  Files.push_back (oss.str ());
+  Rows.clear ();
+  return true;
+}
+
+
+//------------------------------------------------------------------------------
+// writeReversed (vector <string> &, ofstream &) : Writes the rows at arg1 to
+// the SYN file at arg2, last row first.
+//
+void writeReversed (vector <string> &Rows, ofstream &SynOutput) {
+  for (int i = Rows.size () - 1; i >= 0; i --) {
+    SynOutput << Rows [i] << endl;
+  }
+}
+
+
 //------------------------------------------------------------------------------
 // Main program
 //
 int main (int argc, char* argv[]) 
 {
-  ostringstream oss;
   istringstream iss;
   string StrNextLine;
-  KzLine NextLine;
   float Peak = DEF_LINE_PEAK, Width = DEF_LINE_WIDTH, Damping = DEF_LINE_DMP;
   float MinX = 0, MaxX = 0;
   vector <string> Lines;
   vector <string> Args;
+  vector <KzLine> Records;
+  vector <float> RecordPeaks;
+  vector <string> SpillFiles;
+  size_t RowBytes = 0;
+  bool ExpandHfs = false;
+  XgMemLimit Budget ("generatesyn");
+  
+  // Remove the --mem-limit option from anywhere in the command line
+  try {
+    argc = Budget.parseArgs (argc, argv);
+  } catch (int Err) {
+    return ERR_SYNTAX_ERROR;
+  }
+  
+  // Remove the -hfs option, if given, so the other arguments keep their places
+  if (argc > 1 && string (argv[1]) == HFS_OPTION) {
+    ExpandHfs = true;
+    for (int i = 1; i < argc - 1; i ++) {
+      argv[i] = argv[i + 1];
+    }
+    argc --;
+  }
   
   for (unsigned int i = 1; i < argc; i ++) {
     Args.push_back (argv[i]);
@@ -106,13 +432,12 @@ int main (int argc, char* argv[])
     return ERR_SYNTAX_ERROR;
   }
   
-  // Open the Kurucz input list
-  ifstream FullKuruczList (argv [KURUCZ_INPUT]);
-  if (!FullKuruczList.is_open ())
-  {
-    cout << "Error Opening " << argv [KURUCZ_INPUT] << endl << 
-      "Check the file exists and that you have permission to read it" << endl;
-    return ERR_INPUT_READ_ERROR;
+  // Open the Kurucz input lists
+  vector <KuruczInput> Inputs;
+  try {
+    Inputs = parseInputs (argv [KURUCZ_INPUT]);
+  } catch (int Err) {
+    return Err;
   }
   
   // Open the SYN output list
@@ -123,45 +448,87 @@ int main (int argc, char* argv[])
     return ERR_OUTPUT_WRITE_ERROR;
   }
 
-  // Read the Kurucz list and write each line out in SYN format to the SYN file. 
-  while (!FullKuruczList.eof ())
-  {
-    if (FullKuruczList.peek () != '\0')
-    {
-      getline (FullKuruczList, StrNextLine);
-      NextLine.readLine (StrNextLine);
+  // Read the first record of each list, then repeatedly take the record of 
+  // highest wavenumber from the lists and replace it with the next from the
+  // same list, writing each out in SYN format to the SYN file.
+  CompareInputs Compare;
+  Compare.Inputs = &Inputs;
+  priority_queue <unsigned int, vector <unsigned int>, CompareInputs> Heads (Compare);
+  for (unsigned int i = 0; i < Inputs.size (); i ++) {
+    if (readNext (Inputs[i])) Heads.push (i);
+  }
+  while (!Heads.empty ()) {
+    unsigned int Next = Heads.top ();
+    Heads.pop ();
+    KzLine &NextLine = Inputs[Next].Next;
+    float LinePeak = Peak * Inputs[Next].Scale;
       
-      oss.str ("");
-      oss.width (15);
-      if (NextLine.eUpper () > NextLine.eLower ()) {
-        oss << left << NextLine.configUpper () << "  ";
-      } else {
-        oss << left << NextLine.configLower () << "  ";
-      }
-      oss << fixed << right;
-      oss.width (11); oss.precision (5); oss << NextLine.sigma ();
-      oss.width (10); oss.precision (4); oss << Width;
-      oss.width (9);  oss.precision (2); oss << Peak;
-      oss.width (8);  oss.precision (4); oss << Damping;
-      if (argc == REQ_NUM_ARGS_MODE1 || argc == REQ_NUM_ARGS_MODE2) {
-        Lines.push_back (oss.str ());
+    if (argc == REQ_NUM_ARGS_MODE1 || argc == REQ_NUM_ARGS_MODE2
+      || (NextLine.sigma () >= MinX && NextLine.sigma () <= MaxX)) {
+      if (ExpandHfs) {
+        Records.push_back (NextLine);
+        RecordPeaks.push_back (LinePeak);
       } else {
-        if (NextLine.sigma () >= MinX && NextLine.sigma () <= MaxX) {
-          Lines.push_back (oss.str ());
+        Lines.push_back (synRow (synLabel (NextLine), NextLine.sigma (), 
+          Width, LinePeak, Damping));
+        RowBytes += Lines.back ().length () + sizeof (string);
+        if (!Budget.fits (RowBytes)) {
+          if (!spillRows (Lines, argv [argc - 1], SpillFiles)) {
+            cout << "Error writing a temporary file beside " << argv [argc - 1]
+              << endl << "Check that you have permission to write to this location" 
+              << endl;
+            return ERR_OUTPUT_WRITE_ERROR;
+          }
+          RowBytes = 0;
         }
       }
     }
+    if (readNext (Inputs[Next])) Heads.push (Next);
+  }
+  
+  // Expand the components of all the selected lines. These are returned in 
+  // ascending wavenumber. All the records must be held at once to group the
+  // components, so the budget cannot be kept to here.
+  if (ExpandHfs) {
+    if (!Budget.fits (Records.size () * (sizeof (KzLine) + sizeof (float) 
+      + sizeof (SynComponent)))) {
+      Budget.constrain ("Exceeded by the hyperfine expansion, which holds every line at once");
+    }
+    vector <SynComponent> Components = expandComponents (Records, RecordPeaks);
+    for (unsigned int i = 0; i < Components.size (); i ++) {
+      SynOutput << synRow (Components[i].Label, Components[i].Sigma, Width, 
+        Components[i].Peak, Damping) << endl;
+    }
   }
   
   // Output the lines in reverse order so that they are in ascending wavenumber.
-  for (int i = Lines.size () - 1; i >= 0; i --)
-  {
-    SynOutput << Lines [i] << endl;
+  // Those moved to temporary files come after the lines still held, and are
+  // read back in reverse order of writing.
+  writeReversed (Lines, SynOutput);
+  for (int i = SpillFiles.size () - 1; i >= 0; i --) {
+    ifstream Spill (SpillFiles [i].c_str ());
+    Lines.clear ();
+    while (getline (Spill, StrNextLine)) {
+      Lines.push_back (StrNextLine);
+    }
+    Spill.close ();
+    writeReversed (Lines, SynOutput);
+    remove (SpillFiles [i].c_str ());
+  }
+  if (SpillFiles.size () > 0) {
+    ostringstream oss;
+    oss << "SYN rows held in " << SpillFiles.size () << " temporary file"
+      << (SpillFiles.size () == 1 ? "" : "s") << " while reading the list";
+    Budget.constrain (oss.str ());
   }
   
   // Tidy up and quit
-  FullKuruczList.close ();
+  for (unsigned int i = 0; i < Inputs.size (); i ++) {
+    Inputs[i].File -> close ();
+    delete Inputs[i].File;
+  }
   SynOutput.close ();
+  Budget.report ();
   return ERR_NO_ERROR;
 }
 
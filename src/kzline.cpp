@@ -23,6 +23,7 @@
 #include <cstdio>
 #include <cmath>
 #include "kzline.h"
+#include "fixedformat.h"
 
 //------------------------------------------------------------------------------
 // Default constructor. Initialises all class variables.
@@ -130,17 +131,19 @@ void KzLine::readLine (string LineInfoIn) throw (Error) {
   }
   
   // Some of the fields are left blank if not used. Attempt to read them one at
-  // a time. If any are blank, just skip them and set the property to 0 
+  // a time. If any are blank, just skip them and set the property to 0. The
+  // stream state is cleared after every field, as reading a field that fills
+  // its substring sets eofbit, which would otherwise fail the next read.
   iss.str (LineInfoIn.substr (124, 5)); iss >> HfShiftLower;
-  if (iss.fail ()) { HfShiftLower = 0; iss.clear (); }
+  if (iss.fail ()) { HfShiftLower = 0; } iss.clear ();
   iss.str (LineInfoIn.substr (129, 5)); iss >> HfShiftUpper;
-  if (iss.fail ()) { HfShiftUpper = 0; iss.clear (); }
+  if (iss.fail ()) { HfShiftUpper = 0; } iss.clear ();
   iss.str (LineInfoIn.substr (135, 1)); iss >> HfFLower;
-  if (iss.fail ()) { HfFLower = 0; iss.clear (); }
+  if (iss.fail ()) { HfFLower = 0; } iss.clear ();
   iss.str (LineInfoIn.substr (138, 1)); iss >> HfFUpper;
-  if (iss.fail ()) { HfFUpper = 0; iss.clear (); }
+  if (iss.fail ()) { HfFUpper = 0; } iss.clear ();
   iss.str (LineInfoIn.substr (140, 1)); iss >> StrengthClass;
-  if (iss.fail ()) { StrengthClass = 0; iss.clear (); }
+  if (iss.fail ()) { StrengthClass = 0; } iss.clear ();
   
   // The next two parameters should always be present
   iss.str (LineInfoIn.substr (144)); 
@@ -164,18 +167,19 @@ void KzLine::readLine (string LineInfoIn) throw (Error) {
 // and returns the result.
 //
 std::string KzLine::lineString () {
-  std::string rtnString;
-  char str [171];
-  sprintf (str, "%11.4f%7.3f%6.2f%12.3f%5.1f %10s%12.3f%5.1f %10s%6.2f%6.2f%6.2f%4s%2i%2i%3i%6.3f%3i%6.3f%5i%5i %i%c %i%c%i%3s%5i%5i%6i",
-    Lambda, Loggf, Code, ELower, JLower, ConfigLower.c_str(), EUpper, JUpper, 
-    ConfigUpper.c_str(), GammaRad, GammaStark, GammaWaals, Ref.c_str(), NlteLower, 
-    NlteUpper, Isotope, HfStrength, Isotope2, IsotopeAbundance, 
-    HfShiftLower, HfShiftUpper, HfFLower, HfNoteLower, HfFUpper, 
-    HfNoteUpper, StrengthClass, TagCode.c_str(), LandeGLower, LandeGUpper, 
-    IsotopeShift);
-  
-  rtnString = str;
-  return rtnString;
+  FixedRecord Record (KuruczFormat);
+  Record.put (Lambda); Record.put (Loggf); Record.put (Code); 
+  Record.put (ELower); Record.put (JLower); Record.put (ConfigLower);
+  Record.put (EUpper); Record.put (JUpper); Record.put (ConfigUpper);
+  Record.put (GammaRad); Record.put (GammaStark); Record.put (GammaWaals);
+  Record.put (Ref); Record.put (NlteLower); Record.put (NlteUpper);
+  Record.put (Isotope); Record.put (HfStrength); Record.put (Isotope2);
+  Record.put (IsotopeAbundance); Record.put (HfShiftLower);
+  Record.put (HfShiftUpper); Record.put (HfFLower); Record.put (HfNoteLower);
+  Record.put (HfFUpper); Record.put (HfNoteUpper); Record.put (StrengthClass);
+  Record.put (TagCode); Record.put (LandeGLower); Record.put (LandeGUpper);
+  Record.put (IsotopeShift);
+  return Record.str ();
 }
 
 
@@ -354,3 +358,27 @@ double KzLine::sigma () {
 
 
 
+//------------------------------------------------------------------------------
+// componentSigma () : Returns the wavenumber of this hyperfine and/or isotope
+// component of the line. The hyperfine shifts of the two levels from their
+// centres of gravity (in mK) are added to the level energies, and the isotope
+// shift of the wavelength (in mA) is converted to a shift in wavenumber. If the
+// record holds neither shift, this is the same as sigma ().
+//
+double KzLine::componentSigma () {
+  double Shift = (HfShiftUpper - HfShiftLower) / 1000.0;
+  if (EUpper < ELower) Shift = -Shift;
+  double Component = sigma () + Shift;
+  return Component - Component * Component * IsotopeShift * 1.0e-11;
+}
+
+
+//------------------------------------------------------------------------------
+// componentFraction () : Returns the fraction of the total line strength that
+// falls in this component, i.e. the product of the relative hyperfine strength
+// and the isotope abundance. Kurucz gives both as log10 fractions, which are 
+// zero (i.e. a fraction of 1) for lines without hyperfine or isotope structure.
+//
+double KzLine::componentFraction () {
+  return pow (10.0, HfStrength + IsotopeAbundance);
+}
@@ -180,6 +180,8 @@ public:
 
   // Public GET functions for derived line properties.
   double sigma ();
+  double componentSigma ();
+  double componentFraction ();
   double brFrac ()            { return BranchingFraction; }
   double trProb ()            { return TransitionProb; }
   double lifetime ()          { return Lifetime; }
@@ -0,0 +1,331 @@
+// Xgtools
+// Copyright (C) M. P. Ruffoni 2011-2015
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// kzsplit : Splits a Kurucz line list into one list for each species
+//
+// Most uses of a Kurucz list need only the lines of one species, but the
+// master list holds every species together, and must be read in full each time.
+// kzsplit reads the list once and writes the lines of each species, identified
+// by the code in columns 19 to 24 (e.g. 26.01 for Fe II), to a list of its own,
+// named as Kurucz names his per-species files: <prefix><code>.lines, with the
+// code written as four or more digits (e.g. gf2601.lines). The lines of each
+// species are kept in the order in which they appear in the master list, so
+// lists sorted by wavelength remain sorted. These smaller lists can then be
+// given to extractlevel and generatesyn in place of the master list.
+//
+// Every record of a Kurucz list is of the same length, so the list is divided
+// into blocks of whole records by their positions in the file alone. The blocks
+// are split in parallel, one per thread, each thread reading its own block and
+// sorting its records into a buffer for each species. The buffers are then
+// appended to the species lists in the order of the blocks. The number of
+// threads may be reduced to fit within the budget set by --mem-limit.
+//
+// Compile this code using the following command:
+//
+// g++ kzsplit.cpp memlimit.cpp xgtrace.cpp -pthread -o kzsplit
+//
+
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <thread>
+#include "kzline.h"
+#include "memlimit.h"
+#include "xgtrace.h"
+
+using namespace::std;
+
+// kzsplit version
+#define VERSION "1.0"
+
+// The number of records split by each thread at a time
+#define BLOCK_RECORDS 65536
+
+// The most species lists held open at once. When more are needed, all are
+// closed and later reopened to be appended to.
+#define MAX_OPEN_LISTS 256
+
+// The position and width of the species code in each record
+#define CODE_POSITION 18
+#define CODE_WIDTH 6
+
+// Definitions for command line parameters
+#define REQUIRED_NUM_ARGS 3
+#define ARG_INPUT 1
+#define ARG_PREFIX 2
+
+// The block of the Kurucz list split by one thread. Records are sorted into
+// Species by their codes, given in hundredths, e.g. 2601 for 26.01.
+typedef struct td_SplitBlock {
+  long First;                  // Index of the first record in the block
+  long Count;                  // Number of records in the block
+  map <long, string> Species;  // The records of each species, in order
+  long Skipped;                // Number of records with no readable code
+  int Status;                  // LC_NO_ERROR, or the error that stopped the block
+} SplitBlock;
+
+// A species list being written, and the number of lines written to it
+typedef struct td_SpeciesList {
+  string Name;
+  ofstream *File;
+  long Lines;
+} SpeciesList;
+
+
+//------------------------------------------------------------------------------
+// showHelp () : Prints syntax help message to the standard output.
+//
+void showHelp () {
+  cout << endl;
+  cout << "kzsplit : " << endl;
+  cout << "---------------------------------------------------------------" << endl;
+  cout << "Syntax : kzsplit [--mem-limit <size>] <kurucz in> <prefix>" << endl << endl;
+  cout << "<kurucz in> : The Kurucz line list to split by species." << endl;
+  cout << "<prefix>    : The lines of each species are saved as <prefix><code>.lines," << endl;
+  cout << "              e.g. a prefix of gf gives gf2601.lines for Fe II." << endl;
+  cout << "<size>      : The most memory to use, e.g. 512M." << endl << endl;
+}
+
+
+//------------------------------------------------------------------------------
+// recordSize (ifstream &, string) : Returns the number of bytes taken by each
+// record of the Kurucz list open at arg1, named arg2, including its line
+// ending. Throws LC_FILE_READ_ERROR if the first record is not of the length
+// of a Kurucz record.
+//
+size_t recordSize (ifstream &Input, string Name) throw (int) {
+  string FirstRecord;
+  getline (Input, FirstRecord);
+  size_t Length = FirstRecord.length ();
+  if (Length > 0 && FirstRecord [Length - 1] == '\r') Length --;
+  if (Length != KZ_RECORD_LENGTH) {
+    cout << "Error: " << Name << " is not a Kurucz line list. Its records "
+      << "should be " << KZ_RECORD_LENGTH << " characters long." << endl;
+    throw int (LC_FILE_READ_ERROR);
+  }
+  Input.clear ();
+  Input.seekg (0, ios::beg);
+  return FirstRecord.length () + 1;
+}
+
+
+//------------------------------------------------------------------------------
+// speciesName (string, long) : Returns the name of the list written for the
+// species with code arg2, in hundredths, using the prefix at arg1.
+//
+string speciesName (string Prefix, long Code) {
+  char Digits [32];
+  snprintf (Digits, sizeof (Digits), "%04ld", Code);
+  return Prefix + Digits + ".lines";
+}
+
+
+//------------------------------------------------------------------------------
+// splitBlock (SplitBlock *, string, size_t) : Reads the records of the block
+// at arg1 from the Kurucz list named arg2, in which each record is arg3 bytes
+// long, and sorts them by species into the block. The last record of the list
+// may be missing its line ending, in which case one is added.
+//
+void splitBlock (SplitBlock *Block, string InputName, size_t RecordSize) {
+  XgTraceSpan Span ("split block");
+  string Raw (Block -> Count * RecordSize, '\n');
+  ifstream Input (InputName.c_str (), ios::in|ios::binary);
+  Input.seekg (Block -> First * RecordSize, ios::beg);
+  Input.read (&Raw [0], Raw.length ());
+  if (Input.gcount () < (streamsize) Raw.length () - 1) {
+    Block -> Status = LC_FILE_READ_ERROR;
+    return;
+  }
+  Block -> Species.clear ();
+  Block -> Skipped = 0;
+  for (long i = 0; i < Block -> Count; i ++) {
+    const char *Record = Raw.data () + i * RecordSize;
+    string CodeField (Record + CODE_POSITION, CODE_WIDTH);
+    char *End;
+    double Code = strtod (CodeField.c_str (), &End);
+    if (End == CodeField.c_str ()) {
+      Block -> Skipped ++;
+      continue;
+    }
+    Block -> Species [lround (Code * 100.0)].append (Record, RecordSize);
+  }
+  Block -> Status = LC_NO_ERROR;
+}
+
+
+//------------------------------------------------------------------------------
+// writeSpecies (map <long, SpeciesList> &, long, string &, string,
+// set <long> &) : Appends the records at arg3 to the list for the species with
+// code arg2 in arg1, which is created with the prefix at arg4 if it is not yet
+// there. arg5 holds the codes of the lists that are open. If MAX_OPEN_LISTS
+// are already open, they are closed first. Throws LC_FILE_WRITE_ERROR if the
+// list cannot be written.
+//
+void writeSpecies (map <long, SpeciesList> &Lists, long Code, string &Records,
+  string Prefix, set <long> &Open) throw (int) {
+  map <long, SpeciesList>::iterator List = Lists.find (Code);
+  bool Exists = (List != Lists.end ());
+  if (!Exists) {
+    SpeciesList NewList;
+    NewList.Name = speciesName (Prefix, Code);
+    NewList.File = NULL;
+    NewList.Lines = 0;
+    List = Lists.insert (make_pair (Code, NewList)).first;
+  }
+  SpeciesList &Species = List -> second;
+  if (Species.File == NULL) {
+    if (Open.size () >= MAX_OPEN_LISTS) {
+      for (set <long>::iterator i = Open.begin (); i != Open.end (); i ++) {
+        delete Lists [*i].File;
+        Lists [*i].File = NULL;
+      }
+      Open.clear ();
+    }
+    Species.File = new ofstream (Species.Name.c_str (),
+      Exists ? ios::out|ios::binary|ios::app : ios::out|ios::binary|ios::trunc);
+    Open.insert (Code);
+  }
+  Species.File -> write (Records.data (), Records.length ());
+  if (!Species.File -> good ()) {
+    cout << "Error: Unable to write " << Species.Name << ". Check that you have "
+      << "permission to write to this location." << endl;
+    throw int (LC_FILE_WRITE_ERROR);
+  }
+}
+
+
+//------------------------------------------------------------------------------
+// Main program
+//
+int main (int argc, char *argv[]) {
+  XgMemLimit Budget ("kzsplit");
+  vector <SplitBlock> Blocks;
+  vector <thread> Workers;
+  map <long, SpeciesList> Lists;
+  set <long> Open;
+  ifstream Input;
+  long Skipped = 0;
+
+  // Check the user's command line input
+  try {
+    argc = Budget.parseArgs (argc, argv);
+  } catch (int Err) {
+    return Err;
+  }
+  if (argc != REQUIRED_NUM_ARGS) {
+    showHelp ();
+    return LC_SYNTAX_ERROR;
+  }
+  string InputName = argv [ARG_INPUT];
+  string Prefix = argv [ARG_PREFIX];
+
+  // Print introductory message to the standard output
+  cout << "Kurucz List Splitter " << VERSION
+    << " (built " << __DATE__ << ")" << endl;
+  cout << "--------------------------------------------------------" << endl;
+  cout << "Kurucz list       : " << InputName << endl;
+  cout << "Output lists      : " << Prefix << "<code>.lines" << endl;
+
+  try {
+    // Find the number of records from the size of the list. The last record
+    // may be missing its line ending.
+    Input.open (InputName.c_str (), ios::in|ios::binary);
+    if (!Input.is_open ()) {
+      cout << "Error: Unable to open " << InputName << ". Check the file exists "
+        << "and that you have permission to read it." << endl;
+      throw int (LC_FILE_OPEN_ERROR);
+    }
+    size_t RecordSize = recordSize (Input, InputName);
+    Input.close ();
+    size_t FileSize = XgMemLimit::fileSize (InputName);
+    if (FileSize % RecordSize != 0 && (FileSize + 1) % RecordSize != 0) {
+      cout << "Error: The records of " << InputName << " are not all "
+        << KZ_RECORD_LENGTH << " characters long." << endl;
+      throw int (LC_FILE_READ_ERROR);
+    }
+    long NumRecords = (FileSize + 1) / RecordSize;
+    long NumBlocks = (NumRecords + BLOCK_RECORDS - 1) / BLOCK_RECORDS;
+
+    // Run one block per thread, as many as the budget allows. Each thread holds
+    // its block as read and as sorted by species.
+    unsigned int NumWorkers = thread::hardware_concurrency ();
+    if (NumWorkers == 0) NumWorkers = 1;
+    if (long (NumWorkers) > NumBlocks) NumWorkers = NumBlocks;
+    if (NumWorkers == 0) NumWorkers = 1;
+    NumWorkers = Budget.threads (2 * BLOCK_RECORDS * RecordSize, NumWorkers);
+    Blocks.resize (NumWorkers);
+    cout << "Splitting " << NumRecords << " records, in " << NumBlocks
+      << " blocks of " << BLOCK_RECORDS << " records on " << NumWorkers
+      << " thread" << (NumWorkers == 1 ? "" : "s") << "..." << endl;
+
+    // Split the blocks a round at a time. The blocks of each round are split in
+    // parallel, and then their records appended to the species lists in order.
+    for (long Round = 0; Round < NumBlocks; Round += NumWorkers) {
+      unsigned int NumInRound = min (long (NumWorkers), NumBlocks - Round);
+      for (unsigned int i = 0; i < NumInRound; i ++) {
+        Blocks[i].First = (Round + i) * BLOCK_RECORDS;
+        Blocks[i].Count = min (long (BLOCK_RECORDS), NumRecords - Blocks[i].First);
+        Workers.push_back (thread (splitBlock, &Blocks[i], InputName, RecordSize));
+      }
+      for (unsigned int i = 0; i < Workers.size (); i ++) Workers[i].join ();
+      Workers.clear ();
+      for (unsigned int i = 0; i < NumInRound; i ++) {
+        XgTraceSpan Span ("write block");
+        if (Blocks[i].Status != LC_NO_ERROR) {
+          cout << "Error: Unable to read records " << Blocks[i].First + 1
+            << " to " << Blocks[i].First + Blocks[i].Count << " of "
+            << InputName << endl;
+          throw int (Blocks[i].Status);
+        }
+        Skipped += Blocks[i].Skipped;
+        for (map <long, string>::iterator j = Blocks[i].Species.begin ();
+          j != Blocks[i].Species.end (); j ++) {
+          writeSpecies (Lists, j -> first, j -> second, Prefix, Open);
+          Lists [j -> first].Lines += j -> second.length () / RecordSize;
+        }
+        Blocks[i].Species.clear ();
+      }
+    }
+
+    // Close the species lists and summarise them
+    for (map <long, SpeciesList>::iterator i = Lists.begin ();
+      i != Lists.end (); i ++) {
+      if (i -> second.File != NULL) {
+        i -> second.File -> close ();
+        delete i -> second.File;
+      }
+      char Code [32];
+      snprintf (Code, sizeof (Code), "%7.2f", i -> first / 100.0);
+      cout << Code << " : " << i -> second.Lines << " lines saved to "
+        << i -> second.Name << endl;
+    }
+    if (Skipped > 0) {
+      cout << "Warning: " << Skipped << " records had no species code, and "
+        << "were not saved" << endl;
+    }
+  } catch (int Err) {
+    return Err;
+  }
+  Budget.report ();
+  return LC_NO_ERROR;
+}
@@ -16,12 +16,21 @@
 //
 
 #include "line.h"
+#include "fixedformat.h"
 #include <iostream>
 #include <sstream>
 #include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
 
 #define XG_OVERLOAD "**********"
 
+// Column names used in error messages for the fields that are parsed lazily
+static const char *LazyFieldName [LINE_NUM_LAZY_FIELDS] = { "dmp", "eqwidth",
+  "itn", "h", "tags", "epstot", "epsevn", "epsodd", "epsran", "id", 
+  "wavelength" };
+
 //------------------------------------------------------------------------------
 // Default Line constructor : Sets all the line properties to default values
 //
@@ -30,6 +39,7 @@ Line::Line () {
   Dmp = 0.0; EqWidth = 0.0; EpsTot = 0.0; EpsEvn = 0.0; EpsOdd = 0.0; 
   EpsRan = 0.0; Wavelength = 0.0; Tags = '.'; Identification = "";
   WavenumberCorrection = 0.0; AirCorrection = 0.0; IntensityCalibration = 0.0;
+  Pending = 0; RawWavCorr = 0.0; Modified = false;
 }
 
 
@@ -48,41 +58,16 @@ Line::Line (string LineData, double NewWaveCorr, double NewAirCorr,
 
 
 //------------------------------------------------------------------------------
-// Line = operator : Copies the operator Line into the current class instance
-//
-void Line::operator= (Line Operator) {
-  Index = Operator.line ();
-  Itn = Operator.itn ();
-  H = Operator.h ();
-  Wavenumber = Operator.wavenumber ();
-  Peak = Operator.peak ();
-  Width = Operator.width ();
-  Dmp = Operator.dmp ();
-  EqWidth = Operator.eqwidth ();
-  EpsTot = Operator.epstot ();
-  EpsEvn = Operator.epsevn ();
-  EpsOdd = Operator.epsodd ();
-  EpsRan = Operator.epsran ();
-  Wavelength = Operator.wavelength ();
-  Tags = Operator.tags ();
-  Identification = Operator.id ();
-  WavenumberCorrection = Operator.wavCorr ();
-  AirCorrection = Operator.airCorrection ();
-  IntensityCalibration = Operator.intensityCalibration ();
-}
-
-//------------------------------------------------------------------------------
-// checkInput (isstringstream &, const char *) : If a read error occurs in the
-// createLine function below, checkInput is called to examine the failed input.
+// checkInput (const char *, const char *) : If a column cannot be read by the
+// createLine function below, checkInput is called to examine the text at arg1.
 // If the error was caused by XGremlin writing ********** in a column rather
 // than a real value, a warning is printed and input is allowed to continue. Any
 // other error will cause an exception to be thrown.
 //
-void Line::checkInput (istringstream &iss, const char* Err) throw (const char *) {
-  iss.clear ();
-  string TestInput;
-  iss >> TestInput;
-  if (TestInput == XG_OVERLOAD) {
+void Line::checkInput (const char *Token, const char* Err) throw (const char *) {
+  size_t Len = strlen (XG_OVERLOAD);
+  if (strncmp (Token, XG_OVERLOAD, Len) == 0 
+    && (Token [Len] == '\0' || isspace (Token [Len]))) {
     cout << "Warning: " << XG_OVERLOAD << " has been found in the " << Err
       << " column. A value of zero has been taken instead." << endl;
     return;
@@ -93,46 +78,150 @@ void Line::checkInput (istringstream &iss, const char* Err) throw (const char *)
 
 
 //------------------------------------------------------------------------------
-// createLine (string) : Creates a Line from an XGremlin "writelines" string
+// nextToken (const char *, unsigned int &) : Skips any whitespace at position
+// Pos in the string at arg1 and returns the start of the token that follows.
+// Pos is left at the end of that token.
+//
+static unsigned int nextToken (const char *Str, unsigned int &Pos) {
+  while (isspace (Str [Pos])) Pos ++;
+  unsigned int Start = Pos;
+  while (Str [Pos] != '\0' && !isspace (Str [Pos])) Pos ++;
+  return Start;
+}
+
+
+//------------------------------------------------------------------------------
+// nextNumber (const char *, unsigned int &, bool) : Skips any whitespace at 
+// position Pos in the string at arg1 and returns the start of the number that
+// follows, leaving Pos at its end. Only integers are accepted if arg3 is true.
+// XGremlin may run adjacent columns together (e.g. 1.0e-04-2.0e-01), so the
+// end of the number is found from its format rather than the next whitespace.
+// If no number is found, Pos is left at the start of the token.
+//
+static unsigned int nextNumber (const char *Str, unsigned int &Pos, 
+  bool Integer) {
+  while (isspace (Str [Pos])) Pos ++;
+  unsigned int Start = Pos;
+  unsigned int Digits = 0;
+  if (Str [Pos] == '-' || Str [Pos] == '+') Pos ++;
+  while (isdigit (Str [Pos]) || (!Integer && Str [Pos] == '.')) {
+    if (Str [Pos] != '.') Digits ++;
+    Pos ++;
+  }
+  if (Digits == 0) { Pos = Start; return Start; }
+  if (!Integer && (Str [Pos] == 'e' || Str [Pos] == 'E')) {
+    unsigned int Exponent = Pos ++;
+    if (Str [Pos] == '-' || Str [Pos] == '+') Pos ++;
+    if (!isdigit (Str [Pos])) { Pos = Exponent; return Start; }
+    while (isdigit (Str [Pos])) Pos ++;
+  }
+  return Start;
+}
+
+
+//------------------------------------------------------------------------------
+// createLine (string) : Creates a Line from an XGremlin "writelines" string.
+// The index, wavenumber, peak and width are read immediately. The remaining
+// columns are located and checked, but are only parsed by parseField() when
+// first accessed.
 //
 void Line::createLine (string LineString) throw (const char*) {
-  istringstream iss;
-  iss.str (LineString);
-  char IdCharString [LINE_ID_STRING_LEN];
-
-  // Read the contents of the Line string
-  iss >> skipws >> Index; if (iss.fail ()) { Index = 0; checkInput (iss, "index"); }
-  iss >> Wavenumber; if (iss.fail ()) { Wavenumber = 0.0; checkInput (iss, "wavenumber"); }
-  iss >> Peak; if (iss.fail ()) { Peak = 0.0; checkInput (iss, "peak height"); }
-  iss >> Width; if (iss.fail ()) { Width = 0.0; checkInput (iss, "width"); }
-  iss >> Dmp; if (iss.fail ()) { Dmp = 0.0; checkInput (iss, "dmp"); }
-  iss >> EqWidth; if (iss.fail ()) { EqWidth = 0.0; checkInput (iss, "eqwidth"); }
-  iss >> Itn; if (iss.fail ()) { Itn = 0; checkInput (iss, "itn"); }
-  iss >> H; if (iss.fail ()) { H = 0; checkInput (iss, "h"); }
-  iss >> Tags; if (iss.fail ()) if (iss.fail ()) throw ("tags");
-  iss >> EpsTot; if (iss.fail ()) { EpsTot = 0.0; checkInput (iss, "epstot"); }
-  iss >> EpsEvn; if (iss.fail ()) { EpsEvn = 0.0; checkInput (iss, "epsevn"); }
-  iss >> EpsOdd; if (iss.fail ()) { EpsOdd = 0.0; checkInput (iss, "epsodd"); }
-  iss >> EpsRan; if (iss.fail ()) { EpsRan = 0.0; checkInput (iss, "epsran"); }
-  iss >> ws;
+  unsigned int Pos = 0, Start;
+  
+  RawText.swap (LineString);
+  RawWavCorr = WavenumberCorrection;
+  Modified = false;
+  Pending = 0;
+  const char *Str = RawText.c_str ();
+
+  // Read the columns needed by all tools
+  Start = nextNumber (Str, Pos, true);
+  Index = strtol (Str + Start, NULL, 10);
+  if (Pos == Start) { 
+    Index = 0; checkInput (Str + Start, "index"); nextToken (Str, Pos); 
+  }
+  Start = nextNumber (Str, Pos, false);
+  Wavenumber = strtod (Str + Start, NULL);
+  if (Pos == Start) { 
+    Wavenumber = 0.0; checkInput (Str + Start, "wavenumber"); nextToken (Str, Pos); 
+  }
+  Start = nextNumber (Str, Pos, false);
+  Peak = strtod (Str + Start, NULL);
+  if (Pos == Start) { 
+    Peak = 0.0; checkInput (Str + Start, "peak height"); nextToken (Str, Pos); 
+  }
+  Start = nextNumber (Str, Pos, false);
+  Width = strtod (Str + Start, NULL);
+  if (Pos == Start) { 
+    Width = 0.0; checkInput (Str + Start, "width"); nextToken (Str, Pos); 
+  }
   
-  // Read the line identification field based on a fixed length string. This is 
+  // Record the positions of all the other columns up to the line ID. A column
+  // that does not hold a number is checked now so that errors are still found
+  // as the file is read. An XGremlin overload is parsed later as zero.
+  for (int Field = LINE_FIELD_DMP; Field <= LINE_FIELD_EPSRAN; Field ++) {
+    if (Field == LINE_FIELD_TAGS) {
+      FieldPos [Field] = nextToken (Str, Pos);
+      if (Str [FieldPos [Field]] == '\0') throw ("tags");
+      Pos = FieldPos [Field] + 1;
+    } else {
+      FieldPos [Field] = nextNumber (Str, Pos, 
+        Field == LINE_FIELD_ITN || Field == LINE_FIELD_H);
+      if (Pos == FieldPos [Field]) {
+        checkInput (Str + FieldPos [Field], LazyFieldName [Field]);
+        nextToken (Str, Pos);
+      }
+    }
+  }
+  
+  // The line identification field is based on a fixed length string. This is 
   // needed as the field may contain several words that could be interpreted as
-  // multiple fields in a simple istringstream input operation.
-  iss.get (IdCharString, LINE_ID_STRING_LEN);
-  Identification = IdCharString;
-  iss >> Wavelength; if (iss.fail ()) { Wavelength = 0.0; checkInput (iss, "wavelength"); }
-
-  // Remove whitespace at the end of the ID string
-  for (int i = Identification.length () - 1; i >= 0; i --) {
-    if (Identification [i] == ' ') Identification.erase (i);
-    else break;
+  // multiple fields if the row were simply split at whitespace.
+  while (isspace (Str [Pos])) Pos ++;
+  FieldPos [LINE_FIELD_ID] = Pos;
+  Pos += min (RawText.length () - Pos, size_t (LINE_ID_STRING_LEN - 1));
+  FieldPos [LINE_FIELD_WAVELENGTH] = nextNumber (Str, Pos, false);
+  if (Pos == FieldPos [LINE_FIELD_WAVELENGTH]) {
+    checkInput (Str + FieldPos [LINE_FIELD_WAVELENGTH], "wavelength");
   }
+  Pending = (1 << LINE_NUM_LAZY_FIELDS) - 1;
   
   // Finally,remove the wavenumber correction from the internally stored params.
   Wavenumber /= 1.0 + WavenumberCorrection;
   Width /= 1.0 + WavenumberCorrection;
-  Wavelength *= 1.0 + WavenumberCorrection;
+}
+
+
+//------------------------------------------------------------------------------
+// parseField (int) : Parses the column at arg1 from the original row text. This
+// is called the first time that column is accessed. The column has already been
+// checked by createLine(), so no further error checking is needed.
+//
+void Line::parseField (int Field) {
+  const char *Str = RawText.c_str () + FieldPos [Field];
+  switch (Field) {
+    case LINE_FIELD_DMP: Dmp = strtod (Str, NULL); break;
+    case LINE_FIELD_EQWIDTH: EqWidth = strtod (Str, NULL); break;
+    case LINE_FIELD_ITN: Itn = strtol (Str, NULL, 10); break;
+    case LINE_FIELD_H: H = strtol (Str, NULL, 10); break;
+    case LINE_FIELD_TAGS: Tags = Str [0]; break;
+    case LINE_FIELD_EPSTOT: EpsTot = strtod (Str, NULL); break;
+    case LINE_FIELD_EPSEVN: EpsEvn = strtod (Str, NULL); break;
+    case LINE_FIELD_EPSODD: EpsOdd = strtod (Str, NULL); break;
+    case LINE_FIELD_EPSRAN: EpsRan = strtod (Str, NULL); break;
+    case LINE_FIELD_ID:
+      Identification = RawText.substr (FieldPos [Field], LINE_ID_STRING_LEN - 1);
+      // Remove whitespace at the end of the ID string
+      for (int i = Identification.length () - 1; i >= 0; i --) {
+        if (Identification [i] == ' ') Identification.erase (i);
+        else break;
+      }
+      break;
+    case LINE_FIELD_WAVELENGTH:
+      Wavelength = strtod (Str, NULL) * (1.0 + RawWavCorr);
+      break;
+  }
+  Pending &= ~(1 << Field);
 }
 
 
@@ -142,6 +231,7 @@ void Line::createLine (string LineString) throw (const char*) {
 // std::cout by default.
 //
 void Line::print (ostream& Output) {
+  parseAll ();
   Output << "Line " << Index << " (" << Identification << "):" << endl;
   Output.precision (6);
   Output << " Wavenumber : " << fixed << Wavenumber << endl;
@@ -168,40 +258,56 @@ void Line::print (ostream& Output) {
 // use with XGremlin's readlines command in 'syn' mode. 
 //
 string Line::getLineSynString () {
-  ostringstream oss;
-  oss.width (15); oss << left << Identification << "  ";
-  oss.width (12); oss.precision (5); oss << fixed << right << wavenumber ();
-  oss.width (10); oss.precision (4); oss << right << peak ();
-  oss.width (9);  oss.precision (2); oss << right << width ();
-  oss.width (8);  oss.precision (4); oss << right << dmp ();
-  return oss.str();
+  FixedRecord Record (SynFormat);
+  Record.put (id ());
+  Record.put (wavenumber ());
+  Record.put (peak ());
+  Record.put (width ());
+  Record.put (dmp ());
+  return Record.str ();
 }
 
 
 //------------------------------------------------------------------------------
 // getLineString () : Returns the line properties in a formatted string matching
-// the XGremlin writelines file format.
+// the XGremlin writelines file format. A line read from a writelines file that
+// has not since been modified is returned exactly as it was read.
 //
 string Line::getLineString () {
-  string IdLong = id();
-  IdLong.resize (LINE_ID_STRING_LEN, ' ');
-  ostringstream oss;
-  oss.width (6);  oss << right << Index << "  ";
-  oss.width (12); oss.precision (6); oss << fixed << right << wavenumber ();
-  oss.width (10); oss.precision (3); oss << scientific << right << peak ();
-  oss.width (9);  oss.precision (2); oss << fixed << right << width ();
-  oss.width (9);  oss.precision (4); oss << fixed << right << dmp ();
-  oss.width (11); oss.precision (4); oss << scientific << right << eqwidth ();
-  oss.width (6); oss << right << itn ();
-  oss.width (4); oss << right << h ();
-  oss.width (5); oss << right << tags ();
-  oss.width (11); oss.precision (4); oss << scientific << right << epstot ();
-  oss.width (11); oss.precision (4); oss << scientific << right << epsevn ();
-  oss.width (11); oss.precision (4); oss << scientific << right << epsodd ();
-  oss.width (11); oss.precision (4); oss << scientific << right << epsran ();
-  oss << left << " " << IdLong;
-  oss.width (11); oss.precision (6); oss << fixed << right << wavelength ();
-  return oss.str();
+  string Row;
+  FixedRecord Record (WritelinesFormat);
+  appendLineString (Row, Record);
+  return Row;
+}
+
+
+//------------------------------------------------------------------------------
+// appendLineString (string &, FixedRecord &) : Appends the writelines row given
+// by getLineString() to arg1, formatting it in the record at arg2, which must
+// have been created with WritelinesFormat.
+//
+void Line::appendLineString (string &Output, FixedRecord &Record) {
+  if (!Modified && RawText.length () > 0 && WavenumberCorrection == RawWavCorr) {
+    Output.append (RawText);
+    return;
+  }
+  Record.clear ();
+  Record.put (line ());
+  Record.put (wavenumber ());
+  Record.put (peak ());
+  Record.put (width ());
+  Record.put (dmp ());
+  Record.put (eqwidth ());
+  Record.put (itn ());
+  Record.put (h ());
+  Record.put (tags ());
+  Record.put (epstot ());
+  Record.put (epsevn ());
+  Record.put (epsodd ());
+  Record.put (epsran ());
+  Record.put (id ());
+  Record.put (wavelength ());
+  Output.append (Record.str ());
 }
 
 
@@ -216,6 +322,30 @@ double Line::getCentroidError (double PointSpacing) {
 }
 
 
+//------------------------------------------------------------------------------
+// getCentroidErrors (const vector <Line> &, vector <double> &, double) : Fills
+// arg2 with the centroid error of each line in arg1, as getCentroidError would
+// give for a point spacing of arg3.
+//
+void Line::getCentroidErrors (const vector <Line> &Lines,
+  vector <double> &Errors, double PointSpacing) {
+  size_t n = Lines.size ();
+  vector <double> Widths (n), Peaks (n);
+  for (size_t i = 0; i < n; i ++) {
+    Widths[i] = Lines[i].Width;
+    Peaks[i] = Lines[i].Peak;
+  }
+  Errors.resize (n);
+  const double *w = n ? &Widths[0] : NULL;
+  const double *p = n ? &Peaks[0] : NULL;
+  double *e = n ? &Errors[0] : NULL;
+  for (size_t i = 0; i < n; i ++) {
+    double PointsInFwhm = w[i] / (1000.0 * PointSpacing);
+    e[i] = w[i] / (1000.0 * sqrt (PointsInFwhm) * p[i]);
+  }
+}
+
+
 //------------------------------------------------------------------------------
 // Line SET functions that require error checking. Simple set functions that can
 // take any value from the input type are in line.h.
@@ -227,6 +357,7 @@ void Line::wavenumber (double NewWavenumber) {
     throw int (LINE_NEGATIVE_WAVENUMBER);
   }
   Wavenumber = NewWavenumber;
+  Modified = true;
 }
 
 void Line::peak (double NewPeakHeight) {
@@ -236,6 +367,7 @@ void Line::peak (double NewPeakHeight) {
     throw int (LINE_NEGATIVE_PEAK);
   }
   Peak = NewPeakHeight;
+  Modified = true;
 }
 
 void Line::width (double NewWidth) {
@@ -245,6 +377,7 @@ void Line::width (double NewWidth) {
     throw int (LINE_NEGATIVE_WIDTH);
   }
   Width = NewWidth;
+  Modified = true;
 }
 
 void Line::eqwidth (double NewEqWidth) {
@@ -254,6 +387,7 @@ void Line::eqwidth (double NewEqWidth) {
     throw int (LINE_NEGATIVE_EQWIDTH);
   }
   EqWidth = NewEqWidth;
+  set (LINE_FIELD_EQWIDTH);
 }
 
 void Line::wavelength (double NewWavelength) {
@@ -263,5 +397,6 @@ void Line::wavelength (double NewWavelength) {
     throw int (LINE_NEGATIVE_WAVELENGTH);
   }
   Wavelength = NewWavelength;
+  set (LINE_FIELD_WAVELENGTH);
 }
 
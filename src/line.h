@@ -41,12 +41,22 @@
 // use with the 'readlines' command. The line properties may also be printed to
 // a specified stream (or standard output by default) with the print() function.
 //
+// To keep large line lists quick to load, createLine() only parses the index,
+// wavenumber, peak and width columns, which are all that most tools need. The
+// row is tokenised in the same pass and the position of every other column is
+// recorded, with each of these columns parsed the first time it is accessed.
+// The original text of the row is also retained, so getLineString() returns it
+// verbatim if the line has not been modified and its wavenumber correction is
+// unchanged. Any SET function marks the line as modified.
+//
 // Finally, getCentroidError(double) can be used to estimate the error in 
 // determining the line centroid, as calculated from the equation given by
 // Brault. This equation requires the line width and S/N ratio, and the spacing
 // between individual data points. This last term isn't a line property given by
 // XGremlin, and so must be passed in at arg1. A default spacing is given by
-// DEF_POINT_SPACING.
+// DEF_POINT_SPACING. getCentroidErrors() finds the same error for every line in
+// a list at once, gathering their widths and peaks into contiguous arrays so
+// that the calculation can be vectorised by the compiler.
 //
 #ifndef LINE_H
 #define LINE_H
@@ -54,6 +64,7 @@
 #include <iostream>
 #include <string>
 #include <sstream>
+#include <vector>
 #include "ErrDefs.h"
 
 // The default spacing between spectru data points, in cm^-1. This is used by
@@ -65,8 +76,36 @@
 // be interpreted as multiple fields in a simple istringstream input operation.
 #define LINE_ID_STRING_LEN 30
 
+// The 'writelines' columns that are parsed on first access rather than when a
+// line is read. These index Line::FieldPos and the bits of Line::Pending.
+#define LINE_FIELD_DMP        0
+#define LINE_FIELD_EQWIDTH    1
+#define LINE_FIELD_ITN        2
+#define LINE_FIELD_H          3
+#define LINE_FIELD_TAGS       4
+#define LINE_FIELD_EPSTOT     5
+#define LINE_FIELD_EPSEVN     6
+#define LINE_FIELD_EPSODD     7
+#define LINE_FIELD_EPSRAN     8
+#define LINE_FIELD_ID         9
+#define LINE_FIELD_WAVELENGTH 10
+#define LINE_NUM_LAZY_FIELDS  11
+
 using namespace::std;
 
+class FixedRecord;
+
+// A structure to store the header from an XGremlin writelines file. This is
+// filled by readLineList() (see lineio.cpp) and can then be passed to 
+// writeLines() to copy the header to an output line list. Each list keeps its
+// own header, so several lists may be read and written at once.
+typedef struct td_WritelinesHeader {
+  string WaveCorr;
+  string AirCorr;
+  string IntCal;
+  string Columns;
+} WritelinesHeader;
+
 class Line {
   public:
   
@@ -75,44 +114,58 @@ class Line {
     Line (string LineData, double NewWaveCorr = 0.0, double NewAirCorr = 0.0, 
       double NewIntCal = 0.0);
     ~Line () {}
+    
+    // Copies keep the original row text, so columns that have not yet been
+    // parsed can still be parsed later.
+    Line (const Line &) = default;
+    Line (Line &&) = default;
+    Line &operator= (const Line &) = default;
+    Line &operator= (Line &&) = default;
   
     // GET functions to access line properties. Apply the wavenumber correction
-    // factor to any properties that require it.
-    int line () { return Index; }
-    int itn () { return Itn; }
-    int h () { return H; }
-    double wavenumber () { return Wavenumber * (1.0 + WavenumberCorrection); }
-    double peak () { return Peak; }
-    double width () { return Width * (1.0 + WavenumberCorrection); }
-    double dmp () { return Dmp; }
-    double eqwidth () { return EqWidth; }
-    double epstot () { return EpsTot; }
-    double epsevn () { return EpsEvn; }
-    double epsodd () { return EpsOdd; }
-    double epsran () { return EpsRan; }
-    double wavelength () { return Wavelength / (1.0 + WavenumberCorrection); }
-    char tags () { return Tags; }
-    string id () { return Identification; }
-    double wavCorr () { return WavenumberCorrection; }
+    // factor to any properties that require it. The columns of a line read from
+    // a writelines row are only parsed when first needed, so the GET functions
+    // that are not const may modify the line. A list of lines shared between
+    // threads must have parseAll() called on every line before the threads
+    // start.
+    int line () const { return Index; }
+    int itn () { need (LINE_FIELD_ITN); return Itn; }
+    int h () { need (LINE_FIELD_H); return H; }
+    double wavenumber () const { return Wavenumber * (1.0 + WavenumberCorrection); }
+    double peak () const { return Peak; }
+    double width () const { return Width * (1.0 + WavenumberCorrection); }
+    double dmp () { need (LINE_FIELD_DMP); return Dmp; }
+    double eqwidth () { need (LINE_FIELD_EQWIDTH); return EqWidth; }
+    double epstot () { need (LINE_FIELD_EPSTOT); return EpsTot; }
+    double epsevn () { need (LINE_FIELD_EPSEVN); return EpsEvn; }
+    double epsodd () { need (LINE_FIELD_EPSODD); return EpsOdd; }
+    double epsran () { need (LINE_FIELD_EPSRAN); return EpsRan; }
+    double wavelength () { 
+      need (LINE_FIELD_WAVELENGTH);
+      return Wavelength / (1.0 + WavenumberCorrection); 
+    }
+    char tags () { need (LINE_FIELD_TAGS); return Tags; }
+    string id () { need (LINE_FIELD_ID); return Identification; }
+    double wavCorr () const { return WavenumberCorrection; }
     double airCorrection () { return AirCorrection; }
     double intensityCalibration () { return IntensityCalibration; }
     
     // SET functions to modify line properties
-    void line (int NewIndex) { Index = NewIndex; }
-    void itn (int NewItn) { Itn = NewItn; }
-    void h (int NewH) { H = NewH; }
+    void line (int NewIndex) { Index = NewIndex; Modified = true; }
+    void itn (int NewItn) { Itn = NewItn; set (LINE_FIELD_ITN); }
+    void h (int NewH) { H = NewH; set (LINE_FIELD_H); }
     void wavenumber (double NewWavenumber);
     void peak (double NewPeakHeight);
     void width (double NewWidth);
-    void dmp (double NewDamping) { Dmp = NewDamping; }
+    void dmp (double NewDamping) { Dmp = NewDamping; set (LINE_FIELD_DMP); }
     void eqwidth (double NewEqWidth);
-    void epstot (double NewEpstot) { EpsTot = NewEpstot; }
-    void epsevn (double NewEpsevn) { EpsEvn = NewEpsevn; }
-    void epsodd (double NewEpsodd) { EpsOdd = NewEpsodd; } 
-    void epsran (double NewEpsran) { EpsRan = NewEpsran; }
+    void epstot (double NewEpstot) { EpsTot = NewEpstot; set (LINE_FIELD_EPSTOT); }
+    void epsevn (double NewEpsevn) { EpsEvn = NewEpsevn; set (LINE_FIELD_EPSEVN); }
+    void epsodd (double NewEpsodd) { EpsOdd = NewEpsodd; set (LINE_FIELD_EPSODD); } 
+    void epsran (double NewEpsran) { EpsRan = NewEpsran; set (LINE_FIELD_EPSRAN); }
     void wavelength (double NewWavelength);
-    void tags (char NewTags) { Tags = NewTags; }
-    void id (string NewId) { Identification = NewId; }
+    void tags (char NewTags) { Tags = NewTags; set (LINE_FIELD_TAGS); }
+    void id (string NewId) { Identification = NewId; set (LINE_FIELD_ID); }
     void wavCorr (double NewCorr){ WavenumberCorrection = NewCorr;}
     void airCorrection (double NewCorrection) { AirCorrection = NewCorrection; }
     void intensityCalibration (double NewCal) { IntensityCalibration = NewCal; }
@@ -121,8 +174,11 @@ class Line {
     // "writelines" output file.
     void createLine (string LineString) throw (const char*);
     
-    // An = operator to copy the contents of one line to another.
-    void operator= (Line Operator);
+    // Parses every column not yet read. A line that has been fully parsed is
+    // not changed by its GET functions, so several threads may read it at once.
+    void parseAll () {
+      for (int Field = 0; Field < LINE_NUM_LAZY_FIELDS; Field ++) need (Field);
+    }
     
     // Output functions. print (...) writes the line properties to a specified
     // stream or to std::cout by default. getLineSynString() and getLineString()
@@ -132,8 +188,15 @@ class Line {
     string getLineSynString ();
     string getLineString ();
     
+    // As getLineString(), but appends the row to arg1 instead of returning it.
+    // The row is formatted in the record at arg2, whose memory is reused when
+    // the same record is passed for each line of a list.
+    void appendLineString (string &Output, FixedRecord &Record);
+    
     // Calculates the error in the line centroid position using the Brault eqn.
     double getCentroidError (double PointsInFwhm = DEF_POINT_SPACING);
+    static void getCentroidErrors (const vector <Line> &Lines,
+      vector <double> &Errors, double PointSpacing = DEF_POINT_SPACING);
     
   private:
     // Line properties. Follows the naming convention used in the XGremlin
@@ -149,10 +212,24 @@ class Line {
     double AirCorrection;
     double IntensityCalibration;
     
-    // If an error is thrown while reading an XGremlin writelines file, check
-    // the nature of the error for known problems. If these can be handled, fix
-    // the problem. If not, continue to throw the error.
-    void checkInput (istringstream &iss, const char* Err) throw (const char *);
+    // The original 'writelines' row, the position in it of each column that is
+    // yet to be parsed, and a bit for each such column. The correction that
+    // applied to the row when read is kept to parse those columns later.
+    string RawText;
+    unsigned int FieldPos [LINE_NUM_LAZY_FIELDS];
+    unsigned int Pending;
+    double RawWavCorr;
+    bool Modified;
+    
+    // Parse a column of RawText on first access, or mark it as set.
+    void need (int Field) { if (Pending & (1 << Field)) parseField (Field); }
+    void set (int Field) { Pending &= ~(1 << Field); Modified = true; }
+    void parseField (int Field);
+    
+    // If a column of an XGremlin writelines file cannot be read, check the
+    // nature of the error for known problems. If these can be handled, fix the
+    // problem. If not, throw the error.
+    void checkInput (const char *Token, const char* Err) throw (const char *);
 };
     
 #endif // LINE_H
@@ -40,16 +40,6 @@
 #include "ErrDefs.h"
 #include "line.h"
 
-// A namespace to store the header from the XGremlin writelines file. This can
-// then be used to copy the header to the output line list in writeLines().
-namespace writelines_header {
-  string WaveCorr;
-  string AirCorr;
-  string IntCal;
-  string Columns;
-}
-
-
 //------------------------------------------------------------------------------
 // getWavCorr (string) : Extracts the wavenumber scaling factor from an XGremlin
 // 'writelines' header. If no scaling was applied to a line list, a value of
@@ -77,13 +67,15 @@ double getWavCorr (string HeaderLine) throw (int) {
     
 
 //------------------------------------------------------------------------------
-// readLineList (string, vector <Line>) : Opens and reads an XGremlin writelines
-// line list. The string from each individual row in the ascii file is passed to
-// the Line object constructor, which extracts the line parameters. The
-// resulting Line object is added to the Line vector at arg2, which, being 
-// passed in by reference, is returned to the calling function.
+// readLineList (string, vector <Line>, WritelinesHeader) : Opens and reads an
+// XGremlin writelines line list. The string from each individual row in the
+// ascii file is passed to the Line object constructor, which extracts the line
+// parameters. The resulting Line object is added to the Line vector at arg2,
+// which, being passed in by reference, is returned to the calling function. The
+// file header is returned in arg3.
 //
-void readLineList (string Filename, vector <Line> *Lines) throw (int) {
+void readLineList (string Filename, vector <Line> *Lines, 
+  WritelinesHeader *Header) throw (int) {
   string LineString;
   double WavCorr = 0.0;
   unsigned int LineCount = XG_WRITELINES_HEADER_LENGTH;
@@ -97,14 +89,14 @@ void readLineList (string Filename, vector <Line> *Lines) throw (int) {
   
   // Extract the data from the line list header
   try {
-    getline (ListFile, writelines_header::WaveCorr); // wavenumber correction
-    WavCorr = getWavCorr (writelines_header::WaveCorr);
+    getline (ListFile, Header -> WaveCorr); // wavenumber correction
+    WavCorr = getWavCorr (Header -> WaveCorr);
     if (ListFile.fail()) throw(" wavenumber correction ");
-    getline (ListFile, writelines_header::AirCorr);  // air correction
+    getline (ListFile, Header -> AirCorr);  // air correction
     if (ListFile.fail()) throw("  air correction ");
-    getline (ListFile, writelines_header::IntCal);   // intensity calibration
+    getline (ListFile, Header -> IntCal);   // intensity calibration
     if (ListFile.fail()) throw(" intensity calibration ");
-    getline (ListFile, writelines_header::Columns);  // column headers
+    getline (ListFile, Header -> Columns);  // column headers
     if (ListFile.fail()) throw(" column headers ");
   } catch (const char* Line) {
     cout << "Error reading" << Line << "from the " << Filename << " header.\n"
@@ -136,38 +128,43 @@ void readLineList (string Filename, vector <Line> *Lines) throw (int) {
 
 
 //------------------------------------------------------------------------------
-// writeLines (vector <Line>, ostream) : Requests the XGremlin writelines string
-// from each Line in the vector at arg1 and sends this string to the stream at
-// arg2.
+// writeLines (vector <Line> &, WritelinesHeader, ostream) : Requests the
+// XGremlin writelines string from each Line in the vector at arg1 and sends this
+// string to the stream at arg3, after the header at arg2. The stream is only
+// flushed once all the lines have been written.
 //
-void writeLines (vector <Line> Lines, ostream &Output = std::cout) throw (const char*) {
+void writeLines (vector <Line> &Lines, WritelinesHeader &Header, 
+  ostream &Output = std::cout) throw (const char*) {
   if (Lines[0].wavCorr () != 0.0) {
     Output << "  WAVENUMBER CORRECTION APPLIED: wavcorr =   " 
       << Lines[0].wavCorr () << endl;
   }
   else {
-    Output << writelines_header::WaveCorr << endl;
+    Output << Header.WaveCorr << endl;
   }
-  Output << writelines_header::AirCorr << endl;
-  Output << writelines_header::IntCal << endl;
-  Output << writelines_header::Columns << endl;
+  Output << Header.AirCorr << endl;
+  Output << Header.IntCal << endl;
+  Output << Header.Columns << endl;
   if (Output.fail()) throw "the file header";
   for (unsigned int i = 0; i < Lines.size (); i ++) {
-    Output << Lines[i].getLineString() << endl;
+    Output << Lines[i].getLineString() << '\n';
     if (Output.fail ()) {
       ostringstream oss;
       oss << "line " << Lines[i].line ();
       throw oss.str().c_str();
     }
   }
+  Output.flush ();
 }
 
 //------------------------------------------------------------------------------
-// writeLines (vector <Line>, string) : Creates an output file stream from
-// the filename specified at arg2, then calls writeLines (vector <Line>,
-// ostream) to output the XGremlin writelines data to this file.
+// writeLines (vector <Line> &, WritelinesHeader, string) : Creates an output
+// file stream from the filename specified at arg3, then calls writeLines (vector
+// <Line> &, WritelinesHeader, ostream) to output the XGremlin writelines data to
+// this file.
 //
-void writeLines (vector <Line> Lines, string Filename) throw (int) {
+void writeLines (vector <Line> &Lines, WritelinesHeader &Header, string Filename) 
+  throw (int) {
   ofstream ListFile (Filename.c_str(), ios::out);
   if (! ListFile.is_open()) {
     cout << "Error: Cannot open " << Filename 
@@ -175,7 +172,7 @@ void writeLines (vector <Line> Lines, string Filename) throw (int) {
     throw int (LC_FILE_OPEN_ERROR);
   }
   try {
-    writeLines (Lines, ListFile);
+    writeLines (Lines, Header, ListFile);
   } catch (const char *Err) {
     cout << "Error writing " << Err << " to " << Filename << 
       ". List writing ABORTED." << endl;
@@ -0,0 +1,224 @@
+// Xgtools
+// Copyright (C) M. P. Ruffoni 2011-2015
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//==============================================================================
+// LinFile class (linfile.cpp)
+//==============================================================================
+
+#include "linfile.h"
+#include "byteorder.h"
+#include <iostream>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static_assert (sizeof (LinRecord) == 80, "LinRecord must match the .lin record");
+
+// Shuffle masks that swap the byte order of the first 48 bytes of a record,
+// which hold all its numeric values. The tags are left in place.
+static const unsigned char LinSwapMasks [3 * BO_MASK_SIZE] = {
+  7, 6, 5, 4, 3, 2, 1, 0, 11, 10, 9, 8, 15, 14, 13, 12, /* sig xint width   */
+  3, 2, 1, 0, 5, 4, 7, 6, 8, 9, 10, 11, 15, 14, 13, 12, /* dmp itn ihold... */
+  3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12  /* epsevn ... spare */
+};
+
+//------------------------------------------------------------------------------
+// linScore (int, int, size_t) : Returns how plausible it is that a .lin file
+// of arg3 bytes has arg1 lines and arg2 bytes given in its header. This is 0
+// if the lines could not fit in the file, 2 if the lines or the byte count
+// match the file size exactly, and 1 otherwise.
+//
+static int linScore (int Lines, int Bytes, size_t FileSize) {
+  if (Lines < 0) return 0;
+  size_t Needed = LIN_HEADER_SIZE + size_t (Lines) * sizeof (LinRecord);
+  if (Needed > FileSize) return 0;
+  if (Needed == FileSize || size_t (Bytes) == FileSize) return 2;
+  return 1;
+}
+
+
+//------------------------------------------------------------------------------
+// open (string) : Opens the .lin file named at arg1, reads its header and
+// finds its byte order. The file is left ready to read the first record.
+//
+void LinFile::open (string Filename) throw (int) {
+  close ();
+  Name = Filename;
+  File.clear ();
+  File.open (Filename.c_str (), ios::in|ios::binary);
+  if (!File.is_open ()) {
+    cout << "Error opening " << Filename << ". File loading aborted." << endl;
+    throw int (LC_FILE_OPEN_ERROR);
+  }
+  File.seekg (0, ios::end);
+  size_t FileSize = File.tellg ();
+  File.seekg (0, ios::beg);
+  File.read (Header, LIN_HEADER_SIZE);
+  if (!File.good ()) {
+    cout << "Error: " << Filename << " is too short to be a LIN file." << endl;
+    close ();
+    throw int (LC_FILE_HEAD_ERROR);
+  }
+
+  // Judge the byte order by which reading of the header fits the file best
+  Swapped = false;
+  int NativeScore = linScore (headerInt (LIN_NUM_LINES_OFFSET),
+    headerInt (LIN_NUM_BYTES_OFFSET), FileSize);
+  Swapped = true;
+  int SwappedScore = linScore (headerInt (LIN_NUM_LINES_OFFSET),
+    headerInt (LIN_NUM_BYTES_OFFSET), FileSize);
+  Swapped = (SwappedScore > NativeScore);
+  if (NativeScore == 0 && SwappedScore == 0) {
+    cout << "Error: The header of " << Filename << " does not give a valid "
+      << "number of lines." << endl;
+    close ();
+    throw int (LC_FILE_HEAD_ERROR);
+  }
+  NumLines = headerInt (LIN_NUM_LINES_OFFSET);
+}
+
+
+//------------------------------------------------------------------------------
+// read (LinRecord *, size_t) : Reads up to arg2 records into the array at
+// arg1 in a single block, swapping them into the native byte order if needed.
+// Returns the number of complete records read.
+//
+size_t LinFile::read (LinRecord *Records, size_t Count) {
+  File.read ((char *) Records, Count * sizeof (LinRecord));
+  size_t NumRead = File.gcount () / sizeof (LinRecord);
+  if (Swapped) swapLinRecords (Records, NumRead);
+  return NumRead;
+}
+
+
+//------------------------------------------------------------------------------
+// headerInt (int), headerFloat (int) : Return the value at byte arg1 of the
+// header, in native byte order.
+//
+int LinFile::headerInt (int Offset) {
+  int Value;
+  memcpy (&Value, Header + Offset, sizeof (int));
+  if (Swapped) swapBytes32 (&Value, 1);
+  return Value;
+}
+
+float LinFile::headerFloat (int Offset) {
+  float Value;
+  memcpy (&Value, Header + Offset, sizeof (float));
+  if (Swapped) swapBytes32 (&Value, 1);
+  return Value;
+}
+
+
+//------------------------------------------------------------------------------
+// editLinRecord (LinRecord *, const LinEdit &, bool) : Applies the edit at arg2
+// to the record at arg1 if it meets the edit's conditions. The record is in the
+// file's byte order, which is foreign if arg3 is true. Values are only written
+// if they change, so that unchanged pages of the file are not rewritten.
+// Returns true if the record was selected.
+//
+static bool editLinRecord (LinRecord *Record, const LinEdit &Edit, bool Swapped) {
+  LinRecord Native;
+  memcpy (&Native, Record, sizeof (LinRecord));
+  if (Swapped) swapLinRecords (&Native, 1);
+  if (Native.wavenumber < Edit.MinSigma || Native.wavenumber > Edit.MaxSigma
+    || fabs (Native.peak) < Edit.MinPeak || fabs (Native.peak) > Edit.MaxPeak
+    || Native.width < Edit.MinWidth || Native.width > Edit.MaxWidth) {
+    return false;
+  }
+  short Hold = Edit.Hold, Itn = Edit.Itn;
+  if (Swapped) {
+    swapBytes16 (&Hold, 1);
+    swapBytes16 (&Itn, 1);
+  }
+  if (Edit.SetHold && Record -> ihold != Hold) Record -> ihold = Hold;
+  if (Edit.SetItn && Record -> itn != Itn) Record -> itn = Itn;
+  if (Edit.SetTags && memcmp (Record -> tags, Edit.Tags, sizeof (Edit.Tags)) != 0) {
+    memcpy (Record -> tags, Edit.Tags, sizeof (Edit.Tags));
+  }
+  return true;
+}
+
+
+//------------------------------------------------------------------------------
+// editLinFile (string, const LinEdit &) : Maps the .lin file named at arg1 into
+// memory and applies the edit at arg2 to each of its lines in place. Returns
+// the number of lines selected by the edit.
+//
+size_t editLinFile (string Filename, const LinEdit &Edit) throw (int) {
+  LinFile Lin;
+  Lin.open (Filename);
+  bool Swapped = Lin.swapped ();
+  size_t NumLines = Lin.numLines ();
+  Lin.close ();
+
+  int File = ::open (Filename.c_str (), O_RDWR);
+  struct stat FileInfo;
+  if (File < 0 || fstat (File, &FileInfo) != 0) {
+    if (File >= 0) ::close (File);
+    cout << "Error: Unable to open " << Filename << " for editing." << endl;
+    throw int (LC_FILE_OPEN_ERROR);
+  }
+  size_t Size = FileInfo.st_size;
+  void *Mapped = mmap (NULL, Size, PROT_READ|PROT_WRITE, MAP_SHARED, File, 0);
+  ::close (File);
+  if (Mapped == MAP_FAILED) {
+    cout << "Error: Unable to map " << Filename << " into memory." << endl;
+    throw int (LC_FILE_OPEN_ERROR);
+  }
+  LinRecord *Records = (LinRecord *) ((char *) Mapped + LIN_HEADER_SIZE);
+
+  // Test only the listed lines if there are any, or else every line
+  size_t NumSelected = 0;
+  if (Edit.Lines.size () > 0) {
+    for (size_t i = 0; i < Edit.Lines.size (); i ++) {
+      if (Edit.Lines[i] < 1 || size_t (Edit.Lines[i]) > NumLines) continue;
+      if (editLinRecord (&Records [Edit.Lines[i] - 1], Edit, Swapped)) NumSelected ++;
+    }
+  } else {
+    for (size_t i = 0; i < NumLines; i ++) {
+      if (editLinRecord (&Records [i], Edit, Swapped)) NumSelected ++;
+    }
+  }
+  munmap (Mapped, Size);
+  return NumSelected;
+}
+
+
+//------------------------------------------------------------------------------
+// swapLinRecords (LinRecord *, size_t) : Swaps the byte order of every value
+// in the arg2 records at arg1, leaving the tags and identifications alone.
+//
+void swapLinRecords (LinRecord *Records, size_t Count) {
+  shuffleRecords (Records, Count, sizeof (LinRecord), LinSwapMasks, 3);
+}
+
+
+//------------------------------------------------------------------------------
+// setLinHeaderCounts (char *, int, int, bool) : Writes arg2 lines and arg3
+// bytes to the .lin header at arg1, swapping them first if arg4 is true.
+//
+void setLinHeaderCounts (char *Header, int NumLines, int NumBytes,
+  bool Swapped) {
+  if (Swapped) {
+    swapBytes32 (&NumLines, 1);
+    swapBytes32 (&NumBytes, 1);
+  }
+  memcpy (Header + LIN_NUM_LINES_OFFSET, &NumLines, sizeof (int));
+  memcpy (Header + LIN_NUM_BYTES_OFFSET, &NumBytes, sizeof (int));
+}
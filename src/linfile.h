@@ -0,0 +1,153 @@
+// Xgtools
+// Copyright (C) M. P. Ruffoni 2011-2015
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//==============================================================================
+// LinFile class (linfile.h)
+//==============================================================================
+// Reads the binary line lists (.lin files) written by XGremlin, in either byte
+// order. A .lin file starts with a header of LIN_HEADER_SIZE bytes, of which
+// the first word is the number of lines in the file and the second the size of
+// the file in bytes. The line records follow, with the layout given in
+// XGremlin's lineio.f:
+//
+//"* variable    type           size/bytes
+// * --------    ----           ----------
+// * sig         real*2         8
+// * xint        real           4
+// * width       real           4
+// * dmping      real           4
+// * itn         integer*2      2
+// * ihold       integer*2      2
+// * tags        character*4    4
+// * epstot      real           4
+// * epsevn      real           4
+// * epsodd      real           4
+// * epsran      real           4
+// * spare       real           4
+// * ident       character*32   32"
+//
+// The byte order of the file is found from the number of lines in the header:
+// read in the wrong byte order, this is either negative or implies a file
+// larger than the one on disk. Records read from a foreign file are swapped
+// into the native byte order a block at a time, so that they can be used as
+// if the file had been written on the same machine.
+//
+// The hold flags, iteration counts and tags of the lines in a .lin file can be
+// changed in place with editLinFile, without XGremlin. The file is mapped into
+// memory and only the records of the lines to be edited are touched, so that
+// the cost of an edit grows with the number of lines it selects rather than
+// the size of the file when the lines are chosen by number.
+//
+#ifndef XG_LIN_FILE_H
+#define XG_LIN_FILE_H
+
+#include <string>
+#include <fstream>
+#include <vector>
+#include <cmath>
+#include <cstring>
+#include "ErrDefs.h"
+
+#define LIN_HEADER_SIZE 320 /* bytes */
+
+// Offsets of the header values used by Xgtools
+#define LIN_NUM_LINES_OFFSET  0
+#define LIN_NUM_BYTES_OFFSET  4
+#define LIN_SCALE_OFFSET      12
+#define LIN_SIG_CORR_OFFSET   16
+
+using namespace::std;
+
+// A single .lin file record
+typedef struct td_LinRecord {
+  double wavenumber;
+  float peak;
+  float width;
+  float dmp;
+  short itn;
+  short ihold;
+  char tags [4];
+  float epstot;
+  float epsevn;
+  float epsodd;
+  float epsran;
+  float spare;
+  char id [32];
+} LinRecord;
+
+class LinFile {
+  public:
+    LinFile () { NumLines = 0; Swapped = false; }
+    ~LinFile () { close (); }
+
+    // Opens the file named at arg1 and reads its header. Throws an error code
+    // from ErrDefs.h if the file cannot be opened or its header is not valid.
+    void open (string Filename) throw (int);
+    void close () { if (File.is_open ()) File.close (); }
+
+    // Read up to arg2 records into arg1, in native byte order, and return the
+    // number of records read
+    size_t read (LinRecord *Records, size_t Count);
+
+    // Functions to access the header
+    int numLines () { return NumLines; }
+    bool swapped () { return Swapped; }
+    float scale () { return headerFloat (LIN_SCALE_OFFSET); }
+    float sigCorrection () { return headerFloat (LIN_SIG_CORR_OFFSET); }
+    char *header () { return Header; }
+
+  private:
+    ifstream File;
+    string Name;
+    char Header [LIN_HEADER_SIZE];
+    int NumLines;
+    bool Swapped;
+    int headerInt (int Offset);
+    float headerFloat (int Offset);
+};
+
+// The lines of a .lin file to be changed by editLinFile, and the changes to make.
+// A line is edited if it meets every condition. Wavenumbers are as stored in
+// the file, before any wavenumber correction, widths are in mK, and the peak
+// condition applies to the magnitude of the peak. Lines are numbered from 1, as
+// in XGremlin, and if any are listed in Lines only those lines are tested.
+typedef struct td_LinEdit {
+  double MinSigma, MaxSigma;
+  double MinPeak, MaxPeak;
+  double MinWidth, MaxWidth;
+  vector <int> Lines;
+  bool SetHold, SetItn, SetTags;
+  short Hold, Itn;
+  char Tags [4];
+  td_LinEdit () : MinSigma (-HUGE_VAL), MaxSigma (HUGE_VAL), MinPeak (0.0),
+    MaxPeak (HUGE_VAL), MinWidth (-HUGE_VAL), MaxWidth (HUGE_VAL),
+    SetHold (false), SetItn (false), SetTags (false), Hold (0), Itn (0) {
+    memset (Tags, ' ', sizeof (Tags));
+  }
+} LinEdit;
+
+// Applies the edit at arg2 in place to the .lin file named at arg1, in either
+// byte order, and returns the number of lines selected. Throws an error code
+// from ErrDefs.h if the file cannot be opened for writing.
+size_t editLinFile (string Filename, const LinEdit &Edit) throw (int);
+
+// Swap the records at arg1 between byte orders
+void swapLinRecords (LinRecord *Records, size_t Count);
+
+// Set the number of lines and bytes in a .lin header of either byte order
+void setLinHeaderCounts (char *Header, int NumLines, int NumBytes, bool Swapped);
+
+#endif // XG_LIN_FILE_H
@@ -18,13 +18,17 @@
 #include <fstream>
 #include <sstream>
 #include <cmath>
+#include <queue>
+#include <algorithm>
+#include <functional>
 #include "listcal.h"
+#include "fixedformat.h"
 #include "lineio.cpp"
 
 //------------------------------------------------------------------------------
 // Default class constructor. Just set default variable values.
 //
-ListCal::ListCal () {
+ListCal::ListCal () : Cache ("ftscalibrate") {
   WaveCorrection = DEF_WAVE_CORRECTION;
   Discriminator = DEF_DISCRIMINATOR;
   PeakAmpThreshold = DEF_PEAK_THRESHOLD;
@@ -36,6 +40,15 @@ ListCal::ListCal () {
   DiffStdDev = 0.0;
   DiffStdErr = 0.0;
   WaveCorrectionError = 0.0;
+  CacheKeySet = false;
+  StandardsMerged = false;
+  StandardsWeighted = false;
+  DuplicateStandards = 0;
+  StandardError = 0.0;
+  ModelType = LC_MODEL_CONSTANT;
+  ModelOrder = 0;
+  ModelMin = 0.0;
+  ModelMax = 0.0;
 }
 
 
@@ -78,35 +91,197 @@ void ListCal::setPointSpacing (double NewPointSpacing) {
   PointSpacing = NewPointSpacing;
 }
 
+
+//------------------------------------------------------------------------------
+// setCorrectionModel (int, unsigned int) : Selects the form of the wavenumber
+// correction factor, epsilon(sigma), that is fitted by findCorrection(). 
+// The available models, given at arg1, are:
+//
+//   LC_MODEL_CONSTANT   : A single scale factor for the whole list (default).
+//   LC_MODEL_POLYNOMIAL : A polynomial in sigma of order arg2.
+//   LC_MODEL_PIECEWISE  : A continuous piecewise linear function with arg2
+//                         equal pieces spanning the fitted lines.
+//
+// For the last two, sigma is first mapped onto [-1, 1] (polynomial) or the
+// knots of the pieces (piecewise) over the wavenumber range of the fitted lines.
+//
+void ListCal::setCorrectionModel (int NewType, unsigned int NewOrder) {
+  if (NewType == LC_MODEL_PIECEWISE && NewOrder == 0) {
+    cout << "Error: A piecewise linear correction needs at least one piece." << endl;
+    throw int (LC_SYNTAX_ERROR);
+  }
+  if (NewType == LC_MODEL_POLYNOMIAL && NewOrder == 0) NewType = LC_MODEL_CONSTANT;
+  ModelType = NewType;
+  ModelOrder = (NewType == LC_MODEL_CONSTANT) ? 0 : NewOrder;
+}
+
+
 //------------------------------------------------------------------------------
 // Line list loading procedures. The actual file input is carried out in 
 // readLineList(). The other two procedures, loadLineList and loadStandardList,
 // act as wrappers so that the correct Line vector is passed to readLineList().
-// These wrappers also store the list names in the class object.
+// These wrappers also store the list names in the class object. Several 
+// standard lists may be loaded, each with its own wavenumber uncertainty in
+// cm^-1 (or 0.0 if the lines are to be fitted without weights). These are
+// merged by mergeStandardLists().
+//
+// The calibrated list of another ListCal may also be used as a standard. Its
+// lines are copied, and its wavenumber correction applied to the copies.
 //
 void ListCal::loadLineList (const char *Filename) {
-  readLineList (Filename, &FullLineList);
+  readLineList (Filename, &FullLineList, &ListHeader);
   LineListName = Filename;
 }
 
-void ListCal::loadStandardList (const char *Filename) {
-  readLineList (Filename, &StandardList);
-  StandardListName = Filename;
+void ListCal::loadStandardList (const char *Filename, double Uncertainty) {
+  WritelinesHeader StandardHeader;
+  if (Uncertainty < 0.0) {
+    cout << "Error: The uncertainty of " << Filename << " must be positive." << endl;
+    throw int(LC_NEGATIVE_VALUE);
+  }
+  StandardSource NewSource;
+  Standards.push_back (NewSource);
+  readLineList (Filename, &Standards.back().Lines, &StandardHeader);
+  Standards.back().Name = Filename;
+  Standards.back().Uncertainty = Uncertainty;
+  if (StandardListName != "") StandardListName += ", ";
+  StandardListName += Filename;
+  StandardsMerged = false;
+}
+
+void ListCal::loadStandardList (ListCal &Calibrated, double Uncertainty) {
+  if (Uncertainty < 0.0) {
+    cout << "Error: The uncertainty of " << Calibrated.LineListName 
+      << " must be positive." << endl;
+    throw int(LC_NEGATIVE_VALUE);
+  }
+  StandardSource NewSource;
+  Standards.push_back (NewSource);
+  Standards.back().Lines = Calibrated.FullLineList;
+  Calibrated.applyCorrection (Standards.back().Lines);
+  Standards.back().Name = Calibrated.LineListName;
+  Standards.back().Uncertainty = Uncertainty;
+  if (StandardListName != "") StandardListName += ", ";
+  StandardListName += Calibrated.LineListName;
+  StandardsMerged = false;
+}
+
+
+//------------------------------------------------------------------------------
+// lowerWavenumber (const Line &, const Line &) : Sort predicate used to order
+// line lists by ascending wavenumber.
+//
+static bool lowerWavenumber (const Line &a, const Line &b) {
+  return a.wavenumber () < b.wavenumber ();
+}
+
+
+//------------------------------------------------------------------------------
+// mergeStandardLists () : Combines all the loaded standard lists into a single
+// list, StandardList, sorted by wavenumber. The lists are merged with a heap of
+// the next unmerged line from each list, so k lists totalling N lines are
+// merged in O(N log k). If a line lies within the discriminator of any line
+// already merged from a different list, they are taken to be the same standard,
+// and only the line with the smaller uncertainty is kept (or that from the list
+// loaded first if the uncertainties are equal). The fit weight of each line is
+// then set from the uncertainty of its list, scaled to the units of dSig/Sig
+// used in the fit. If no uncertainties were given, all weights are 1.0. This is
+// called by findCommonLines() if any new standard lists have been loaded.
+//
+void ListCal::mergeStandardLists () {
+  typedef pair <double, pair <unsigned int, size_t> > MergeEntry;
+  priority_queue <MergeEntry, vector <MergeEntry>, greater <MergeEntry> > Heap;
+  unsigned int NumWeighted = 0;
+  
+  for (unsigned int i = 0; i < Standards.size (); i ++) {
+    vector <Line> &Lines = Standards[i].Lines;
+    if (!is_sorted (Lines.begin (), Lines.end (), lowerWavenumber)) {
+      stable_sort (Lines.begin (), Lines.end (), lowerWavenumber);
+    }
+    if (Lines.size () > 0) {
+      Heap.push (MergeEntry (Lines[0].wavenumber (), make_pair (i, 0)));
+    }
+    if (Standards[i].Uncertainty > 0.0) NumWeighted ++;
+  }
+  if (NumWeighted > 0 && NumWeighted < Standards.size ()) {
+    cout << "Error: An uncertainty must be given for either all or none of the "
+      << "standard line lists." << endl;
+    throw int (LC_SYNTAX_ERROR);
+  }
+  StandardsWeighted = (NumWeighted > 0);
+  
+  StandardList.clear ();
+  StandardWeight.clear ();
+  StandardOrigin.clear ();
+  DuplicateStandards = 0;
+  while (!Heap.empty ()) {
+    unsigned int Source = Heap.top ().second.first;
+    size_t Pos = Heap.top ().second.second;
+    Heap.pop ();
+    if (Pos + 1 < Standards[Source].Lines.size ()) {
+      Heap.push (MergeEntry (Standards[Source].Lines[Pos + 1].wavenumber (), 
+        make_pair (Source, Pos + 1)));
+    }
+    Line &NextLine = Standards[Source].Lines[Pos];
+    
+    // Resolve standards that appear in more than one list. Any line already
+    // merged within the discriminator may be the same standard, not just the
+    // last one, so search back through all of them for the nearest line that
+    // came from a different list. If NextLine replaces it, it is moved to the
+    // end of the merged list to keep that list sorted.
+    size_t Match = StandardList.size ();
+    for (size_t j = StandardList.size (); j > 0 && NextLine.wavenumber ()
+      - StandardList[j - 1].wavenumber () < Discriminator; j --) {
+      if (StandardOrigin[j - 1] != Source) {
+        Match = j - 1;
+        break;
+      }
+    }
+    if (Match < StandardList.size ()) {
+      DuplicateStandards ++;
+      if (Standards[Source].Uncertainty < Standards[StandardOrigin[Match]].Uncertainty) {
+        StandardList.erase (StandardList.begin () + Match);
+        StandardOrigin.erase (StandardOrigin.begin () + Match);
+        StandardList.push_back (NextLine);
+        StandardOrigin.push_back (Source);
+      }
+      continue;
+    }
+    StandardList.push_back (NextLine);
+    StandardOrigin.push_back (Source);
+  }
+  
+  StandardWeight.resize (StandardList.size (), 1.0);
+  vector <double> Wavenumbers (StandardList.size ());
+  for (unsigned int i = 0; i < StandardList.size (); i ++) {
+    Wavenumbers[i] = StandardList[i].wavenumber ();
+    if (StandardsWeighted) {
+      StandardWeight[i] = pow (LC_DATA_SCALE 
+        * Standards[StandardOrigin[i]].Uncertainty / Wavenumbers[i], -2);
+    }
+  }
+  StandardIndex.build (Wavenumbers);
+  StandardsMerged = true;
 }
 
 
 //------------------------------------------------------------------------------
-// findCommonLines (bool) ; Scans through the uncalibrated and standard line
-// lists, searching for lines common to both. When a common line is found, a new
+// findCommonLines (bool) ; Scans through the uncalibrated line list, searching
+// the standard line list for lines common to both. The standard list is
+// accessed through StandardIndex, so the search for each line jumps directly to
+// the first candidate standard instead of stepping through all the standard
+// lines between it and the previous match. When a common line is found, a new
 // LinePair is created with pointers to its location in each of the two lists.
 // This is then pushed onto the CommonLines class vector.
 //
 void ListCal::findCommonLines (bool Verbose) {
-  unsigned int ListIndex = 0;
-  unsigned int StdIndex = 0;
+  unsigned int ListIndex;
+  size_t StdRank = 0;
+  size_t NextRank;
   double Difference;
   LinePair NewLinePair;
 
+  if (!StandardsMerged) mergeStandardLists ();
   if (FullLineList.size () == 0 || StandardList.size () == 0) {
     throw int (LC_NO_DATA);
   }
@@ -116,30 +291,40 @@ void ListCal::findCommonLines (bool Verbose) {
     cout << "Index" << '\t' << "Wavenumber (K)" << '\t' << "Peak Height" << '\t' << "Ref Wavenumber (K)" << endl;
   }
   CommonLines.clear ();
-  while (ListIndex < FullLineList.size () && StdIndex < StandardList.size ()) {
-    Difference = 
-      StandardList[StdIndex].wavenumber() - FullLineList[ListIndex].wavenumber();
+  for (ListIndex = 0; ListIndex < FullLineList.size () 
+    && StdRank < StandardIndex.size (); ListIndex ++) {
+    // Find the first standard line that is not below the discriminator window
+    NextRank = StandardIndex.lowerBound 
+      (FullLineList[ListIndex].wavenumber() - Discriminator);
+    if (NextRank < StdRank) NextRank = StdRank;
+    while (NextRank < StandardIndex.size () && StandardIndex.wavenumber (NextRank)
+      <= FullLineList[ListIndex].wavenumber() - Discriminator) {
+      NextRank ++;
+    }
+    if (Verbose) {
+      // Any standard lines skipped over are missing from the experiment
+      for (; StdRank < NextRank; StdRank ++) {
+        Line &Absent = StandardList[StandardIndex.line (StdRank)];
+        cout << "Reference line " << Absent.line() << " (" 
+          << Absent.wavenumber() << "K) is absent from the experiment." << endl;
+      }
+    }
+    StdRank = NextRank;
+    if (StdRank == StandardIndex.size ()) break;
+    
+    Difference = StandardIndex.wavenumber (StdRank) 
+      - FullLineList[ListIndex].wavenumber();
     if (abs(Difference) < Discriminator) {
       // A common line has been found.
       NewLinePair.List = &FullLineList[ListIndex];
-      NewLinePair.Standard = &StandardList[StdIndex];
+      NewLinePair.Standard = &StandardList[StandardIndex.line (StdRank)];
+      NewLinePair.Weight = StandardWeight[StandardIndex.line (StdRank)];
       CommonLines.push_back (NewLinePair);
       if (Verbose) { 
         cout << NewLinePair.List -> line() << '\t' << NewLinePair.List -> wavenumber() << '\t' << '\t'
           << NewLinePair.List -> peak() << '\t' << '\t' << NewLinePair.Standard -> wavenumber() << endl;
       }
-      StdIndex ++;
-      ListIndex ++;
-    } else if (StandardList[StdIndex].wavenumber() < FullLineList[ListIndex].wavenumber()) {
-      // One of the standard lines is missing from the experiment
-      if (Verbose) {
-        cout << "Reference line " << StandardList[StdIndex].line() << " (" 
-          << StandardList[StdIndex].wavenumber() << "K) is absent from the experiment." << endl;
-      }
-      StdIndex ++;
-    } else {
-      // One of the experiment lines is missing from the standard
-      ListIndex ++;
+      StdRank ++;
     }
   }
   if (CommonLines.size () == 0) { 
@@ -176,10 +361,11 @@ void ListCal::findFittedLines (bool Verbose) {
       }
     }
   }
-  if (Verbose) 
+  if (Verbose) {
     cout.unsetf (ios_base::fixed);
     cout.precision (6);
     cout << "------------------------------------------" << endl << endl;
+  }
 }
 
 
@@ -193,7 +379,8 @@ int ListCal::removeBadLines (bool Verbose) {
   double Difference = 0.0;
   int LinesRemoved = 0;
   for (int i = (int)FittedLines.size () - 1; i >= 0; i --) {
-    Difference = (FittedLines[i] -> List-> wavenumber() * (1.0 + WaveCorrection) -
+    Difference = (FittedLines[i] -> List-> wavenumber() 
+      * (1.0 + correction (FittedLines[i] -> List -> wavenumber())) -
       FittedLines[i] -> Standard -> wavenumber()) * LC_DATA_SCALE;
     Difference /= FittedLines[i]->Standard->wavenumber();
     if (abs(Difference) > abs(DiffMean) + DiscardLimit * DiffStdDev) {
@@ -231,9 +418,15 @@ int ListCal::printLineList (vector <Line> LineList) {
 // in FittedLines to the wavenumbers in the user-specified calibration standard.
 // The result is the optimal wavenumber correction factor for the uncalibrated
 // data, which is stored in the class variable WaveCorrection. Information about
-// the fit residuals are saved by calling calcDiffStats().
+// the fit residuals are saved by calling calcDiffStats(). If a polynomial or
+// piecewise linear correction model has been selected, the fit is instead 
+// performed by findModelCorrection().
 //
-void ListCal::findCorrection () {
+void ListCal::findCorrection (bool Verbose) {
+  if (ModelType != LC_MODEL_CONSTANT) {
+    findModelCorrection (Verbose);
+    return;
+  }
 
   // Prepare the GSL Solver and associated objects. A non-linear solver is used,
   // the precise type of which is determined by SOLVER_TYPE, defined in 
@@ -283,18 +476,22 @@ void ListCal::findCorrection () {
   double dof = NumLines - double(NumParameters);
   double c = chi / sqrt (dof);
   
-  cout << "Correction factor: " << FIT(0) << " +/- " << c*ERR(0) << " ("
-    << "reduced chi^2 = " << pow(chi, 2) / dof << ", "
-    << "lines fitted = " << NumLines << ", c = " << c << ")" << endl;
+  if (Verbose) {
+    cout << "Correction factor: " << FIT(0) << " +/- " << c*ERR(0) << " ("
+      << "reduced chi^2 = " << pow(chi, 2) / dof << ", "
+      << "lines fitted = " << NumLines << ", c = " << c << ")" << endl;
+  }
 
   // Apply the wavenumber correction to all the lines loaded from the
   // uncalibrated spectrum
   WaveCorrection = FIT(0);
   WaveCorrectionError = c*ERR(0);
   calcDiffStats ();
-  cout << "dSig/Sig Mean Residual: " << DiffMean / LC_DATA_SCALE 
-    << ", StdDev: " << DiffStdDev / LC_DATA_SCALE
-    << ", StdErr: " << DiffStdErr / LC_DATA_SCALE << endl;
+  if (Verbose) {
+    cout << "dSig/Sig Mean Residual: " << DiffMean / LC_DATA_SCALE 
+      << ", StdDev: " << DiffStdDev / LC_DATA_SCALE
+      << ", StdErr: " << DiffStdErr / LC_DATA_SCALE << endl;
+  }
 
   // Clean up the memory and exit
   gsl_multifit_fdfsolver_free (Solver);
@@ -302,6 +499,239 @@ void ListCal::findCorrection () {
 }
 
 
+//------------------------------------------------------------------------------
+// findModelCorrection () : Fits a polynomial or piecewise linear correction
+// model to the lines in FittedLines. Both models are linear in their 
+// coefficients, so the least-squares solution is found in a single pass over
+// the fitted lines by accumulating the normal equations, (A^T W A) c = A^T W y,
+// which are then solved by Cholesky decomposition. The residuals are the same
+// weighted dSig/Sig differences used by fitFn(). As with the constant model,
+// the covariance of the coefficients is scaled by the reduced chi^2. For
+// display and for transferring the calibration, WaveCorrection is set to the
+// correction at the centre of the fitted wavenumber range.
+//
+void ListCal::findModelCorrection (bool Verbose) {
+  const size_t NumParameters = numModelParameters ();
+  const size_t NumLines = FittedLines.size ();
+  vector <double> Basis;
+  double Sigma, Std, Root, a, y, Residual, ChiSq = 0.0;
+  
+  // Find the wavenumber range of the fitted lines to define the model basis
+  if (NumLines == 0) throw int (LC_NO_DATA);
+  ModelMin = ModelMax = FittedLines[0] -> List -> wavenumber ();
+  for (unsigned int i = 1; i < NumLines; i ++) {
+    ModelMin = min (ModelMin, FittedLines[i] -> List -> wavenumber ());
+    ModelMax = max (ModelMax, FittedLines[i] -> List -> wavenumber ());
+  }
+  if (NumLines <= NumParameters || ModelMax <= ModelMin) {
+    cout << "Error: Too few lines remain to fit a correction model with " 
+      << NumParameters << " parameters." << endl;
+    throw int (LC_NO_DATA);
+  }
+  if (ModelType == LC_MODEL_PIECEWISE) {
+    vector <unsigned int> LinesInPiece (ModelOrder, 0);
+    for (unsigned int i = 0; i < NumLines; i ++) {
+      unsigned int Piece = (unsigned int)((FittedLines[i] -> List -> wavenumber ()
+        - ModelMin) / (ModelMax - ModelMin) * ModelOrder);
+      LinesInPiece [min (Piece, ModelOrder - 1)] ++;
+    }
+    for (unsigned int i = 0; i < ModelOrder; i ++) {
+      if (LinesInPiece[i] < 2) {
+        cout << "Error: Piece " << i + 1 << " of the piecewise linear correction"
+          << " contains fewer than 2 fitted lines. Use fewer pieces." << endl;
+        throw int (LC_NO_DATA);
+      }
+    }
+  }
+  
+  // Accumulate the normal equations
+  gsl_matrix *Normal = gsl_matrix_calloc (NumParameters, NumParameters);
+  gsl_vector *Target = gsl_vector_calloc (NumParameters);
+  gsl_vector *Coeffs = gsl_vector_alloc (NumParameters);
+  for (unsigned int i = 0; i < NumLines; i ++) {
+    Sigma = FittedLines[i] -> List -> wavenumber ();
+    Std = FittedLines[i] -> Standard -> wavenumber ();
+    Root = sqrt (FittedLines[i] -> Weight);
+    a = Sigma / Std * LC_DATA_SCALE * Root;
+    y = (Std - Sigma) / Std * LC_DATA_SCALE * Root;
+    modelBasis (Sigma, Basis);
+    for (unsigned int j = 0; j < NumParameters; j ++) {
+      if (Basis[j] == 0.0) continue;
+      *gsl_vector_ptr (Target, j) += a * Basis[j] * y;
+      for (unsigned int k = 0; k < NumParameters; k ++) {
+        *gsl_matrix_ptr (Normal, j, k) += a * a * Basis[j] * Basis[k];
+      }
+    }
+  }
+  
+  // Solve for the coefficients, then replace the normal matrix by its inverse.
+  // If the lines do not constrain every coefficient the normal matrix is not
+  // positive definite, so turn off the GSL error handler, which would abort,
+  // and report the failure instead. The previous handler is restored after.
+  gsl_error_handler_t *OldHandler = gsl_set_error_handler_off ();
+  int Status = gsl_linalg_cholesky_decomp (Normal);
+  if (Status == GSL_SUCCESS) {
+    Status = gsl_linalg_cholesky_solve (Normal, Target, Coeffs);
+  }
+  if (Status == GSL_SUCCESS) Status = gsl_linalg_cholesky_invert (Normal);
+  gsl_set_error_handler (OldHandler);
+  if (Status != GSL_SUCCESS) {
+    gsl_matrix_free (Normal);
+    gsl_vector_free (Target);
+    gsl_vector_free (Coeffs);
+    cout << "Error: The fitted lines do not constrain every coefficient of the "
+      << "correction model. Use a lower order or fewer pieces." << endl;
+    throw int (LC_NO_DATA);
+  }
+  ModelCoeffs.resize (NumParameters);
+  for (unsigned int j = 0; j < NumParameters; j ++) {
+    ModelCoeffs[j] = gsl_vector_get (Coeffs, j);
+  }
+  
+  // Scale the covariance matrix by the reduced chi^2 of the fit
+  for (unsigned int i = 0; i < NumLines; i ++) {
+    Sigma = FittedLines[i] -> List -> wavenumber ();
+    Std = FittedLines[i] -> Standard -> wavenumber ();
+    Residual = (Sigma * (1.0 + correction (Sigma)) - Std) * LC_DATA_SCALE / Std;
+    ChiSq += pow (Residual, 2) * FittedLines[i] -> Weight;
+  }
+  double dof = NumLines - double(NumParameters);
+  ModelCovariance.resize (NumParameters * NumParameters);
+  for (unsigned int j = 0; j < NumParameters; j ++) {
+    for (unsigned int k = 0; k < NumParameters; k ++) {
+      ModelCovariance[j * NumParameters + k] = 
+        gsl_matrix_get (Normal, j, k) * ChiSq / dof;
+    }
+  }
+  WaveCorrection = correction ((ModelMin + ModelMax) / 2.0);
+  WaveCorrectionError = sqrt (modelVariance ((ModelMin + ModelMax) / 2.0));
+  
+  if (Verbose) {
+    cout << "Correction model: " << (ModelType == LC_MODEL_POLYNOMIAL ? 
+      "polynomial of order " : "piecewise linear, pieces = ") << ModelOrder
+      << " (reduced chi^2 = " << ChiSq / dof << ", lines fitted = " << NumLines 
+      << ")" << endl;
+    for (unsigned int j = 0; j < NumParameters; j ++) {
+      cout << "  Coefficient " << j << ": " << ModelCoeffs[j] << " +/- " 
+        << sqrt (ModelCovariance[j * NumParameters + j]) << endl;
+    }
+    cout << "Correction factor at " << (ModelMin + ModelMax) / 2.0 << " K: "
+      << WaveCorrection << " +/- " << WaveCorrectionError << endl;
+  }
+  calcDiffStats ();
+  if (Verbose) {
+    cout << "dSig/Sig Mean Residual: " << DiffMean / LC_DATA_SCALE 
+      << ", StdDev: " << DiffStdDev / LC_DATA_SCALE
+      << ", StdErr: " << DiffStdErr / LC_DATA_SCALE << endl;
+  }
+  
+  gsl_matrix_free (Normal);
+  gsl_vector_free (Target);
+  gsl_vector_free (Coeffs);
+}
+
+
+//------------------------------------------------------------------------------
+// numModelParameters () : Returns the number of coefficients in the selected
+// correction model.
+//
+unsigned int ListCal::numModelParameters () {
+  return ModelOrder + 1;
+}
+
+
+//------------------------------------------------------------------------------
+// modelBasis (double, vector <double> &) : Evaluates each basis function of the
+// correction model at the wavenumber Sigma, returning the values in arg2. The
+// correction factor is then the sum of each basis value times its coefficient.
+// The polynomial basis is the powers of t, where t maps the fitted range onto
+// [-1, 1]. The piecewise basis holds a triangular function centred on each knot,
+// so only the two knots either side of Sigma are non-zero. Beyond the fitted
+// range the model is not extrapolated, since a polynomial of high order soon
+// diverges there. Instead it is held at its value at the nearer end of the
+// range.
+//
+void ListCal::modelBasis (double Sigma, vector <double> &Basis) {
+  Basis.assign (numModelParameters (), 0.0);
+  Sigma = min (max (Sigma, ModelMin), ModelMax);
+  if (ModelType == LC_MODEL_POLYNOMIAL) {
+    double t = (2.0 * Sigma - ModelMin - ModelMax) / (ModelMax - ModelMin);
+    Basis[0] = 1.0;
+    for (unsigned int j = 1; j < Basis.size (); j ++) Basis[j] = Basis[j-1] * t;
+  } else if (ModelType == LC_MODEL_PIECEWISE) {
+    double u = (Sigma - ModelMin) / (ModelMax - ModelMin) * ModelOrder;
+    int Piece = (int) floor (u);
+    if (Piece < 0) Piece = 0;
+    if (Piece > (int) ModelOrder - 1) Piece = ModelOrder - 1;
+    Basis[Piece] = 1.0 - (u - Piece);
+    Basis[Piece + 1] = u - Piece;
+  } else {
+    Basis[0] = 1.0;
+  }
+}
+
+
+//------------------------------------------------------------------------------
+// correction (double) : Returns the correction factor at the uncorrected
+// wavenumber Sigma. This is WaveCorrection for the constant model, or until a
+// model has been fitted.
+//
+double ListCal::correction (double Sigma) {
+  if (ModelType == LC_MODEL_CONSTANT || ModelCoeffs.size () == 0) {
+    return WaveCorrection;
+  }
+  vector <double> Basis;
+  double Epsilon = 0.0;
+  modelBasis (Sigma, Basis);
+  for (unsigned int j = 0; j < Basis.size (); j ++) {
+    Epsilon += Basis[j] * ModelCoeffs[j];
+  }
+  return Epsilon;
+}
+
+
+//------------------------------------------------------------------------------
+// modelVariance (double) : Returns the variance of the fitted correction model
+// at the uncorrected wavenumber Sigma, propagated from the covariance matrix of
+// the model coefficients.
+//
+double ListCal::modelVariance (double Sigma) {
+  vector <double> Basis;
+  double Variance = 0.0;
+  modelBasis (Sigma, Basis);
+  for (unsigned int j = 0; j < Basis.size (); j ++) {
+    for (unsigned int k = 0; k < Basis.size (); k ++) {
+      Variance += Basis[j] * Basis[k] * ModelCovariance[j * Basis.size () + k];
+    }
+  }
+  return Variance;
+}
+
+
+//------------------------------------------------------------------------------
+// correctionError (double) : Returns the total error in the correction factor
+// at the uncorrected wavenumber Sigma, i.e. the error of the fitted model 
+// combined with that of the standards themselves (see StandardError).
+//
+double ListCal::correctionError (double Sigma) {
+  if (ModelType == LC_MODEL_CONSTANT || ModelCoeffs.size () == 0) {
+    return getTotalCorrectionError ();
+  }
+  return sqrt (modelVariance (Sigma) + pow (StandardError, 2));
+}
+
+
+//------------------------------------------------------------------------------
+// applyCorrection (vector <Line> &) : Sets the wavenumber correction of every
+// line in arg1 to the value of the fitted correction at its wavenumber.
+//
+void ListCal::applyCorrection (vector <Line> &Lines) {
+  for (unsigned int i = 0; i < Lines.size (); i ++) {
+    Lines[i].wavCorr (correction (Lines[i].wavenumber ()));
+  }
+}
+
+
 //------------------------------------------------------------------------------
 // calcDiffStats () : Calculates the mean wavenumber, and its standard deviation
 // and standard error, after the application of the wavenumber correction factor
@@ -314,7 +744,8 @@ void ListCal::calcDiffStats () {
   DiffStdDev = 0.0;
   double Difference = 0.0;
   for (unsigned int i = 0; i < FittedLines.size (); i ++) {
-    Difference = (FittedLines[i] -> List -> wavenumber() * (1.0 + WaveCorrection)
+    Difference = (FittedLines[i] -> List -> wavenumber() 
+      * (1.0 + correction (FittedLines[i] -> List -> wavenumber()))
       - FittedLines[i] -> Standard -> wavenumber()) * LC_DATA_SCALE;
     Difference /= FittedLines[i]->Standard->wavenumber();
     DiffMean += Difference;
@@ -322,7 +753,8 @@ void ListCal::calcDiffStats () {
   DiffMean /= FittedLines.size ();
 
   for (unsigned int i = 0; i < FittedLines.size (); i ++) {
-    Difference = (FittedLines[i] -> List -> wavenumber() * (1.0 + WaveCorrection)
+    Difference = (FittedLines[i] -> List -> wavenumber() 
+      * (1.0 + correction (FittedLines[i] -> List -> wavenumber()))
       - FittedLines[i] -> Standard -> wavenumber()) * LC_DATA_SCALE;
     Difference /= FittedLines[i]->Standard->wavenumber();
     DiffStdDev += pow (Difference - DiffMean, 2);
@@ -332,6 +764,118 @@ void ListCal::calcDiffStats () {
 }
 
 
+//------------------------------------------------------------------------------
+// loadCachedCalibration () : Builds the cache key for this calibration from the
+// contents of both line lists and the fit parameters. If a calibration with the
+// same key has been saved before, the correction factor, residual statistics,
+// and the lists of fitted and discarded lines are restored from the cache and
+// true is returned. Otherwise, false is returned and the fit must be performed.
+//
+bool ListCal::loadCachedCalibration () {
+  XgCacheRecord Record;
+  vector <int> Fitted, Discarded;
+  if (!CacheKeySet) {
+    try {
+      Cache.addFile (LineListName);
+      for (unsigned int i = 0; i < Standards.size (); i ++) {
+        for (unsigned int j = 0; j < Standards[i].Lines.size (); j ++) {
+          Cache.addValue (Standards[i].Lines[j].wavenumber ());
+        }
+        Cache.addValue (Standards[i].Uncertainty);
+      }
+    } catch (int Err) {
+      return false;
+    }
+    Cache.addValue (WaveCorrection);
+    Cache.addValue (Discriminator);
+    Cache.addValue (PeakAmpThreshold);
+    Cache.addValue (DiscardLimit);
+    Cache.addValue (double (ModelType));
+    Cache.addValue (double (ModelOrder));
+    CacheKeySet = true;
+  }
+  if (!Cache.fetch (Record)) return false;
+  
+  // Read the whole record into local copies first, so that a truncated or
+  // inconsistent record leaves the calibration exactly as it was
+  double NewCorrection, NewCorrectionError, NewDiffMean, NewDiffStdDev;
+  double NewDiffStdErr, NewModelMin, NewModelMax;
+  vector <double> NewCoeffs, NewCovariance;
+  try {
+    Record.get (NewCorrection);
+    Record.get (NewCorrectionError);
+    Record.get (NewDiffMean);
+    Record.get (NewDiffStdDev);
+    Record.get (NewDiffStdErr);
+    Record.get (Fitted);
+    Record.get (Discarded);
+    Record.get (NewModelMin);
+    Record.get (NewModelMax);
+    Record.get (NewCoeffs);
+    Record.get (NewCovariance);
+  } catch (int Err) {
+    return false;
+  }
+  if (NewCovariance.size () != NewCoeffs.size () * NewCoeffs.size ()) return false;
+  if (ModelType != LC_MODEL_CONSTANT && NewCoeffs.size () == 0) return false;
+  for (unsigned int i = 0; i < Fitted.size (); i ++) {
+    if (Fitted[i] < 0 || Fitted[i] >= (int)CommonLines.size ()) return false;
+  }
+  for (unsigned int i = 0; i < Discarded.size (); i ++) {
+    if (Discarded[i] < 0 || Discarded[i] >= (int)CommonLines.size ()) return false;
+  }
+
+  // The record is valid, so replace the calibration with it
+  WaveCorrection = NewCorrection;
+  WaveCorrectionError = NewCorrectionError;
+  DiffMean = NewDiffMean;
+  DiffStdDev = NewDiffStdDev;
+  DiffStdErr = NewDiffStdErr;
+  ModelMin = NewModelMin;
+  ModelMax = NewModelMax;
+  ModelCoeffs.swap (NewCoeffs);
+  ModelCovariance.swap (NewCovariance);
+  FittedLines.clear ();
+  DiscardedLines.clear ();
+  for (unsigned int i = 0; i < Fitted.size (); i ++) {
+    FittedLines.push_back (&CommonLines [Fitted[i]]);
+  }
+  for (unsigned int i = 0; i < Discarded.size (); i ++) {
+    DiscardedLines.push_back (&CommonLines [Discarded[i]]);
+  }
+  return true;
+}
+
+
+//------------------------------------------------------------------------------
+// saveCachedCalibration () : Saves the result of the calibration under the key
+// built by loadCachedCalibration(). Nothing is saved if the cache is disabled.
+//
+void ListCal::saveCachedCalibration () {
+  if (!CacheKeySet || !Cache.enabled ()) return;
+  XgCacheRecord Record;
+  vector <int> Fitted, Discarded;
+  for (unsigned int i = 0; i < FittedLines.size (); i ++) {
+    Fitted.push_back (FittedLines[i] - &CommonLines[0]);
+  }
+  for (unsigned int i = 0; i < DiscardedLines.size (); i ++) {
+    Discarded.push_back (DiscardedLines[i] - &CommonLines[0]);
+  }
+  Record.put (WaveCorrection);
+  Record.put (WaveCorrectionError);
+  Record.put (DiffMean);
+  Record.put (DiffStdDev);
+  Record.put (DiffStdErr);
+  Record.put (Fitted);
+  Record.put (Discarded);
+  Record.put (ModelMin);
+  Record.put (ModelMax);
+  Record.put (ModelCoeffs);
+  Record.put (ModelCovariance);
+  Cache.store (Record);
+}
+
+
 //------------------------------------------------------------------------------
 // plotDifferences () : Uses Gnuplot to plot the FittedLines and DiscardedLines.
 // Output is first to the screen, and then to the postscipt file Calibration.ps.
@@ -449,31 +993,94 @@ void ListCal::plotDifferences () {
 }  
 
 
+//------------------------------------------------------------------------------
+// writeBlock (FILE *, string &) : Writes the text buffered in arg2 to the file
+// at arg1 and empties the buffer. Returns false if it was not all written.
+//
+static bool writeBlock (FILE *File, string &Buffer) {
+  bool Complete = (fwrite (Buffer.data (), 1, Buffer.length (), File) 
+    == Buffer.length ());
+  Buffer.clear ();
+  return Complete;
+}
+
+
 //------------------------------------------------------------------------------
 // saveLineList (const char *Filename) : Produces a calibrated line list in the
 // XGremlin writelines format and a calibration results files. The latter
 // contains all the calibration settings and then lists the calibrated wave-
 // numbers with all the associated error components.
 //
+// Rather than copying the line list, the correction is applied to each line of
+// FullLineList in turn while its row of the .cln file is formatted, and its own
+// correction is then restored. The error components are found for all the
+// lines at once from arrays of their wavenumbers and centroid errors. The rows
+// of both files are formatted into a buffer that is written LC_WRITE_BLOCK
+// bytes at a time. LC_FILE_WRITE_ERROR is returned if either file could not be
+// written in full.
+//
 int ListCal::saveLineList (const char *Filename) {
   if (FullLineList.size () == 0) { return LC_NO_DATA; }
   ostringstream oss;
   oss.str ("");
   oss << Filename << ".cln";
+  string ClnName = oss.str ();
+  FILE *ListFile = fopen (ClnName.c_str (), "w");
+  if (! ListFile) {
+    cout << "Error: Cannot open " << ClnName
+      << " for output. List writing ABORTED." << endl;
+    throw int (LC_FILE_OPEN_ERROR);
+  }
 
-  // First save the calibrated line list to an XGremlin writelines formatted
-  // file. Work on a copy of the FullLineList so as not to modify its wavcorr.
-  vector <Line> SavedLines;
-  for (unsigned int i = 0; i < FullLineList.size (); i ++) {
-    SavedLines.push_back (FullLineList[i]);
-    SavedLines[i].wavCorr (getWaveCorrection ());
+  // First save the calibrated line list in the XGremlin writelines format,
+  // noting the uncorrected and corrected wavenumber of each line. The header
+  // is that written by writeLines() for the corrected list.
+  size_t n = FullLineList.size ();
+  vector <double> Sigma (n), Calibrated (n);
+  string Rows;
+  Rows.reserve (LC_WRITE_BLOCK + 256);
+  oss.str ("");
+  double FirstCorr = correction (FullLineList[0].wavenumber ());
+  if (FirstCorr != 0.0) {
+    oss << "  WAVENUMBER CORRECTION APPLIED: wavcorr =   " << FirstCorr << endl;
+  } else {
+    oss << ListHeader.WaveCorr << endl;
+  }
+  oss << ListHeader.AirCorr << endl << ListHeader.IntCal << endl 
+    << ListHeader.Columns << endl;
+  Rows = oss.str ();
+  FixedRecord Record (WritelinesFormat);
+  bool Written = true;
+  for (size_t i = 0; i < n; i ++) {
+    double OldCorr = FullLineList[i].wavCorr ();
+    Sigma[i] = FullLineList[i].wavenumber ();
+    FullLineList[i].wavCorr (correction (Sigma[i]));
+    Calibrated[i] = FullLineList[i].wavenumber ();
+    try {
+      FullLineList[i].appendLineString (Rows, Record);
+    } catch (const char *Err) {
+      FullLineList[i].wavCorr (OldCorr);
+      fclose (ListFile);
+      cout << "Error writing " << Err << " to " << ClnName 
+        << ". List writing ABORTED." << endl;
+      throw int (LC_FILE_WRITE_ERROR);
+    }
+    FullLineList[i].wavCorr (OldCorr);
+    Rows += '\n';
+    if (Rows.length () >= LC_WRITE_BLOCK || i == n - 1) {
+      Written = writeBlock (ListFile, Rows) && Written;
+    }
+  }
+  if (fclose (ListFile) != 0) Written = false;
+  if (!Written) {
+    cout << "Error: Could not write all of " << ClnName << endl;
+    return LC_FILE_WRITE_ERROR;
   }
-  writeLines (SavedLines, oss.str().c_str());
 
   // Now prepare to save the calibration results themselves.
   oss.str ("");
   oss << Filename << ".cal";
-  double FullErrorStdDev, FullErrorBrault;
+  double ScaleError = getTotalCorrectionError ();
   FILE *LineFile;
   LineFile = fopen (oss.str().c_str(), "w");
   if (! LineFile) {
@@ -483,31 +1090,80 @@ int ListCal::saveLineList (const char *Filename) {
   // Write the calibration output header
   fprintf (LineFile, "# Fitted lines from %s against standards in %s\n", 
     LineListName.c_str(), StandardListName.c_str());
+  if (Standards.size () > 1 || StandardsWeighted) {
+    vector <unsigned int> NumFitted (Standards.size (), 0);
+    vector <unsigned int> NumMerged (Standards.size (), 0);
+    for (unsigned int i = 0; i < StandardOrigin.size (); i ++) {
+      NumMerged[StandardOrigin[i]] ++;
+    }
+    for (unsigned int i = 0; i < FittedLines.size (); i ++) {
+      NumFitted[StandardOrigin[FittedLines[i]->Standard - &StandardList[0]]] ++;
+    }
+    for (unsigned int i = 0; i < Standards.size (); i ++) {
+      fprintf (LineFile, "# Standard list %-3d : %s (uncertainty / K %e, %d lines, %d used, %d fitted)\n",
+        i + 1, Standards[i].Name.c_str(), Standards[i].Uncertainty, 
+        (int)Standards[i].Lines.size(), NumMerged[i], NumFitted[i]);
+    }
+    fprintf (LineFile, "# Duplicate standards: %d\n", DuplicateStandards);
+  }
+  if (StandardError != 0.0) {
+    fprintf (LineFile, "# Standard error    : %e (from the calibration of the standards)\n", 
+      StandardError);
+  }
   fprintf (LineFile, "# Discriminator / K : %f\n", Discriminator);
   fprintf (LineFile, "# Peak Amp Threshold: %f\n", PeakAmpThreshold);
   fprintf (LineFile, "# Discard Limit     : %f\n", DiscardLimit); 
   fprintf (LineFile, "# Point Spacing     : %f\n#\n", PointSpacing);
-  fprintf (LineFile, "# Correction factor : %e +/- %e\n", WaveCorrection, WaveCorrectionError);
+  if (ModelType == LC_MODEL_CONSTANT) {
+    fprintf (LineFile, "# Correction factor : %e +/- %e\n", WaveCorrection, ScaleError);
+  } else {
+    fprintf (LineFile, "# Correction model  : %s %d over %f - %f K\n", 
+      ModelType == LC_MODEL_POLYNOMIAL ? "polynomial, order" : "piecewise linear, pieces",
+      ModelOrder, ModelMin, ModelMax);
+    for (unsigned int j = 0; j < ModelCoeffs.size (); j ++) {
+      fprintf (LineFile, "# Coefficient %-6d: %e +/- %e\n", j, ModelCoeffs[j],
+        sqrt (ModelCovariance[j * ModelCoeffs.size () + j]));
+    }
+    fprintf (LineFile, "# Correction factor : %e +/- %e (at %f K)\n", WaveCorrection, 
+      ScaleError, (ModelMin + ModelMax) / 2.0);
+  }
   fprintf (LineFile, "# Mean fit residual : %e\n", DiffMean / LC_DATA_SCALE);
   fprintf (LineFile, "# Residual std dev  : %e\n#\n", DiffStdDev / LC_DATA_SCALE);
   fprintf (LineFile, "#  n  Wavenumber    Scale Error   StdDev Error  Brault Error  Full Error\n");
 
-  // Output the calibrated wavenumber for each line, the individual error
-  // components, and the total wavenumber error. All units are cm^-1.
-  FullErrorStdDev = sqrt (pow (getWaveCorrectionError (), 2) 
-    + pow (DiffStdDev / LC_DATA_SCALE, 2));
-  for (unsigned int i = 0; i < SavedLines.size (); i ++) {
-    FullErrorBrault = sqrt (pow (SavedLines[i].wavenumber() * getWaveCorrectionError (), 2) 
-      + pow (SavedLines[i].getCentroidError (PointSpacing), 2));
-    fprintf (LineFile, "%4d  %11.6f  %11.6e  %11.6e  %11.6e  %11.6e\n", 
-      SavedLines[i].line(),
-      SavedLines[i].wavenumber(),
-      SavedLines[i].wavenumber() * getWaveCorrectionError (),
-      SavedLines[i].wavenumber() * DiffStdDev / LC_DATA_SCALE,
-      SavedLines[i].getCentroidError (PointSpacing),
-      max (SavedLines[i].wavenumber() * FullErrorStdDev, FullErrorBrault));
-  }
-  fclose (LineFile);
+  // Find the individual error components of every line, and the total
+  // wavenumber error. All units are cm^-1. With a correction model, the scale
+  // error depends on the wavenumber of the line.
+  vector <double> ScaleErrors (n, ScaleError), Brault, FullErrors (n);
+  if (ModelType != LC_MODEL_CONSTANT) {
+    for (size_t i = 0; i < n; i ++) ScaleErrors[i] = correctionError (Sigma[i]);
+  }
+  Line::getCentroidErrors (FullLineList, Brault, PointSpacing);
+  const double StdDevError = DiffStdDev / LC_DATA_SCALE;
+  for (size_t i = 0; i < n; i ++) {
+    double FullErrorStdDev = sqrt (pow (ScaleErrors[i], 2) + pow (StdDevError, 2));
+    double FullErrorBrault = sqrt (pow (Calibrated[i] * ScaleErrors[i], 2) 
+      + pow (Brault[i], 2));
+    FullErrors[i] = max (Calibrated[i] * FullErrorStdDev, FullErrorBrault);
+  }
+
+  // Output the calibrated wavenumber for each line with its errors
+  char Row [256];
+  for (size_t i = 0; i < n; i ++) {
+    int Length = snprintf (Row, sizeof (Row), "%4d  %11.6f  %11.6e  %11.6e  %11.6e  %11.6e\n", 
+      FullLineList[i].line(), Calibrated[i], Calibrated[i] * ScaleErrors[i],
+      Calibrated[i] * DiffStdDev / LC_DATA_SCALE, Brault[i], FullErrors[i]);
+    Rows.append (Row, min (Length, int (sizeof (Row)) - 1));
+    if (Rows.length () >= LC_WRITE_BLOCK || i == n - 1) {
+      Written = writeBlock (LineFile, Rows) && Written;
+    }
+  }
+  if (ferror (LineFile)) Written = false;
+  if (fclose (LineFile) != 0) Written = false;
+  if (!Written) {
+    cout << "Error: Could not write all of " << oss.str () << endl;
+    return LC_FILE_WRITE_ERROR;
+  }
   return LC_NO_ERROR;
 }
 
@@ -517,7 +1173,8 @@ int ListCal::saveLineList (const char *Filename) {
 //
 // fitFn (const gsl_vector *, void *, gsl_vector) : Calculates the difference
 // between the uncalibrated and standard line lists after an offset, Step, has
-// been applied to the uncalibrated list. 
+// been applied to the uncalibrated list. Each difference is scaled by the
+// square root of the weight of its line pair.
 //
 int fitFn (const gsl_vector *x, void *data, gsl_vector *f) {
   double Step = gsl_vector_get (x, 0);
@@ -525,7 +1182,8 @@ int fitFn (const gsl_vector *x, void *data, gsl_vector *f) {
   for (unsigned int i = 0; i < FittedLines->size (); i ++) {
     gsl_vector_set (f, i, (FittedLines->at(i)->List->wavenumber() * (1.0 + Step) 
       - FittedLines->at(i)->Standard->wavenumber()) * LC_DATA_SCALE 
-      / FittedLines->at(i)->Standard->wavenumber());
+      / FittedLines->at(i)->Standard->wavenumber()
+      * sqrt (FittedLines->at(i)->Weight));
   }
   return GSL_SUCCESS;
 }
@@ -534,14 +1192,14 @@ int fitFn (const gsl_vector *x, void *data, gsl_vector *f) {
 // derivFn (const gsl_vector *, void *, gsl_vcector *) : In principle, this
 // function should calculate the derivatives of the list differences with
 // respect to changes in each fit parameter and return a Jacobian matrix.
-// However, since the wavenumber calibration is linear, the derivatives will all
-// be zero.
+// However, since the wavenumber calibration is linear, the derivatives are
+// constant, scaled only by the weight of each line.
 //
 int derivFn (const gsl_vector *x, void *data, gsl_matrix *J) {  
-  // First initalise the Jacobian (J) so all elements are zero
+  vector <LinePair*> *FittedLines = (vector <LinePair*> *) data;  
   for (unsigned int i = 0; i < J -> size1; i ++) {
     for (unsigned int j = 0; j < J -> size2; j ++) {
-      gsl_matrix_set (J, i, j, LC_DATA_SCALE);
+      gsl_matrix_set (J, i, j, LC_DATA_SCALE * sqrt (FittedLines->at(i)->Weight));
     }
   }
   return GSL_SUCCESS;  
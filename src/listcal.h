@@ -19,13 +19,18 @@
 
 #include <vector>
 #include <string>
+#include <cmath>
 #include <gsl/gsl_vector.h>
 #include <gsl/gsl_blas.h>
 #include <gsl/gsl_multifit_nlin.h>
 #include <gsl/gsl_math.h>
 #include <gsl/gsl_deriv.h>
+#include <gsl/gsl_linalg.h>
+#include <gsl/gsl_errno.h>
 #include "ErrDefs.h"
 #include "line.h"
+#include "xgcache.h"
+#include "waveindex.h"
 
 // Default spectrum processing parameters
 #define DEF_WAVE_CORRECTION 0.0  /* wavenumbers                               */
@@ -35,6 +40,14 @@
 
 // Output parameters
 #define LC_DATA_SCALE   1.0e6    /* scale the output amplitude by this factor */
+#define LC_WRITE_BLOCK  65536    /* bytes of .cal rows written at a time      */
+
+// Wavenumber correction models. The correction factor, epsilon, may be a
+// constant (the default), a polynomial in wavenumber, or a piecewise linear
+// function of wavenumber. See setCorrectionModel() in listcal.cpp.
+#define LC_MODEL_CONSTANT   0
+#define LC_MODEL_POLYNOMIAL 1
+#define LC_MODEL_PIECEWISE  2
 
 // GSL Fitting parameters
 #define SOLVER_TYPE gsl_multifit_fdfsolver_lmsder
@@ -46,12 +59,23 @@ using namespace::std;
 
 // Define a structure in which a matched pair of lines can be stored. One of
 // these will come from the uncalibrated list, the other from the calibration
-// standard.
+// standard. The weight of the pair in the calibration fit is derived from the
+// uncertainty of the standard line, and is 1.0 if no uncertainty was given.
 typedef struct td_LinePair {
   Line *List;
   Line *Standard;
+  double Weight;
 } LinePair;
 
+// Define a structure to hold one of the standard line lists passed to ListCal,
+// together with the wavenumber uncertainty (in cm^-1) of its lines. All the
+// standard lists are merged into a single list before the calibration.
+typedef struct td_StandardSource {
+  string Name;
+  double Uncertainty;
+  vector <Line> Lines;
+} StandardSource;
+
 // Create the ListCal class
 class ListCal {
 public:
@@ -59,7 +83,8 @@ public:
   ~ListCal () { /* Do nothing */ };
   
   // File I/O functions
-  void loadStandardList (const char *Filename);
+  void loadStandardList (const char *Filename, double Uncertainty = 0.0);
+  void loadStandardList (ListCal &Calibrated, double Uncertainty = 0.0);
   void loadLineList (const char *Filename);
   int saveLineList (const char *Filename);
 
@@ -69,29 +94,60 @@ public:
   void setPeakAmpThreshold (double NewThreshold);
   void setDiscardLimit (double NewDiscardLimit);
   void setPointSpacing (double NewPointSpacing);
+  void setStandardError (double NewError) { StandardError = NewError; }
+  void setCorrectionModel (int NewType, unsigned int NewOrder);
   double getWaveCorrection () { return WaveCorrection; }
   double getWaveCorrectionError () { return WaveCorrectionError; }
+  // The error in the correction including that of the standards themselves
+  double getTotalCorrectionError () { 
+    if (StandardError == 0.0) return WaveCorrectionError;
+    return sqrt (pow (WaveCorrectionError, 2) + pow (StandardError, 2));
+  }
+  
+  // The correction factor and its total error at the uncorrected wavenumber 
+  // Sigma. For the constant model these are simply the values above.
+  double correction (double Sigma);
+  double correctionError (double Sigma);
+  void applyCorrection (vector <Line> &Lines);
   double getDiscriminator () { return Discriminator; }
   double getPeakAmpThreshold () { return PeakAmpThreshold; }
   double getDiscardLimit () { return DiscardLimit; }
   double getDiffMean () { return DiffMean; }
   double getDiffStdDev () { return DiffStdDev; }
   double getDiffStdErr () { return DiffStdErr; }
+  unsigned int getNumFittedLines () { return FittedLines.size (); }
+  vector <Line> &lineList () { return FullLineList; }
+  string lineListName () { return LineListName; }
   
   // Calibration and list manipulation functions
-  void findCorrection ();
+  void findCorrection (bool Verbose = true);
+  void findModelCorrection (bool Verbose = true);
+  void mergeStandardLists ();
   void findCommonLines (bool Verbose = false);
   void findFittedLines (bool Verbose = false);
   int removeBadLines (bool Verbose = false);
   void calcDiffStats ();
   
+  // Reuse or save the result of an identical earlier calibration. These must
+  // be called after findFittedLines(). See xgcache.h for details.
+  bool loadCachedCalibration ();
+  void saveCachedCalibration ();
+  
   // Output functions
   int printLineList (vector <Line> LineList);
   void plotDifferences ();
 
 private:
   vector <Line> FullLineList;   // All the lines from the uncalibrated line list
-  vector <Line> StandardList;   // All the lines from the standard line list
+  WritelinesHeader ListHeader;  // The header of the uncalibrated line list
+  vector <StandardSource> Standards; // The standard line lists as loaded
+  vector <Line> StandardList;   // All the lines from the merged standard lists
+  vector <double> StandardWeight; // Fit weight of each line in StandardList
+  vector <unsigned int> StandardOrigin; // Source in Standards of each line
+  bool StandardsMerged;
+  bool StandardsWeighted;
+  unsigned int DuplicateStandards;
+  WaveIndex StandardIndex;      // Wavenumber search index over StandardList
   vector <LinePair> CommonLines;  // Lines from FullLineList that exist in StandardList
   vector <LinePair*> FittedLines; // Lines from CommonLines to be fitted (weak lines omitted)
   vector <LinePair*> DiscardedLines; // Lines removed from FittedLines
@@ -106,6 +162,18 @@ private:
   double DiffStdDev;
   double DiffStdErr;
   double PointSpacing;
+  double StandardError;         // Error in dSig/Sig of the standard wavenumbers
+  int ModelType;                // One of the LC_MODEL_... definitions above
+  unsigned int ModelOrder;      // Polynomial order or number of linear pieces
+  double ModelMin;              // Wavenumber range mapped onto the model basis
+  double ModelMax;
+  vector <double> ModelCoeffs;  // Fitted model coefficients
+  vector <double> ModelCovariance; // Their covariance matrix, row by row
+  unsigned int numModelParameters ();
+  void modelBasis (double Sigma, vector <double> &Basis);
+  double modelVariance (double Sigma);
+  XgCache Cache;
+  bool CacheKeySet;
 };
 
 int fitFn (const gsl_vector *x, void *data, gsl_vector *f);
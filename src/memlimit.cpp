@@ -0,0 +1,206 @@
+// Xgtools
+// Copyright (C) M. P. Ruffoni 2011-2015
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//==============================================================================
+// XgMemLimit class (memlimit.cpp)
+//==============================================================================
+
+#include <iostream>
+#include <sstream>
+#include <cstdlib>
+#include <cstring>
+#include <sys/stat.h>
+#include "memlimit.h"
+
+//------------------------------------------------------------------------------
+// XgMemLimit constructor : Reads the budget from the XGTOOLS_MEM_LIMIT
+// environment variable. arg1 is the name of the program, used when reporting.
+// An invalid value is ignored, leaving the budget unlimited.
+//
+XgMemLimit::XgMemLimit (string NewToolName) {
+  ToolName = NewToolName;
+  Limit = 0;
+  const char *Env = getenv (XG_MEM_LIMIT_ENV);
+  if (Env != NULL && strlen (Env) > 0) {
+    try {
+      Limit = parseSize (Env);
+    } catch (int Err) {
+      cout << "Warning: Ignoring invalid " << XG_MEM_LIMIT_ENV << " of "
+        << Env << endl;
+    }
+  }
+}
+
+
+//------------------------------------------------------------------------------
+// parseArgs (int, char *[]) : Looks for the --mem-limit option in the argc
+// arguments at arg2, given either as --mem-limit <size> or --mem-limit=<size>.
+// The option is removed so that the remaining arguments keep their usual
+// positions, and the new number of arguments is returned.
+//
+int XgMemLimit::parseArgs (int argc, char *argv[]) throw (int) {
+  string Option = XG_MEM_LIMIT_OPTION;
+  for (int i = 1; i < argc; i ++) {
+    string Arg = argv[i];
+    int Used;
+    if (Arg == Option) {
+      if (i + 1 >= argc) {
+        cout << "Error: " << Option << " must be followed by a size" << endl;
+        throw int (LC_SYNTAX_ERROR);
+      }
+      Limit = parseSize (argv[i + 1]);
+      Used = 2;
+    } else if (Arg.compare (0, Option.length () + 1, Option + "=") == 0) {
+      Limit = parseSize (Arg.substr (Option.length () + 1));
+      Used = 1;
+    } else {
+      continue;
+    }
+    for (int j = i; j < argc - Used; j ++) {
+      argv[j] = argv[j + Used];
+    }
+    argc -= Used;
+    i --;
+  }
+  return argc;
+}
+
+
+//------------------------------------------------------------------------------
+// items (size_t, size_t, string) : Returns the number of items of arg1 bytes
+// each that may be held at once, up to the total of arg2 items. At least one
+// item is always allowed. If fewer than arg2 items fit within the budget, a
+// note is recorded using the description of the items given in arg3.
+//
+size_t XgMemLimit::items (size_t ItemSize, size_t NumItems, string What) {
+  if (Limit == 0 || ItemSize == 0 || ItemSize * NumItems <= Limit) {
+    return NumItems;
+  }
+  size_t Allowed = Limit / ItemSize;
+  if (Allowed == 0) Allowed = 1;
+  ostringstream oss;
+  oss << What << " processed in blocks of " << Allowed << " rather than "
+    << NumItems << " at once";
+  constrain (oss.str ());
+  return Allowed;
+}
+
+
+//------------------------------------------------------------------------------
+// threads (size_t, unsigned int) : Returns the number of threads, each needing
+// arg1 bytes, that may run at once, up to a maximum of arg2. At least one
+// thread is always allowed.
+//
+unsigned int XgMemLimit::threads (size_t ThreadSize, unsigned int NumThreads) {
+  if (Limit == 0 || ThreadSize == 0 || ThreadSize * NumThreads <= Limit) {
+    return NumThreads;
+  }
+  unsigned int Allowed = Limit / ThreadSize;
+  if (Allowed == 0) Allowed = 1;
+  if (Allowed >= NumThreads) return NumThreads;
+  ostringstream oss;
+  oss << "Using " << Allowed << " thread" << (Allowed == 1 ? "" : "s")
+    << " rather than " << NumThreads;
+  constrain (oss.str ());
+  return Allowed;
+}
+
+
+//------------------------------------------------------------------------------
+// constrain (string) : Records a note of how the budget has constrained the
+// program, which will be printed by report ().
+//
+void XgMemLimit::constrain (string Note) {
+  Notes.push_back (Note);
+}
+
+
+//------------------------------------------------------------------------------
+// report () : Prints every note recorded by constrain (), if there are any.
+//
+void XgMemLimit::report () {
+  if (Notes.size () == 0) return;
+  cout << ToolName << " was limited by the memory budget of "
+    << sizeString (Limit) << ":" << endl;
+  for (unsigned int i = 0; i < Notes.size (); i ++) {
+    cout << "  " << Notes[i] << endl;
+  }
+}
+
+
+//------------------------------------------------------------------------------
+// parseSize (string) : Converts a size in bytes, optionally followed by one of
+// the suffixes k, M, G or T (powers of 1024), to a number of bytes. A size of
+// zero means that there is no limit.
+//
+size_t XgMemLimit::parseSize (string Size) throw (int) {
+  char *End;
+  double Value = strtod (Size.c_str (), &End);
+  string Suffix = End;
+  if (Suffix.length () > 1 && (Suffix[1] == 'B' || Suffix[1] == 'b')) {
+    Suffix.erase (1);
+  }
+  if (End == Size.c_str () || Value < 0.0 || Suffix.length () > 1) {
+    cout << "Error: Invalid memory limit " << Size << endl;
+    throw int (LC_SYNTAX_ERROR);
+  }
+  if (Suffix.length () == 1) {
+    // Each unit falls through to the next smaller one, multiplying by 1024 for
+    // each step down to bytes
+    switch (Suffix[0]) {
+      case 'T': case 't': Value *= 1024.0;
+        // fall through
+      case 'G': case 'g': Value *= 1024.0;
+        // fall through
+      case 'M': case 'm': Value *= 1024.0;
+        // fall through
+      case 'K': case 'k': Value *= 1024.0; break;
+      default:
+        cout << "Error: Invalid memory limit " << Size << endl;
+        throw int (LC_SYNTAX_ERROR);
+    }
+  }
+  return size_t (Value);
+}
+
+
+//------------------------------------------------------------------------------
+// sizeString (size_t) : Returns arg1 bytes as a string in the largest unit in
+// which it is at least 1, e.g. 512 MB.
+//
+string XgMemLimit::sizeString (size_t Size) {
+  const char *Units[] = { "bytes", "kB", "MB", "GB", "TB" };
+  double Value = Size;
+  unsigned int Unit = 0;
+  while (Value >= 1024.0 && Unit < 4) {
+    Value /= 1024.0;
+    Unit ++;
+  }
+  ostringstream oss;
+  oss << Value << " " << Units[Unit];
+  return oss.str ();
+}
+
+
+//------------------------------------------------------------------------------
+// fileSize (string) : Returns the size in bytes of the file named at arg1, or
+// zero if it cannot be found.
+//
+size_t XgMemLimit::fileSize (string Filename) {
+  struct stat Info;
+  if (stat (Filename.c_str (), &Info) != 0) return 0;
+  return Info.st_size;
+}
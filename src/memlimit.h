@@ -0,0 +1,80 @@
+// Xgtools
+// Copyright (C) M. P. Ruffoni 2011-2015
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//==============================================================================
+// XgMemLimit class (memlimit.h)
+//==============================================================================
+// A memory budget shared by the Xgtools programs that stream large files. The
+// budget is unlimited by default. It is set either by the --mem-limit option,
+// which may appear anywhere on the command line, or by the XGTOOLS_MEM_LIMIT
+// environment variable, the option taking precedence. Sizes are given in bytes
+// or with a suffix of k, M, G or T, e.g. --mem-limit 512M or --mem-limit=2G.
+//
+// Programs ask the budget how many items of a given size they may hold at once
+// with items(), and how many worker threads they may run with threads(). The
+// answers are used to choose tile sizes and thread counts, or to fall back to
+// an out-of-core method that keeps its working set on disk. Every time the
+// budget makes a program do less at once than it otherwise would, a note is
+// recorded, and report() prints these notes when the program has finished.
+//
+#ifndef XG_MEM_LIMIT_H
+#define XG_MEM_LIMIT_H
+
+#include <string>
+#include <vector>
+#include "ErrDefs.h"
+
+// The environment variable and the command line option that set the budget
+#define XG_MEM_LIMIT_ENV    "XGTOOLS_MEM_LIMIT"
+#define XG_MEM_LIMIT_OPTION "--mem-limit"
+
+using namespace::std;
+
+class XgMemLimit {
+  public:
+    XgMemLimit (string NewToolName);
+    ~XgMemLimit () {}
+
+    // Reads and removes the --mem-limit option from the command line, and
+    // returns the new number of arguments. An LC_SYNTAX_ERROR is thrown if
+    // the size is not valid.
+    int parseArgs (int argc, char *argv[]) throw (int);
+
+    // Returns true if a budget has been set, and the budget in bytes
+    bool limited () { return Limit > 0; }
+    size_t limit () { return Limit; }
+
+    // Functions for sizing the working set of a program
+    size_t items (size_t ItemSize, size_t NumItems, string What);
+    unsigned int threads (size_t ThreadSize, unsigned int NumThreads);
+    bool fits (size_t Size) { return Limit == 0 || Size <= Limit; }
+
+    // Records and reports how the budget constrained the program
+    void constrain (string Note);
+    void report ();
+
+    // Utility functions
+    static size_t parseSize (string Size) throw (int);
+    static string sizeString (size_t Size);
+    static size_t fileSize (string Filename);
+
+  private:
+    string ToolName;
+    size_t Limit;
+    vector <string> Notes;
+};
+
+#endif // XG_MEM_LIMIT_H
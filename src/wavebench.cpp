@@ -0,0 +1,125 @@
+// Xgtools
+// Copyright (C) M. P. Ruffoni 2011-2015
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// wavebench : Measures the cost of WaveIndex lookups as a line list grows
+//
+// For line lists of 10^3 to 10^7 lines (or up to the size given on the command
+// line), random wavenumbers between 1000 and 50000 /cm are indexed, and the
+// average time of a nearest() lookup, a range() query 0.1 /cm wide, and a
+// std::lower_bound search of the sorted wavenumbers is printed for each size.
+// The random number generator is seeded with a constant, so every run uses the
+// same lists and queries. This is not installed with Xgtools. Build and run it
+// with:
+//
+// make bench && ./wavebench
+//
+// The 10^7 line list needs about 500 MB of memory.
+//
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+#include "waveindex.h"
+
+using namespace::std;
+
+#define MIN_LIST_SIZE 1000
+#define MAX_LIST_SIZE 10000000
+#define NUM_QUERIES   1000000
+#define RANDOM_SEED   12345
+#define MIN_SIGMA     1000.0  /* /cm */
+#define MAX_SIGMA     50000.0 /* /cm */
+#define RANGE_WIDTH   0.1     /* /cm */
+
+typedef chrono::steady_clock BenchClock;
+
+
+//------------------------------------------------------------------------------
+// nsPerQuery (BenchClock::time_point, BenchClock::time_point) : Returns the time
+// between arg1 and arg2 divided by NUM_QUERIES, in ns.
+//
+double nsPerQuery (BenchClock::time_point Start, BenchClock::time_point End) {
+  return chrono::duration <double, nano> (End - Start).count () / NUM_QUERIES;
+}
+
+
+//------------------------------------------------------------------------------
+// Main program
+//
+int main (int argc, char *argv[])
+{
+  size_t MaxSize = MAX_LIST_SIZE;
+  if (argc > 1) {
+    istringstream iss (argv [1]);
+    if (!(iss >> MaxSize) || MaxSize < MIN_LIST_SIZE) {
+      cout << "Syntax : wavebench [<max lines>]" << endl;
+      cout << "<max lines> : The largest line list to index, at least "
+        << MIN_LIST_SIZE << " (default " << MAX_LIST_SIZE << ")" << endl;
+      return 1;
+    }
+  }
+
+  mt19937 Random (RANDOM_SEED);
+  uniform_real_distribution <double> Sigma (MIN_SIGMA, MAX_SIGMA);
+  vector <double> Queries (NUM_QUERIES);
+  for (size_t i = 0; i < NUM_QUERIES; i ++) Queries [i] = Sigma (Random);
+
+  // Sum the results of every query and print the total at the end, so that the
+  // compiler cannot discard the lookups
+  size_t Check = 0;
+  cout << "       Lines   Build (ms)  nearest (ns)    range (ns)  "
+    << "lower_bound (ns)" << endl;
+  for (size_t Size = MIN_LIST_SIZE; Size <= MaxSize; Size *= 10) {
+    vector <double> Wavenumbers (Size);
+    for (size_t i = 0; i < Size; i ++) Wavenumbers [i] = Sigma (Random);
+
+    BenchClock::time_point Start = BenchClock::now ();
+    WaveIndex Index (Wavenumbers);
+    double BuildTime = chrono::duration <double, milli>
+      (BenchClock::now () - Start).count ();
+
+    Start = BenchClock::now ();
+    for (size_t i = 0; i < NUM_QUERIES; i ++) {
+      Check += Index.nearest (Queries [i]);
+    }
+    double NearestTime = nsPerQuery (Start, BenchClock::now ());
+
+    Start = BenchClock::now ();
+    for (size_t i = 0; i < NUM_QUERIES; i ++) {
+      Check += Index.range (Queries [i], Queries [i] + RANGE_WIDTH).size ();
+    }
+    double RangeTime = nsPerQuery (Start, BenchClock::now ());
+
+    vector <double> Sorted (Wavenumbers);
+    sort (Sorted.begin (), Sorted.end ());
+    Start = BenchClock::now ();
+    for (size_t i = 0; i < NUM_QUERIES; i ++) {
+      Check += lower_bound (Sorted.begin (), Sorted.end (), Queries [i])
+        - Sorted.begin ();
+    }
+    double LowerBoundTime = nsPerQuery (Start, BenchClock::now ());
+
+    cout << fixed << setprecision (1) << setw (12) << Size << setw (13)
+      << BuildTime << setw (14) << NearestTime << setw (14) << RangeTime
+      << setw (18) << LowerBoundTime << endl;
+  }
+  cout << "Checksum of query results: " << Check << endl;
+  return 0;
+}
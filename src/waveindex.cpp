@@ -0,0 +1,135 @@
+// Xgtools
+// Copyright (C) M. P. Ruffoni 2011-2015
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//==============================================================================
+// WaveIndex class (waveindex.cpp)
+//==============================================================================
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include "waveindex.h"
+
+// Orders line positions by wavenumber, keeping lines of equal wavenumber in
+// their original order.
+struct CompareWavenumbers {
+  const vector <double> *Wavenumbers;
+  CompareWavenumbers (const vector <double> *W) { Wavenumbers = W; }
+  bool operator() (unsigned int a, unsigned int b) const {
+    if ((*Wavenumbers)[a] != (*Wavenumbers)[b]) {
+      return (*Wavenumbers)[a] < (*Wavenumbers)[b];
+    }
+    return a < b;
+  }
+};
+
+//------------------------------------------------------------------------------
+// build (const vector <double> &) : Sorts the wavenumbers at arg1 and lays them
+// out in the Eytzinger order used by lowerBound(). The tree is padded with
+// infinite wavenumbers to the next size of 2^h - 1 nodes, so that every search
+// descends exactly h levels.
+//
+void WaveIndex::build (const vector <double> &Wavenumbers) {
+  size_t n = Wavenumbers.size ();
+  vector <unsigned int> Order (n);
+  for (size_t i = 0; i < n; i ++) Order [i] = i;
+  sort (Order.begin (), Order.end (), CompareWavenumbers (&Wavenumbers));
+
+  Sorted.resize (n);
+  for (size_t i = 0; i < n; i ++) {
+    Sorted [i].Sigma = Wavenumbers [Order [i]];
+    Sorted [i].Line = Order [i];
+  }
+
+  for (Leaves = 1; Leaves <= n; Leaves *= 2);
+  Tree.assign (Leaves + PREFETCH_STRIDE, HUGE_VAL);
+  size_t NextRank = 0;
+  fillTree (NextRank, 1);
+}
+
+
+//------------------------------------------------------------------------------
+// treeBase () : Returns a pointer to node 0 of the tree, offset within Tree so
+// that nodes 8k to 8k+7, the descendants of node k three levels down, share a
+// single cache line. This is worked out on each call, as the alignment of Tree
+// changes if the index is copied.
+//
+double *WaveIndex::treeBase () {
+  size_t Offset = (reinterpret_cast <uintptr_t> (Tree.data ()) / sizeof (double))
+    % PREFETCH_STRIDE;
+  return Tree.data () + (PREFETCH_STRIDE - Offset) % PREFETCH_STRIDE;
+}
+
+
+//------------------------------------------------------------------------------
+// fillTree (size_t &, size_t) : Places the sorted wavenumbers into the tree by
+// an in-order traversal from the node at arg2. The children of node k are the
+// nodes 2k and 2k+1.
+//
+void WaveIndex::fillTree (size_t &NextRank, size_t Node) {
+  if (Node >= Leaves) return;
+  fillTree (NextRank, 2 * Node);
+  if (NextRank < Sorted.size ()) treeBase () [Node] = Sorted [NextRank ++].Sigma;
+  fillTree (NextRank, 2 * Node + 1);
+}
+
+
+//------------------------------------------------------------------------------
+// lowerBound (double) : Returns the rank of the first line with a wavenumber of
+// at least Sigma. The search descends the tree without branching on the result
+// of each comparison, prefetching the cache line that holds the nodes three
+// levels below the current one. Since the tree is complete, each descent from
+// the root to a leaf spells out in binary the number of wavenumbers less than
+// Sigma, which is the position of the leaf in the row below the tree.
+//
+size_t WaveIndex::lowerBound (double Sigma) {
+  const double *Base = treeBase ();
+  size_t k = 1;
+  while (k < Leaves) {
+    __builtin_prefetch (Base + PREFETCH_STRIDE * k);
+    k = 2 * k + (Base [k] < Sigma);
+  }
+  return k - Leaves;
+}
+
+
+//------------------------------------------------------------------------------
+// range (double, double) : Returns the original positions of all lines with
+// wavenumbers between Min and Max inclusive, in order of ascending wavenumber.
+//
+vector <size_t> WaveIndex::range (double Min, double Max) {
+  vector <size_t> Lines;
+  for (size_t r = lowerBound (Min); r < Sorted.size () && Sorted [r].Sigma <= Max;
+    r ++) {
+    Lines.push_back (Sorted [r].Line);
+  }
+  return Lines;
+}
+
+
+//------------------------------------------------------------------------------
+// nearest (double) : Returns the original position of the line closest in
+// wavenumber to Sigma, or -1 if the index is empty.
+//
+long WaveIndex::nearest (double Sigma) {
+  size_t r = lowerBound (Sigma);
+  if (Sorted.size () == 0) return -1;
+  if (r == Sorted.size ()) return Sorted [r - 1].Line;
+  if (r > 0 && fabs (Sorted [r - 1].Sigma - Sigma) <= fabs (Sorted [r].Sigma - Sigma)) {
+    return Sorted [r - 1].Line;
+  }
+  return Sorted [r].Line;
+}
@@ -0,0 +1,490 @@
+// Xgtools
+// Copyright (C) M. P. Ruffoni 2011-2015
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// xgboltzmann : Finds the excitation temperature of a source from a Boltzmann
+// plot of its lines
+//
+// The lines of an XGremlin writelines list are identified by matching their
+// wavenumbers with those of the lines in one or more Kurucz lists (separated by
+// commas, as for generatesyn). Each line is matched to the nearest Kurucz line
+// within the tolerance. A line is left out if other Kurucz lines of different
+// transitions also lie within the tolerance, since its intensity may be shared
+// between them, or if either level of its transition is only predicted. Lines
+// with predicted levels are still matched, as for any other Kurucz line, so
+// that they count when deciding whether a match is ambiguous.
+//
+// If the populations of the upper levels follow a Boltzmann distribution, the
+// integrated intensity I of a line of wavelength lambda, from a level of energy
+// E, satisfies
+//
+//   ln (I lambda / gA) = ln (I / gf sigma^3) + constant = -E / kT + constant
+//
+// so that a straight line fitted to ln (I / gf sigma^3) against E has a slope
+// of -1/kT. The lines of each species (identified by its Kurucz code) are
+// fitted separately, and the species are fitted at the same time on separate
+// threads.
+//
+// The uncertainty of each value of ln (I / gf sigma^3) is taken as that of the
+// intensity, 1 / peak, which assumes that the spectrum was normalised so that
+// the peaks of the lines are their S/N ratios, added in quadrature to
+// LOGGF_UNCERTAINTY for the uncertainty of log gf. The lines are weighted by
+// the inverse squares of these uncertainties. Each fit is repeated, leaving out
+// lines whose weighted residuals are more than CLIP_LIMIT times their median
+// absolute deviation (scaled to a standard deviation) from the fit, until the
+// same lines are left out twice in a row. If that does not happen within
+// MAX_CLIP_ITERATIONS passes, the lines left out by the last pass are refitted
+// and the summary notes that the rejection did not converge. The uncertainty
+// of the slope is then scaled by the reduced chi-squared of the fit.
+//
+// Every matched line is written to the output, with its Boltzmann plot
+// coordinates, weight, and whether it was used in the fit ('*') or rejected
+// ('x'). The temperatures are given at the end of the output and printed to
+// the screen.
+//
+// Make sure the GNU Scientific Library (GSL) development package is installed
+// on your system, then compile this code using the following command:
+//
+// g++ xgboltzmann.cpp line.cpp kzline.cpp waveindex.cpp fixedformat.cpp
+//   -lgsl -lgslcblas -pthread -o xgboltzmann
+//
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+#include <thread>
+#include <gsl/gsl_fit.h>
+#include "ErrDefs.h"
+#include "line.h"
+#include "kzline.h"
+#include "waveindex.h"
+#include "fixedformat.h"
+#include "lineio.cpp"
+
+using namespace::std;
+
+// Definitions for command line parameters
+#define MIN_NUM_ARGS     4
+#define MAX_NUM_ARGS     5
+#define ARG_LIST         1
+#define ARG_KURUCZ       2
+#define ARG_OUTPUT       3
+#define ARG_TOLERANCE    4
+
+// The default largest difference in wavenumber between matched lines
+#define DEF_MATCH_TOLERANCE 0.05 /* cm-1 */
+
+// Kurucz lines are of the same transition if their level energies differ by
+// less than this, as for the hyperfine and isotope components of a line
+#define SAME_LEVEL_TOLERANCE 0.001 /* cm-1 */
+
+// The uncertainty of ln (gf), added in quadrature to that of ln (I)
+#define LOGGF_UNCERTAINTY 0.1
+
+// Lines are rejected if their residuals exceed this many standard deviations,
+// as estimated from the median absolute deviation of the residuals
+#define CLIP_LIMIT 3.0
+#define MAD_TO_SIGMA 1.4826
+#define MAX_CLIP_ITERATIONS 20
+
+// The fewest lines from which a temperature is found
+#define MIN_FIT_LINES 3
+
+// The Boltzmann constant in cm^-1 / K
+#define BOLTZMANN_CM 0.69503476
+
+// Flags written in the last column of the output
+#define FIT_USED     '*'
+#define FIT_REJECTED 'x'
+
+// The rows of the output, one for each matched line
+static const FieldFormat BoltzmannFormat [] = {
+  {   0,  8,  2, FF_FIXED },      /* Kurucz code      */
+  {   8,  7,  0, FF_INTEGER },    /* Line number      */
+  {  15, 14,  6, FF_FIXED },      /* Wavenumber       */
+  {  29, 11,  3, FF_FIXED },      /* Kurucz - line/mK */
+  {  40, 12,  3, FF_FIXED },      /* Upper level      */
+  {  52,  8,  3, FF_FIXED },      /* log gf           */
+  {  60, 12,  3, FF_SCIENTIFIC }, /* Intensity        */
+  {  72, 11,  4, FF_FIXED },      /* ln (I/gf sig^3)  */
+  {  83, 11,  3, FF_SCIENTIFIC }, /* Weight           */
+  {  95,  1,  0, FF_CHAR },       /* Used in the fit  */
+  {   0,  0,  0, FF_END }
+};
+
+// The Kurucz lines against which the observed lines are matched. Level
+// energies are held without the minus signs of predicted levels, and Predicted
+// marks the lines with either level predicted.
+typedef struct td_KuruczLines {
+  vector <double> Sigma;
+  vector <double> Code;
+  vector <double> ELower;
+  vector <double> EUpper;
+  vector <double> LogGf;
+  vector <bool> Predicted;
+  WaveIndex Index;
+} KuruczLines;
+
+// The lines of one species and their Boltzmann plot. The arrays of each line's
+// properties are filled when the lines are matched, and the rest by fitSpecies.
+typedef struct td_SpeciesFit {
+  double Code;
+  vector <unsigned int> Line;    // Line number in the writelines list
+  vector <double> Sigma;         // Observed wavenumber
+  vector <double> Offset;        // Kurucz - observed wavenumber
+  vector <double> Energy;        // Upper level energy
+  vector <double> LogGf;
+  vector <double> Intensity;
+  vector <double> Peak;
+  vector <double> Y;             // ln (I / gf sigma^3)
+  vector <double> Weight;
+  vector <char> Used;
+  unsigned int NumUsed;
+  double Slope, Intercept, SlopeError, ChiSqDof;
+  double Temperature, TemperatureError;
+  bool Fitted;
+  bool Converged;                // The rejected lines settled before the limit
+} SpeciesFit;
+
+
+//------------------------------------------------------------------------------
+// showHelp () : Prints syntax help message to the standard output.
+//
+void showHelp () {
+  cout << endl;
+  cout << "xgboltzmann : Finds excitation temperatures from Boltzmann plots" << endl;
+  cout << "---------------------------------------------------------------" << endl;
+  cout << "Syntax : xgboltzmann <list> <kurucz in> <output> [<tolerance>]" << endl << endl;
+  cout << "<list>      : An XGremlin writelines line list, with the integrated" << endl;
+  cout << "              intensity of each line in its eqwidth column." << endl;
+  cout << "<kurucz in> : A Kurucz line list with which to identify the lines, or" << endl;
+  cout << "              several separated by commas." << endl;
+  cout << "<output>    : The matched lines and fitted temperatures are saved here." << endl;
+  cout << "<tolerance> : The largest difference in wavenumber between a line and" << endl;
+  cout << "              its Kurucz line (default " << DEF_MATCH_TOLERANCE
+    << " cm-1)." << endl << endl;
+}
+
+
+//------------------------------------------------------------------------------
+// loadKurucz (string, KuruczLines &) : Adds the lines of the Kurucz list named
+// at arg1 to arg2. Lines with a predicted level, given a negative energy by
+// Kurucz, are marked as predicted. Throws an LC_ error code if the list cannot
+// be read.
+//
+void loadKurucz (string Filename, KuruczLines &Kurucz) throw (int) {
+  ifstream Input (Filename.c_str (), ios::in);
+  if (!Input.is_open ()) {
+    cout << "Error: Cannot read " << Filename
+      << ". Check the file exists and has read permissions." << endl;
+    throw int (LC_FILE_OPEN_ERROR);
+  }
+  string Record;
+  KzLine NextLine;
+  unsigned int RowNumber = 0;
+  while (getline (Input, Record)) {
+    RowNumber ++;
+    if (Record.length () == 0) continue;
+    try {
+      NextLine.readLine (Record);
+    } catch (Error &Err) {
+      cout << "Error: Unable to read row " << RowNumber << " of " << Filename
+        << endl;
+      throw int (LC_FILE_READ_ERROR);
+    }
+    // The wavenumber is found from the energies without their signs, since
+    // KzLine::sigma() takes the difference of the signed energies
+    double E1 = fabs (NextLine.eLower ()), E2 = fabs (NextLine.eUpper ());
+    Kurucz.Sigma.push_back (fabs (E2 - E1));
+    Kurucz.Code.push_back (NextLine.code ());
+    Kurucz.ELower.push_back (min (E1, E2));
+    Kurucz.EUpper.push_back (max (E1, E2));
+    Kurucz.LogGf.push_back (NextLine.loggf ());
+    Kurucz.Predicted.push_back (NextLine.eLower () < 0.0 || NextLine.eUpper () < 0.0);
+  }
+}
+
+
+//------------------------------------------------------------------------------
+// matchLine (KuruczLines &, double, double) : Returns the position in arg1 of
+// the Kurucz line nearest to the wavenumber arg2, or -1 if there is none within
+// arg3, or if a line of another transition is also within arg3.
+//
+long matchLine (KuruczLines &Kurucz, double Sigma, double Tolerance) {
+  vector <size_t> Found = Kurucz.Index.range (Sigma - Tolerance, Sigma + Tolerance);
+  if (Found.size () == 0) return -1;
+  size_t Nearest = Found [0];
+  for (unsigned int i = 1; i < Found.size (); i ++) {
+    if (fabs (Kurucz.Sigma [Found[i]] - Sigma) < fabs (Kurucz.Sigma [Nearest] - Sigma)) {
+      Nearest = Found [i];
+    }
+  }
+  for (unsigned int i = 0; i < Found.size (); i ++) {
+    if (Kurucz.Code [Found[i]] != Kurucz.Code [Nearest]
+      || fabs (Kurucz.ELower [Found[i]] - Kurucz.ELower [Nearest]) > SAME_LEVEL_TOLERANCE
+      || fabs (Kurucz.EUpper [Found[i]] - Kurucz.EUpper [Nearest]) > SAME_LEVEL_TOLERANCE) {
+      return -1;
+    }
+  }
+  return Nearest;
+}
+
+
+//------------------------------------------------------------------------------
+// fitSpecies (SpeciesFit *) : Finds the Boltzmann plot coordinates and weights
+// of the lines at arg1, and fits the excitation temperature to them, rejecting
+// outlying lines as described above.
+//
+void fitSpecies (SpeciesFit *Species) {
+  size_t n = Species -> Energy.size ();
+  vector <double> &Y = Species -> Y;
+  vector <double> &Weight = Species -> Weight;
+  Y.resize (n);
+  Weight.resize (n);
+  Species -> Used.assign (n, FIT_USED);
+  Species -> Fitted = false;
+  Species -> Converged = false;
+
+  // Find the coordinates and weights of all the lines in a single pass
+  const double Ln10 = log (10.0);
+  const double GfVariance = LOGGF_UNCERTAINTY * LOGGF_UNCERTAINTY;
+  for (size_t i = 0; i < n; i ++) {
+    Y[i] = log (Species -> Intensity[i]) - 3.0 * log (Species -> Sigma[i])
+      - Species -> LogGf[i] * Ln10;
+    double RelError = 1.0 / Species -> Peak[i];
+    Weight[i] = 1.0 / (RelError * RelError + GfVariance);
+  }
+
+  // Fit the lines still in use, then reject those far from the fit, until the
+  // same lines are used twice in a row. After the last pass allowed, the lines
+  // are fitted once more without testing them, so that the fit always matches
+  // the lines marked as used.
+  vector <double> x, y, w, Residuals;
+  double c0 = 0.0, c1 = 0.0, cov00, cov01, cov11 = 0.0, ChiSq = 0.0;
+  for (int Iteration = 0; ; Iteration ++) {
+    x.clear (); y.clear (); w.clear ();
+    for (size_t i = 0; i < n; i ++) {
+      if (Species -> Used[i] != FIT_USED) continue;
+      x.push_back (Species -> Energy[i]);
+      y.push_back (Y[i]);
+      w.push_back (Weight[i]);
+    }
+    Species -> NumUsed = x.size ();
+    if (x.size () < MIN_FIT_LINES) return;
+    gsl_fit_wlinear (&x[0], 1, &w[0], 1, &y[0], 1, x.size (), &c0, &c1,
+      &cov00, &cov01, &cov11, &ChiSq);
+    if (Iteration == MAX_CLIP_ITERATIONS) break;
+
+    // Estimate the scatter of the weighted residuals of the lines in use from
+    // their median absolute deviation
+    Residuals.clear ();
+    for (size_t i = 0; i < n; i ++) {
+      if (Species -> Used[i] != FIT_USED) continue;
+      Residuals.push_back (fabs (Y[i] - c0 - c1 * Species -> Energy[i]) * sqrt (Weight[i]));
+    }
+    nth_element (Residuals.begin (), Residuals.begin () + Residuals.size () / 2,
+      Residuals.end ());
+    double Scatter = MAD_TO_SIGMA * Residuals [Residuals.size () / 2];
+    if (Scatter <= 0.0) {
+      Species -> Converged = true;
+      break;
+    }
+
+    // Test every line against the fit, so lines rejected earlier may return
+    bool Changed = false;
+    for (size_t i = 0; i < n; i ++) {
+      double Residual = fabs (Y[i] - c0 - c1 * Species -> Energy[i]) * sqrt (Weight[i]);
+      char Flag = (Residual > CLIP_LIMIT * Scatter) ? FIT_REJECTED : FIT_USED;
+      if (Flag != Species -> Used[i]) Changed = true;
+      Species -> Used[i] = Flag;
+    }
+    if (!Changed) {
+      Species -> Converged = true;
+      break;
+    }
+  }
+
+  // Find the temperature from the last fit
+  if (Species -> NumUsed < MIN_FIT_LINES) return;
+  Species -> Intercept = c0;
+  Species -> Slope = c1;
+  Species -> ChiSqDof = (Species -> NumUsed > 2) ?
+    ChiSq / (Species -> NumUsed - 2) : 0.0;
+  Species -> SlopeError = sqrt (cov11 * max (Species -> ChiSqDof, 0.0));
+  if (c1 >= 0.0) return;
+  Species -> Temperature = -1.0 / (BOLTZMANN_CM * c1);
+  Species -> TemperatureError = Species -> SlopeError / (BOLTZMANN_CM * c1 * c1);
+  Species -> Fitted = true;
+}
+
+
+//------------------------------------------------------------------------------
+// Main program
+//
+int main (int argc, char *argv[])
+{
+  KuruczLines Kurucz;
+  vector <Line> Lines;
+  WritelinesHeader Header;
+  map <double, unsigned int> SpeciesIndex;
+  vector <SpeciesFit> Species;
+  vector <thread> Workers;
+  double Tolerance = DEF_MATCH_TOLERANCE;
+  unsigned int NumUnmatched = 0, NumPredicted = 0, NumNoIntensity = 0;
+  ofstream Output;
+
+  // Check the user's command line input
+  if (argc < MIN_NUM_ARGS || argc > MAX_NUM_ARGS) {
+    cout << "Syntax error: Wrong number of arguments" << endl;
+    showHelp ();
+    return LC_SYNTAX_ERROR;
+  }
+  if (argc == MAX_NUM_ARGS) {
+    istringstream iss (argv [ARG_TOLERANCE]);
+    if (!(iss >> Tolerance) || Tolerance < 0.0) {
+      cout << "Syntax error: Invalid tolerance " << argv [ARG_TOLERANCE] << endl;
+      return LC_SYNTAX_ERROR;
+    }
+  }
+
+  try {
+    // Load the Kurucz lists and the line list, and index the Kurucz lines
+    istringstream iss (argv [ARG_KURUCZ]);
+    string NextList;
+    while (getline (iss, NextList, ',')) {
+      if (NextList.length () > 0) loadKurucz (NextList, Kurucz);
+    }
+    Kurucz.Index.build (Kurucz.Sigma);
+    readLineList (argv [ARG_LIST], &Lines, &Header);
+    Output.open (argv [ARG_OUTPUT], ios::out);
+    if (!Output.is_open ()) {
+      cout << "Error: Cannot open " << argv [ARG_OUTPUT]
+        << " for output. Fit aborted." << endl;
+      throw int (LC_FILE_OPEN_ERROR);
+    }
+  } catch (int Err) {
+    return Err;
+  }
+
+  // Match each line with a Kurucz line, and sort the matched lines by species.
+  // Lines matched to a transition with a predicted level, or with no positive
+  // intensity, cannot be placed on a Boltzmann plot.
+  for (unsigned int i = 0; i < Lines.size (); i ++) {
+    long Match = matchLine (Kurucz, Lines[i].wavenumber (), Tolerance);
+    if (Match < 0) {
+      NumUnmatched ++;
+      continue;
+    }
+    if (Kurucz.Predicted [Match]) {
+      NumPredicted ++;
+      continue;
+    }
+    if (Lines[i].eqwidth () <= 0.0 || Lines[i].peak () == 0.0) {
+      NumNoIntensity ++;
+      continue;
+    }
+    map <double, unsigned int>::iterator Index = SpeciesIndex.find (Kurucz.Code [Match]);
+    if (Index == SpeciesIndex.end ()) {
+      Index = SpeciesIndex.insert (make_pair (Kurucz.Code [Match],
+        (unsigned int) Species.size ())).first;
+      Species.push_back (SpeciesFit ());
+      Species.back ().Code = Kurucz.Code [Match];
+    }
+    SpeciesFit &Fit = Species [Index -> second];
+    Fit.Line.push_back (Lines[i].line ());
+    Fit.Sigma.push_back (Lines[i].wavenumber ());
+    Fit.Offset.push_back (Kurucz.Sigma [Match] - Lines[i].wavenumber ());
+    Fit.Energy.push_back (Kurucz.EUpper [Match]);
+    Fit.LogGf.push_back (Kurucz.LogGf [Match]);
+    Fit.Intensity.push_back (Lines[i].eqwidth ());
+    Fit.Peak.push_back (fabs (Lines[i].peak ()));
+  }
+
+  // Fit the species a round at a time, one species to each thread
+  unsigned int NumWorkers = thread::hardware_concurrency ();
+  if (NumWorkers == 0) NumWorkers = 1;
+  for (unsigned int Round = 0; Round < Species.size (); Round += NumWorkers) {
+    for (unsigned int i = Round; i < Species.size () && i < Round + NumWorkers; i ++) {
+      Workers.push_back (thread (fitSpecies, &Species[i]));
+    }
+    for (unsigned int i = 0; i < Workers.size (); i ++) Workers[i].join ();
+    Workers.clear ();
+  }
+
+  // Write the matched lines of each species, in order of species code
+  Output << "# list: " << argv [ARG_LIST] << endl;
+  Output << "# kurucz: " << argv [ARG_KURUCZ] << endl;
+  Output << "#  code   line    wavenumber  dsig/mK     E upper  log gf"
+    << "    intensity  ln(I/gfs3)     weight use" << endl;
+  for (map <double, unsigned int>::iterator i = SpeciesIndex.begin ();
+    i != SpeciesIndex.end (); i ++) {
+    SpeciesFit &Fit = Species [i -> second];
+    for (unsigned int j = 0; j < Fit.Line.size (); j ++) {
+      FixedRecord Record (BoltzmannFormat);
+      Record.put (Fit.Code);
+      Record.put (int (Fit.Line[j]));
+      Record.put (Fit.Sigma[j]);
+      Record.put (Fit.Offset[j] * 1000.0);
+      Record.put (Fit.Energy[j]);
+      Record.put (Fit.LogGf[j]);
+      Record.put (Fit.Intensity[j]);
+      Record.put (Fit.Y[j]);
+      Record.put (Fit.Weight[j]);
+      Record.put (Fit.Used[j]);
+      Output << Record.str () << '\n';
+    }
+  }
+
+  // Summarise the fits on the screen and at the end of the output
+  ostringstream Summary;
+  Summary << Lines.size () - NumUnmatched - NumPredicted - NumNoIntensity
+    << " of " << Lines.size () << " lines matched (" << NumUnmatched
+    << " unmatched or ambiguous, " << NumPredicted << " of predicted levels, "
+    << NumNoIntensity << " without an intensity)" << endl;
+  for (map <double, unsigned int>::iterator i = SpeciesIndex.begin ();
+    i != SpeciesIndex.end (); i ++) {
+    SpeciesFit &Fit = Species [i -> second];
+    char Code [32];
+    snprintf (Code, sizeof (Code), "%.2f", Fit.Code);
+    Summary << "  " << Code << " : " << Fit.NumUsed << " of " << Fit.Line.size ()
+      << " lines used, ";
+    if (Fit.Fitted) {
+      Summary << "T_exc = " << Fit.Temperature << " +/- " << Fit.TemperatureError
+        << " K, chi^2/dof = " << Fit.ChiSqDof << endl;
+    } else if (Fit.NumUsed < MIN_FIT_LINES) {
+      Summary << "too few lines to fit" << endl;
+    } else {
+      Summary << "the slope is not negative, so no temperature was found" << endl;
+    }
+    if (!Fit.Converged && Fit.NumUsed >= MIN_FIT_LINES) {
+      Summary << "    Warning: The rejected lines still changed after "
+        << MAX_CLIP_ITERATIONS << " passes. The fit is of the last lines used."
+        << endl;
+    }
+  }
+  cout << Summary.str ();
+  istringstream SummaryLines (Summary.str ());
+  string SummaryRow;
+  while (getline (SummaryLines, SummaryRow)) {
+    Output << "# " << SummaryRow << endl;
+  }
+  Output.close ();
+  return LC_NO_ERROR;
+}
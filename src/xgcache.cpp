@@ -0,0 +1,322 @@
+// Xgtools
+// Copyright (C) M. P. Ruffoni 2011-2015
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//==============================================================================
+// XgCache class (xgcache.cpp)
+//==============================================================================
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <atomic>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include "xgcache.h"
+
+#define FNV_OFFSET_BASIS 14695981039346656037ULL
+#define FNV_PRIME        1099511628211ULL
+#define HASH_BUFFER_SIZE 1048576 /* bytes */
+
+// Numbers the temporary files written by store(), so that threads of the same
+// process storing the same key at once never write to the same file
+static atomic <unsigned long> TempFileCount (0);
+
+//------------------------------------------------------------------------------
+// fnvHash (unsigned long long, const char *, size_t) : Continues the 64-bit
+// FNV-1a hash at arg1 over the Size bytes at arg2 and returns the result.
+//
+static unsigned long long fnvHash (unsigned long long Hash, const char *Bytes,
+  size_t Size) {
+  for (size_t i = 0; i < Size; i ++) {
+    Hash ^= (unsigned char) Bytes[i];
+    Hash *= FNV_PRIME;
+  }
+  return Hash;
+}
+
+
+//==============================================================================
+// XgCacheRecord
+//==============================================================================
+
+void XgCacheRecord::putBytes (const void *Bytes, size_t Size) {
+  const char *Start = (const char *) Bytes;
+  Data.insert (Data.end (), Start, Start + Size);
+}
+
+void XgCacheRecord::getBytes (void *Bytes, size_t Size) throw (int) {
+  if (Pos + Size > Data.size ()) throw int (LC_FILE_READ_ERROR);
+  memcpy (Bytes, &Data[Pos], Size);
+  Pos += Size;
+}
+
+void XgCacheRecord::put (int Value) { putBytes (&Value, sizeof (int)); }
+void XgCacheRecord::put (double Value) { putBytes (&Value, sizeof (double)); }
+
+void XgCacheRecord::put (string Value) {
+  put (int (Value.size ()));
+  putBytes (Value.data (), Value.size ());
+}
+
+void XgCacheRecord::put (vector <int> &Values) {
+  put (int (Values.size ()));
+  if (Values.size () > 0) putBytes (&Values[0], sizeof (int) * Values.size ());
+}
+
+void XgCacheRecord::put (vector <double> &Values) {
+  put (int (Values.size ()));
+  if (Values.size () > 0) putBytes (&Values[0], sizeof (double) * Values.size ());
+}
+
+void XgCacheRecord::get (int &Value) throw (int) { getBytes (&Value, sizeof (int)); }
+void XgCacheRecord::get (double &Value) throw (int) { getBytes (&Value, sizeof (double)); }
+
+void XgCacheRecord::get (string &Value) throw (int) {
+  int Size;
+  get (Size);
+  if (Size < 0 || Pos + Size > Data.size ()) throw int (LC_FILE_READ_ERROR);
+  Value.assign (&Data[0] + Pos, Size);
+  Pos += Size;
+}
+
+void XgCacheRecord::get (vector <int> &Values) throw (int) {
+  int Size;
+  get (Size);
+  if (Size < 0) throw int (LC_FILE_READ_ERROR);
+  Values.resize (Size);
+  if (Size > 0) getBytes (&Values[0], sizeof (int) * Size);
+}
+
+void XgCacheRecord::get (vector <double> &Values) throw (int) {
+  int Size;
+  get (Size);
+  if (Size < 0) throw int (LC_FILE_READ_ERROR);
+  Values.resize (Size);
+  if (Size > 0) getBytes (&Values[0], sizeof (double) * Size);
+}
+
+
+//==============================================================================
+// XgCache
+//==============================================================================
+
+//------------------------------------------------------------------------------
+// Constructor : Checks the XGTOOLS_CACHE environment variable. If it is set, the
+// cache directory is created if necessary and the cache enabled. The tool name
+// at arg1 is the first component of every key so that different tools never
+// share records.
+//
+XgCache::XgCache (string NewToolName) {
+  const char *Env = getenv (XG_CACHE_ENV);
+  struct stat DirInfo;
+
+  ToolName = NewToolName;
+  Hash = FNV_OFFSET_BASIS;
+  addValue (ToolName);
+  Enabled = false;
+  if (Env == NULL || Env[0] == '\0') return;
+
+  Directory = Env;
+  if (stat (Directory.c_str (), &DirInfo) != 0) {
+    mkdir (Directory.c_str (), 0755);
+  }
+  if (stat (Directory.c_str (), &DirInfo) != 0 || !S_ISDIR (DirInfo.st_mode)
+    || access (Directory.c_str (), W_OK) != 0) {
+    cout << "Warning: Unable to use " << Directory << " as a cache directory. "
+      << "Continuing without the cache." << endl;
+    return;
+  }
+  Enabled = true;
+}
+
+
+//------------------------------------------------------------------------------
+// addBytes (const char *, size_t) : Adds raw bytes to the key of the current
+// calculation.
+//
+void XgCache::addBytes (const char *Bytes, size_t Size) {
+  Hash = fnvHash (Hash, Bytes, Size);
+}
+
+
+//------------------------------------------------------------------------------
+// addFile (string) : Adds the size and complete contents of the file at arg1 to
+// the key of the current calculation. Nothing is read if the cache is disabled.
+//
+void XgCache::addFile (string Filename) throw (int) {
+  if (!Enabled) return;
+  ifstream File (Filename.c_str (), ios::in|ios::binary);
+  if (!File.is_open ()) {
+    cout << "Error: Cannot read " << Filename
+      << ". Check the file exists and has read permissions." << endl;
+    throw int (LC_FILE_OPEN_ERROR);
+  }
+  vector <char> Buffer (HASH_BUFFER_SIZE);
+  unsigned long long FileSize = 0;
+  while (File.good ()) {
+    File.read (&Buffer[0], HASH_BUFFER_SIZE);
+    addBytes (&Buffer[0], File.gcount ());
+    FileSize += File.gcount ();
+  }
+  addBytes ((char*) &FileSize, sizeof (FileSize));
+  File.close ();
+}
+
+
+//------------------------------------------------------------------------------
+// addFileStat (string) : Adds the path, size, modification time and inode of the
+// file at arg1 to the key of the current calculation, without reading the file.
+// Used for inputs too large to hash on every run. Nothing is added if the cache
+// is disabled.
+//
+void XgCache::addFileStat (string Filename) throw (int) {
+  if (!Enabled) return;
+  struct stat FileInfo;
+  if (stat (Filename.c_str (), &FileInfo) != 0) {
+    cout << "Error: Cannot read " << Filename
+      << ". Check the file exists and has read permissions." << endl;
+    throw int (LC_FILE_OPEN_ERROR);
+  }
+  unsigned long long FileSize = FileInfo.st_size;
+  long long ModTime = FileInfo.st_mtime;
+  long long ModTimeNs = FileInfo.st_mtim.tv_nsec;
+  unsigned long long Inode = FileInfo.st_ino;
+  addValue (Filename);
+  addBytes ((char*) &FileSize, sizeof (FileSize));
+  addBytes ((char*) &ModTime, sizeof (ModTime));
+  addBytes ((char*) &ModTimeNs, sizeof (ModTimeNs));
+  addBytes ((char*) &Inode, sizeof (Inode));
+}
+
+
+//------------------------------------------------------------------------------
+// addValue (...) : Adds a numeric or string parameter to the key of the current
+// calculation. The size of a string is included so that consecutive strings
+// cannot alias one another.
+//
+void XgCache::addValue (double Value) {
+  addBytes ((char*) &Value, sizeof (double));
+}
+
+void XgCache::addValue (string Value) {
+  int Size = Value.size ();
+  addBytes ((char*) &Size, sizeof (int));
+  addBytes (Value.data (), Value.size ());
+}
+
+
+//------------------------------------------------------------------------------
+// key () : Returns the current key as a hexadecimal string. This is also used
+// as the name of the record file in the cache directory.
+//
+string XgCache::key () {
+  char Str [17];
+  sprintf (Str, "%016llx", Hash);
+  return ToolName + "-" + string (Str);
+}
+
+
+//------------------------------------------------------------------------------
+// fetch (XgCacheRecord &) : Loads the record for the current key into arg1.
+// Returns false if the cache is disabled, or if no valid record exists.
+//
+bool XgCache::fetch (XgCacheRecord &Record) {
+  if (!Enabled) return false;
+  string Filename = Directory + "/" + key ();
+  ifstream RecordFile (Filename.c_str (), ios::in|ios::binary);
+  if (!RecordFile.is_open ()) return false;
+
+  int Magic = 0, Version = 0;
+  unsigned long long StoredHash = 0, Size = 0, Checksum = 0;
+  RecordFile.read ((char*) &Magic, sizeof (int));
+  RecordFile.read ((char*) &Version, sizeof (int));
+  RecordFile.read ((char*) &StoredHash, sizeof (StoredHash));
+  RecordFile.read ((char*) &Size, sizeof (Size));
+  if (!RecordFile.good () || Magic != XG_CACHE_MAGIC
+    || Version != XG_CACHE_VERSION || StoredHash != Hash) {
+    return false;
+  }
+
+  // A corrupt or truncated entry may give a size larger than the file holds,
+  // which must be treated as a miss before any memory is allocated for it
+  streampos Start = RecordFile.tellg ();
+  RecordFile.seekg (0, ios::end);
+  streampos End = RecordFile.tellg ();
+  RecordFile.seekg (Start);
+  if (!RecordFile.good () || Start < 0 || End < Start
+    || Size > (unsigned long long) (End - Start)
+    || (unsigned long long) (End - Start) - Size < sizeof (Checksum)) {
+    return false;
+  }
+  vector <char> &Data = Record.data ();
+  Data.resize (Size);
+  if (Size > 0) RecordFile.read (&Data[0], Size);
+  RecordFile.read ((char*) &Checksum, sizeof (Checksum));
+  if (!RecordFile.good ()
+    || Checksum != fnvHash (FNV_OFFSET_BASIS, Size ? &Data[0] : 0, Size)) {
+    Data.clear ();
+    return false;
+  }
+  RecordFile.close ();
+  Record.rewind ();
+  return true;
+}
+
+
+//------------------------------------------------------------------------------
+// store (XgCacheRecord &) : Saves the record at arg1 under the current key. The
+// record is written to a temporary file, named after the key, the process and a
+// count of the files written by the process, which is renamed once complete.
+// Returns false if the cache is disabled or the record could not be written.
+//
+bool XgCache::store (XgCacheRecord &Record) {
+  if (!Enabled) return false;
+  ostringstream oss;
+  oss << Directory << "/." << key () << "." << getpid () << "."
+    << TempFileCount ++;
+  string TempName = oss.str ();
+  string Filename = Directory + "/" + key ();
+
+  ofstream RecordFile (TempName.c_str (), ios::out|ios::binary);
+  if (!RecordFile.is_open ()) {
+    cout << "Warning: Unable to write to the cache directory " << Directory
+      << endl;
+    return false;
+  }
+  vector <char> &Data = Record.data ();
+  int Magic = XG_CACHE_MAGIC, Version = XG_CACHE_VERSION;
+  unsigned long long Size = Data.size ();
+  unsigned long long Checksum =
+    fnvHash (FNV_OFFSET_BASIS, Size ? &Data[0] : 0, Size);
+  RecordFile.write ((char*) &Magic, sizeof (int));
+  RecordFile.write ((char*) &Version, sizeof (int));
+  RecordFile.write ((char*) &Hash, sizeof (Hash));
+  RecordFile.write ((char*) &Size, sizeof (Size));
+  if (Size > 0) RecordFile.write (&Data[0], Size);
+  RecordFile.write ((char*) &Checksum, sizeof (Checksum));
+  RecordFile.close ();
+  if (RecordFile.fail () || rename (TempName.c_str (), Filename.c_str ()) != 0) {
+    remove (TempName.c_str ());
+    cout << "Warning: Unable to write to the cache directory " << Directory
+      << endl;
+    return false;
+  }
+  return true;
+}
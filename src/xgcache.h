@@ -0,0 +1,120 @@
+// Xgtools
+// Copyright (C) M. P. Ruffoni 2011-2015
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//==============================================================================
+// XgCache class (xgcache.h)
+//==============================================================================
+// An opt-in memoisation cache for the results of expensive Xgtools operations,
+// such as response function spline fits and line list calibrations. The cache
+// is disabled by default. It is enabled by setting the XGTOOLS_CACHE
+// environment variable to the directory in which results should be stored.
+//
+// Each result is identified by a key, which is built up by passing the input
+// files and parameters of the calculation to addFile() and addValue(). The key
+// is a 64-bit FNV-1a hash of the tool name, the full contents of every input
+// file, and every parameter value, so any change to the inputs produces a new
+// key. Inputs too large to read on every run, such as the full Kurucz line
+// lists, are instead added with addFileStat(), which keys them on their path,
+// size, modification time and inode. fetch() then returns the stored record
+// for the current key, if one exists, and store() saves a new record under
+// that key.
+//
+// Records are written as a small binary file containing the key, the record
+// length and a checksum, so that stale or truncated entries are treated as a
+// cache miss rather than an error. Each record is first written to a temporary
+// file and then renamed into place, so concurrent runs never see a partially
+// written entry.
+//
+// The contents of a record are assembled and read back with the XgCacheRecord
+// class, which packs integers, doubles, vectors and strings into a byte buffer.
+//
+#ifndef XG_CACHE_H
+#define XG_CACHE_H
+
+#include <string>
+#include <vector>
+#include "ErrDefs.h"
+
+// The environment variable that enables the cache and gives its location
+#define XG_CACHE_ENV "XGTOOLS_CACHE"
+
+// Identifiers written at the start of every cache record. The version must be
+// raised whenever a tool changes what it stores in a record, so that records
+// written by an older version are treated as a cache miss. Version 2 stores
+// the ftsintensity spline covariance scaled by chi^2/dof.
+#define XG_CACHE_MAGIC   0x31434758 /* "XGC1" */
+#define XG_CACHE_VERSION 2
+
+using namespace::std;
+
+class XgCacheRecord {
+  public:
+    XgCacheRecord () { Pos = 0; }
+    ~XgCacheRecord () {}
+
+    // Append values to the end of the record
+    void put (int Value);
+    void put (double Value);
+    void put (string Value);
+    void put (vector <int> &Values);
+    void put (vector <double> &Values);
+
+    // Read values back from the record in the order in which they were put.
+    // An LC_FILE_READ_ERROR is thrown if the record is too short.
+    void get (int &Value) throw (int);
+    void get (double &Value) throw (int);
+    void get (string &Value) throw (int);
+    void get (vector <int> &Values) throw (int);
+    void get (vector <double> &Values) throw (int);
+
+    vector <char> &data () { return Data; }
+    void rewind () { Pos = 0; }
+
+  private:
+    vector <char> Data;
+    size_t Pos;
+    void putBytes (const void *Bytes, size_t Size);
+    void getBytes (void *Bytes, size_t Size) throw (int);
+};
+
+class XgCache {
+  public:
+    XgCache (string NewToolName);
+    ~XgCache () {}
+
+    // Returns true if XGTOOLS_CACHE points to a usable cache directory
+    bool enabled () { return Enabled; }
+
+    // Functions for building the key of the current calculation
+    void addFile (string Filename) throw (int);
+    void addFileStat (string Filename) throw (int);
+    void addValue (double Value);
+    void addValue (string Value);
+    string key ();
+
+    // Functions to retrieve or save the record for the current key
+    bool fetch (XgCacheRecord &Record);
+    bool store (XgCacheRecord &Record);
+
+  private:
+    bool Enabled;
+    string Directory;
+    string ToolName;
+    unsigned long long Hash;
+    void addBytes (const char *Bytes, size_t Size);
+};
+
+#endif // XG_CACHE_H
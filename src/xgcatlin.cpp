@@ -23,34 +23,22 @@
 // updated. This therefore assumes that all the concatenated LIN files belong to
 // THE SAME spectrum.
 //
+// The LIN files may have been written on machines of either byte order. The
+// lines are read into the native byte order, and the new file is written in
+// the byte order of the first file, to match its header.
+//
 #include <iostream>
 #include <fstream>
 #include <vector>
+#include <cstring>
+#include "linfile.h"
 
 using namespace::std;
 
 // Definitions for command line parameters
 #define MIN_NUM_ARGS      4
 
-#define LIN_HEADER_SIZE 320 /* bytes */
-
-typedef struct lin {
-  double wavenumber;
-  float peak;
-  float width;
-  float dmp;
-  short itn;
-  short ihold;
-  char tags [4];
-  float epstot;
-  float epsevn;
-  float epsodd;
-  float epsran;
-  float spare;
-  char id [32];
-} line_in;
-
-const int line_in_size = sizeof (line_in);
+const int line_in_size = sizeof (LinRecord);
 
 //------------------------------------------------------------------------------
 // showHelp () : Prints syntax help message to the standard output.
@@ -70,12 +58,13 @@ void showHelp () {
 //
 int main (int argc, char *argv[]) 
 {
-  ifstream LinIn;
+  LinFile LinIn;
   ofstream Output;
   int FileSize, NumLines;
-  line_in NextLineIn;
-  vector <line_in> Lines;
-  char NextByte;
+  LinRecord NextLineIn;
+  vector <LinRecord> Lines;
+  char Header [LIN_HEADER_SIZE];
+  bool OutputSwapped = false;
   bool SomeLinesSwapped;
   
   // Check the user's command line input
@@ -93,39 +82,38 @@ int main (int argc, char *argv[])
     return 1;
   }
   
-  // Copy the header from the first LIN file to the output file
-  LinIn.open (argv [1], ios::in|ios::binary);
-  if (!LinIn.is_open ()) {
-    cout << "Error: Unable to open " << argv [1] << endl
-      << "Aborting" << endl;
+  // Keep the header from the first LIN file for the output file
+  try {
+    LinIn.open (argv [1]);
+  } catch (int Err) {
+    cout << "Aborting" << endl;
     return 1;
   }
-  for (unsigned int i = 0; i < LIN_HEADER_SIZE; i ++) {
-    LinIn.get (NextByte);
-    Output.put (NextByte);
-  }
+  memcpy (Header, LinIn.header (), LIN_HEADER_SIZE);
+  OutputSwapped = LinIn.swapped ();
   LinIn.close ();
 
   // Read the lines from each of the LIN files specified by the user at the
   // command line. Store the lines in a vector so they can be sorted later.
   for (int File = 1; File < argc - 1; File ++) {
     // Open the next LIN file 
-    LinIn.open (argv [File], ios::in|ios::binary);
-    if (!LinIn.is_open ()) {
-      cout << "Error: Unable to open " << argv [File] << endl << 
-        "Only the lines to this point will be saved in " << argv [argc - 1] << endl;
+    try {
+      LinIn.open (argv [File]);
+    } catch (int Err) {
+      cout << "Only the lines to this point will be saved in " << argv [argc - 1] << endl;
       break;
     }
   
-    // Extract the lines from the file
-    LinIn.read ((char*)&NumLines, sizeof (int));
-    LinIn.seekg (LIN_HEADER_SIZE, ios::beg);
-    for (int i = 0; i < NumLines; i ++) {
-      LinIn.read ((char*)&NextLineIn, line_in_size);
-      Lines.push_back (NextLineIn);
+    // Extract all the lines from the file in a single block
+    NumLines = LinIn.numLines ();
+    size_t FirstLine = Lines.size ();
+    Lines.resize (FirstLine + NumLines);
+    if (NumLines > 0) {
+      Lines.resize (FirstLine + LinIn.read (&Lines [FirstLine], NumLines));
     }
     LinIn.close ();
-    cout << "Read " << NumLines << " lines from " << argv [File] << endl;
+    cout << "Read " << Lines.size () - FirstLine << " lines from " << argv [File] 
+      << (LinIn.swapped () ? " (byte-swapped)" : "") << endl;
   }
   
   
@@ -142,16 +130,17 @@ int main (int argc, char *argv[])
     }
   } while (SomeLinesSwapped);
   
-  // Finally, save the lines to the output file. Update the file header so that
-  // it contains the correct number of lines and bytes in the file.
-  for (unsigned int i = 0; i < Lines.size (); i ++) {
-    Output.write ((char*)&Lines [i], line_in_size);
-  }
-  FileSize = Output.tellp ();
-  Output.seekp (0, ios::beg);
+  // Finally, save the lines to the output file, in the byte order of the first
+  // LIN file. Update the file header so that it contains the correct number of
+  // lines and bytes in the file.
   NumLines = Lines.size ();
-  Output.write ((char*)&NumLines, sizeof (int));
-  Output.write ((char*)&FileSize, sizeof (int));
+  FileSize = LIN_HEADER_SIZE + NumLines * line_in_size;
+  setLinHeaderCounts (Header, NumLines, FileSize, OutputSwapped);
+  Output.write (Header, LIN_HEADER_SIZE);
+  if (NumLines > 0) {
+    if (OutputSwapped) swapLinRecords (&Lines [0], NumLines);
+    Output.write ((char*)&Lines [0], FileSize - LIN_HEADER_SIZE);
+  }
   Output.close ();
   cout << "Saved " << NumLines << " lines (" << FileSize << " bytes)" << " to "
     << argv [argc - 1] << endl;
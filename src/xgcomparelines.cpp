@@ -0,0 +1,345 @@
+// Xgtools
+// Copyright (C) M. P. Ruffoni 2011-2015
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// xgcomparelines : Compares two fits of the same spectrum
+//
+// xgcomparelines compares two XGremlin writelines line lists, typically from
+// fits of the same spectrum with different settings, to show how stable the
+// fitted line parameters are. Lines in the two lists are matched by wavenumber,
+// and for each matched pair the changes in wavenumber, peak, width and epstot
+// from the first list to the second are written to the output. Lines found in
+// only one list are flagged: '-' for a line that has disappeared from the
+// second list, and '+' for a line that has appeared in it. The mean, standard
+// deviation and largest magnitude of every change are given at the end of the
+// output and printed to the screen.
+//
+// Both lists must be sorted by wavenumber, as XGremlin writes them. They are
+// read together in a single sweep, holding only the next two lines of each, so
+// lists of any length can be compared. A line is matched to the nearest line
+// in the other list within the tolerance, unless the following line of either
+// list would be a closer match.
+//
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cmath>
+#include "ErrDefs.h"
+#include "line.h"
+#include "fixedformat.h"
+#include "lineio.cpp"
+
+using namespace::std;
+
+// Definitions for command line parameters
+#define MIN_NUM_ARGS     4
+#define MAX_NUM_ARGS     5
+#define ARG_LIST_1       1
+#define ARG_LIST_2       2
+#define ARG_OUTPUT       3
+#define ARG_TOLERANCE    4
+
+// The default largest difference in wavenumber between matched lines
+#define DEF_MATCH_TOLERANCE 0.01 /* cm-1 */
+
+// Flags written in the first column of the output
+#define CMP_MATCHED     '='
+#define CMP_DISAPPEARED '-'
+#define CMP_APPEARED    '+'
+
+// The rows of the comparison. Rows for unmatched lines end after the
+// wavenumber. Changes in wavenumber and width are given in mK.
+static const FieldFormat CompareFormat [] = {
+  {   0,  1,  0, FF_CHAR },       /* Flag            */
+  {   1,  7,  0, FF_INTEGER },    /* Line in list 1  */
+  {   8,  7,  0, FF_INTEGER },    /* Line in list 2  */
+  {  15, 14,  6, FF_FIXED },      /* Wavenumber      */
+  {  29, 11,  3, FF_FIXED },      /* d(Wavenumber)   */
+  {  40, 12,  3, FF_SCIENTIFIC }, /* d(Peak)         */
+  {  52, 10,  2, FF_FIXED },      /* d(Width)        */
+  {  62, 12,  3, FF_SCIENTIFIC }, /* d(Epstot)       */
+  {   0,  0,  0, FF_END }
+};
+
+// The statistics kept for a change in one line parameter. These are updated
+// as each pair of lines is compared, using Welford's method for the variance.
+typedef struct td_DeltaStats {
+  unsigned int N;
+  double Mean;
+  double SumSq;
+  double MaxAbs;
+  td_DeltaStats () { N = 0; Mean = 0.0; SumSq = 0.0; MaxAbs = 0.0; }
+  void add (double Delta) {
+    N ++;
+    double Diff = Delta - Mean;
+    Mean += Diff / N;
+    SumSq += Diff * (Delta - Mean);
+    if (fabs (Delta) > MaxAbs) MaxAbs = fabs (Delta);
+  }
+  double stdDev () { return N > 1 ? sqrt (SumSq / (N - 1)) : 0.0; }
+} DeltaStats;
+
+//==============================================================================
+// ListStream class : Reads the lines of a writelines list one at a time, and
+// keeps the next two so that they may be compared with another list.
+//==============================================================================
+class ListStream {
+  public:
+    void open (string Filename) throw (int);
+    bool has (int i) { return i < NumHeld; }
+    Line &peek (int i) { return Held [i]; }
+    void advance () throw (int);
+    string name () { return Name; }
+
+  private:
+    ifstream File;
+    string Name;
+    double WavCorr;
+    unsigned int Row;
+    Line Held [2];
+    int NumHeld;
+    bool readNext (Line &Next) throw (int);
+};
+
+
+//------------------------------------------------------------------------------
+// open (string) : Opens the writelines list named at arg1, reads its header,
+// and reads the first two lines.
+//
+void ListStream::open (string Filename) throw (int) {
+  string HeaderRow;
+  Name = Filename;
+  File.open (Filename.c_str (), ios::in);
+  if (!File.is_open ()) {
+    cout << "Error: Cannot read " << Filename
+      << ". Check the file exists and has read permissions." << endl;
+    throw int (LC_FILE_OPEN_ERROR);
+  }
+  for (Row = 1; Row <= XG_WRITELINES_HEADER_LENGTH; Row ++) {
+    if (!getline (File, HeaderRow)) {
+      cout << "Error reading the header of " << Filename << ".\n"
+        << "Check the file was written with XGremlin's 'writelines' command."
+        << endl;
+      throw int (LC_FILE_HEAD_ERROR);
+    }
+    if (Row == 1) WavCorr = getWavCorr (HeaderRow);
+  }
+  NumHeld = 0;
+  while (NumHeld < 2 && readNext (Held [NumHeld])) NumHeld ++;
+}
+
+
+//------------------------------------------------------------------------------
+// advance () : Drops the first line held and reads the next from the file.
+//
+void ListStream::advance () throw (int) {
+  if (NumHeld == 0) return;
+  if (NumHeld == 2) {
+    Held [0] = Held [1];
+    NumHeld = readNext (Held [1]) ? 2 : 1;
+  } else {
+    NumHeld = 0;
+  }
+}
+
+
+//------------------------------------------------------------------------------
+// readNext (Line &) : Reads the next line in the list into arg1. Returns false
+// at the end of the list. An error is thrown if a row cannot be read, or if
+// the list is not sorted by wavenumber.
+//
+bool ListStream::readNext (Line &Next) throw (int) {
+  string LineString;
+  while (getline (File, LineString)) {
+    Row ++;
+    if (LineString.find_first_not_of (" \t\r") == string::npos) continue;
+    double Last = (NumHeld > 0) ? Held [NumHeld - 1].wavenumber () : 0.0;
+    try {
+      Next = Line (LineString, WavCorr);
+    } catch (const char *Err) {
+      cout << "Error reading " << Err << " from line " << Row << " in "
+        << Name << ". Comparison aborted." << endl;
+      throw int (LC_FILE_READ_ERROR);
+    }
+    if (NumHeld > 0 && Next.wavenumber () < Last) {
+      cout << "Error: " << Name << " is not sorted by wavenumber at line "
+        << Row << ". Sort it with xgmergelines first." << endl;
+      throw int (LC_FILE_READ_ERROR);
+    }
+    return true;
+  }
+  return false;
+}
+
+
+//------------------------------------------------------------------------------
+// showHelp () : Prints syntax help message to the standard output.
+//
+void showHelp () {
+  cout << endl;
+  cout << "xgcomparelines : " << endl;
+  cout << "---------------------------------------------------------------" << endl;
+  cout << "Syntax : xgcomparelines <list 1> <list 2> <output> [<tolerance>]" << endl << endl;
+  cout << "<list n>    : An XGremlin writelines line list, sorted by wavenumber." << endl;
+  cout << "<output>    : The changes in each line from list 1 to list 2 are saved here." << endl;
+  cout << "<tolerance> : The largest wavenumber difference between matched lines" << endl;
+  cout << "              (default " << DEF_MATCH_TOLERANCE << " cm-1)." << endl << endl;
+}
+
+
+//------------------------------------------------------------------------------
+// writeUnmatched (ostream &, char, Line &) : Writes a row for the line at arg3,
+// which is only found in one list, marked with the flag at arg2.
+//
+void writeUnmatched (ostream &Output, char Flag, Line &Unmatched) {
+  FixedRecord Record (CompareFormat);
+  Record.put (Flag);
+  if (Flag == CMP_DISAPPEARED) {
+    Record.put (Unmatched.line ());
+    Record.put ("");
+  } else {
+    Record.put ("");
+    Record.put (Unmatched.line ());
+  }
+  Record.put (Unmatched.wavenumber ());
+  Output << Record.str () << '\n';
+}
+
+
+//------------------------------------------------------------------------------
+// writeStats (ostream &, string, DeltaStats &) : Writes the statistics at arg3
+// for the change in the line parameter named at arg2.
+//
+void writeStats (ostream &Output, string Name, DeltaStats &Stats) {
+  Output << "  " << Name << " : mean = " << Stats.Mean << ", std dev = "
+    << Stats.stdDev () << ", max |change| = " << Stats.MaxAbs << endl;
+}
+
+
+//------------------------------------------------------------------------------
+// Main program
+//
+int main (int argc, char *argv[])
+{
+  ListStream List1, List2;
+  ofstream Output;
+  double Tolerance = DEF_MATCH_TOLERANCE;
+  DeltaStats Sigma, Peak, Width, Epstot;
+  unsigned int NumDisappeared = 0, NumAppeared = 0;
+
+  // Check the user's command line input
+  if (argc < MIN_NUM_ARGS || argc > MAX_NUM_ARGS) {
+    cout << "Syntax error: Wrong number of arguments" << endl;
+    showHelp ();
+    return LC_SYNTAX_ERROR;
+  }
+  if (argc == MAX_NUM_ARGS) {
+    istringstream iss (argv [ARG_TOLERANCE]);
+    if (!(iss >> Tolerance) || Tolerance < 0.0) {
+      cout << "Syntax error: Invalid tolerance " << argv [ARG_TOLERANCE] << endl;
+      return LC_SYNTAX_ERROR;
+    }
+  }
+
+  try {
+    List1.open (argv [ARG_LIST_1]);
+    List2.open (argv [ARG_LIST_2]);
+    Output.open (argv [ARG_OUTPUT], ios::out);
+    if (!Output.is_open ()) {
+      cout << "Error: Cannot open " << argv [ARG_OUTPUT]
+        << " for output. Comparison aborted." << endl;
+      throw int (LC_FILE_OPEN_ERROR);
+    }
+    Output << "# list 1: " << List1.name () << endl;
+    Output << "# list 2: " << List2.name () << endl;
+    Output << "#  line1  line2    wavenumber   dsig/mK        dpeak  dwidth/mK"
+      << "      depstot" << endl;
+
+    // Sweep through both lists together. The line with the lower wavenumber
+    // is unmatched if no line in the other list is close enough. Otherwise the
+    // two are matched, unless the next line in either list is closer still.
+    while (List1.has (0) || List2.has (0)) {
+      if (!List2.has (0) || (List1.has (0) &&
+        List1.peek (0).wavenumber () < List2.peek (0).wavenumber () - Tolerance)) {
+        writeUnmatched (Output, CMP_DISAPPEARED, List1.peek (0));
+        NumDisappeared ++;
+        List1.advance ();
+        continue;
+      }
+      if (!List1.has (0) ||
+        List2.peek (0).wavenumber () < List1.peek (0).wavenumber () - Tolerance) {
+        writeUnmatched (Output, CMP_APPEARED, List2.peek (0));
+        NumAppeared ++;
+        List2.advance ();
+        continue;
+      }
+      Line &Line1 = List1.peek (0);
+      Line &Line2 = List2.peek (0);
+      double Separation = fabs (Line2.wavenumber () - Line1.wavenumber ());
+      if (List2.has (1) &&
+        fabs (List2.peek (1).wavenumber () - Line1.wavenumber ()) < Separation) {
+        writeUnmatched (Output, CMP_APPEARED, Line2);
+        NumAppeared ++;
+        List2.advance ();
+        continue;
+      }
+      if (List1.has (1) &&
+        fabs (List1.peek (1).wavenumber () - Line2.wavenumber ()) < Separation) {
+        writeUnmatched (Output, CMP_DISAPPEARED, Line1);
+        NumDisappeared ++;
+        List1.advance ();
+        continue;
+      }
+      FixedRecord Record (CompareFormat);
+      Record.put (CMP_MATCHED);
+      Record.put (Line1.line ());
+      Record.put (Line2.line ());
+      Record.put (Line1.wavenumber ());
+      Record.put ((Line2.wavenumber () - Line1.wavenumber ()) * 1000.0);
+      Record.put (Line2.peak () - Line1.peak ());
+      Record.put (Line2.width () - Line1.width ());
+      Record.put (Line2.epstot () - Line1.epstot ());
+      Output << Record.str () << '\n';
+      Sigma.add ((Line2.wavenumber () - Line1.wavenumber ()) * 1000.0);
+      Peak.add (Line2.peak () - Line1.peak ());
+      Width.add (Line2.width () - Line1.width ());
+      Epstot.add (Line2.epstot () - Line1.epstot ());
+      List1.advance ();
+      List2.advance ();
+    }
+  } catch (int Err) {
+    return Err;
+  }
+
+  // Summarise the comparison on the screen and at the end of the output
+  ostringstream Summary;
+  Summary << Sigma.N << " lines matched, " << NumDisappeared
+    << " only in list 1 (-), " << NumAppeared << " only in list 2 (+)" << endl;
+  if (Sigma.N > 0) {
+    Summary << "Changes from list 1 to list 2:" << endl;
+    writeStats (Summary, "wavenumber / mK", Sigma);
+    writeStats (Summary, "peak           ", Peak);
+    writeStats (Summary, "width / mK     ", Width);
+    writeStats (Summary, "epstot         ", Epstot);
+  }
+  cout << Summary.str ();
+  istringstream Lines (Summary.str ());
+  string SummaryRow;
+  while (getline (Lines, SummaryRow)) {
+    Output << "# " << SummaryRow << endl;
+  }
+  Output.close ();
+  return LC_NO_ERROR;
+}
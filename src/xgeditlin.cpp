@@ -0,0 +1,175 @@
+// Xgtools
+// Copyright (C) M. P. Ruffoni 2011-2015
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// xgeditlin : Sets the hold flags, iteration counts or tags of lines in an
+// XGremlin LIN file
+//
+// The lines to edit are chosen by wavenumber, peak or width, or by number, and
+// the file is changed in place, without starting XGremlin. For example,
+//
+//   xgeditlin spectrum.lin -peak 0 5 -hold 7
+//   xgeditlin spectrum.lin -lines 3,8,20-25 -tags X
+//
+// holds every line with a peak of magnitude below 5, and tags lines 3, 8 and 20
+// to 25 with an X. A line is edited only if it meets every condition given.
+// Wavenumbers are as stored in the LIN file, without any wavenumber correction,
+// and widths are in mK. The file may have been written in either byte order,
+// and is left in the byte order in which it was written.
+//
+// Compile this code using the following command:
+//
+// g++ xgeditlin.cpp linfile.cpp byteorder.cpp -o xgeditlin
+//
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include "linfile.h"
+
+using namespace::std;
+
+// Definitions for command line parameters
+#define MIN_NUM_ARGS 4
+#define ARG_LIN      1
+
+// The number of characters of tags held by each line
+#define LIN_TAGS_LENGTH 4
+
+
+//------------------------------------------------------------------------------
+// showHelp () : Prints syntax help message to the standard output.
+//
+void showHelp () {
+  cout << endl;
+  cout << "xgeditlin : Edits the lines of an XGremlin LIN file in place" << endl;
+  cout << "---------------------------------------------------------------" << endl;
+  cout << "Syntax : xgeditlin <lin file> [<conditions>] <changes>" << endl << endl;
+  cout << "<lin file>   : The XGremlin LIN file to edit." << endl;
+  cout << "<conditions> : Any of the following, all of which a line must meet" << endl;
+  cout << "               to be edited (default all lines):" << endl;
+  cout << "  -sigma <min> <max> : Wavenumber between min and max" << endl;
+  cout << "  -peak <min> <max>  : Magnitude of the peak between min and max" << endl;
+  cout << "  -width <min> <max> : Width in mK between min and max" << endl;
+  cout << "  -lines <list>      : Line numbers, e.g. 3,8,20-25" << endl;
+  cout << "<changes>    : One or more of the following:" << endl;
+  cout << "  -hold <n>          : Set the hold flags (ihold) to n" << endl;
+  cout << "  -itn <n>           : Set the iteration count (itn) to n" << endl;
+  cout << "  -tags <tags>       : Set the tags to up to " << LIN_TAGS_LENGTH
+    << " characters" << endl << endl;
+}
+
+
+//------------------------------------------------------------------------------
+// parseLineList (string, vector <int> &) : Adds the line numbers in the list at
+// arg1, given as numbers or ranges separated by commas, to arg2. Returns false
+// if the list cannot be read.
+//
+bool parseLineList (string List, vector <int> &Lines) {
+  istringstream iss (List);
+  string Item;
+  while (getline (iss, Item, ',')) {
+    int First, Last;
+    char Dash;
+    istringstream Range (Item);
+    if (!(Range >> First)) return false;
+    Last = First;
+    if (Range >> Dash) {
+      if (Dash != '-' || !(Range >> Last) || Last < First) return false;
+    }
+    for (int i = First; i <= Last; i ++) Lines.push_back (i);
+  }
+  sort (Lines.begin (), Lines.end ());
+  Lines.erase (unique (Lines.begin (), Lines.end ()), Lines.end ());
+  return Lines.size () > 0;
+}
+
+
+//------------------------------------------------------------------------------
+// readValue (char *, T &) : Reads the value at arg1 into arg2. Returns false if
+// arg1 does not hold a value of the right type.
+//
+template <class T> bool readValue (char *Text, T &Value) {
+  istringstream iss (Text);
+  char Extra;
+  return (iss >> Value) && !(iss >> Extra);
+}
+
+
+//------------------------------------------------------------------------------
+// Main program
+//
+int main (int argc, char *argv[])
+{
+  LinEdit Edit;
+  bool ValidArgs = (argc >= MIN_NUM_ARGS);
+
+  // Read the conditions and changes from the command line
+  for (int i = ARG_LIN + 1; ValidArgs && i < argc; i ++) {
+    string Option = argv [i];
+    int NumValues = (Option == "-sigma" || Option == "-peak"
+      || Option == "-width") ? 2 : 1;
+    if (i + NumValues >= argc) {
+      ValidArgs = false;
+    } else if (Option == "-sigma") {
+      ValidArgs = readValue (argv [i+1], Edit.MinSigma)
+        && readValue (argv [i+2], Edit.MaxSigma);
+    } else if (Option == "-peak") {
+      ValidArgs = readValue (argv [i+1], Edit.MinPeak)
+        && readValue (argv [i+2], Edit.MaxPeak);
+    } else if (Option == "-width") {
+      ValidArgs = readValue (argv [i+1], Edit.MinWidth)
+        && readValue (argv [i+2], Edit.MaxWidth);
+    } else if (Option == "-lines") {
+      ValidArgs = parseLineList (argv [i+1], Edit.Lines);
+    } else if (Option == "-hold") {
+      ValidArgs = Edit.SetHold = readValue (argv [i+1], Edit.Hold);
+    } else if (Option == "-itn") {
+      ValidArgs = Edit.SetItn = readValue (argv [i+1], Edit.Itn);
+    } else if (Option == "-tags") {
+      ValidArgs = Edit.SetTags = (strlen (argv [i+1]) <= LIN_TAGS_LENGTH);
+      memcpy (Edit.Tags, argv [i+1], min (strlen (argv [i+1]),
+        size_t (LIN_TAGS_LENGTH)));
+    } else {
+      ValidArgs = false;
+    }
+    if (!ValidArgs) {
+      cout << "Syntax error: Invalid option or value at " << Option << endl;
+    }
+    i += NumValues;
+  }
+  if (ValidArgs && !Edit.SetHold && !Edit.SetItn && !Edit.SetTags) {
+    cout << "Syntax error: No changes were specified" << endl;
+    ValidArgs = false;
+  }
+  if (!ValidArgs) {
+    if (argc < MIN_NUM_ARGS) cout << "Syntax error: Too few arguments" << endl;
+    showHelp ();
+    return LC_SYNTAX_ERROR;
+  }
+
+  // Edit the file in place
+  size_t NumEdited;
+  try {
+    NumEdited = editLinFile (argv [ARG_LIN], Edit);
+  } catch (int Err) {
+    cout << "Aborting" << endl;
+    return Err;
+  }
+  cout << "Edited " << NumEdited << " lines in " << argv [ARG_LIN] << endl;
+  return LC_NO_ERROR;
+}
@@ -37,6 +37,7 @@
 #include <cmath>
 //#include "line.h"
 #include "xgline.h"
+#include "linfile.h"
 
 #define NUM_REQ_ARGS 4
 #define ERR_SYNTAX_ERROR 1
@@ -57,7 +58,6 @@ using namespace::std;
 
 //#define XG_WRITELINES_HEADER_LENGTH 4 /* rows */
 #define XG_WAVCORR_OFFSET 33
-#define LIN_HEADER_SIZE 320 /* bytes */
 
 // A namespace to store the header from the XGremlin writelines file. This can
 // then be used to copy the header to the output line list in writeLines().
@@ -68,43 +68,6 @@ namespace writelines_header {
   string Columns;
 }
 
-// In XGremlin's lineio.f, the layout of a .lin file record is explained:
-// 
-//"* variable    type           size/bytes
-// * --------    ----           ----------
-// * sig         real*2         8
-// * xint        real           4
-// * width       real           4
-// * dmping      real           4
-// * itn         integer*2      2
-// * ihold       integer*2      2
-// * tags        character*4    4
-// * epstot      real           4
-// * epsevn      real           4
-// * epsodd      real           4
-// * epsran      real           4
-// * spare       real           4
-// * ident       character*32   32"
-// 
-// struct line_in replicates this record structure, allowing individual lines
-// to be read directly from a .lin file in the readLinFile() function below.
-//
-typedef struct line_in {
-  double wavenumber;
-  float peak;
-  float width;
-  float dmp;
-  short itn;
-  short ihold;
-  char tags [4];
-  float epstot;
-  float epsevn;
-  float epsodd;
-  float epsran;
-  float spare;
-  char id [32];
-} LineIn;
-
 
 void prep_spectrum (char *Filename, char *LineList, vector <string> &Script, double Scale);
 void load_spectrum (char *Filename, vector <string> &Script);
@@ -112,7 +75,7 @@ void fit_lines (int Iterations, vector <bool> Drop, vector <string> &Script);
 void write_lines (vector <string> &Script);
 void run_xg_script (vector <string> &Script) throw (string);
 //void readLineList (string Filename, vector <Line> *Lines) throw (int);
-vector <XgLine> readLinFile (string LinFile) throw (int);
+vector <XgLine> readLinFile (string LinName) throw (int);
 void testArguments (int argc, char *argv[]) throw (string);
 void showHelp ();
 
@@ -330,32 +293,30 @@ void showHelp () {
 //------------------------------------------------------------------------------
 // readLinFile
 //
-vector <XgLine> readLinFile (string LinFile) throw (int) {
-  ifstream LinIn;
+vector <XgLine> readLinFile (string LinName) throw (int) {
+  LinFile LinIn;
   int NumLines;
-  float Scale, SigCorrection;
-  LineIn NextLineIn;
+  LinRecord NextLineIn;
+  vector <LinRecord> Records;
   XgLine NextLine;
   vector <XgLine> RtnLines;
 //  VoigtLsqfit V;
   
-  LinIn.open (LinFile.c_str (), ios::in|ios::binary);
-  if (!LinIn.is_open ()) {
-    cout << "Error opening " << LinFile << ". File loading aborted." << endl;
+  // Open the file, finding its byte order, and read the necessary information
+  // from the LIN file header.
+  try {
+    LinIn.open (LinName);
+  } catch (int Err) {
     throw int(LC_FILE_READ_ERROR);
   }
+  NumLines = LinIn.numLines ();
   
-  // Read the necessary information from the LIN file header.
-  LinIn.read ((char*)&NumLines, sizeof (int));
-  LinIn.seekg (sizeof (int) + sizeof (float), ios::cur);
-  LinIn.read ((char*)&Scale, sizeof (float));
-  LinIn.read ((char*)&SigCorrection, sizeof (float));
-  
-  // Move to the location of the first line then extract all the line records.
-  LinIn.seekg (LIN_HEADER_SIZE, ios::beg);
+  // Extract all the line records in a single block, in native byte order.
+  Records.resize (NumLines);
+  size_t NumRead = (NumLines > 0) ? LinIn.read (&Records [0], NumLines) : 0;
   for (int i = 0; i < NumLines; i ++) {
-    LinIn.read ((char*)&NextLineIn, sizeof (LineIn));
-    if (LinIn.good ()) {
+    NextLineIn = Records [i];
+    if ((size_t) i < NumRead) {
       NextLine.line (i + 1);
       NextLine.itn (NextLineIn.itn);
       NextLine.h (NextLineIn.ihold);
@@ -370,7 +331,7 @@ vector <XgLine> readLinFile (string LinFile) throw (int) {
       NextLine.epsran (NextLineIn.epsran);
       NextLine.id (string (NextLineIn.id));
       NextLine.id (NextLine.id().substr (0, NextLine.id().length () - 4));
-      NextLine.name (LinFile.substr (LinFile.find_last_of ("/\\") + 1));
+      NextLine.name (LinName.substr (LinName.find_last_of ("/\\") + 1));
       
       // Calculate the equivalent width of the line using XGremlin's mystical
       // "p" array, as shown in subroutine wrtlin in lineio.f
@@ -385,7 +346,7 @@ vector <XgLine> readLinFile (string LinFile) throw (int) {
       RtnLines.push_back (NextLine);
     }
     else {
-      cout << "Error extracting data from " << LinFile << ". File loading aborted." << endl;
+      cout << "Error extracting data from " << LinName << ". File loading aborted." << endl;
       throw int(LC_FILE_READ_ERROR);
     }    
   }
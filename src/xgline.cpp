@@ -19,6 +19,7 @@
 //==============================================================================
 
 #include "xgline.h"
+#include "fixedformat.h"
 #include <iostream>
 #include <sstream>
 #include <cmath>
@@ -195,13 +196,13 @@ void XgLine::print (ostream& Output) {
 // use with XGremlin's readlines command in 'syn' mode. 
 //
 string XgLine::getLineSynString () {
-  ostringstream oss;
-  oss.width (15); oss << left << Identification << "  ";
-  oss.width (12); oss.precision (5); oss << fixed << right << wavenumber ();
-  oss.width (10); oss.precision (4); oss << right << peak ();
-  oss.width (9);  oss.precision (2); oss << right << width ();
-  oss.width (8);  oss.precision (4); oss << right << dmp ();
-  return oss.str();
+  FixedRecord Record (SynFormat);
+  Record.put (Identification);
+  Record.put (wavenumber ());
+  Record.put (peak ());
+  Record.put (width ());
+  Record.put (dmp ());
+  return Record.str ();
 }
 
 
@@ -210,25 +211,23 @@ string XgLine::getLineSynString () {
 // the XGremlin writelines file format.
 //
 string XgLine::getLineString () {
-  string IdLong = id();
-  IdLong.resize (LINE_ID_STRING_LEN, ' ');
-  ostringstream oss;
-  oss.width (6);  oss << right << Index << "  ";
-  oss.width (12); oss.precision (6); oss << fixed << right << wavenumber ();
-  oss.width (10); oss.precision (3); oss << scientific << right << peak ();
-  oss.width (9);  oss.precision (2); oss << fixed << right << width ();
-  oss.width (9);  oss.precision (4); oss << fixed << right << dmp ();
-  oss.width (11); oss.precision (4); oss << scientific << right << eqwidth ();
-  oss.width (6); oss << right << itn ();
-  oss.width (4); oss << right << h ();
-  oss.width (5); oss << right << tags ();
-  oss.width (11); oss.precision (4); oss << scientific << right << epstot ();
-  oss.width (11); oss.precision (4); oss << scientific << right << epsevn ();
-  oss.width (11); oss.precision (4); oss << scientific << right << epsodd ();
-  oss.width (11); oss.precision (4); oss << scientific << right << epsran ();
-  oss << left << " " << IdLong;
-  oss.width (11); oss.precision (6); oss << fixed << right << wavelength ();
-  return oss.str();
+  FixedRecord Record (WritelinesFormat);
+  Record.put (line ());
+  Record.put (wavenumber ());
+  Record.put (peak ());
+  Record.put (width ());
+  Record.put (dmp ());
+  Record.put (eqwidth ());
+  Record.put (itn ());
+  Record.put (h ());
+  Record.put (tags ());
+  Record.put (epstot ());
+  Record.put (epsevn ());
+  Record.put (epsodd ());
+  Record.put (epsran ());
+  Record.put (id ());
+  Record.put (wavelength ());
+  return Record.str ();
 }
 
 
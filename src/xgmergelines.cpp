@@ -0,0 +1,344 @@
+// Xgtools
+// Copyright (C) M. P. Ruffoni 2011-2015
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// xgmergelines : Merges XGremlin writelines line lists
+//
+// xgmergelines merges several XGremlin ASCII (writelines) line lists, such as
+// the .cln files written by ftscalibrate for many spectra, into a single list
+// sorted by wavenumber. The four line header of the FIRST list is copied to the
+// output, and every row is copied exactly as it appears in its input list, so
+// the fixed columns are kept intact. With the -n option, the line numbers in
+// the first column are rewritten to count up from 1 in the merged list.
+//
+// Lists of any size can be merged within the memory budget set by --mem-limit
+// or XGTOOLS_MEM_LIMIT. Rows are read until the budget is full, sorted, and
+// written to a temporary file beside the output, called a run. The runs are
+// then merged by repeatedly taking the row with the lowest wavenumber from the
+// heads of all the runs, which needs only one row from each run to be held at
+// once. Rows with equal wavenumbers keep the order in which they were read.
+//
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include "ErrDefs.h"
+#include "fixedformat.h"
+#include "memlimit.h"
+
+using namespace::std;
+
+// Definitions for command line parameters
+#define MIN_NUM_ARGS       3
+#define RENUMBER_OPTION    "-n"
+
+// The number of header rows in a writelines file
+#define XG_WRITELINES_HEADER_LENGTH 4 /* rows */
+
+// The most runs merged at once. If there are more runs than this, groups of
+// runs are first merged into longer runs, to limit the number of open files.
+#define MAX_MERGE_RUNS 64
+
+// A single row of a line list, with the wavenumber by which it is sorted
+typedef struct td_SortRow {
+  double Wavenumber;
+  string Text;
+} SortRow;
+
+// The row at the head of a run during a merge. Rows are taken from the heap in
+// order of wavenumber, and then of the run they came from.
+typedef struct td_RunHead {
+  double Wavenumber;
+  unsigned int Run;
+  bool operator< (const td_RunHead &Other) const {
+    if (Wavenumber != Other.Wavenumber) return Wavenumber > Other.Wavenumber;
+    return Run > Other.Run;
+  }
+} RunHead;
+
+
+//------------------------------------------------------------------------------
+// showHelp () : Prints syntax help message to the standard output.
+//
+void showHelp () {
+  cout << endl;
+  cout << "xgmergelines : " << endl;
+  cout << "---------------------------------------------------------------" << endl;
+  cout << "Syntax : xgmergelines [-n] <list 1> [<list 2> ...] <output>" << endl << endl;
+  cout << "<list n> : An XGremlin writelines line list." << endl;
+  cout << "<output> : The merged list, sorted by wavenumber, is saved here." << endl;
+  cout << "-n       : Renumber the lines in the merged list from 1." << endl;
+  cout << endl << "The memory used may be limited with --mem-limit <size>." << endl << endl;
+}
+
+
+//------------------------------------------------------------------------------
+// compareRows (const SortRow &, const SortRow &) : Orders rows by wavenumber.
+//
+bool compareRows (const SortRow &Row1, const SortRow &Row2) {
+  return Row1.Wavenumber < Row2.Wavenumber;
+}
+
+
+//------------------------------------------------------------------------------
+// rowWavenumber (const string &, double &) : Reads the wavenumber from the
+// second column of the writelines row at arg1 into arg2. Returns false if the
+// row does not contain a valid wavenumber.
+//
+bool rowWavenumber (const string &Row, double &Wavenumber) {
+  const char *Start = Row.c_str ();
+  char *End;
+  strtol (Start, &End, 10);
+  if (End == Start) return false;
+  Start = End;
+  Wavenumber = strtod (Start, &End);
+  return End != Start;
+}
+
+
+//------------------------------------------------------------------------------
+// renumberRow (const string &, int) : Returns the writelines row at arg1 with
+// its line number replaced by arg2. The rest of the row is left unchanged.
+//
+string renumberRow (const string &Row, int Index) {
+  size_t End = Row.find_first_not_of (' ');
+  if (End != string::npos) End = Row.find (' ', End);
+  if (End == string::npos) End = Row.length ();
+  return FixedRecord::format (WritelinesFormat [0], Index) + Row.substr (End);
+}
+
+
+//------------------------------------------------------------------------------
+// writeRun (vector <SortRow> &, string, vector <string> &) : Sorts the rows at
+// arg1 and writes them to a new run file, named from arg2 and the number of
+// runs already listed in arg3. The name of the run is added to arg3 and the
+// rows are cleared.
+//
+void writeRun (vector <SortRow> &Rows, string Stem, vector <string> &Runs)
+  throw (int) {
+  ostringstream oss;
+  oss << Stem << ".run" << Runs.size ();
+  stable_sort (Rows.begin (), Rows.end (), compareRows);
+  ofstream Run (oss.str ().c_str ());
+  for (unsigned int i = 0; i < Rows.size () && Run.good (); i ++) {
+    Run << Rows[i].Text << '\n';
+  }
+  Run.close ();
+  if (!Run.good ()) {
+    cout << "Error writing the temporary file " << oss.str () << endl
+      << "Check that you have permission to write to this location" << endl;
+    remove (oss.str ().c_str ());
+    throw int (LC_FILE_WRITE_ERROR);
+  }
+  Runs.push_back (oss.str ());
+  Rows.clear ();
+}
+
+
+//------------------------------------------------------------------------------
+// mergeRuns (vector <string> &, unsigned int, unsigned int, ostream &, bool) :
+// Merges the arg3 runs listed in arg1 from index arg2 onwards, writing the
+// rows to arg4 in order of wavenumber. If arg5 is true, each row is renumbered
+// by its position in the output. The runs are deleted once merged.
+//
+void mergeRuns (vector <string> &Runs, unsigned int First, unsigned int Count,
+  ostream &Output, bool Renumber) throw (int) {
+  vector <ifstream *> Files (Count);
+  vector <string> Heads (Count);
+  priority_queue <RunHead> Heap;
+  RunHead Next;
+  int Index = 0;
+
+  for (unsigned int i = 0; i < Count; i ++) {
+    Files[i] = new ifstream (Runs [First + i].c_str ());
+    if (getline (*Files[i], Heads[i])) {
+      rowWavenumber (Heads[i], Next.Wavenumber);
+      Next.Run = i;
+      Heap.push (Next);
+    }
+  }
+  while (!Heap.empty ()) {
+    Next = Heap.top ();
+    Heap.pop ();
+    if (Renumber) {
+      Output << renumberRow (Heads [Next.Run], ++ Index) << '\n';
+    } else {
+      Output << Heads [Next.Run] << '\n';
+    }
+    if (getline (*Files [Next.Run], Heads [Next.Run])) {
+      rowWavenumber (Heads [Next.Run], Next.Wavenumber);
+      Heap.push (Next);
+    }
+  }
+  for (unsigned int i = 0; i < Count; i ++) {
+    delete Files[i];
+    remove (Runs [First + i].c_str ());
+  }
+  if (Output.fail ()) {
+    cout << "Error writing the merged line list. Merge ABORTED." << endl;
+    throw int (LC_FILE_WRITE_ERROR);
+  }
+}
+
+
+//------------------------------------------------------------------------------
+// Main program
+//
+int main (int argc, char *argv[])
+{
+  XgMemLimit Budget ("xgmergelines");
+  vector <SortRow> Rows;
+  vector <string> Runs, Merged;
+  string Header [XG_WRITELINES_HEADER_LENGTH];
+  string LineString;
+  SortRow NextRow;
+  size_t RowBytes = 0;
+  bool Renumber = false;
+  int Err = LC_NO_ERROR;
+
+  // Remove the --mem-limit and -n options so the other arguments keep their
+  // places
+  try {
+    argc = Budget.parseArgs (argc, argv);
+  } catch (int Error) {
+    return Error;
+  }
+  if (argc > 1 && string (argv[1]) == RENUMBER_OPTION) {
+    Renumber = true;
+    for (int i = 1; i < argc - 1; i ++) {
+      argv[i] = argv[i + 1];
+    }
+    argc --;
+  }
+
+  // Check the user's command line input
+  if (argc < MIN_NUM_ARGS) {
+    cout << "Syntax error: Too few arguments were specified" << endl;
+    showHelp ();
+    return LC_SYNTAX_ERROR;
+  }
+  string OutputName = argv [argc - 1];
+
+  try {
+    // Read the rows of every list, saving a sorted run each time the budget
+    // is full. The header of each list is skipped, but that of the first list
+    // is kept for the output.
+    for (int i = 1; i < argc - 1; i ++) {
+      ifstream ListFile (argv[i], ios::in);
+      if (!ListFile.is_open ()) {
+        cout << "Error: Cannot read " << argv[i]
+          << ". Check the file exists and has read permissions." << endl;
+        throw int (LC_FILE_OPEN_ERROR);
+      }
+      for (int j = 0; j < XG_WRITELINES_HEADER_LENGTH; j ++) {
+        if (!getline (ListFile, LineString)) {
+          cout << "Error reading the header of " << argv[i] << ".\n"
+            << "Check the file was written with XGremlin's 'writelines' command."
+            << endl;
+          throw int (LC_FILE_HEAD_ERROR);
+        }
+        if (i == 1) {
+          Header[j] = LineString;
+        } else if (j == 0 && LineString != Header[0]) {
+          cout << "Warning: " << argv[i] << " has a different wavenumber "
+            << "correction to " << argv[1] << endl;
+        }
+      }
+      unsigned int LineCount = XG_WRITELINES_HEADER_LENGTH;
+      while (getline (ListFile, LineString)) {
+        LineCount ++;
+        if (LineString.find_first_not_of (" \t\r") == string::npos) continue;
+        if (!rowWavenumber (LineString, NextRow.Wavenumber)) {
+          cout << "Error reading the wavenumber from line " << LineCount
+            << " in " << argv[i] << ". Merge ABORTED." << endl;
+          throw int (LC_FILE_READ_ERROR);
+        }
+        NextRow.Text = LineString;
+        Rows.push_back (NextRow);
+        RowBytes += sizeof (SortRow) + LineString.length ();
+        if (!Budget.fits (RowBytes)) {
+          writeRun (Rows, OutputName, Runs);
+          RowBytes = 0;
+        }
+      }
+      ListFile.close ();
+    }
+
+    // Open the output list and copy the header of the first list
+    ofstream Output (OutputName.c_str (), ios::out);
+    if (!Output.is_open ()) {
+      cout << "Error: Cannot open " << OutputName
+        << " for output. Merge ABORTED." << endl;
+      throw int (LC_FILE_OPEN_ERROR);
+    }
+    for (int j = 0; j < XG_WRITELINES_HEADER_LENGTH; j ++) {
+      Output << Header[j] << '\n';
+    }
+
+    // If every row was held at once, just sort them and write them out.
+    // Otherwise save the last rows as a run, merge groups of runs until few
+    // enough remain to be opened together, and merge those into the output.
+    if (Runs.size () == 0) {
+      stable_sort (Rows.begin (), Rows.end (), compareRows);
+      for (unsigned int i = 0; i < Rows.size (); i ++) {
+        if (Renumber) {
+          Output << renumberRow (Rows[i].Text, i + 1) << '\n';
+        } else {
+          Output << Rows[i].Text << '\n';
+        }
+      }
+      if (Output.fail ()) {
+        cout << "Error writing " << OutputName << ". Merge ABORTED." << endl;
+        throw int (LC_FILE_WRITE_ERROR);
+      }
+    } else {
+      if (Rows.size () > 0) writeRun (Rows, OutputName, Runs);
+      ostringstream oss;
+      oss << "Lines sorted in " << Runs.size () << " temporary run"
+        << (Runs.size () == 1 ? "" : "s") << " before merging";
+      Budget.constrain (oss.str ());
+      for (int Pass = 0; Runs.size () > MAX_MERGE_RUNS; Pass ++) {
+        for (unsigned int First = 0; First < Runs.size (); First += MAX_MERGE_RUNS) {
+          unsigned int Count = min (size_t (MAX_MERGE_RUNS), Runs.size () - First);
+          ostringstream Name;
+          Name << OutputName << ".merge" << Pass << "." << Merged.size ();
+          Merged.push_back (Name.str ());
+          ofstream Merge (Name.str ().c_str ());
+          mergeRuns (Runs, First, Count, Merge, false);
+        }
+        Runs.swap (Merged);
+        Merged.clear ();
+      }
+      mergeRuns (Runs, 0, Runs.size (), Output, Renumber);
+    }
+    Output.close ();
+  } catch (int Error) {
+    // Remove the temporary files of the runs, including any intermediate
+    // merges written by an unfinished pass
+    for (unsigned int i = 0; i < Runs.size (); i ++) {
+      remove (Runs[i].c_str ());
+    }
+    for (unsigned int i = 0; i < Merged.size (); i ++) {
+      remove (Merged[i].c_str ());
+    }
+    Err = Error;
+  }
+  Budget.report ();
+  return Err;
+}
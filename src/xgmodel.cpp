@@ -0,0 +1,411 @@
+// Xgtools
+// Copyright (C) M. P. Ruffoni 2011-2015
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// xgmodel : Generates the model and residual spectra of an XGremlin line fit
+//
+// Checking a line fit has meant reopening XGremlin and plotting each line in
+// turn. xgmodel instead rebuilds the whole fitted spectrum from the lines in a
+// LIN file, so that the fit to every line in a spectrum can be judged in one
+// batch run.
+//
+// Each line is drawn from its fitted wavenumber, peak, width (FWHM, in mK) and
+// damping. The damping of a LIN record runs from 1 (a Gaussian profile) to 26
+// (a Lorentzian), and is converted to a Lorentzian fraction of the width, d, as
+// in xgfit. The Voigt profile is approximated by a pseudo-Voigt: a sum of a
+// Gaussian and a Lorentzian of the same FWHM, whose Lorentzian weight is
+//
+// \eta = 1.36603 d - 0.47719 d^2 + 0.11116 d^3
+//
+// from Ida et al., J. Appl. Cryst. 33 pp. 1311 (2000). Each line is drawn only
+// over a window of <support> FWHM either side of its centre, rather than across
+// the whole spectrum.
+//
+// The spectrum is divided into one block of points for each thread. Each thread
+// draws into its block every line whose window overlaps it, so no two threads
+// write to the same point. The residual spectrum is then the measured spectrum
+// minus the model. For each line, the RMS residual over the points within one
+// FWHM of its centre is written to a text file, along with the same RMS as a
+// fraction of the line peak, so that poor fits can be picked out by sorting.
+//
+// The model and residual spectra are saved as <output>.model and
+// <output>.resid (.dat and .hdr), each with a copy of the measured spectrum's
+// header, and in the same byte order as the measured spectrum. The RMS values
+// are saved in <output>.rms.
+//
+
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include "xgspectrum.h"
+#include "linfile.h"
+#include "byteorder.h"
+#include "xgtrace.h"
+
+using namespace::std;
+
+// xgmodel version
+#define VERSION "1.0"
+
+// Default half-width of the window over which each line is drawn, in FWHM
+#define DEFAULT_SUPPORT 25.0
+
+// Half-width of the window over which the residual RMS of a line is found,
+// in FWHM
+#define RMS_WINDOW 1.0
+
+// Definitions for command line parameters
+#define REQUIRED_NUM_ARGS_MODE1 4
+#define REQUIRED_NUM_ARGS_MODE2 5
+#define ARG_SPECTRUM 1
+#define ARG_LIN_FILE 2
+#define ARG_OUTPUT 3
+#define ARG_SUPPORT 4
+
+// Define a structure to hold the profile of a single fitted line
+typedef struct td_ModelLine {
+  unsigned int Index;  // Position of the line in the LIN file, from 1
+  double Sigma;        // Wavenumber of the line centre
+  double Peak;
+  double Width;        // FWHM in cm^-1
+  double Damping;      // Lorentzian fraction of the width, 0 to 1
+  double Eta;          // Lorentzian weight of the pseudo-Voigt
+  size_t NumPoints;    // Points used for the residual RMS
+  double Rms;          // Residual RMS within RMS_WINDOW of the centre
+} ModelLine;
+
+// The work shared by all the threads
+typedef struct td_ModelJob {
+  XgSpectrum *Spectrum;
+  vector <ModelLine> *Lines;
+  vector <float> *Model;
+  double Support;
+} ModelJob;
+
+
+//------------------------------------------------------------------------------
+// showHelp () : Prints syntax help message to the standard output.
+//
+void showHelp () {
+  cout << endl;
+  cout << "xgmodel : Generates the model and residual spectra of an XGremlin line fit" << endl;
+  cout << "---------------------------------------------------------------" << endl;
+  cout << "Syntax : xgmodel <spectrum> <lin file> <output> [<support>]" << endl << endl;
+  cout << "<spectrum> : The XGremlin spectrum that was fitted (do not include the '.dat' extension)." << endl;
+  cout << "<lin file> : The XGremlin LIN file holding the fitted lines." << endl;
+  cout << "<output>   : The model and residual spectra are saved as <output>.model and" << endl;
+  cout << "             <output>.resid, and the residual RMS of each line in <output>.rms." << endl;
+  cout << "<support>  : Each line is drawn out to this many FWHM either side of its centre" << endl;
+  cout << "             (default " << DEFAULT_SUPPORT << ")." << endl << endl;
+}
+
+
+//------------------------------------------------------------------------------
+// compareLines (const ModelLine &, const ModelLine &) : Orders lines by
+// ascending wavenumber.
+//
+bool compareLines (const ModelLine &A, const ModelLine &B) {
+  return A.Sigma < B.Sigma;
+}
+
+
+//------------------------------------------------------------------------------
+// compareIndex (const ModelLine &, const ModelLine &) : Orders lines as they
+// were in the LIN file.
+//
+bool compareIndex (const ModelLine &A, const ModelLine &B) {
+  return A.Index < B.Index;
+}
+
+
+//------------------------------------------------------------------------------
+// readModelLines (string) : Reads the fitted lines from the LIN file at arg1,
+// and returns them in ascending wavenumber. Lines of zero width are skipped.
+//
+vector <ModelLine> readModelLines (string LinName) throw (int) {
+  LinFile LinIn;
+  vector <LinRecord> Records;
+  vector <ModelLine> Lines;
+
+  LinIn.open (LinName);
+  Records.resize (LinIn.numLines ());
+  if (Records.size () > 0) {
+    Records.resize (LinIn.read (&Records [0], Records.size ()));
+  }
+  LinIn.close ();
+  for (unsigned int i = 0; i < Records.size (); i ++) {
+    if (Records[i].width <= 0.0) continue;
+    ModelLine NewLine;
+    NewLine.Index = i + 1;
+    NewLine.Sigma = Records[i].wavenumber;
+    NewLine.Peak = Records[i].peak;
+    NewLine.Width = Records[i].width / 1000.0;
+    NewLine.Damping = (Records[i].dmp - 1.0) / 25.0;
+    NewLine.Damping = max (0.0, min (1.0, NewLine.Damping));
+    double d = NewLine.Damping;
+    NewLine.Eta = 1.36603 * d - 0.47719 * d * d + 0.11116 * d * d * d;
+    NewLine.NumPoints = 0;
+    NewLine.Rms = 0.0;
+    Lines.push_back (NewLine);
+  }
+  sort (Lines.begin (), Lines.end (), compareLines);
+  return Lines;
+}
+
+
+//------------------------------------------------------------------------------
+// pointRange (XgSpectrum &, double, double, size_t &, size_t &) : Sets arg4 and
+// arg5 to the first and one past the last point of the spectrum at arg1 that
+// lie between wavenumbers arg2 and arg3. Both are zero if there are none.
+//
+void pointRange (XgSpectrum &Spectrum, double Min, double Max, size_t &First,
+  size_t &Last) {
+  double a = (Min - Spectrum.wstart ()) / Spectrum.delw ();
+  double b = (Max - Spectrum.wstart ()) / Spectrum.delw ();
+  if (a > b) swap (a, b);
+  a = max (ceil (a), 0.0);
+  b = min (floor (b) + 1.0, double (Spectrum.size ()));
+  if (a >= b) {
+    First = Last = 0;
+  } else {
+    First = size_t (a);
+    Last = size_t (b);
+  }
+}
+
+
+//------------------------------------------------------------------------------
+// renderBlock (ModelJob *, size_t, size_t) : Draws every line whose window
+// overlaps points arg2 to arg3 - 1 of the model spectrum, into those points
+// only.
+//
+void renderBlock (ModelJob *Job, size_t Start, size_t End) {
+  XgTraceSpan Span ("render block");
+  XgSpectrum &Spectrum = *Job -> Spectrum;
+  vector <ModelLine> &Lines = *Job -> Lines;
+  vector <float> &Model = *Job -> Model;
+  const double FourLn2 = 4.0 * log (2.0);
+  if (Start >= End) return;
+
+  // The widest line sets how far beyond the block a line centre may lie
+  double MaxWidth = 0.0;
+  for (unsigned int i = 0; i < Lines.size (); i ++) {
+    MaxWidth = max (MaxWidth, Lines[i].Width);
+  }
+  double Reach = Job -> Support * MaxWidth;
+  double BlockMin = min (Spectrum.wavenumber (Start), Spectrum.wavenumber (End - 1));
+  double BlockMax = max (Spectrum.wavenumber (Start), Spectrum.wavenumber (End - 1));
+  ModelLine Bound;
+  Bound.Sigma = BlockMin - Reach;
+  vector <ModelLine>::iterator Next =
+    lower_bound (Lines.begin (), Lines.end (), Bound, compareLines);
+
+  for (; Next != Lines.end () && Next -> Sigma <= BlockMax + Reach; Next ++) {
+    size_t First, Last;
+    double HalfWindow = Job -> Support * Next -> Width;
+    pointRange (Spectrum, Next -> Sigma - HalfWindow, Next -> Sigma + HalfWindow,
+      First, Last);
+    First = max (First, Start);
+    Last = min (Last, End);
+    double InvWidthSq = 1.0 / (Next -> Width * Next -> Width);
+    for (size_t i = First; i < Last; i ++) {
+      double x = Spectrum.wavenumber (i) - Next -> Sigma;
+      double x2 = x * x * InvWidthSq;
+      double Lorentz = 1.0 / (1.0 + 4.0 * x2);
+      double Gauss = exp (-FourLn2 * x2);
+      Model [i] += Next -> Peak * (Next -> Eta * Lorentz
+        + (1.0 - Next -> Eta) * Gauss);
+    }
+  }
+}
+
+
+//------------------------------------------------------------------------------
+// lineResiduals (ModelJob *, vector <float> *, size_t, size_t) : Finds the
+// residual RMS of lines arg3 to arg4 - 1, from the residual spectrum at arg2.
+//
+void lineResiduals (ModelJob *Job, vector <float> *Residual, size_t Start,
+  size_t End) {
+  XgTraceSpan Span ("line residuals");
+  XgSpectrum &Spectrum = *Job -> Spectrum;
+  vector <ModelLine> &Lines = *Job -> Lines;
+  for (size_t j = Start; j < End; j ++) {
+    size_t First, Last;
+    double HalfWindow = RMS_WINDOW * Lines[j].Width;
+    pointRange (Spectrum, Lines[j].Sigma - HalfWindow,
+      Lines[j].Sigma + HalfWindow, First, Last);
+    double SumSq = 0.0;
+    for (size_t i = First; i < Last; i ++) {
+      SumSq += (*Residual)[i] * (*Residual)[i];
+    }
+    Lines[j].NumPoints = Last - First;
+    Lines[j].Rms = (Last > First) ? sqrt (SumSq / (Last - First)) : 0.0;
+  }
+}
+
+
+//------------------------------------------------------------------------------
+// saveSpectrum (vector <float> &, string, string, bool) : Saves the points at
+// arg1 as the spectrum arg2, with a copy of the header file at arg3. The points
+// are swapped into the other byte order if arg4 is true.
+//
+void saveSpectrum (vector <float> &Points, string Name, string HeaderSource,
+  bool Swapped) throw (int) {
+  XgTraceSpan Span ("write spectrum");
+  string DataName = Name + ".dat";
+  string HeaderName = Name + ".hdr";
+  ofstream DataFile (DataName.c_str (), ios::out|ios::binary);
+  ifstream HeaderIn (HeaderSource.c_str (), ios::in);
+  ofstream HeaderOut (HeaderName.c_str (), ios::out);
+  if (!DataFile.is_open () || !HeaderOut.is_open ()) {
+    cout << "Error: Unable to write " << Name << ". Check that you have "
+      << "permission to write to this location." << endl;
+    throw int (LC_FILE_WRITE_ERROR);
+  }
+  if (Swapped) swapBytes32 (Points.data (), Points.size ());
+  DataFile.write ((char*)Points.data (), Points.size () * sizeof (float));
+  if (Swapped) swapBytes32 (Points.data (), Points.size ());
+  DataFile.close ();
+  HeaderOut << HeaderIn.rdbuf ();
+  HeaderOut.close ();
+}
+
+
+//------------------------------------------------------------------------------
+// saveResiduals (vector <ModelLine>, string) : Writes the residual RMS of each
+// line at arg1 to the text file at arg2, in the order of the LIN file.
+//
+void saveResiduals (vector <ModelLine> Lines, string Filename) throw (int) {
+  ofstream Output (Filename.c_str (), ios::out);
+  if (!Output.is_open ()) {
+    cout << "Error: Unable to write " << Filename << ". Check that you have "
+      << "permission to write to this location." << endl;
+    throw int (LC_FILE_WRITE_ERROR);
+  }
+  sort (Lines.begin (), Lines.end (), compareIndex);
+  Output << "#  line   wavenumber        peak   width   dmp  points         rms  rms/peak" << endl;
+  for (unsigned int i = 0; i < Lines.size (); i ++) {
+    ModelLine &L = Lines [i];
+    char Row [128];
+    snprintf (Row, sizeof (Row), "%7u %12.6f %11.4e %7.2f %5.3f %7lu %11.4e %9.4f",
+      L.Index, L.Sigma, L.Peak, L.Width * 1000.0, L.Damping,
+      (unsigned long) L.NumPoints, L.Rms, (L.Peak != 0.0) ? L.Rms / fabs (L.Peak) : 0.0);
+    Output << Row << endl;
+  }
+  Output.close ();
+}
+
+
+//------------------------------------------------------------------------------
+// Main program
+//
+int main (int argc, char *argv[]) {
+  XgSpectrum Spectrum;
+  vector <ModelLine> Lines;
+  vector <float> Model, Residual;
+  vector <thread> Workers;
+  ModelJob Job;
+  double Support = DEFAULT_SUPPORT;
+
+  // Check the user's command line input
+  if (argc != REQUIRED_NUM_ARGS_MODE1 && argc != REQUIRED_NUM_ARGS_MODE2) {
+    showHelp ();
+    return LC_SYNTAX_ERROR;
+  }
+  if (argc == REQUIRED_NUM_ARGS_MODE2) {
+    Support = atof (argv [ARG_SUPPORT]);
+    if (Support <= 0.0) {
+      cout << "Error: <support> must be a positive number of FWHM" << endl;
+      return LC_SYNTAX_ERROR;
+    }
+  }
+  string Output = argv [ARG_OUTPUT];
+
+  // Print introductory message to the standard output
+  cout << "XGremlin Fit Model Generator " << VERSION
+    << " (built " << __DATE__ << ")" << endl;
+  cout << "--------------------------------------------------------" << endl;
+  cout << "Spectrum file     : " << argv [ARG_SPECTRUM] << endl;
+  cout << "Fitted lines      : " << argv [ARG_LIN_FILE] << endl;
+  cout << "Output files      : " << Output << ".model, " << Output << ".resid, "
+    << Output << ".rms" << endl;
+
+  // Load the spectrum and the fitted lines
+  try {
+    XgTraceSpan Span ("read input");
+    Spectrum.load (argv [ARG_SPECTRUM]);
+    Lines = readModelLines (argv [ARG_LIN_FILE]);
+  } catch (int Err) {
+    return Err;
+  }
+  cout << "Read " << Spectrum.size () << " points and " << Lines.size ()
+    << " lines" << endl;
+
+  // Draw the model spectrum, with each thread filling its own block of points
+  unsigned int NumWorkers = thread::hardware_concurrency ();
+  if (NumWorkers == 0) NumWorkers = 1;
+  Model.assign (Spectrum.size (), 0.0);
+  Job.Spectrum = &Spectrum;
+  Job.Lines = &Lines;
+  Job.Model = &Model;
+  Job.Support = Support;
+  cout << "Drawing the model with " << NumWorkers << " thread"
+    << (NumWorkers == 1 ? "" : "s") << "..." << endl;
+  size_t BlockSize = (Spectrum.size () + NumWorkers - 1) / NumWorkers;
+  for (unsigned int i = 0; i < NumWorkers; i ++) {
+    size_t Start = min (i * BlockSize, Spectrum.size ());
+    size_t End = min (Start + BlockSize, Spectrum.size ());
+    Workers.push_back (thread (renderBlock, &Job, Start, End));
+  }
+  for (unsigned int i = 0; i < Workers.size (); i ++) Workers[i].join ();
+  Workers.clear ();
+
+  // Find the residual spectrum, then the residual RMS of each line
+  Residual.resize (Spectrum.size ());
+  double SumSq = 0.0;
+  for (size_t i = 0; i < Spectrum.size (); i ++) {
+    Residual [i] = Spectrum [i] - Model [i];
+    SumSq += Residual [i] * Residual [i];
+  }
+  BlockSize = (Lines.size () + NumWorkers - 1) / NumWorkers;
+  for (unsigned int i = 0; i < NumWorkers; i ++) {
+    size_t Start = min (i * BlockSize, Lines.size ());
+    size_t End = min (Start + BlockSize, Lines.size ());
+    Workers.push_back (thread (lineResiduals, &Job, &Residual, Start, End));
+  }
+  for (unsigned int i = 0; i < Workers.size (); i ++) Workers[i].join ();
+
+  // Save the results
+  try {
+    string HeaderSource = string (argv [ARG_SPECTRUM]) + ".hdr";
+    saveSpectrum (Model, Output + ".model", HeaderSource, Spectrum.swapped ());
+    saveSpectrum (Residual, Output + ".resid", HeaderSource, Spectrum.swapped ());
+    saveResiduals (Lines, Output + ".rms");
+  } catch (int Err) {
+    return Err;
+  }
+  if (Spectrum.size () > 0) {
+    cout << "RMS residual over the whole spectrum: "
+      << sqrt (SumSq / Spectrum.size ()) << endl;
+  }
+  return LC_NO_ERROR;
+}
@@ -0,0 +1,213 @@
+// Xgtools
+// Copyright (C) M. P. Ruffoni 2011-2015
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// xgquery : Sends queries to xgqueryd and prints the answers
+//
+// A query given on the command line is sent on its own, e.g.
+//
+//   xgquery near 18125.431 0.02
+//   xgquery level 26140.196
+//
+// If no query is given, queries are read from the standard input, one per row,
+// and sent in turn over a single connection. The rows of each answer are
+// printed as they are received from xgqueryd, without the row ending the
+// answer. With -t, the time taken to answer each query is printed to the
+// standard error. The queries and the form of their answers are described in
+// xgquery.h.
+//
+// Compile this code using the following command:
+//
+// g++ xgquery.cpp -o xgquery
+//
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "xgquery.h"
+
+using namespace::std;
+
+#define ERR_NO_ERROR     0
+#define ERR_SYNTAX_ERROR 1
+#define ERR_QUERY_ERROR  2
+#define ERR_SOCKET_ERROR 3
+
+// The number of bytes read from the connection at a time
+#define READ_BUFFER_SIZE 65536
+
+//------------------------------------------------------------------------------
+// showHelp () : Prints syntax help message to the standard output.
+//
+void showHelp () {
+  cout << endl;
+  cout << "xgquery : Sends queries to xgqueryd and prints the answers" << endl;
+  cout << "---------------------------------------------------------------" << endl;
+  cout << "Syntax : xgquery [-s <socket>] [-t] [<query>]" << endl << endl;
+  cout << "<query> : One of" << endl;
+  cout << "            near <sigma> [<tolerance>]" << endl;
+  cout << "            level <energy> [<tolerance>]" << endl;
+  cout << "            ritz <energy 1> <energy 2> [<tolerance>]" << endl;
+  cout << "            info" << endl;
+  cout << "          If no query is given, queries are read from the standard input." << endl;
+  cout << "-s      : The socket on which xgqueryd is listening (default" << endl;
+  cout << "          $" << XGQUERY_SOCKET_ENV << ", or " << XGQUERY_DEF_SOCKET << ")" << endl;
+  cout << "-t      : Print the time taken to answer each query" << endl << endl;
+}
+
+
+//==============================================================================
+// QueryConnection class : A connection to xgqueryd, over which queries are sent
+// and their answers read back a row at a time.
+//
+class QueryConnection {
+  public:
+    QueryConnection () { Socket = -1; }
+    ~QueryConnection () { if (Socket >= 0) close (Socket); }
+
+    bool open (string SocketName);
+    bool query (string Query, bool &Failed);
+
+  private:
+    int Socket;
+    string Pending;
+    bool readRow (string &Row);
+};
+
+
+//------------------------------------------------------------------------------
+// open (string) : Connects to the service listening on the socket named at
+// arg1. Returns false if it cannot be reached.
+//
+bool QueryConnection::open (string SocketName) {
+  struct sockaddr_un Address;
+  memset (&Address, 0, sizeof (Address));
+  Address.sun_family = AF_UNIX;
+  strncpy (Address.sun_path, SocketName.c_str (), sizeof (Address.sun_path) - 1);
+  Socket = socket (AF_UNIX, SOCK_STREAM, 0);
+  if (Socket < 0) return false;
+  return connect (Socket, (struct sockaddr *) &Address, sizeof (Address)) == 0;
+}
+
+
+//------------------------------------------------------------------------------
+// readRow (string &) : Reads the next row of an answer into arg1, without its
+// line ending. Returns false if the connection was closed.
+//
+bool QueryConnection::readRow (string &Row) {
+  char Buffer [READ_BUFFER_SIZE];
+  size_t End;
+  while ((End = Pending.find ('\n')) == string::npos) {
+    ssize_t n = recv (Socket, Buffer, sizeof (Buffer), 0);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    Pending.append (Buffer, n);
+  }
+  Row = Pending.substr (0, End);
+  Pending.erase (0, End + 1);
+  return true;
+}
+
+
+//------------------------------------------------------------------------------
+// query (string, bool &) : Sends the query at arg1 and prints its answer. arg2
+// is set if the answer reports an error. Returns false if the connection was
+// lost.
+//
+bool QueryConnection::query (string Query, bool &Failed) {
+  Query += '\n';
+  size_t Sent = 0;
+  while (Sent < Query.length ()) {
+    ssize_t n = send (Socket, Query.data () + Sent, Query.length () - Sent,
+      MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    Sent += n;
+  }
+  string Row;
+  Failed = false;
+  while (readRow (Row)) {
+    if (Row == XGQUERY_END) return true;
+    if (Row.compare (0, 6, "error ") == 0) Failed = true;
+    cout << Row << '\n';
+  }
+  return false;
+}
+
+
+//------------------------------------------------------------------------------
+// Main program
+//
+int main (int argc, char *argv[]) {
+  QueryConnection Connection;
+  string SocketName = XGQUERY_DEF_SOCKET;
+  string Query;
+  bool ShowTime = false, Failed, AnyFailed = false;
+  int Arg = 1;
+
+  if (getenv (XGQUERY_SOCKET_ENV) != NULL) SocketName = getenv (XGQUERY_SOCKET_ENV);
+
+  // Process the command line options. Negative numbers in a query are not
+  // options, so only the known options are removed.
+  while (Arg < argc) {
+    string Option = argv [Arg];
+    if (Option == "-s" && Arg < argc - 1) {
+      SocketName = argv [Arg + 1];
+      Arg += 2;
+    } else if (Option == "-t") {
+      ShowTime = true;
+      Arg ++;
+    } else if (Option == "-h" || Option == "--help") {
+      showHelp ();
+      return ERR_SYNTAX_ERROR;
+    } else break;
+  }
+  for (int i = Arg; i < argc; i ++) {
+    Query += string (i > Arg ? " " : "") + argv [i];
+  }
+
+  if (!Connection.open (SocketName)) {
+    cout << "Error: Unable to connect to xgqueryd on " << SocketName << " ("
+      << strerror (errno) << ")" << endl;
+    return ERR_SOCKET_ERROR;
+  }
+
+  // Send the query from the command line, or else each row of the standard
+  // input in turn
+  bool FromInput = (Query == "");
+  while (!FromInput || getline (cin, Query)) {
+    if (Query == "quit") break;
+    chrono::steady_clock::time_point Start = chrono::steady_clock::now ();
+    if (!Connection.query (Query, Failed)) {
+      cout << "Error: The connection to xgqueryd was lost" << endl;
+      return ERR_SOCKET_ERROR;
+    }
+    cout.flush ();
+    if (ShowTime) {
+      cerr << "Answered in " << chrono::duration_cast <chrono::microseconds>
+        (chrono::steady_clock::now () - Start).count () << " us" << endl;
+    }
+    AnyFailed = AnyFailed || Failed;
+    if (!FromInput) break;
+  }
+  return AnyFailed ? ERR_QUERY_ERROR : ERR_NO_ERROR;
+}
@@ -0,0 +1,62 @@
+// Xgtools
+// Copyright (C) M. P. Ruffoni 2011-2015
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//==============================================================================
+// Query protocol (xgquery.h)
+//==============================================================================
+// Definitions shared by the query service, xgqueryd, and its client, xgquery.
+// They talk over a Unix domain socket, by default XGQUERY_DEF_SOCKET in the
+// current directory, or the path given in the XGTOOLS_QUERY_SOCKET environment
+// variable, or with the -s option of either program.
+//
+// Each query is a single line of text, made of a command and its parameters
+// separated by spaces. All energies and wavenumbers are in cm^-1:
+//
+//   near <sigma> [<tolerance>]      : Lines within tolerance of sigma.
+//   level <energy> [<tolerance>]    : Kurucz transitions to or from a level.
+//   ritz <energy 1> <energy 2> [<tolerance>]
+//                                   : The Ritz wavenumber of a transition
+//                                     between two levels, and the lines near it.
+//   info                            : The lists held by the service.
+//   quit                            : Closes the connection.
+//
+// The answer to each query is zero or more rows, followed by a row holding only
+// XGQUERY_END. Each row begins with a word saying what it holds:
+//
+//   kz <record>             : A record of a Kurucz list, verbatim.
+//   line <list> <record>    : A writelines record of the numbered line list.
+//   ritz <sigma>            : A Ritz wavenumber.
+//   list <n> <name> <lines> : A list held by the service (for info).
+//   error <message>         : The query could not be answered.
+//
+// Any number of queries may be sent on one connection, each answered in turn.
+//
+#ifndef XG_QUERY_H
+#define XG_QUERY_H
+
+// The environment variable and default name of the socket
+#define XGQUERY_SOCKET_ENV "XGTOOLS_QUERY_SOCKET"
+#define XGQUERY_DEF_SOCKET "xgqueryd.sock"
+
+// The row that ends the answer to each query
+#define XGQUERY_END "."
+
+// Default tolerances for the near and ritz queries, and the level query, in
+// cm^-1. The latter is the same as that used by extractlevel.
+#define XGQUERY_DEF_TOLERANCE 0.05
+#define XGQUERY_DEF_LEVEL_TOLERANCE 0.005
+
+#endif // XG_QUERY_H
@@ -0,0 +1,447 @@
+// Xgtools
+// Copyright (C) M. P. Ruffoni 2011-2015
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// xgqueryd : Answers queries on Kurucz and XGremlin line lists held in memory
+//
+// Identifying the lines of a spectrum means asking many small questions of the
+// same lists: which lines lie near this wavenumber, which transitions involve
+// this level, and where the Ritz wavenumber of a transition falls. Answering
+// each with extractlevel means reading the whole Kurucz list again. xgqueryd
+// instead reads the Kurucz lists and any XGremlin writelines lists once, builds
+// indices of their wavenumbers and level energies in memory, and then answers
+// queries sent by xgquery over a Unix domain socket until it is stopped with
+// SIGINT or SIGTERM. The queries and the form of their answers are described in
+// xgquery.h.
+//
+// The Kurucz lists are given as for generatesyn, separated by commas. As in
+// extractlevel, the energies of predicted levels are taken without their minus
+// signs. Each list is held as its fixed-length records, one after another in a
+// single block of memory. The wavenumbers of the lines, and the energies of
+// both levels of every line, are each indexed by a WaveIndex, so a query costs
+// a single search of an index and a scan of the lines found.
+//
+// Each connection is served by a thread of its own. The Line objects normally
+// parse some of their columns only when first used, so every line is parsed in
+// full as it is loaded. Nothing is then changed by a query, and the threads
+// answer their queries concurrently.
+//
+// Compile this code using the following command:
+//
+// g++ xgqueryd.cpp line.cpp waveindex.cpp fixedformat.cpp -pthread -o xgqueryd
+//
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <cerrno>
+#include <csignal>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "line.h"
+#include "waveindex.h"
+#include "fixedformat.h"
+#include "kzline.h"
+#include "xgquery.h"
+#include "lineio.cpp"
+
+using namespace::std;
+
+#define MIN_NUM_ARGS 2
+
+#define ERR_NO_ERROR     0
+#define ERR_SYNTAX_ERROR 1
+#define ERR_LOAD_ERROR   2
+#define ERR_SOCKET_ERROR 3
+
+// The number of bytes read from a connection at a time
+#define READ_BUFFER_SIZE 4096
+
+// Set by the signal handler to request a clean shutdown
+static volatile sig_atomic_t StopRequested = 0;
+
+//==============================================================================
+// QueryData class : The Kurucz records and XGremlin line lists held by the
+// service, with the indices used to answer queries on them. The data are not
+// changed once loaded, so answer() may be called by several threads at once.
+//
+class QueryData {
+  public:
+    QueryData () {}
+
+    void loadKurucz (string Filename) throw (int);
+    void loadList (string Filename) throw (int);
+    void buildIndices ();
+    string answer (string Query);
+    size_t numRecords () { return KzSigma.size (); }
+
+  private:
+    string KzRecords;               // Every Kurucz record, KZ_RECORD_LENGTH each
+    vector <double> KzSigma;        // Wavenumber of each Kurucz record
+    vector <double> KzLevels;       // Energies of both levels of each record
+    WaveIndex KzSigmaIndex;
+    WaveIndex KzLevelIndex;
+    vector <string> KzNames;
+    vector <size_t> KzCounts;
+    vector <string> ListNames;
+    vector <vector <Line> > Lists;
+    vector <WaveIndex> ListIndices;
+
+    void addNear (ostringstream &Answer, double Sigma, double Tolerance);
+    void addRecord (ostringstream &Answer, size_t Record);
+};
+
+
+//------------------------------------------------------------------------------
+// loadKurucz (string) : Appends every record of the Kurucz list named at arg1 to
+// the records held, noting the wavenumber and level energies of each. Throws
+// LC_FILE_OPEN_ERROR if the list cannot be read, or LC_FILE_READ_ERROR if a
+// record is not of the length of a Kurucz record.
+//
+void QueryData::loadKurucz (string Filename) throw (int) {
+  ifstream Input (Filename.c_str (), ios::in);
+  if (!Input.is_open ()) {
+    cout << "Error: Cannot read " << Filename
+      << ". Check the file exists and has read permissions." << endl;
+    throw int (LC_FILE_OPEN_ERROR);
+  }
+  const FieldFormat &Energy1 = KuruczFormat [KZ_FIELD_ENERGY_1];
+  const FieldFormat &Energy2 = KuruczFormat [KZ_FIELD_ENERGY_2];
+  string Record;
+  size_t RowNumber = 0, Count = 0;
+  while (getline (Input, Record)) {
+    RowNumber ++;
+    if (Record.length () > 0 && Record [Record.length () - 1] == '\r') {
+      Record.erase (Record.length () - 1);
+    }
+    if (Record.length () == 0) continue;
+    if (Record.length () != KZ_RECORD_LENGTH) {
+      cout << "Error: Row " << RowNumber << " of " << Filename << " is not a "
+        << "Kurucz record of " << KZ_RECORD_LENGTH << " characters." << endl;
+      throw int (LC_FILE_READ_ERROR);
+    }
+    double ELower = fabs (atof (Record.substr (Energy1.Offset, Energy1.Width).c_str ()));
+    double EUpper = fabs (atof (Record.substr (Energy2.Offset, Energy2.Width).c_str ()));
+    KzRecords.append (Record);
+    KzSigma.push_back (fabs (EUpper - ELower));
+    KzLevels.push_back (ELower);
+    KzLevels.push_back (EUpper);
+    Count ++;
+  }
+  KzNames.push_back (Filename);
+  KzCounts.push_back (Count);
+}
+
+
+//------------------------------------------------------------------------------
+// loadList (string) : Reads the XGremlin writelines list named at arg1, and
+// parses every column of its lines. The wavenumbers of its lines are given with
+// the wavenumber correction of the list applied. Throws an LC_ error code if the
+// list cannot be read.
+//
+void QueryData::loadList (string Filename) throw (int) {
+  WritelinesHeader Header;
+  vector <Line> NewLines;
+  readLineList (Filename, &NewLines, &Header);
+  for (unsigned int i = 0; i < NewLines.size (); i ++) NewLines[i].parseAll ();
+  ListNames.push_back (Filename);
+  Lists.push_back (NewLines);
+}
+
+
+//------------------------------------------------------------------------------
+// buildIndices () : Indexes the wavenumbers and level energies of the Kurucz
+// records, and the wavenumbers of the lines of each list.
+//
+void QueryData::buildIndices () {
+  KzSigmaIndex.build (KzSigma);
+  KzLevelIndex.build (KzLevels);
+  ListIndices.resize (Lists.size ());
+  for (unsigned int i = 0; i < Lists.size (); i ++) {
+    vector <double> Wavenumbers (Lists[i].size ());
+    for (unsigned int j = 0; j < Lists[i].size (); j ++) {
+      Wavenumbers [j] = Lists[i][j].wavenumber ();
+    }
+    ListIndices[i].build (Wavenumbers);
+  }
+}
+
+
+//------------------------------------------------------------------------------
+// addRecord (ostringstream &, size_t) : Adds the Kurucz record at position arg2
+// to the answer at arg1.
+//
+void QueryData::addRecord (ostringstream &Answer, size_t Record) {
+  Answer << "kz ";
+  Answer.write (KzRecords.data () + Record * KZ_RECORD_LENGTH, KZ_RECORD_LENGTH);
+  Answer << '\n';
+}
+
+
+//------------------------------------------------------------------------------
+// addNear (ostringstream &, double, double) : Adds to the answer at arg1 every
+// Kurucz record and every line of the lists with a wavenumber within arg3 of
+// arg2, each in ascending wavenumber.
+//
+void QueryData::addNear (ostringstream &Answer, double Sigma, double Tolerance) {
+  vector <size_t> Found = KzSigmaIndex.range (Sigma - Tolerance, Sigma + Tolerance);
+  for (unsigned int i = 0; i < Found.size (); i ++) {
+    addRecord (Answer, Found [i]);
+  }
+  for (unsigned int i = 0; i < Lists.size (); i ++) {
+    Found = ListIndices[i].range (Sigma - Tolerance, Sigma + Tolerance);
+    for (unsigned int j = 0; j < Found.size (); j ++) {
+      Answer << "line " << i + 1 << " " << Lists[i][Found[j]].getLineString ()
+        << '\n';
+    }
+  }
+}
+
+
+//------------------------------------------------------------------------------
+// answer (string) : Returns the answer to the query at arg1, ending with the
+// XGQUERY_END row. An empty string is returned for the quit query.
+//
+string QueryData::answer (string Query) {
+  istringstream iss (Query);
+  ostringstream Answer;
+  string Command;
+  double Value1, Value2, Tolerance;
+  iss >> Command;
+  if (Command == "near") {
+    Tolerance = XGQUERY_DEF_TOLERANCE;
+    if (!(iss >> Value1)) {
+      Answer << "error Syntax: near <sigma> [<tolerance>]\n";
+    } else {
+      iss >> Tolerance;
+      addNear (Answer, Value1, fabs (Tolerance));
+    }
+  } else if (Command == "level") {
+    Tolerance = XGQUERY_DEF_LEVEL_TOLERANCE;
+    if (!(iss >> Value1)) {
+      Answer << "error Syntax: level <energy> [<tolerance>]\n";
+    } else {
+      iss >> Tolerance;
+      Value1 = fabs (Value1);
+      Tolerance = fabs (Tolerance);
+      vector <size_t> Found = KzLevelIndex.range (Value1 - Tolerance,
+        Value1 + Tolerance);
+      for (unsigned int i = 0; i < Found.size (); i ++) {
+        addRecord (Answer, Found [i] / 2);
+      }
+    }
+  } else if (Command == "ritz") {
+    Tolerance = XGQUERY_DEF_TOLERANCE;
+    if (!(iss >> Value1 >> Value2)) {
+      Answer << "error Syntax: ritz <energy 1> <energy 2> [<tolerance>]\n";
+    } else {
+      iss >> Tolerance;
+      char Sigma [32];
+      snprintf (Sigma, sizeof (Sigma), "%.4f", fabs (fabs (Value1) - fabs (Value2)));
+      Answer << "ritz " << Sigma << '\n';
+      addNear (Answer, fabs (fabs (Value1) - fabs (Value2)), fabs (Tolerance));
+    }
+  } else if (Command == "info") {
+    for (unsigned int i = 0; i < KzNames.size (); i ++) {
+      Answer << "list kz " << KzNames[i] << " " << KzCounts[i] << '\n';
+    }
+    for (unsigned int i = 0; i < ListNames.size (); i ++) {
+      Answer << "list " << i + 1 << " " << ListNames[i] << " "
+        << Lists[i].size () << '\n';
+    }
+  } else if (Command == "quit") {
+    return "";
+  } else if (Command != "") {
+    Answer << "error Unknown query " << Command << '\n';
+  }
+  Answer << XGQUERY_END << '\n';
+  return Answer.str ();
+}
+
+
+//------------------------------------------------------------------------------
+// showHelp () : Prints syntax help message to the standard output.
+//
+void showHelp () {
+  cout << endl;
+  cout << "xgqueryd : Answers queries on line lists held in memory" << endl;
+  cout << "---------------------------------------------------------------" << endl;
+  cout << "Syntax : xgqueryd [-s <socket>] <kurucz in> [<list 1> <list 2> ...]" << endl << endl;
+  cout << "<kurucz in> : A Kurucz line list, or several separated by commas" << endl;
+  cout << "<list N>    : XGremlin writelines line lists, numbered from 1 in queries" << endl;
+  cout << "-s          : The Unix domain socket on which queries are received (default" << endl;
+  cout << "              $" << XGQUERY_SOCKET_ENV << ", or " << XGQUERY_DEF_SOCKET << ")" << endl << endl;
+  cout << "Query with xgquery. Stop the service with SIGINT or SIGTERM." << endl << endl;
+}
+
+
+//------------------------------------------------------------------------------
+// sendAll (int, string) : Writes the whole of arg2 to the socket at arg1.
+// Returns false if the connection has been closed.
+//
+bool sendAll (int Socket, string Data) {
+  size_t Sent = 0;
+  while (Sent < Data.length ()) {
+    ssize_t n = send (Socket, Data.data () + Sent, Data.length () - Sent, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    Sent += n;
+  }
+  return true;
+}
+
+
+//------------------------------------------------------------------------------
+// serve (int, QueryData *) : Answers the queries received on the connection at
+// arg1 from the data at arg2, until the client quits or closes the connection.
+//
+void serve (int Socket, QueryData *Data) {
+  char Buffer [READ_BUFFER_SIZE];
+  string Pending;
+  bool Open = true;
+  while (Open) {
+    ssize_t n = recv (Socket, Buffer, sizeof (Buffer), 0);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) break;
+    Pending.append (Buffer, n);
+    size_t End;
+    while (Open && (End = Pending.find ('\n')) != string::npos) {
+      string Query = Pending.substr (0, End);
+      Pending.erase (0, End + 1);
+      string Answer = Data -> answer (Query);
+      Open = (Answer != "") && sendAll (Socket, Answer);
+    }
+  }
+  close (Socket);
+}
+
+
+//------------------------------------------------------------------------------
+// stopServing (int) : Signal handler for SIGINT and SIGTERM.
+//
+void stopServing (int) {
+  StopRequested = 1;
+}
+
+
+//------------------------------------------------------------------------------
+// Main program
+//
+int main (int argc, char *argv[]) {
+  // This is not deleted, since connections may still be open on exit
+  QueryData &Data = *new QueryData;
+  string SocketName = XGQUERY_DEF_SOCKET;
+  int Arg = 1;
+
+  if (getenv (XGQUERY_SOCKET_ENV) != NULL) SocketName = getenv (XGQUERY_SOCKET_ENV);
+
+  // Process the command line options
+  while (Arg < argc - 1 && argv [Arg][0] == '-') {
+    string Option = argv [Arg];
+    if (Option == "-s") SocketName = argv [Arg + 1];
+    else {
+      cout << "Syntax error: Unknown option " << Option << endl;
+      showHelp ();
+      return ERR_SYNTAX_ERROR;
+    }
+    Arg += 2;
+  }
+  if (argc - Arg < MIN_NUM_ARGS - 1) {
+    showHelp ();
+    return ERR_SYNTAX_ERROR;
+  }
+
+  // Load the lists and index them
+  try {
+    istringstream iss (argv [Arg]);
+    string NextList;
+    while (getline (iss, NextList, ',')) {
+      if (NextList.length () > 0) Data.loadKurucz (NextList);
+    }
+    for (int i = Arg + 1; i < argc; i ++) {
+      Data.loadList (argv [i]);
+    }
+  } catch (int Err) {
+    return ERR_LOAD_ERROR;
+  }
+  Data.buildIndices ();
+  cout << "Loaded " << Data.numRecords () << " Kurucz records and "
+    << argc - Arg - 1 << " line list" << (argc - Arg - 1 == 1 ? "" : "s")
+    << endl;
+
+  // Open the socket. If one of the same name is left from an earlier run, it
+  // is replaced, unless another service is still listening on it.
+  struct sockaddr_un Address;
+  memset (&Address, 0, sizeof (Address));
+  Address.sun_family = AF_UNIX;
+  if (SocketName.length () >= sizeof (Address.sun_path)) {
+    cout << "Error: The socket name " << SocketName << " is too long" << endl;
+    return ERR_SOCKET_ERROR;
+  }
+  strncpy (Address.sun_path, SocketName.c_str (), sizeof (Address.sun_path) - 1);
+  int Listener = socket (AF_UNIX, SOCK_STREAM, 0);
+  if (Listener < 0) {
+    cout << "Error: Unable to create a socket (" << strerror (errno) << ")" << endl;
+    return ERR_SOCKET_ERROR;
+  }
+  if (connect (Listener, (struct sockaddr *) &Address, sizeof (Address)) == 0) {
+    cout << "Error: Another service is already listening on " << SocketName << endl;
+    return ERR_SOCKET_ERROR;
+  }
+  close (Listener);
+  unlink (SocketName.c_str ());
+  Listener = socket (AF_UNIX, SOCK_STREAM, 0);
+  if (Listener < 0
+    || bind (Listener, (struct sockaddr *) &Address, sizeof (Address)) < 0
+    || listen (Listener, SOMAXCONN) < 0) {
+    cout << "Error: Unable to listen on " << SocketName << " ("
+      << strerror (errno) << ")" << endl;
+    return ERR_SOCKET_ERROR;
+  }
+
+  // Stop cleanly on SIGINT or SIGTERM. SA_RESTART is deliberately not set so
+  // that the blocking accept below is interrupted.
+  struct sigaction Action;
+  memset (&Action, 0, sizeof (Action));
+  Action.sa_handler = stopServing;
+  sigaction (SIGINT, &Action, NULL);
+  sigaction (SIGTERM, &Action, NULL);
+  cout << "Listening on " << SocketName << endl;
+
+  // Serve each connection on a thread of its own until a signal is received
+  while (!StopRequested) {
+    int Connection = accept (Listener, NULL, NULL);
+    if (Connection < 0) {
+      if (errno == EINTR) continue;
+      cout << "Error: Unable to accept a connection on " << SocketName << " ("
+        << strerror (errno) << ")" << endl;
+      break;
+    }
+    thread (serve, Connection, &Data).detach ();
+  }
+
+  cout << "Stopping." << endl;
+  close (Listener);
+  unlink (SocketName.c_str ());
+  return ERR_NO_ERROR;
+}
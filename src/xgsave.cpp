@@ -27,11 +27,18 @@
 // another spectrum and saved as an accompanying .hdr file for this new .dat.
 // Care should be taken to ensure that this header file correctly describes the
 // scratch spectrum!
+//
+// Scratch files carry no record of their byte order, so this is judged from
+// the data themselves. The .dat file is written in the byte order given by
+// bocode in the copied header, if it has one, and otherwise in that of the
+// scratch file.
 
 #include <iostream>
 #include <fstream>
 #include <string>
 #include <sstream>
+#include <vector>
+#include "byteorder.h"
 
 #define HEADER_SIZE 368 /* bytes */
 #define REQUIRED_NUM_ARGS 5
@@ -61,8 +68,10 @@ int main (int argc, char *argv[]) {
   ofstream DatFileOut, HeaderOut;
   string OutputSpectrum, OutputHeader;
   char NextByte;
-  float yBegin, yEnd, y;
+  float y;
   int BoxcarSize;
+  vector <float> Scratch, Padded;
+  bool ScratchSwapped, OutputSwapped;
   
   // Check that the correct arguments have been supplied. If not, output a
   // simple program description and quit.
@@ -80,7 +89,7 @@ int main (int argc, char *argv[]) {
   
   // Open the input scratch file. Output an error message and quite if it
   // failed to open.
-  ScratchFileIn.open (argv[1]);
+  ScratchFileIn.open (argv[1], ios::in|ios::binary);
   if (!ScratchFileIn.is_open ()) {
     cout << "Error: Unable to open the scratch file " << argv[1] << ". Check the file exists and is readable." << endl;
     return ERR_CANT_OPEN_SCRATCH;
@@ -111,7 +120,7 @@ int main (int argc, char *argv[]) {
   // messages and quit if either failed to open.
   OutputHeader = argv[4]; OutputHeader += ".hdr";
   OutputSpectrum = argv[4]; OutputSpectrum += ".dat";
-  DatFileOut.open (OutputSpectrum.c_str());
+  DatFileOut.open (OutputSpectrum.c_str(), ios::out|ios::binary);
   if (!DatFileOut.is_open ()) {
     cout << "Error: Unable to open " << OutputSpectrum.c_str() << " for output. Check that you have write permissions for that location." << endl;
     return ERR_CANT_OPEN_OUTPUT;
@@ -125,24 +134,42 @@ int main (int argc, char *argv[]) {
   // Now begin the actual process of converting the scratch file to an XGremlin
   // line spectrum.
   
-  // First Move the scratch file get pointer to the end of the file header.
-  ScratchFileIn.seekg (ios::beg + HEADER_SIZE * sizeof(char));
+  // First read all the data points after the scratch file header in a single
+  // block, and put them in the native byte order.
+  ScratchFileIn.seekg (0, ios::end);
+  long ScratchSize = long (ScratchFileIn.tellg ()) - HEADER_SIZE;
+  if (ScratchSize > 0) {
+    Scratch.resize (ScratchSize / sizeof (float));
+    ScratchFileIn.seekg (HEADER_SIZE, ios::beg);
+    ScratchFileIn.read ((char*)Scratch.data (), Scratch.size () * sizeof (float));
+  }
+  double Native = plausibleFraction (Scratch.data (), Scratch.size ());
+  swapBytes32 (Scratch.data (), Scratch.size ());
+  ScratchSwapped = (plausibleFraction (Scratch.data (), Scratch.size ()) > Native);
+  if (!ScratchSwapped) swapBytes32 (Scratch.data (), Scratch.size ());
+  int HeaderOrder = headerByteOrder (argv[2]);
+  OutputSwapped = (HeaderOrder == BO_UNKNOWN) ? ScratchSwapped 
+    : (HeaderOrder != nativeByteOrder ());
+  if (ScratchSwapped) {
+    cout << "Reading " << argv[1] << " as a byte-swapped scratch file" << endl;
+  }
 
-  // Now copy the scratch spectrum, byte by byte to the output spectrum.
-  
-  ScratchFileIn.read ((char*)&yBegin, sizeof (float));
-  ScratchFileIn.read ((char*)&yEnd, sizeof (float));
-//  DatFileOut.write ((char*)&yBegin, sizeof (float));
-  for (unsigned int i = 1; i <= BoxcarSize; i ++) {
-      DatFileOut.write ((char*)&yBegin, sizeof (float));
+  // Now pad the scratch spectrum by linear interpolation between each pair
+  // of points, and write it to the output spectrum.
+  if (Scratch.size () > 0) {
+    Padded.reserve (Scratch.size () * BoxcarSize);
+    for (int i = 1; i <= BoxcarSize; i ++) {
+      Padded.push_back (Scratch [0]);
     }
-  while (!ScratchFileIn.eof()) {
-    for (unsigned int i = 1; i <= BoxcarSize; i ++) {
-      y = (float (i) / float (BoxcarSize)) * (yEnd - yBegin) + yBegin;
-      DatFileOut.write ((char*)&y, sizeof (float));
+    for (size_t j = 1; j < Scratch.size (); j ++) {
+      for (int i = 1; i <= BoxcarSize; i ++) {
+        y = (float (i) / float (BoxcarSize)) * (Scratch [j] - Scratch [j - 1]) 
+          + Scratch [j - 1];
+        Padded.push_back (y);
+      }
     }
-    yBegin = yEnd;
-    ScratchFileIn.read ((char*)&yEnd, sizeof (float));
+    if (OutputSwapped) swapBytes32 (Padded.data (), Padded.size ());
+    DatFileOut.write ((char*)Padded.data (), Padded.size () * sizeof (float));
   }
   
   // Produce an exact copy of the input header for the converted spectrum
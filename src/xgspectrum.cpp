@@ -0,0 +1,161 @@
+// Xgtools
+// Copyright (C) M. P. Ruffoni 2011-2015
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//==============================================================================
+// XgSpectrum class (xgspectrum.cpp)
+//==============================================================================
+
+#include "xgspectrum.h"
+#include "byteorder.h"
+#include <iostream>
+#include <sstream>
+#include <cmath>
+
+//------------------------------------------------------------------------------
+// load (string) : Loads the spectrum named at arg1. The wavenumber scale is
+// read from <arg1>.hdr and the data points from <arg1>.dat, which are put in
+// the native byte order if they were written in the other. Throws an error
+// code from ErrDefs.h if either file cannot be read.
+//
+void XgSpectrum::load (string NewName) throw (int) {
+  string DataName = NewName + ".dat";
+  loadHeader (NewName);
+
+  // Read all the data points in a single block
+  ifstream DataFile (DataName.c_str (), ios::in|ios::binary);
+  Data.resize (NumPoints);
+  DataFile.read ((char*)&Data [0], NumPoints * sizeof (float));
+  if (DataFile.gcount () != (streamsize)(NumPoints * sizeof (float))) {
+    cout << "Error: Unable to read " << DataName << "." << endl;
+    Data.clear ();
+    NumPoints = 0;
+    throw int (LC_FILE_READ_ERROR);
+  }
+  DataFile.close ();
+  if (Swapped) swapBytes32 (Data.data (), Data.size ());
+}
+
+
+//------------------------------------------------------------------------------
+// loadHeader (string) : Reads the wavenumber scale of the spectrum named at
+// arg1 from <arg1>.hdr, and finds the byte order of <arg1>.dat, without reading
+// the data points. Throws an error code from ErrDefs.h if the header cannot be
+// read, or if the .dat file does not hold all the points given in the header.
+//
+void XgSpectrum::loadHeader (string NewName) throw (int) {
+  string HeaderName = NewName + ".hdr";
+  string DataName = NewName + ".dat";
+  long NewNumPoints;
+
+  // Load the wavenumber scale from the header file
+  ifstream Header (HeaderName.c_str (), ios::in);
+  if (!Header.is_open ()) {
+    cout << "Error: Unable to open " << HeaderName
+      << ". Check the file exists and is readable." << endl;
+    throw int (LC_FILE_OPEN_ERROR);
+  }
+  try {
+    WStart = getHeaderField (Header, XGSPEC_WSTART_TAG);
+    DelW = getHeaderField (Header, XGSPEC_DELW_TAG);
+    NewNumPoints = (long) getHeaderField (Header, XGSPEC_NUM_PTS_TAG);
+  } catch (int Err) {
+    cout << "Error: Couldn't load the required XGremlin header data from "
+      << HeaderName << endl;
+    throw int (LC_FILE_HEAD_ERROR);
+  }
+  Header.close ();
+  if (DelW == 0.0 || NewNumPoints < 2) {
+    cout << "Error: " << HeaderName << " does not describe a valid wavenumber "
+      << "scale (delw " << DelW << ", npo " << NewNumPoints << ")." << endl;
+    throw int (LC_FILE_HEAD_ERROR);
+  }
+
+  // Check that the data file holds every point
+  ifstream DataFile (DataName.c_str (), ios::in|ios::binary);
+  if (!DataFile.is_open ()) {
+    cout << "Error: Unable to open " << DataName
+      << ". Check the file exists and is readable." << endl;
+    throw int (LC_FILE_OPEN_ERROR);
+  }
+  DataFile.seekg (0, ios::end);
+  if (DataFile.tellg () < (streamoff)(NewNumPoints * sizeof (float))) {
+    cout << "Error: " << DataName << " contains fewer than the " << NewNumPoints
+      << " points given in " << HeaderName << "." << endl;
+    throw int (LC_FILE_READ_ERROR);
+  }
+  DataFile.close ();
+  Data.clear ();
+  NumPoints = NewNumPoints;
+  Swapped = datIsSwapped (DataName, HeaderName);
+  Name = NewName;
+}
+
+
+//------------------------------------------------------------------------------
+// getHeaderField (ifstream &, string) : Searches the XGremlin header file
+// attached to the ifstream at arg1 for the variable specified at arg2. If
+// found, its value is extracted and returned as a double.
+//
+double XgSpectrum::getHeaderField (ifstream &Header, string FieldName)
+  throw (int) {
+  string LineString, NextField;
+  double ReturnValue;
+  istringstream iss;
+
+  // Search the XGremlin header for FieldName
+  Header.clear ();
+  Header.seekg (0, ios::beg);
+  do {
+    getline (Header, LineString);
+    iss.str (LineString);
+    iss >> NextField;
+    iss.clear ();
+  } while (NextField != FieldName && !Header.eof ());
+
+  // See if the end of file has been reached. If not, extract the variable.
+  if (NextField != FieldName || LineString.length () < 10) throw (1);
+  iss.str (LineString.substr (9, 23));
+  if (!(iss >> ReturnValue)) throw (1);
+  return ReturnValue;
+}
+
+
+//------------------------------------------------------------------------------
+// minWavenumber (), maxWavenumber () : Return the lowest and highest wavenumber
+// in the spectrum, allowing for a negative point spacing.
+//
+double XgSpectrum::minWavenumber () {
+  return (DelW > 0.0) ? WStart : wavenumber (NumPoints - 1);
+}
+
+double XgSpectrum::maxWavenumber () {
+  return (DelW > 0.0) ? wavenumber (NumPoints - 1) : WStart;
+}
+
+
+//------------------------------------------------------------------------------
+// interpolate (double) : Returns the value of the spectrum at the wavenumber
+// Sigma by linear interpolation between the two nearest data points. Throws
+// XGSPEC_OUT_OF_BOUNDS if Sigma lies outside the spectrum.
+//
+double XgSpectrum::interpolate (double Sigma) throw (int) {
+  double x = (Sigma - WStart) / DelW;
+  if (x < 0.0 || x > Data.size () - 1.0) throw int (XGSPEC_OUT_OF_BOUNDS);
+  size_t i = (size_t) x;
+  if (i >= Data.size () - 1) return Data [Data.size () - 1];
+  double f = x - i;
+  return Data [i] * (1.0 - f) + Data [i + 1] * f;
+}
@@ -0,0 +1,85 @@
+// Xgtools
+// Copyright (C) M. P. Ruffoni 2011-2015
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//==============================================================================
+// XgSpectrum class (xgspectrum.h)
+//==============================================================================
+// Holds an XGremlin line spectrum, as stored in a .dat file of single precision
+// data points with an accompanying .hdr file. A spectrum is loaded by passing
+// its name, without either extension, to load(). The header must contain the
+// wavenumber of the first point (wstart), the spacing between points (delw) and
+// the number of points (npo).
+//
+// The data points can then be read by index with the [] operator, where the
+// wavenumber of point i is given by wavenumber(i). interpolate() returns the
+// spectrum at any wavenumber between the first and last points, by linear
+// interpolation between the two neighbouring points. The points are always
+// held in native byte order, and swapped() reports whether the .dat file was
+// written in the other.
+//
+// Tools that read the data points in blocks can instead call loadHeader(),
+// which reads only the wavenumber scale and the byte order. size() then gives
+// the number of points in the .dat file, but none are held.
+//
+#ifndef XG_SPECTRUM_H
+#define XG_SPECTRUM_H
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include "ErrDefs.h"
+
+// XGremlin header tags for the wavenumber scale of the spectrum
+#define XGSPEC_WSTART_TAG  "wstart"
+#define XGSPEC_DELW_TAG    "delw"
+#define XGSPEC_NUM_PTS_TAG "npo"
+
+using namespace::std;
+
+class XgSpectrum {
+  public:
+    XgSpectrum () { WStart = 0.0; DelW = 0.0; NumPoints = 0; Swapped = false; }
+    XgSpectrum (string NewName) throw (int) { load (NewName); }
+    ~XgSpectrum () {}
+
+    // Reads the .hdr and .dat files of the spectrum at arg1
+    void load (string NewName) throw (int);
+    void loadHeader (string NewName) throw (int);
+
+    // Wavenumber scale and data access
+    string name () { return Name; }
+    size_t size () { return NumPoints; }
+    double wstart () { return WStart; }
+    double delw () { return DelW; }
+    double wavenumber (size_t i) { return WStart + DelW * i; }
+    double minWavenumber ();
+    double maxWavenumber ();
+    float &operator[] (size_t i) { return Data [i]; }
+    vector <float> &data () { return Data; }
+    bool swapped () { return Swapped; }
+    double interpolate (double Sigma) throw (int);
+
+  private:
+    string Name;
+    double WStart;
+    double DelW;
+    size_t NumPoints;
+    vector <float> Data;
+    bool Swapped;        // true if the .dat file is not in native byte order
+    double getHeaderField (ifstream &Header, string FieldName) throw (int);
+};
+
+#endif // XG_SPECTRUM_H
@@ -0,0 +1,183 @@
+// Xgtools
+// Copyright (C) M. P. Ruffoni 2011-2015
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//==============================================================================
+// XgTrace class (xgtrace.cpp)
+//==============================================================================
+
+#include "xgtrace.h"
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+// A single recorded span
+typedef struct td_TraceEvent {
+  const char *Name;
+  long long Start;     // ns since the program started
+  long long Duration;  // ns
+} TraceEvent;
+
+// The ring buffer of spans recorded by one thread. Count is the number of
+// spans ever recorded, so the most recent is at (Count - 1) modulo the size.
+typedef struct td_TraceBuffer {
+  unsigned int Thread;
+  size_t Count;
+  TraceEvent Events [XG_TRACE_BUFFER_SIZE];
+} TraceBuffer;
+
+// Holds the buffer of the current thread, and hands it on to be reused by a
+// later thread when this one finishes
+typedef struct td_TraceBufferOwner {
+  TraceBuffer *Buffer;
+  td_TraceBufferOwner () { Buffer = NULL; }
+  ~td_TraceBufferOwner ();
+} TraceBufferOwner;
+
+// The time at which the program started, the name of the trace file, every
+// buffer that has been created, and those not in use by a running thread.
+// These are defined before Enabled so that they are initialised first.
+static chrono::steady_clock::time_point TraceOrigin = chrono::steady_clock::now ();
+static string TraceFile;
+static vector <TraceBuffer *> TraceBuffers;
+static vector <TraceBuffer *> FreeBuffers;
+static mutex TraceBuffersLock;
+static thread_local TraceBufferOwner LocalBuffer;
+
+bool XgTrace::Enabled = XgTrace::init ();
+
+//------------------------------------------------------------------------------
+// TraceBufferOwner destructor : Returns the buffer of a finished thread to the
+// free buffers.
+//
+td_TraceBufferOwner::~td_TraceBufferOwner () {
+  if (Buffer == NULL) return;
+  TraceBuffersLock.lock ();
+  FreeBuffers.push_back (Buffer);
+  TraceBuffersLock.unlock ();
+}
+
+
+//------------------------------------------------------------------------------
+// writeTrace () : Writes the trace when the program exits.
+//
+static void writeTrace () {
+  XgTrace::write ();
+}
+
+
+//------------------------------------------------------------------------------
+// init () : Reads the name of the trace file from XGTOOLS_TRACE. If it is set,
+// the trace is arranged to be written at exit and true is returned.
+//
+bool XgTrace::init () {
+  const char *Env = getenv (XG_TRACE_ENV);
+  if (Env == NULL || Env[0] == '\0') return false;
+  TraceFile = Env;
+  atexit (writeTrace);
+  return true;
+}
+
+
+//------------------------------------------------------------------------------
+// now () : Returns the number of nanoseconds since the program started.
+//
+long long XgTrace::now () {
+  return chrono::duration_cast <chrono::nanoseconds>
+    (chrono::steady_clock::now () - TraceOrigin).count ();
+}
+
+
+//------------------------------------------------------------------------------
+// record (const char *, long long) : Adds a span named arg1, from time arg2 to
+// now, to the ring buffer of the calling thread. A buffer is found the first
+// time a thread records a span, which is the only time a lock is taken. The
+// buffer of a finished thread is reused if there is one, so a program that
+// starts new threads for each stage of its work shows them as a fixed set of
+// threads in the trace, and its memory use does not grow.
+//
+void XgTrace::record (const char *Name, long long Start) {
+  long long End = now ();
+  TraceBuffer *Buffer = LocalBuffer.Buffer;
+  if (Buffer == NULL) {
+    TraceBuffersLock.lock ();
+    if (FreeBuffers.size () > 0) {
+      Buffer = FreeBuffers.back ();
+      FreeBuffers.pop_back ();
+    } else {
+      Buffer = new TraceBuffer;
+      Buffer -> Count = 0;
+      Buffer -> Thread = TraceBuffers.size ();
+      TraceBuffers.push_back (Buffer);
+    }
+    TraceBuffersLock.unlock ();
+    LocalBuffer.Buffer = Buffer;
+  }
+  TraceEvent &Event = Buffer -> Events [Buffer -> Count % XG_TRACE_BUFFER_SIZE];
+  Event.Name = Name;
+  Event.Start = Start;
+  Event.Duration = End - Start;
+  Buffer -> Count ++;
+}
+
+
+//------------------------------------------------------------------------------
+// write () : Writes the spans of every thread to the trace file as Chrome
+// trace events, with times in microseconds. The threads are numbered by the
+// buffers they used. Any buffer that overflowed is reported, since only its
+// latest spans are in the trace. All the threads that recorded spans must have
+// finished.
+//
+void XgTrace::write () {
+  if (!Enabled) return;
+  ofstream Output (TraceFile.c_str (), ios::out);
+  if (!Output.is_open ()) {
+    cout << "Warning: Unable to write the trace to " << TraceFile << endl;
+    return;
+  }
+  TraceBuffersLock.lock ();
+  Output << "{\"traceEvents\":[" << endl;
+  bool First = true;
+  char Row [256];
+  for (unsigned int i = 0; i < TraceBuffers.size (); i ++) {
+    TraceBuffer &Buffer = *TraceBuffers [i];
+    snprintf (Row, sizeof (Row), "%s{\"name\":\"thread_name\",\"ph\":\"M\","
+      "\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"thread %u\"}}",
+      First ? "" : ",\n", Buffer.Thread, Buffer.Thread);
+    Output << Row;
+    First = false;
+    size_t Oldest = (Buffer.Count > XG_TRACE_BUFFER_SIZE) ?
+      Buffer.Count - XG_TRACE_BUFFER_SIZE : 0;
+    for (size_t j = Oldest; j < Buffer.Count; j ++) {
+      TraceEvent &Event = Buffer.Events [j % XG_TRACE_BUFFER_SIZE];
+      snprintf (Row, sizeof (Row), ",\n{\"name\":\"%s\",\"cat\":\"xgtools\","
+        "\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+        Event.Name, Buffer.Thread, Event.Start / 1000.0, Event.Duration / 1000.0);
+      Output << Row;
+    }
+    if (Oldest > 0) {
+      cout << "Warning: Only the last " << XG_TRACE_BUFFER_SIZE << " of "
+        << Buffer.Count << " spans of thread " << Buffer.Thread
+        << " were kept in the trace" << endl;
+    }
+  }
+  Output << endl << "],\"displayTimeUnit\":\"ms\"}" << endl;
+  TraceBuffersLock.unlock ();
+  Output.close ();
+}
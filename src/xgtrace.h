@@ -0,0 +1,90 @@
+// Xgtools
+// Copyright (C) M. P. Ruffoni 2011-2015
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//==============================================================================
+// XgTrace and XgTraceSpan classes (xgtrace.h)
+//==============================================================================
+// Records a timeline of the work done by each thread of an Xgtools program, to
+// show where a parallel run waits on I/O, where its threads are unevenly
+// loaded, and how long its serial stages take. Tracing is enabled by naming an
+// output file in the XGTOOLS_TRACE environment variable, e.g.
+//
+//   XGTOOLS_TRACE=trace.json ftsconvolve spectrum gauss 20 smoothed
+//
+// When the program exits, the trace is written to this file in the Chrome
+// trace event format, which can be viewed in chrome://tracing or Perfetto.
+//
+// Each stage of work to be timed is enclosed in a scope holding an XgTraceSpan,
+// named by a string literal:
+//
+//   {
+//     XgTraceSpan Span ("read block");
+//     ...
+//   }
+//
+// The span is recorded when it goes out of scope. Each thread records its spans
+// in a ring buffer of its own, so no locks are taken while recording. Only the
+// most recent XG_TRACE_BUFFER_SIZE spans of each buffer are kept. When a thread
+// finishes, its buffer is passed on to the next thread to start. If tracing is
+// not enabled, a span does nothing more than test a flag.
+//
+#ifndef XG_TRACE_H
+#define XG_TRACE_H
+
+#include <string>
+
+// The environment variable that names the trace file
+#define XG_TRACE_ENV "XGTOOLS_TRACE"
+
+// The number of spans kept for each thread
+#define XG_TRACE_BUFFER_SIZE 65536
+
+using namespace::std;
+
+class XgTrace {
+  public:
+    // Returns true if XGTOOLS_TRACE has been set
+    static bool enabled () { return Enabled; }
+
+    // Returns the time in nanoseconds since the program started
+    static long long now ();
+
+    // Records a span named arg1, which started at time arg2 and ends now. arg1
+    // must remain valid until the program exits.
+    static void record (const char *Name, long long Start);
+
+    // Writes every recorded span to the trace file
+    static void write ();
+
+  private:
+    static bool Enabled;
+    static bool init ();
+};
+
+class XgTraceSpan {
+  public:
+    XgTraceSpan (const char *NewName) {
+      Name = NewName;
+      Start = XgTrace::enabled () ? XgTrace::now () : 0;
+    }
+    ~XgTraceSpan () { if (XgTrace::enabled ()) XgTrace::record (Name, Start); }
+
+  private:
+    const char *Name;
+    long long Start;
+};
+
+#endif // XG_TRACE_H
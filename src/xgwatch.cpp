@@ -0,0 +1,587 @@
+// Xgtools
+// Copyright (C) M. P. Ruffoni 2011-2015
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// xgwatch : Processes new spectra as they are written to a directory
+//
+// xgwatch watches a directory with inotify and waits for complete XGremlin
+// spectra (a .dat and .hdr pair with the same name) to be written there. Each
+// new spectrum is placed in a queue and processed by a fixed number of worker
+// threads, which run the commands listed in a chain file one after the other.
+// Each line of the chain file is a program and its arguments, separated by
+// spaces or tabs. An argument containing spaces may be enclosed in single or
+// double quotes. In each argument the following placeholders are replaced:
+//
+//   %s : The full path of the spectrum, without the .dat/.hdr extension
+//   %n : The name of the spectrum, without the directory or extension
+//   %d : The watched directory
+//   %% : A literal % character
+//
+// The program is run directly rather than by a shell, so a file name can never
+// be read as part of a command, whatever characters it contains. Pipes,
+// redirection and shell variables are therefore not available; use a script
+// for these. Blank lines and lines beginning with # are ignored. A chain stops
+// at the first command that returns a non-zero exit code. For example:
+//
+//   ftsintensity %s response.txt %d/processed/%n
+//   xgfit %d/processed/%n lines.syn %d/processed/%n.lines
+//
+// The queue holds at most <queue size> spectra. If it fills, xgwatch stops
+// reading events until a worker becomes free. Events are buffered by the kernel
+// in the meantime, and the directory is rescanned if that buffer overflows.
+//
+// The state of each spectrum (queued, running, done or failed) is written to a
+// status file, which is replaced atomically at most once every STATUS_INTERVAL
+// while spectra are changing state. Only the last MAX_STATUS_ENTRIES finished
+// spectra are listed, though the totals count every spectrum. Note that output written to the watched directory is picked up as a
+// new spectrum if it matches the name pattern, so use -p or a separate output
+// directory to exclude it. Also note that xgfit uses ~/.xgremlinrc, so chains
+// that run xgfit must be processed with a single worker.
+//
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_set>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <cerrno>
+#include <csignal>
+#include <unistd.h>
+#include <dirent.h>
+#include <fnmatch.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/inotify.h>
+#include <poll.h>
+
+using namespace::std;
+
+#define MIN_NUM_ARGS 3
+
+#define DEF_NUM_WORKERS 1
+#define DEF_QUEUE_SIZE  16
+#define DEF_PATTERN     "*"
+#define STATUS_FILENAME "xgwatch.status"
+#define EVENT_BUFFER_SIZE 65536 /* bytes */
+#define QUEUE_POLL_TIME   250   /* ms */
+#define STATUS_INTERVAL   1000  /* ms */
+#define MAX_STATUS_ENTRIES 1000
+
+#define ERR_NO_ERROR     0
+#define ERR_SYNTAX_ERROR 1
+#define ERR_CHAIN_ERROR  2
+#define ERR_WATCH_ERROR  3
+
+// The states through which each spectrum passes
+#define JOB_QUEUED  "queued"
+#define JOB_RUNNING "running"
+#define JOB_DONE    "done"
+#define JOB_FAILED  "failed"
+
+typedef struct td_JobStatus {
+  string State;
+  time_t Queued, Started, Finished;
+  int ExitCode;
+  unsigned int FailedCommand;
+} JobStatus;
+
+// Set by the signal handler to request a clean shutdown
+static volatile sig_atomic_t StopRequested = 0;
+
+//------------------------------------------------------------------------------
+// JobQueue class : A bounded queue of spectra waiting to be processed, together
+// with the status of the spectra queued, running, or recently finished. The
+// names of all the spectra seen are kept so that none is processed twice. All
+// access is serialised by a single mutex. push() blocks while the queue is full
+// and pop() blocks while it is empty, until close() is called.
+//
+class JobQueue {
+  public:
+    JobQueue (size_t NewMaxSize, string NewStatusFile) {
+      MaxSize = NewMaxSize; StatusFile = NewStatusFile; Closed = false;
+      NumDone = NumFailed = 0; StatusChanged = false;
+    }
+
+    bool seen (string Name);
+    bool push (string Name);
+    bool pop (string &Name);
+    void close ();
+    void setState (string Name, string State, int ExitCode = 0,
+      unsigned int FailedCommand = 0);
+    void flushStatus ();
+
+  private:
+    deque <string> Pending;
+    unordered_set <string> Seen;
+    map <string, JobStatus> Status;
+    deque <string> Finished;          // Finished spectra in Status, oldest first
+    unsigned long NumDone, NumFailed;
+    size_t MaxSize;
+    string StatusFile;
+    bool Closed, StatusChanged;
+    chrono::steady_clock::time_point LastWrite;
+    mutex Lock;
+    condition_variable NotFull, NotEmpty;
+    void statusChanged ();
+    void writeStatus ();
+};
+
+bool JobQueue::seen (string Name) {
+  lock_guard <mutex> Guard (Lock);
+  return Seen.count (Name) > 0;
+}
+
+bool JobQueue::push (string Name) {
+  unique_lock <mutex> Guard (Lock);
+  if (Seen.count (Name)) return false;
+  if (Pending.size () >= MaxSize) {
+    cout << "Queue full (" << MaxSize << " spectra). Waiting for a free worker."
+      << endl;
+  }
+  // The signal handler cannot notify NotFull, so wake periodically to check
+  // whether a shutdown has been requested while waiting for a free slot
+  while (Pending.size () >= MaxSize && !Closed && !StopRequested) {
+    NotFull.wait_for (Guard, chrono::milliseconds (QUEUE_POLL_TIME));
+  }
+  if (Closed || StopRequested) return false;
+  Pending.push_back (Name);
+  Seen.insert (Name);
+  JobStatus NewStatus;
+  NewStatus.State = JOB_QUEUED;
+  NewStatus.Queued = time (NULL);
+  NewStatus.Started = NewStatus.Finished = 0;
+  NewStatus.ExitCode = 0;
+  NewStatus.FailedCommand = 0;
+  Status [Name] = NewStatus;
+  statusChanged ();
+  NotEmpty.notify_one ();
+  return true;
+}
+
+bool JobQueue::pop (string &Name) {
+  unique_lock <mutex> Guard (Lock);
+  while (Pending.empty () && !Closed) NotEmpty.wait (Guard);
+  if (Pending.empty ()) return false;
+  Name = Pending.front ();
+  Pending.pop_front ();
+  NotFull.notify_one ();
+  return true;
+}
+
+void JobQueue::close () {
+  lock_guard <mutex> Guard (Lock);
+  Closed = true;
+  NotFull.notify_all ();
+  NotEmpty.notify_all ();
+}
+
+void JobQueue::setState (string Name, string State, int ExitCode,
+  unsigned int FailedCommand) {
+  lock_guard <mutex> Guard (Lock);
+  JobStatus &Job = Status [Name];
+  Job.State = State;
+  if (State == JOB_RUNNING) Job.Started = time (NULL);
+  else Job.Finished = time (NULL);
+  Job.ExitCode = ExitCode;
+  Job.FailedCommand = FailedCommand;
+
+  // Keep only the most recently finished spectra in the status list
+  if (State == JOB_DONE || State == JOB_FAILED) {
+    if (State == JOB_DONE) NumDone ++;
+    else NumFailed ++;
+    Finished.push_back (Name);
+    if (Finished.size () > MAX_STATUS_ENTRIES) {
+      Status.erase (Finished.front ());
+      Finished.pop_front ();
+    }
+  }
+  statusChanged ();
+}
+
+void JobQueue::flushStatus () {
+  lock_guard <mutex> Guard (Lock);
+  if (StatusChanged) writeStatus ();
+}
+
+//------------------------------------------------------------------------------
+// statusChanged () : Notes that the status has changed, and rewrites the status
+// file if it was last written more than STATUS_INTERVAL ago. Otherwise it is
+// left to a later change or to flushStatus(). Must be called with the queue
+// lock held.
+//
+void JobQueue::statusChanged () {
+  StatusChanged = true;
+  if (chrono::steady_clock::now () - LastWrite
+    >= chrono::milliseconds (STATUS_INTERVAL)) {
+    writeStatus ();
+  }
+}
+
+//------------------------------------------------------------------------------
+// writeStatus () : Writes the state of each spectrum in the status list to a
+// temporary file and renames it over the status file, so readers never see a partial update. Must
+// be called with the queue lock held.
+//
+void JobQueue::writeStatus () {
+  map <string, int> Counts;
+  map <string, JobStatus>::iterator it;
+  string TempName = StatusFile + ".tmp";
+  ofstream Output (TempName.c_str (), ios::out);
+  if (!Output.is_open ()) return;
+
+  for (it = Status.begin (); it != Status.end (); it ++) {
+    Counts [it -> second.State] ++;
+  }
+  Output << "# xgwatch status, updated " << time (NULL) << endl;
+  Output << "# queued " << Counts [JOB_QUEUED] << ", running "
+    << Counts [JOB_RUNNING] << ", done " << NumDone << ", failed "
+    << NumFailed << endl;
+  Output << "# spectrum  state  queued  started  finished  exit code  command" << endl;
+  for (it = Status.begin (); it != Status.end (); it ++) {
+    Output << it -> first << " " << it -> second.State << " "
+      << it -> second.Queued << " " << it -> second.Started << " "
+      << it -> second.Finished << " " << it -> second.ExitCode << " "
+      << it -> second.FailedCommand << endl;
+  }
+  Output.close ();
+  rename (TempName.c_str (), StatusFile.c_str ());
+  StatusChanged = false;
+  LastWrite = chrono::steady_clock::now ();
+}
+
+
+//------------------------------------------------------------------------------
+// showHelp () : Prints syntax help message to the standard output.
+//
+void showHelp () {
+  cout << endl;
+  cout << "xgwatch : Processes new spectra as they are written to a directory" << endl;
+  cout << "-------------------------------------------------------------------" << endl;
+  cout << "Syntax : xgwatch [options] <directory> <chain>" << endl << endl;
+  cout << "<directory> : The directory in which new .dat/.hdr pairs will appear." << endl;
+  cout << "<chain>     : A file listing the commands to run for each new spectrum." << endl;
+  cout << "              Commands are run directly, not by a shell." << endl;
+  cout << "              %s is replaced by the spectrum path (without extension)," << endl;
+  cout << "              %n by its name, and %d by <directory>." << endl << endl;
+  cout << "[options] :" << endl;
+  cout << "  -w <n>       : Number of worker threads (default " << DEF_NUM_WORKERS << ")." << endl;
+  cout << "  -q <n>       : Maximum number of queued spectra (default " << DEF_QUEUE_SIZE << ")." << endl;
+  cout << "  -p <pattern> : Only process spectra whose names match this pattern (default \""
+    << DEF_PATTERN << "\")." << endl;
+  cout << "  -s <file>    : Status file (default <directory>/" << STATUS_FILENAME << ")." << endl << endl;
+}
+
+
+//------------------------------------------------------------------------------
+// splitCommand (string, string, string, vector <string> &) : Splits the chain
+// command at arg1 into the program and its arguments, replacing the
+// placeholders for the spectrum at arg2 in the directory at arg3, and puts them
+// in arg4. Text substituted for a placeholder is never split or unquoted.
+// Returns false if the command is empty or has an unterminated quote.
+//
+bool splitCommand (string Command, string Name, string Directory,
+  vector <string> &Args) {
+  string Word;
+  bool InWord = false;
+  char Quote = 0;
+  Args.clear ();
+  for (size_t i = 0; i < Command.size (); i ++) {
+    char c = Command [i];
+    if (Quote == 0 && (c == ' ' || c == '\t' || c == '\r')) {
+      if (InWord) Args.push_back (Word);
+      Word = "";
+      InWord = false;
+      continue;
+    }
+    InWord = true;
+    if (Quote == 0 && (c == '\'' || c == '"')) {
+      Quote = c;
+    } else if (c == Quote) {
+      Quote = 0;
+    } else if (c == '%' && i + 1 < Command.size ()) {
+      switch (Command [++ i]) {
+        case 's': Word += Directory + "/" + Name; break;
+        case 'n': Word += Name; break;
+        case 'd': Word += Directory; break;
+        case '%': Word += '%'; break;
+        default: Word += '%'; Word += Command [i];
+      }
+    } else {
+      Word += c;
+    }
+  }
+  if (InWord) Args.push_back (Word);
+  return Quote == 0 && Args.size () > 0;
+}
+
+
+//------------------------------------------------------------------------------
+// runCommand (vector <string> &) : Runs the program named by the first element
+// of arg1 with the rest as its arguments, without a shell, and waits for it to
+// finish. Returns its exit code, or -1 if it could not be run or was killed by
+// a signal.
+//
+int runCommand (vector <string> &Args) {
+  // Build the argument list before forking, since only async-signal-safe
+  // functions may be called in the child of a threaded process
+  vector <char *> Argv (Args.size () + 1, (char *) NULL);
+  for (unsigned int i = 0; i < Args.size (); i ++) {
+    Argv [i] = (char *) Args [i].c_str ();
+  }
+  pid_t Child = fork ();
+  if (Child < 0) return -1;
+  if (Child == 0) {
+    execvp (Argv [0], &Argv [0]);
+    _exit (127);
+  }
+  int Status;
+  while (waitpid (Child, &Status, 0) < 0) {
+    if (errno != EINTR) return -1;
+  }
+  return WIFEXITED (Status) ? WEXITSTATUS (Status) : -1;
+}
+
+
+//------------------------------------------------------------------------------
+// readChain (string) : Loads the list of commands to run for each spectrum.
+//
+vector <string> readChain (string Filename) throw (int) {
+  vector <string> Commands;
+  string NextLine;
+  ifstream ChainFile (Filename.c_str ());
+  if (!ChainFile.is_open ()) {
+    cout << "Error: Unable to open " << Filename << endl;
+    throw int (ERR_CHAIN_ERROR);
+  }
+  while (getline (ChainFile, NextLine)) {
+    size_t First = NextLine.find_first_not_of (" \t");
+    if (First == string::npos || NextLine [First] == '#') continue;
+    vector <string> Args;
+    if (!splitCommand (NextLine, "", "", Args)) {
+      cout << "Error: Unterminated quote in " << Filename << ": " << NextLine
+        << endl;
+      throw int (ERR_CHAIN_ERROR);
+    }
+    Commands.push_back (NextLine.substr (First));
+  }
+  if (Commands.size () == 0) {
+    cout << "Error: " << Filename << " does not contain any commands" << endl;
+    throw int (ERR_CHAIN_ERROR);
+  }
+  return Commands;
+}
+
+
+//------------------------------------------------------------------------------
+// fileExists (string) : Returns true if arg1 is an existing regular file.
+//
+bool fileExists (string Filename) {
+  struct stat Info;
+  return stat (Filename.c_str (), &Info) == 0 && S_ISREG (Info.st_mode);
+}
+
+
+//------------------------------------------------------------------------------
+// checkSpectrum (JobQueue &, string, string, string) : Called whenever a file
+// named arg2 has been written to the directory at arg3. If it completes a new
+// .dat/.hdr pair whose name matches the pattern at arg4, the spectrum is added
+// to the queue. This blocks while the queue is full.
+//
+void checkSpectrum (JobQueue &Queue, string Filename, string Directory,
+  string Pattern) {
+  if (Filename.size () < 5) return;
+  string Extension = Filename.substr (Filename.size () - 4);
+  string Name = Filename.substr (0, Filename.size () - 4);
+  if (Extension != ".dat" && Extension != ".hdr") return;
+  if (fnmatch (Pattern.c_str (), Name.c_str (), 0) != 0) return;
+  if (Queue.seen (Name)) return;
+  string Base = Directory + "/" + Name;
+  if (fileExists (Base + ".dat") && fileExists (Base + ".hdr")) {
+    if (Queue.push (Name)) {
+      cout << "Queued " << Name << endl;
+    }
+  }
+}
+
+
+//------------------------------------------------------------------------------
+// scanDirectory (JobQueue &, string, string) : Queues every complete spectrum
+// in the directory that has not been seen before. Used if inotify events were
+// lost because the kernel event queue overflowed.
+//
+void scanDirectory (JobQueue &Queue, string Directory, string Pattern) {
+  DIR *Dir = opendir (Directory.c_str ());
+  struct dirent *Entry;
+  if (Dir == NULL) return;
+  while ((Entry = readdir (Dir)) != NULL && !StopRequested) {
+    checkSpectrum (Queue, Entry -> d_name, Directory, Pattern);
+  }
+  closedir (Dir);
+}
+
+
+//------------------------------------------------------------------------------
+// worker (JobQueue *, vector <string> *, string) : The worker thread. Takes the
+// next spectrum from the queue and runs each of the chain commands for it in
+// turn, until the queue is closed.
+//
+void worker (JobQueue *Queue, vector <string> *Chain, string Directory) {
+  string Name;
+  while (Queue -> pop (Name)) {
+    int ExitCode = 0;
+    unsigned int i;
+    Queue -> setState (Name, JOB_RUNNING);
+    cout << "Processing " << Name << endl;
+    for (i = 0; i < Chain -> size (); i ++) {
+      vector <string> Args;
+      splitCommand (Chain -> at (i), Name, Directory, Args);
+      ExitCode = runCommand (Args);
+      if (ExitCode != 0) break;
+    }
+    if (ExitCode == 0) {
+      Queue -> setState (Name, JOB_DONE);
+      cout << "Finished " << Name << endl;
+    } else {
+      Queue -> setState (Name, JOB_FAILED, ExitCode, i + 1);
+      cout << "Failed " << Name << " at command " << i + 1 << " (exit code "
+        << ExitCode << ")" << endl;
+    }
+  }
+}
+
+
+//------------------------------------------------------------------------------
+// stopWatching (int) : Signal handler for SIGINT and SIGTERM.
+//
+void stopWatching (int) {
+  StopRequested = 1;
+}
+
+
+//------------------------------------------------------------------------------
+// Main program
+//
+int main (int argc, char *argv[]) {
+  unsigned int NumWorkers = DEF_NUM_WORKERS, QueueSize = DEF_QUEUE_SIZE;
+  string Pattern = DEF_PATTERN, StatusFile = "", Directory;
+  vector <string> Chain;
+  int Arg = 1;
+
+  // Process the command line options
+  while (Arg < argc - 1 && argv [Arg][0] == '-') {
+    string Option = argv [Arg];
+    if (Option == "-w") NumWorkers = atoi (argv [Arg + 1]);
+    else if (Option == "-q") QueueSize = atoi (argv [Arg + 1]);
+    else if (Option == "-p") Pattern = argv [Arg + 1];
+    else if (Option == "-s") StatusFile = argv [Arg + 1];
+    else {
+      cout << "Syntax error: Unknown option " << Option << endl;
+      showHelp ();
+      return ERR_SYNTAX_ERROR;
+    }
+    Arg += 2;
+  }
+  if (argc - Arg != MIN_NUM_ARGS - 1 || NumWorkers < 1 || QueueSize < 1) {
+    cout << "Syntax error: Incorrect command line parameters" << endl;
+    showHelp ();
+    return ERR_SYNTAX_ERROR;
+  }
+  Directory = argv [Arg];
+  if (Directory.size () > 1 && Directory [Directory.size () - 1] == '/') {
+    Directory.erase (Directory.size () - 1);
+  }
+  if (StatusFile == "") StatusFile = Directory + "/" + STATUS_FILENAME;
+  try {
+    Chain = readChain (argv [Arg + 1]);
+  } catch (int Err) {
+    return Err;
+  }
+
+  // Start watching the directory for files that have been closed after
+  // writing, or moved into the directory.
+  int Inotify = inotify_init ();
+  if (Inotify < 0 || inotify_add_watch (Inotify, Directory.c_str (),
+    IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+    cout << "Error: Unable to watch " << Directory << " (" << strerror (errno)
+      << ")" << endl;
+    return ERR_WATCH_ERROR;
+  }
+
+  // Stop cleanly on SIGINT or SIGTERM. SA_RESTART is deliberately not set so
+  // that the blocking read below is interrupted.
+  struct sigaction Action;
+  memset (&Action, 0, sizeof (Action));
+  Action.sa_handler = stopWatching;
+  sigaction (SIGINT, &Action, NULL);
+  sigaction (SIGTERM, &Action, NULL);
+
+  JobQueue Queue (QueueSize, StatusFile);
+  vector <thread> Workers;
+  for (unsigned int i = 0; i < NumWorkers; i ++) {
+    Workers.push_back (thread (worker, &Queue, &Chain, Directory));
+  }
+  cout << "Watching " << Directory << " with " << NumWorkers << " worker"
+    << (NumWorkers > 1 ? "s" : "") << ". Status is written to " << StatusFile
+    << endl;
+
+  // Read inotify events until a signal is received. Wait for them with poll so
+  // that status changes held back by the workers are written out regularly.
+  vector <char> Buffer (EVENT_BUFFER_SIZE);
+  struct pollfd Events;
+  Events.fd = Inotify;
+  Events.events = POLLIN;
+  while (!StopRequested) {
+    Queue.flushStatus ();
+    int Ready = poll (&Events, 1, STATUS_INTERVAL);
+    if (Ready == 0) continue;
+    ssize_t Length = (Ready > 0) ? read (Inotify, &Buffer[0], Buffer.size ()) : -1;
+    if (Length < 0) {
+      if (errno == EINTR) continue;
+      cout << "Error: Unable to read events for " << Directory << " ("
+        << strerror (errno) << ")" << endl;
+      break;
+    }
+    for (ssize_t Pos = 0; Pos < Length; ) {
+      struct inotify_event *Event = (struct inotify_event *) &Buffer[Pos];
+      if (Event -> mask & IN_Q_OVERFLOW) {
+        cout << "Warning: Events were lost. Rescanning " << Directory << endl;
+        scanDirectory (Queue, Directory, Pattern);
+      } else if (Event -> len > 0) {
+        checkSpectrum (Queue, Event -> name, Directory, Pattern);
+      }
+      Pos += sizeof (struct inotify_event) + Event -> len;
+    }
+  }
+
+  // Let the workers finish the spectra already in the queue, then quit
+  cout << "Stopping. Waiting for queued spectra to finish..." << endl;
+  close (Inotify);
+  Queue.close ();
+  for (unsigned int i = 0; i < Workers.size (); i ++) {
+    Workers [i].join ();
+  }
+  Queue.flushStatus ();
+  return ERR_NO_ERROR;
+}